@@ -2,11 +2,26 @@
 
 #include <iostream>
 #include <fstream>
-#include <sstream>
+#include <chrono>
 #include <cstdint>
 #include <cstring>
+#include <algorithm>
 #include "multishader.h"
 #include "dxbc.h"
+#include "legacy.h"
+#include "pipeline.h"
+#include "shard.h"
+#include "discovery.h"
+#include "log.h"
+#include "timings.h"
+#include "memstats.h"
+#include "trace.h"
+#include "report.h"
+#include "jsonfile.h"
+#include "sidecar.h"
+#include "bundle.h"
+#include "lazymsw.h"
+#include "scheduler.h"
 
 #define RAPIDJSON_HAS_STDSTRING 1
 
@@ -74,27 +89,6 @@ const char* GetShaderSetVersionDesc(int ver) {
     }
 }
 
-// Calculate shader count using v12 algorithm (7-byte features)
-int CalculateShaderCount_v12(const unsigned char features[7]) {
-    if (features[0] != 0xFF) {
-        return features[0];
-    }
-
-    int v6 = 2 * ((features[1] != 0) + 1);
-    if (!features[2])
-        v6 = (features[1] != 0) + 1;
-
-    int v7 = v6;
-    if (features[3])
-        v7 *= 2;
-
-    int numShaders = 2 * v7;
-    if (!features[6])
-        numShaders = v7;
-
-    return numShaders;
-}
-
 // Calculate shader count using v15 algorithm (9-byte features, but we only have 7)
 // This approximates based on available data
 int CalculateShaderCount_v15(const unsigned char features[7]) {
@@ -110,118 +104,220 @@ int CalculateShaderCount_v15(const unsigned char features[7]) {
     return shaderCount;
 }
 
+// Writes a shader the way unpack lays it out: <i>.fxc per standard entry,
+// data.json and its binary manifest
+void writeShaderDirectory(const CMultiShaderWrapperIO::Shader_t& shader, const std::string& outputDir) {
+    ALLOC_CATEGORY(AllocCategory::IO);
+    fs::create_directories(outputDir);
+    for (size_t i = 0; i < shader.entries.size(); i++) {
+
+        auto& entry = shader.entries[i];
+        if(!entry.buffer)continue;
+        std::ofstream out{ (outputDir + "/" + std::to_string(i) + ".fxc").c_str(),std::ios::binary };
+        out.write(entry.buffer, entry.size);
+        out.close();
+    }
+    ALLOC_CATEGORY(AllocCategory::Json);
+    rapidjson::StringBuffer jsonBuf{};
+    rapidjson::PrettyWriter<rapidjson::StringBuffer> jsonWriter{jsonBuf};
+    jsonWriter.StartObject();
+    jsonWriter.Key("type");
+    jsonWriter.Int((int)MultiShaderWrapperFileType_e::SHADER);
+    jsonWriter.Key("shaderType");
+    jsonWriter.Int((int)shader.shaderType);
+    jsonWriter.Key("name");
+    jsonWriter.String(shader.name);
+    jsonWriter.Key("features");
+    jsonWriter.StartArray();
+    for (int i = 0; i < 7; i++) {
+        jsonWriter.Int(shader.features[i]);
+    }
+    jsonWriter.EndArray();
+    jsonWriter.Key("entryFlags");
+    jsonWriter.StartArray();
+    for (auto& entry : shader.entries) {
+        jsonWriter.StartArray();
+        for (int i = 0; i < 2; i++) {
+            jsonWriter.Uint64(entry.flags[i]);
+        }
+        jsonWriter.EndArray();
+    }
+    jsonWriter.EndArray();
+    jsonWriter.Key("entryRefs");
+    jsonWriter.StartObject();
+    for (size_t i = 0; i < shader.entries.size(); i++) {
+        if ((!shader.entries[i].buffer)&&shader.entries[i].refIndex!=0xFFFF) {
+            char key[4];
+            snprintf(key,4,"%zu",i);
+            jsonWriter.Key(key);
+            jsonWriter.Int(shader.entries[i].refIndex);
+        }
+    }
+    jsonWriter.EndObject();
+    jsonWriter.EndObject();
+    std::ofstream jsonOut{ (outputDir + "/data.json").c_str() };
+    jsonOut.write(jsonBuf.GetString(), jsonBuf.GetSize());
+    jsonOut.close();
+
+    ShaderManifest manifest;
+    ShaderManifestFromShader(shader, manifest);
+    WriteShaderManifest(outputDir, manifest);
+}
+
+// Writes a shader set's data.json the way unpack lays it out
+void writeShaderSetDirectory(const CMultiShaderWrapperIO::ShaderSet_t& shaderSet, const std::string& outputDir) {
+    fs::create_directories(outputDir);
+
+    ALLOC_CATEGORY(AllocCategory::Json);
+    rapidjson::StringBuffer jsonBuf{};
+    rapidjson::PrettyWriter<rapidjson::StringBuffer> jsonWriter{jsonBuf};
+    jsonWriter.StartObject();
+    jsonWriter.Key("type");
+    jsonWriter.Int((int)MultiShaderWrapperFileType_e::SHADERSET);
+    jsonWriter.Key("pixelShaderGuid");
+    jsonWriter.Uint64(shaderSet.pixelShaderGuid);
+    jsonWriter.Key("vertexShaderGuid");
+    jsonWriter.Uint64(shaderSet.vertexShaderGuid);
+    jsonWriter.Key("numPixelShaderTextures");
+    jsonWriter.Uint(shaderSet.numPixelShaderTextures);
+    jsonWriter.Key("numVertexShaderTextures");
+    jsonWriter.Uint(shaderSet.numVertexShaderTextures);
+    jsonWriter.Key("numSamplers");
+    jsonWriter.Uint(shaderSet.numSamplers);
+    jsonWriter.Key("firstResourceBindPoint");
+    jsonWriter.Uint(shaderSet.firstResourceBindPoint);
+    jsonWriter.Key("numResources");
+    jsonWriter.Uint(shaderSet.numResources);
+    jsonWriter.EndObject();
+    std::ofstream jsonOut{ (outputDir + "/data.json").c_str() };
+    jsonOut.write(jsonBuf.GetString(), jsonBuf.GetSize());
+    jsonOut.close();
+}
+
 void unpack(const char* path) {
+    ALLOC_CATEGORY(AllocCategory::IO);
     CMultiShaderWrapperIO::ShaderCache_t shaderCache = {};
-    MSW_ParseFile(path,shaderCache);
+    if (!MSW_ParseFile(path,shaderCache))
+        return;
     switch (shaderCache.type) {
     case MultiShaderWrapperFileType_e::SHADER:
     {
         // Use filename as output directory if shader has no embedded name
-        std::string outputDir = shaderCache.shader->name;
-        if (outputDir.empty()) {
-            fs::path inputPath(path);
-            outputDir = inputPath.stem().string();  // Get filename without extension
-            shaderCache.shader->name = outputDir;   // Also set for JSON output
-        }
-        fs::create_directories(outputDir);
-        for (size_t i = 0; i < shaderCache.shader->entries.size(); i++) {
-
-            auto& entry = shaderCache.shader->entries[i];
-            if(!entry.buffer)continue;
-            std::ofstream out{ std::format("{}/{}.fxc",outputDir,i).c_str(),std::ios::binary };
-            out.write(entry.buffer, entry.size);
-            out.close();
-        }
-        rapidjson::StringBuffer jsonBuf{};
-        rapidjson::PrettyWriter<rapidjson::StringBuffer> jsonWriter{jsonBuf};
-        jsonWriter.StartObject();
-        jsonWriter.Key("type");
-        jsonWriter.Int((int)MultiShaderWrapperFileType_e::SHADER);
-        jsonWriter.Key("shaderType");
-        jsonWriter.Int((int)shaderCache.shader->shaderType);
-        jsonWriter.Key("name");
-        jsonWriter.String(shaderCache.shader->name);
-        jsonWriter.Key("features");
-        jsonWriter.StartArray();
-        for (int i = 0; i < 7; i++) {
-            jsonWriter.Int(shaderCache.shader->features[i]);
-        }
-        jsonWriter.EndArray();
-        jsonWriter.Key("entryFlags");
-        jsonWriter.StartArray();
-        for (auto& entry : shaderCache.shader->entries) {
-            jsonWriter.StartArray();
-            for (int i = 0; i < 2; i++) {
-                jsonWriter.Uint64(entry.flags[i]);
-            }
-            jsonWriter.EndArray();
-        }
-        jsonWriter.EndArray();
-        jsonWriter.Key("entryRefs");
-        jsonWriter.StartObject();
-        for (size_t i = 0; i < shaderCache.shader->entries.size(); i++) {
-            if ((!shaderCache.shader->entries[i].buffer)&&shaderCache.shader->entries[i].refIndex!=0xFFFF) {
-                char key[4];
-                snprintf(key,4,"%d",i);
-                jsonWriter.Key(key);
-                jsonWriter.Int(shaderCache.shader->entries[i].refIndex);
-            }
+        if (shaderCache.shader->name.empty()) {
+            shaderCache.shader->name = fs::path(path).stem().string();  // Also set for JSON output
         }
-        jsonWriter.EndObject();
-        jsonWriter.EndObject();
-        std::ofstream jsonOut{ std::format("{}/data.json",outputDir).c_str() };
-        jsonOut.write(jsonBuf.GetString(), jsonBuf.GetSize());
-        jsonOut.close();
+        writeShaderDirectory(*shaderCache.shader, shaderCache.shader->name);
     }
         break;
     case MultiShaderWrapperFileType_e::SHADERSET:
-    {
         // Use filename as output directory for shader sets
-        fs::path inputPath(path);
-        std::string shaderSetDir = inputPath.stem().string();
-        fs::create_directories(shaderSetDir);
+        writeShaderSetDirectory(shaderCache.shaderSet, fs::path(path).stem().string());
+        break;
+    case MultiShaderWrapperFileType_e::BUNDLE:
+        fprintf(stderr, "%s is a bundle, use extract or pack --from-bundle\n", path);
+        break;
+    }
+}
 
-        rapidjson::StringBuffer jsonBuf{};
-        rapidjson::PrettyWriter<rapidjson::StringBuffer> jsonWriter{jsonBuf};
-        jsonWriter.StartObject();
-        jsonWriter.Key("type");
-        jsonWriter.Int((int)MultiShaderWrapperFileType_e::SHADERSET);
-        jsonWriter.Key("pixelShaderGuid");
-        jsonWriter.Uint64(shaderCache.shaderSet.pixelShaderGuid);
-        jsonWriter.Key("vertexShaderGuid");
-        jsonWriter.Uint64(shaderCache.shaderSet.vertexShaderGuid);
-        jsonWriter.Key("numPixelShaderTextures");
-        jsonWriter.Uint(shaderCache.shaderSet.numPixelShaderTextures);
-        jsonWriter.Key("numVertexShaderTextures");
-        jsonWriter.Uint(shaderCache.shaderSet.numVertexShaderTextures);
-        jsonWriter.Key("numSamplers");
-        jsonWriter.Uint(shaderCache.shaderSet.numSamplers);
-        jsonWriter.Key("firstResourceBindPoint");
-        jsonWriter.Uint(shaderCache.shaderSet.firstResourceBindPoint);
-        jsonWriter.Key("numResources");
-        jsonWriter.Uint(shaderCache.shaderSet.numResources);
-        jsonWriter.EndObject();
-        std::ofstream jsonOut{ std::format("{}/data.json",shaderSetDir).c_str() };
-        jsonOut.write(jsonBuf.GetString(), jsonBuf.GetSize());
-        jsonOut.close();
+// How pack and pack --from-bundle write .msw files
+struct PackOptions {
+    unsigned int mswVersion;        // 0 lets the writer pick, see SetFileVersion
+    unsigned int bufferAlignment;   // 0 packs buffers back to back, see SetBufferAlignment
+
+    PackOptions()
+        : mswVersion(0)
+        , bufferAlignment(0)
+    {}
+};
+
+// Applies the pack options, writes and reports the alignment padding
+bool writePackedMsw(CMultiShaderWrapperIO& writer, const std::string& outputPath, const PackOptions& options) {
+    writer.SetFileVersion(options.mswVersion);
+    writer.SetBufferAlignment(options.bufferAlignment);
+    if (!writer.WriteFile(outputPath.c_str())) {
+        if (options.mswVersion && options.mswVersion < MSW_FILE_VER) {
+            LOG_ERROR("Error: Could not write %s (version %u offsets are 32 bits, the file may be over 4 GB)\n",
+                      outputPath.c_str(), options.mswVersion);
+        } else {
+            LOG_ERROR("Error: Could not write %s\n", outputPath.c_str());
+        }
+        return false;
     }
-        break;
+
+    if (options.bufferAlignment) {
+        std::error_code ec;
+        uintmax_t fileSize = fs::file_size(outputPath, ec);
+        LOG_INFO("%s: buffers aligned to %u bytes, %llu bytes of padding (%.2f%% of the file)\n", outputPath.c_str(),
+                 options.bufferAlignment, static_cast<unsigned long long>(writer.GetPaddingBytes()),
+                 !ec && fileSize ? 100.0 * writer.GetPaddingBytes() / fileSize : 0.0);
     }
+    return true;
+}
+
+// Reads <path>/<index>.fxc into the entry, leaves it empty if there is none
+void loadEntryFxc(const char* path, size_t index, CMultiShaderWrapperIO::ShaderEntry_t& ent) {
+    ALLOC_CATEGORY(AllocCategory::IO);
+    std::ifstream shaderFile{std::string(path) + "/" + std::to_string(index) + ".fxc",std::ios::binary};
+    if (!shaderFile.fail()) {
+        shaderFile.seekg(0,std::ios::end);
+        ent.size = shaderFile.tellg();
+        char* buf = new char[ent.size];
+        shaderFile.seekg(0,std::ios::beg);
+        shaderFile.read(buf,ent.size);
+        ent.buffer = buf;
+    }
+    else {
+        ent.buffer = 0;
+        ent.size = 0;
+    }
+}
+
+// pack from the binary manifest unpack wrote next to data.json
+void packFromManifest(const char* path, const ShaderManifest& manifest, const PackOptions& options) {
+    CMultiShaderWrapperIO::Shader_t shader(manifest.shaderType);
+    shader.name = manifest.name;
+    memcpy(shader.features, manifest.features, sizeof(shader.features));
+    printf("Shader will be exported as %s.msw\n",shader.name.c_str());
+
+    shader.entries.reserve(manifest.EntryCount());
+    for (size_t i = 0; i < manifest.EntryCount(); i++) {
+        CMultiShaderWrapperIO::ShaderEntry_t& ent = shader.entries.emplace_back();
+        ent.refIndex = manifest.refIndices[i];
+        ent.flags[0] = manifest.flags[i * 2];
+        ent.flags[1] = manifest.flags[i * 2 + 1];
+        if (ent.refIndex == 0xFFFF) {
+            loadEntryFxc(path, i, ent);
+        }
+        else {
+            ent.buffer = 0;
+            ent.size = 0;
+        }
+    }
+
+    ALLOC_CATEGORY(AllocCategory::IO);
+    CMultiShaderWrapperIO writer{};
+    writer.SetFileType(MultiShaderWrapperFileType_e::SHADER);
+    writer.SetShader(&shader);
+    writePackedMsw(writer, std::string(path) + ".msw", options);
 }
 
-void pack(const char* path) {
+void pack(const char* path, const PackOptions& options) {
+    ALLOC_CATEGORY(AllocCategory::Json);
     printf("creating Shader\n");
-    std::ifstream jsonFile(fs::path(path)/"data.json");
-    std::stringstream jsonFileStream;
-    rapidjson::Document jsonDoc;
-    if (jsonFile.fail())return;
-    
-    while (jsonFile.peek() != EOF)
-        jsonFileStream << (char)jsonFile.get();
-
-    jsonFile.close();
-    jsonDoc.Parse<rapidjson::ParseFlag::kParseCommentsFlag | rapidjson::ParseFlag::kParseTrailingCommasFlag>(
-        jsonFileStream.str().c_str());
+
+    ShaderManifest manifest;
+    ManifestStatus manifestStatus = ReadShaderManifest(path, manifest);
+    if (manifestStatus == ManifestStatus::Loaded) {
+        packFromManifest(path, manifest, options);
+        return;
+    }
+    if (manifestStatus == ManifestStatus::Stale) {
+        printf("data.json changed since %s was written, using data.json\n", SHADER_MANIFEST_FILE);
+    }
+
+    JsonFile json;
+    if (!json.Load(fs::path(path) / "data.json"))return;
+    rapidjson::Document& jsonDoc = json.GetDocument();
     if(!jsonDoc.IsObject())return;
     if((!jsonDoc.HasMember("type"))||(!jsonDoc["type"].IsInt()))return;
     switch ((MultiShaderWrapperFileType_e)jsonDoc["type"].GetInt()) {
@@ -272,26 +368,13 @@ void pack(const char* path) {
             ent.refIndex = 0xFFFF;
             if (jsonDoc.HasMember("entryRefs") && jsonDoc["entryRefs"].IsObject()) {
                 char key[4];
-                snprintf(key,4,"%d",i);
+                snprintf(key,4,"%zu",i);
                 if(jsonDoc["entryRefs"].HasMember(key))
                     if(jsonDoc["entryRefs"][key].IsInt())
                         ent.refIndex = jsonDoc["entryRefs"][key].GetInt();
             }
             if (ent.refIndex == 0xFFFF) {
-                std::ifstream shaderFile{std::format("{}/{}.fxc",path,i),std::ios::binary};
-                if (!shaderFile.fail()) {
-                    shaderFile.seekg(0,std::ios::end);
-                    ent.size = shaderFile.tellg();
-                    char* buf = new char[ent.size];
-                    shaderFile.seekg(0,std::ios::beg);
-                    shaderFile.read(buf,ent.size);
-                    ent.buffer = buf;
-                }
-                else {
-                    ent.buffer = 0;
-                    ent.size = 0;
-                }
-                
+                loadEntryFxc(path, i, ent);
             }
             else {
                 ent.buffer = 0;
@@ -305,10 +388,11 @@ void pack(const char* path) {
             }
             
         }
+        ALLOC_CATEGORY(AllocCategory::IO);
         CMultiShaderWrapperIO writer{};
         writer.SetFileType(MultiShaderWrapperFileType_e::SHADER);
         writer.SetShader(&shader);
-        writer.WriteFile(std::format("{}.msw",path).c_str());
+        writePackedMsw(writer, std::string(path) + ".msw", options);
     }
         break;
     case MultiShaderWrapperFileType_e::SHADERSET:
@@ -380,10 +464,11 @@ void pack(const char* path) {
         if (!isValid) {
             printf("Did not write file since there are errors");
         }
+        ALLOC_CATEGORY(AllocCategory::IO);
         CMultiShaderWrapperIO writer{};
         writer.SetFileType(MultiShaderWrapperFileType_e::SHADERSET);
         writer.SetShaderSet(shaderSet);
-        writer.WriteFile(std::format("{}.msw",path).c_str());
+        writePackedMsw(writer, std::string(path) + ".msw", options);
     }
         break;
     default:
@@ -391,26 +476,738 @@ void pack(const char* path) {
     }
 }
 
+// ============================================================================
+// Input Files
+// ============================================================================
+
+// '*' and '?' only, for shells that leave wildcards to the program
+bool wildcardMatch(const char* pattern, const char* text) {
+    const char* star = nullptr;
+    const char* resume = nullptr;
+    while (*text) {
+        if (*pattern == '?' || *pattern == *text) {
+            pattern++;
+            text++;
+        } else if (*pattern == '*') {
+            star = pattern++;
+            resume = text;
+        } else if (star) {
+            pattern = star + 1;
+            text = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (*pattern == '*') {
+        pattern++;
+    }
+    return !*pattern;
+}
+
+// Expands the inputs of commands that take many MSWs: files as they are,
+// directories to the .msw files in them (and their subdirectories with
+// recursive), and a wildcard in the file name part to the files it matches.
+// Each directory or wildcard adds its files sorted. Entries that can't be
+// read (broken links, link loops, no permission) are skipped.
+void collectMswFiles(const std::vector<std::string>& inputs, bool recursive, std::vector<fs::path>& files) {
+    for (const std::string& input : inputs) {
+        fs::path inputPath(input);
+        std::string fileName = inputPath.filename().string();
+        size_t first = files.size();
+        std::error_code ec;
+
+        if (fileName.find_first_of("*?") != std::string::npos) {
+            fs::path parent = inputPath.has_parent_path() ? inputPath.parent_path() : fs::path(".");
+            for (fs::directory_iterator it(parent, ec), end; !ec && it != end; it.increment(ec)) {
+                std::error_code entryEc;
+                if (it->is_regular_file(entryEc) && wildcardMatch(fileName.c_str(), it->path().filename().string().c_str())) {
+                    files.push_back(it->path());
+                }
+            }
+        } else if (fs::is_directory(inputPath, ec)) {
+            auto addFile = [&](const fs::directory_entry& item) {
+                std::error_code entryEc;
+                if (item.is_regular_file(entryEc) && HasMswExtension(item.path())) {
+                    files.push_back(item.path());
+                }
+            };
+            if (recursive) {
+                fs::recursive_directory_iterator it(inputPath, fs::directory_options::skip_permission_denied, ec);
+                for (; !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+                    addFile(*it);
+                }
+            } else {
+                for (fs::directory_iterator it(inputPath, ec), end; !ec && it != end; it.increment(ec)) {
+                    addFile(*it);
+                }
+            }
+        } else {
+            files.push_back(inputPath);
+            continue;
+        }
+
+        if (ec) {
+            LOG_ERROR("Error: Could not read %s: %s\n", inputPath.string().c_str(), ec.message().c_str());
+        }
+        std::sort(files.begin() + first, files.end());
+    }
+}
+
+// ============================================================================
+// Bundles
+// ============================================================================
+
+// unpack --bundle: the shaders and shader sets of every input (MSW files, or
+// the .msw files in a directory) into one bundle instead of a directory each
+int unpackBundle(const char* bundlePath, const std::vector<std::string>& inputs) {
+    std::vector<fs::path> files;
+    collectMswFiles(inputs, false, files);
+
+    BundleWriter writer;
+    if (!writer.Open(bundlePath)) {
+        LOG_ERROR("Error: Could not create %s\n", bundlePath);
+        return 1;
+    }
+
+    size_t entryCount = 0;
+    int failed = 0;
+    for (const fs::path& file : files) {
+        ALLOC_CATEGORY(AllocCategory::IO);
+        CMultiShaderWrapperIO::ShaderCache_t shaderCache = {};
+        if (!MSW_ParseFile(file, shaderCache)) {
+            failed++;
+            continue;
+        }
+
+        if (shaderCache.type == MultiShaderWrapperFileType_e::SHADERSET) {
+            // Named after the file, like unpack names its directory
+            std::string name = file.stem().string();
+            if (writer.HasShaderSet(name)) {
+                LOG_ERROR("Error: %s: a shader set named %s is already in the bundle\n", file.string().c_str(), name.c_str());
+                failed++;
+                continue;
+            }
+            if (!writer.AddShaderSet(name, shaderCache.shaderSet)) {
+                LOG_ERROR("Error: Could not write %s\n", bundlePath);
+                return 1;
+            }
+            LOG_VERBOSE("  %s: shader set\n", name.c_str());
+            continue;
+        }
+
+        if (shaderCache.type != MultiShaderWrapperFileType_e::SHADER) {
+            LOG_WARNING("Skipped %s: %s files are not bundled\n", file.string().c_str(), MSW_TypeToString(shaderCache.type));
+            continue;
+        }
+
+        CMultiShaderWrapperIO::Shader_t& shader = *shaderCache.shader;
+        if (shader.name.empty()) {
+            shader.name = file.stem().string();
+        }
+        if (writer.HasShader(shader.name)) {
+            LOG_ERROR("Error: %s: a shader named %s is already in the bundle\n", file.string().c_str(), shader.name.c_str());
+            failed++;
+            continue;
+        }
+        if (!writer.AddShader(shader)) {
+            LOG_ERROR("Error: Could not write %s\n", bundlePath);
+            return 1;
+        }
+
+        entryCount += shader.entries.size();
+        LOG_VERBOSE("  %s: %zu entries\n", shader.name.c_str(), shader.entries.size());
+    }
+
+    if (!writer.Finish()) {
+        LOG_ERROR("Error: Could not write %s\n", bundlePath);
+        return 1;
+    }
+
+    LOG_INFO("Bundled %u shader(s), %u shader set(s), %zu entries, %.2f MB of bytecode into %s\n", writer.ShaderCount(),
+             writer.ShaderSetCount(), entryCount, writer.BlobBytes() / (1024.0 * 1024.0), bundlePath);
+    if (writer.DedupedEntries()) {
+        LOG_INFO("  %llu duplicate entries shared, %.2f MB saved\n",
+                 static_cast<unsigned long long>(writer.DedupedEntries()), writer.DedupedBytes() / (1024.0 * 1024.0));
+    }
+    return failed ? 1 : 0;
+}
+
+// pack --from-bundle: <outputDir>/<name>.msw for everything in the bundle,
+// or for the named shaders and shader sets
+int packFromBundle(const char* bundlePath, const char* outputDir, const std::vector<std::string>& names,
+                   const PackOptions& options) {
+    BundleReader reader;
+    if (!reader.Open(bundlePath)) {
+        LOG_ERROR("Error: %s is not a shader bundle\n", bundlePath);
+        return 1;
+    }
+
+    std::vector<BundleShader> shaders;
+    std::vector<BundleShaderSet> shaderSets;
+    int failed = 0;
+    if (names.empty()) {
+        if (!reader.ReadAll(shaders, shaderSets)) {
+            LOG_ERROR("Error: Could not read %s\n", bundlePath);
+            return 1;
+        }
+    }
+    for (const std::string& name : names) {
+        if (reader.FindShader(name, shaders.emplace_back())) {
+            continue;
+        }
+        shaders.pop_back();
+        if (reader.FindShaderSet(name, shaderSets.emplace_back())) {
+            continue;
+        }
+        shaderSets.pop_back();
+
+        LOG_ERROR("Error: No shader or shader set named %s in %s\n", name.c_str(), bundlePath);
+        failed++;
+    }
+
+    fs::create_directories(outputDir);
+
+    int packed = 0;
+    for (const BundleShader& bundleShader : shaders) {
+        ALLOC_CATEGORY(AllocCategory::IO);
+        CMultiShaderWrapperIO::Shader_t shader;
+        std::string outputPath = (fs::path(outputDir) / (bundleShader.name + ".msw")).string();
+
+        CMultiShaderWrapperIO writer{};
+        writer.SetFileType(MultiShaderWrapperFileType_e::SHADER);
+        writer.SetShader(&shader);
+        if (!reader.ReadShader(bundleShader, shader) || !writePackedMsw(writer, outputPath, options)) {
+            LOG_ERROR("Error: Could not pack %s\n", bundleShader.name.c_str());
+            failed++;
+            continue;
+        }
+
+        LOG_VERBOSE("  %s\n", outputPath.c_str());
+        packed++;
+    }
+
+    for (const BundleShaderSet& bundleShaderSet : shaderSets) {
+        ALLOC_CATEGORY(AllocCategory::IO);
+        const CMultiShaderWrapperIO::ShaderSet_t& src = bundleShaderSet.header;
+        std::string outputPath = (fs::path(outputDir) / (bundleShaderSet.name + ".msw")).string();
+
+        CMultiShaderWrapperIO writer{};
+        writer.SetFileType(MultiShaderWrapperFileType_e::SHADERSET);
+        writer.SetShaderSetHeader(src.pixelShaderGuid, src.vertexShaderGuid,
+                                  src.numPixelShaderTextures, src.numVertexShaderTextures,
+                                  src.numSamplers, src.firstResourceBindPoint, src.numResources);
+        if (!writePackedMsw(writer, outputPath, options)) {
+            LOG_ERROR("Error: Could not pack %s\n", bundleShaderSet.name.c_str());
+            failed++;
+            continue;
+        }
+
+        LOG_VERBOSE("  %s\n", outputPath.c_str());
+        packed++;
+    }
+
+    LOG_INFO("Packed %d file(s) from %s into %s\n", packed, bundlePath, outputDir);
+    return failed ? 1 : 0;
+}
+
+// extract: list a bundle, unpack one shader or shader set from it, or write
+// one entry
+int extractFromBundle(const char* bundlePath, const char* selector, const char* outputArg) {
+    BundleReader reader;
+    if (!reader.Open(bundlePath)) {
+        LOG_ERROR("Error: %s is not a shader bundle\n", bundlePath);
+        return 1;
+    }
+
+    if (!selector) {
+        std::vector<BundleShader> shaders;
+        std::vector<BundleShaderSet> shaderSets;
+        if (!reader.ReadAll(shaders, shaderSets)) {
+            LOG_ERROR("Error: Could not read %s\n", bundlePath);
+            return 1;
+        }
+
+        printf("%-48s %7s %8s %12s\n", "Shader", "Entries", "Standard", "Bytes");
+        for (const BundleShader& bundleShader : shaders) {
+            size_t standard = 0;
+            uint64_t bytes = 0;
+            for (const BundleEntry& entry : bundleShader.entries) {
+                standard += entry.standard;
+                bytes += entry.size;
+            }
+            printf("%-48s %7zu %8zu %12llu\n", bundleShader.name.c_str(), bundleShader.entries.size(), standard,
+                   static_cast<unsigned long long>(bytes));
+        }
+        for (const BundleShaderSet& bundleShaderSet : shaderSets) {
+            printf("%-48s shader set\n", bundleShaderSet.name.c_str());
+        }
+
+        const BundleHeader& header = reader.GetHeader();
+        printf("%zu shader(s), %zu shader set(s), %llu bytes of bytecode, %llu more shared\n", shaders.size(),
+               shaderSets.size(), static_cast<unsigned long long>(header.blobBytes),
+               static_cast<unsigned long long>(header.dedupedBytes));
+        return 0;
+    }
+
+    // <name>:<entry> picks one entry
+    std::string name = selector;
+    long entryIndex = -1;
+    size_t colon = name.rfind(':');
+    if (colon != std::string::npos && colon + 1 < name.size() &&
+        name.find_first_not_of("0123456789", colon + 1) == std::string::npos) {
+        entryIndex = atol(name.c_str() + colon + 1);
+        name.resize(colon);
+    }
+
+    BundleShader bundleShader;
+    if (!reader.FindShader(name, bundleShader)) {
+        BundleShaderSet bundleShaderSet;
+        if (entryIndex < 0 && reader.FindShaderSet(name, bundleShaderSet)) {
+            std::string outputDir = (fs::path(outputArg ? outputArg : ".") / name).string();
+            writeShaderSetDirectory(bundleShaderSet.header, outputDir);
+            LOG_INFO("Extracted shader set %s to %s\n", name.c_str(), outputDir.c_str());
+            return 0;
+        }
+
+        LOG_ERROR("Error: No shader named %s in %s\n", name.c_str(), bundlePath);
+        return 1;
+    }
+
+    if (entryIndex < 0) {
+        CMultiShaderWrapperIO::Shader_t shader;
+        if (!reader.ReadShader(bundleShader, shader)) {
+            LOG_ERROR("Error: Could not read %s from %s\n", name.c_str(), bundlePath);
+            return 1;
+        }
+
+        std::string outputDir = (fs::path(outputArg ? outputArg : ".") / name).string();
+        writeShaderDirectory(shader, outputDir);
+        LOG_INFO("Extracted %s (%zu entries) to %s\n", name.c_str(), shader.entries.size(), outputDir.c_str());
+        return 0;
+    }
+
+    if (entryIndex >= static_cast<long>(bundleShader.entries.size())) {
+        LOG_ERROR("Error: %s has %zu entries\n", name.c_str(), bundleShader.entries.size());
+        return 1;
+    }
+
+    const BundleEntry& entry = bundleShader.entries[entryIndex];
+    if (!entry.standard) {
+        if (entry.refIndex != 0xFFFF) {
+            LOG_ERROR("Error: Entry %ld of %s has no bytecode of its own, it references entry %u\n", entryIndex,
+                      name.c_str(), entry.refIndex);
+        } else {
+            LOG_ERROR("Error: Entry %ld of %s is a null entry\n", entryIndex, name.c_str());
+        }
+        return 1;
+    }
+
+    std::vector<char> data;
+    std::string outputPath = outputArg ? outputArg : name + "_" + std::to_string(entryIndex) + ".fxc";
+    FILE* file = nullptr;
+    if (!reader.ReadEntry(entry, data) || fopen_s(&file, outputPath.c_str(), "wb") != 0 || !file) {
+        LOG_ERROR("Error: Could not extract entry %ld of %s\n", entryIndex, name.c_str());
+        return 1;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+    if (fclose(file) != 0 || !ok) {
+        LOG_ERROR("Error: Could not write %s\n", outputPath.c_str());
+        return 1;
+    }
+
+    LOG_INFO("Extracted entry %ld of %s (%zu bytes) to %s\n", entryIndex, name.c_str(), data.size(), outputPath.c_str());
+    return 0;
+}
+
+// ============================================================================
+// Info
+// ============================================================================
+
+struct MswInfo {
+    bool loaded;
+    MultiShaderWrapperFileType_e type;
+    unsigned int version;
+    uint64_t fileSize;
+    uint64_t bytesRead;
+
+    // Shaders, or the shaders embedded in a shader set
+    std::string name;
+    unsigned char features[7];
+    unsigned int bufferAlignment;
+    size_t entries;
+    size_t standard;
+    size_t references;
+    size_t nulls;
+    uint64_t bytecodeBytes;
+
+    // Shader sets
+    uint64_t pixelShaderGuid;
+    uint64_t vertexShaderGuid;
+
+    // Bundles
+    uint32_t bundleShaders;
+    uint32_t bundleShaderSets;
+
+    MswInfo()
+        : loaded(false), type(MultiShaderWrapperFileType_e::SHADER), version(0), fileSize(0), bytesRead(0),
+          features{}, bufferAlignment(0), entries(0), standard(0), references(0), nulls(0), bytecodeBytes(0),
+          pixelShaderGuid(0), vertexShaderGuid(0), bundleShaders(0), bundleShaderSets(0) {}
+};
+
+void addShaderInfo(const LazyMswShader& shader, MswInfo& info) {
+    info.entries += shader.entries.size();
+    for (const LazyMswEntry& entry : shader.entries) {
+        switch (entry.type) {
+        case MultiShaderWrapperDescType_e::STANDARD:
+            info.standard++;
+            info.bytecodeBytes += entry.size;
+            break;
+        case MultiShaderWrapperDescType_e::REFERENCE:
+            info.references++;
+            break;
+        case MultiShaderWrapperDescType_e::NONE:
+            info.nulls++;
+            break;
+        }
+    }
+}
+
+// Headers and descriptors only, no bytecode is read
+void readMswInfo(const fs::path& path, MswInfo& info) {
+    LazyMswReader reader;
+    if (!reader.Open(path)) {
+        info.bytesRead = reader.BytesRead();
+        return;
+    }
+
+    info.loaded = true;
+    info.type = reader.GetType();
+    info.version = reader.GetVersion();
+    info.fileSize = reader.GetFileSize();
+
+    if (LazyMswShader* shader = reader.GetShader()) {
+        info.name = shader->name;
+        memcpy(info.features, shader->features, sizeof(info.features));
+        info.bufferAlignment = shader->bufferAlignment;
+        addShaderInfo(*shader, info);
+    } else if (info.type == MultiShaderWrapperFileType_e::SHADERSET) {
+        info.pixelShaderGuid = reader.GetShaderSet().pixelShaderGuid;
+        info.vertexShaderGuid = reader.GetShaderSet().vertexShaderGuid;
+        if (reader.GetPixelShader()) {
+            addShaderInfo(*reader.GetPixelShader(), info);
+        }
+        if (reader.GetVertexShader()) {
+            addShaderInfo(*reader.GetVertexShader(), info);
+        }
+    }
+    info.bytesRead = reader.BytesRead();
+
+    if (info.type == MultiShaderWrapperFileType_e::BUNDLE) {
+        BundleReader bundle;
+        if (bundle.Open(path)) {
+            info.bundleShaders = bundle.ShaderCount();
+            info.bundleShaderSets = bundle.ShaderSetCount();
+            info.bytecodeBytes = bundle.GetHeader().blobBytes;
+        }
+    }
+}
+
+void printInfoJson(const std::vector<fs::path>& files, const std::vector<MswInfo>& infos) {
+    ALLOC_CATEGORY(AllocCategory::Json);
+    rapidjson::StringBuffer jsonBuf{};
+    rapidjson::PrettyWriter<rapidjson::StringBuffer> jsonWriter{jsonBuf};
+    jsonWriter.StartArray();
+    for (size_t i = 0; i < files.size(); i++) {
+        const MswInfo& info = infos[i];
+        jsonWriter.StartObject();
+        jsonWriter.Key("path");
+        jsonWriter.String(files[i].string());
+        if (!info.loaded) {
+            jsonWriter.Key("error");
+            jsonWriter.String("not a readable MSW file");
+            jsonWriter.EndObject();
+            continue;
+        }
+
+        jsonWriter.Key("type");
+        jsonWriter.String(MSW_TypeToString(info.type));
+        jsonWriter.Key("version");
+        jsonWriter.Uint(info.version);
+        jsonWriter.Key("fileSize");
+        jsonWriter.Uint64(info.fileSize);
+
+        if (info.type == MultiShaderWrapperFileType_e::BUNDLE) {
+            jsonWriter.Key("shaders");
+            jsonWriter.Uint(info.bundleShaders);
+            jsonWriter.Key("shaderSets");
+            jsonWriter.Uint(info.bundleShaderSets);
+            jsonWriter.Key("bytecodeBytes");
+            jsonWriter.Uint64(info.bytecodeBytes);
+            jsonWriter.EndObject();
+            continue;
+        }
+
+        if (info.type == MultiShaderWrapperFileType_e::SHADER) {
+            jsonWriter.Key("name");
+            jsonWriter.String(info.name);
+            jsonWriter.Key("features");
+            jsonWriter.StartArray();
+            for (int j = 0; j < 7; j++) {
+                jsonWriter.Int(info.features[j]);
+            }
+            jsonWriter.EndArray();
+            jsonWriter.Key("bufferAlignment");
+            jsonWriter.Uint(info.bufferAlignment);
+        } else {
+            jsonWriter.Key("pixelShaderGuid");
+            jsonWriter.Uint64(info.pixelShaderGuid);
+            jsonWriter.Key("vertexShaderGuid");
+            jsonWriter.Uint64(info.vertexShaderGuid);
+        }
+        jsonWriter.Key("entries");
+        jsonWriter.Uint64(info.entries);
+        jsonWriter.Key("standard");
+        jsonWriter.Uint64(info.standard);
+        jsonWriter.Key("references");
+        jsonWriter.Uint64(info.references);
+        jsonWriter.Key("null");
+        jsonWriter.Uint64(info.nulls);
+        jsonWriter.Key("bytecodeBytes");
+        jsonWriter.Uint64(info.bytecodeBytes);
+        jsonWriter.EndObject();
+    }
+    jsonWriter.EndArray();
+    fwrite(jsonBuf.GetString(), 1, jsonBuf.GetSize(), stdout);
+    printf("\n");
+}
+
+void printInfoTable(const std::vector<fs::path>& files, const std::vector<MswInfo>& infos) {
+    printf("%-10s %3s %7s %5s %5s %5s %12s  %-20s  %-40s  %s\n", "Type", "Ver", "Entries", "Std", "Ref", "Null",
+           "Bytes", "Features", "Name", "File");
+    for (size_t i = 0; i < files.size(); i++) {
+        const MswInfo& info = infos[i];
+        if (!info.loaded) {
+            printf("%-10s %3s %7s %5s %5s %5s %12s  %-20s  %-40s  %s\n", "error", "-", "-", "-", "-", "-", "-", "-",
+                   "-", files[i].string().c_str());
+            continue;
+        }
+
+        if (info.type == MultiShaderWrapperFileType_e::BUNDLE) {
+            char contents[64];
+            snprintf(contents, sizeof(contents), "%u shaders, %u shader sets", info.bundleShaders, info.bundleShaderSets);
+            printf("%-10s %3u %7s %5s %5s %5s %12llu  %-20s  %-40s  %s\n", MSW_TypeToString(info.type), info.version,
+                   "-", "-", "-", "-", static_cast<unsigned long long>(info.bytecodeBytes), "-", contents,
+                   files[i].string().c_str());
+            continue;
+        }
+
+        char features[32] = "-";
+        std::string name = info.name;
+        if (info.type == MultiShaderWrapperFileType_e::SHADER) {
+            snprintf(features, sizeof(features), "%02x %02x %02x %02x %02x %02x %02x", info.features[0],
+                     info.features[1], info.features[2], info.features[3], info.features[4], info.features[5],
+                     info.features[6]);
+        } else {
+            char guids[64];
+            snprintf(guids, sizeof(guids), "ps %016llx vs %016llx", static_cast<unsigned long long>(info.pixelShaderGuid),
+                     static_cast<unsigned long long>(info.vertexShaderGuid));
+            name = guids;
+        }
+        printf("%-10s %3u %7zu %5zu %5zu %5zu %12llu  %-20s  %-40s  %s\n", MSW_TypeToString(info.type), info.version,
+               info.entries, info.standard, info.references, info.nulls,
+               static_cast<unsigned long long>(info.bytecodeBytes), features, name.c_str(), files[i].string().c_str());
+    }
+}
+
+// info: what is in MSW files, from their headers and descriptors alone
+int infoCommand(const std::vector<std::string>& inputs, bool recursive, bool json, int numWorkers) {
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<fs::path> files;
+    collectMswFiles(inputs, recursive, files);
+
+    std::vector<MswInfo> infos(files.size());
+    {
+        WorkStealingPool pool(numWorkers);
+        TaskGroup group;
+        for (size_t i = 0; i < files.size(); i++) {
+            pool.Submit(group, [&files, &infos, i]() { readMswInfo(files[i], infos[i]); });
+        }
+        pool.Wait(group);
+    }
+
+    int failed = 0;
+    uint64_t bytesRead = 0;
+    uint64_t fileBytes = 0;
+    for (const MswInfo& info : infos) {
+        failed += !info.loaded;
+        bytesRead += info.bytesRead;
+        fileBytes += info.fileSize;
+    }
+
+    if (json) {
+        printInfoJson(files, infos);
+    } else {
+        printInfoTable(files, infos);
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%zu file(s), %d unreadable, read %.2f MB of %.2f MB in %.2fs\n", files.size(), failed,
+               bytesRead / (1024.0 * 1024.0), fileBytes / (1024.0 * 1024.0), seconds);
+    }
+    return failed ? 1 : 0;
+}
+
+// ============================================================================
+// Selective Unpack
+// ============================================================================
+
+// Which entries unpack --entries / --flags-mask writes, every one if neither is given
+struct EntryFilter {
+    std::vector<std::pair<size_t, size_t>> ranges;  // Inclusive [first, last], empty = any index
+    bool useMask;
+    uint64_t mask;                  // Applied to inputFlags[0]
+    uint64_t value;                 // Kept if (inputFlags[0] & mask) == value
+
+    EntryFilter() : useMask(false), mask(0), value(0) {}
+
+    bool Matches(size_t index, const uint64_t flags[2]) const {
+        auto inRange = [index](const std::pair<size_t, size_t>& range) {
+            return index >= range.first && index <= range.second;
+        };
+        if (!ranges.empty() && std::none_of(ranges.begin(), ranges.end(), inRange)) {
+            return false;
+        }
+        return !useMask || (flags[0] & mask) == value;
+    }
+};
+
+// "0,4,8" or ranges, "0-3,8". Ranges are kept as they are, not expanded, so a
+// huge one costs no more than a small one.
+bool parseEntryList(const char* text, std::vector<std::pair<size_t, size_t>>& ranges) {
+    const char* cursor = text;
+    while (*cursor) {
+        char* end = nullptr;
+        unsigned long first = strtoul(cursor, &end, 10);
+        if (end == cursor) {
+            return false;
+        }
+        unsigned long last = first;
+        cursor = end;
+        if (*cursor == '-') {
+            last = strtoul(++cursor, &end, 10);
+            if (end == cursor || last < first) {
+                return false;
+            }
+            cursor = end;
+        }
+        ranges.emplace_back(first, last);
+        if (*cursor == ',') {
+            cursor++;
+        } else if (*cursor) {
+            return false;
+        }
+    }
+    return !ranges.empty();
+}
+
+// "<mask>" keeps entries with all of the mask's bits set, "<mask>:<value>" those
+// whose masked bits equal value. Decimal or 0x hex.
+bool parseFlagsMask(const char* text, EntryFilter& filter) {
+    char* end = nullptr;
+    filter.mask = strtoull(text, &end, 0);
+    if (end == text) {
+        return false;
+    }
+    filter.value = filter.mask;
+    if (*end == ':') {
+        const char* valueText = end + 1;
+        filter.value = strtoull(valueText, &end, 0);
+        if (end == valueText) {
+            return false;
+        }
+    }
+    filter.useMask = true;
+    return *end == '\0';
+}
+
+// unpack --entries/--flags-mask: only the selected entries' <index>.fxc, read
+// straight from their descriptors and buffers. A selected reference gets the
+// bytecode it points at. No data.json is written, the directory holds only
+// part of the shader and can't be packed back.
+int unpackSelected(const std::vector<std::string>& inputs, const EntryFilter& filter) {
+    std::vector<fs::path> files;
+    collectMswFiles(inputs, false, files);
+
+    int failed = 0;
+    for (const fs::path& file : files) {
+        ALLOC_CATEGORY(AllocCategory::IO);
+        LazyMswReader reader;
+        if (!reader.Open(file)) {
+            LOG_ERROR("Error: Failed to load MSW file \"%s\"\n", file.string().c_str());
+            failed++;
+            continue;
+        }
+
+        LazyMswShader* shader = reader.GetShader();
+        if (!shader) {
+            LOG_WARNING("Skipped %s: %s files have no entries to select\n", file.string().c_str(),
+                        MSW_TypeToString(reader.GetType()));
+            continue;
+        }
+
+        std::string outputDir = shader->name.empty() ? file.stem().string() : shader->name;
+        size_t written = 0;
+        for (size_t i = 0; i < shader->entries.size(); i++) {
+            if (!filter.Matches(i, shader->entries[i].flags)) {
+                continue;
+            }
+
+            const LazyMswEntry* entry = reader.GetEntry(*shader, i);
+            if (!entry) {
+                LOG_VERBOSE("  %s: entry %zu has no bytecode\n", outputDir.c_str(), i);
+                continue;
+            }
+
+            fs::create_directories(outputDir);
+            std::string outputPath = outputDir + "/" + std::to_string(i) + ".fxc";
+            FILE* out = nullptr;
+            bool ok = fopen_s(&out, outputPath.c_str(), "wb") == 0 && out;
+            ok = ok && fwrite(entry->data.get(), 1, entry->size, out) == entry->size;
+            if (out && fclose(out) != 0) {
+                ok = false;
+            }
+            if (!ok) {
+                LOG_ERROR("Error: Could not write %s\n", outputPath.c_str());
+                failed++;
+                continue;
+            }
+
+            if (&shader->entries[i] != entry) {
+                LOG_VERBOSE("  %s (reference to entry %u)\n", outputPath.c_str(), shader->entries[i].refIndex);
+            } else {
+                LOG_VERBOSE("  %s\n", outputPath.c_str());
+            }
+            written++;
+        }
+
+        LOG_INFO("%s: wrote %zu of %zu entries to %s (read %.1f KB of %.1f KB)\n", file.string().c_str(), written,
+                 shader->entries.size(), outputDir.c_str(), reader.BytesRead() / 1024.0, reader.GetFileSize() / 1024.0);
+    }
+    return failed ? 1 : 0;
+}
+
 // Convert shader/shaderset data.json to target version format
 // This modifies the JSON to include version info and adjusts fields for compatibility
 void convert(const char* path, int targetShaderVersion, int targetShaderSetVersion) {
+    ALLOC_CATEGORY(AllocCategory::Json);
     printf("Converting to shader v%d, shaderset v%d\n", targetShaderVersion, targetShaderSetVersion);
 
-    std::ifstream jsonFile(fs::path(path) / "data.json");
-    std::stringstream jsonFileStream;
-    rapidjson::Document jsonDoc;
-
-    if (jsonFile.fail()) {
+    JsonFile json;
+    if (!json.Load(fs::path(path) / "data.json")) {
         fprintf(stderr, "Error: Could not open %s/data.json\n", path);
         return;
     }
-
-    while (jsonFile.peek() != EOF)
-        jsonFileStream << (char)jsonFile.get();
-    jsonFile.close();
-
-    jsonDoc.Parse<rapidjson::ParseFlag::kParseCommentsFlag | rapidjson::ParseFlag::kParseTrailingCommasFlag>(
-        jsonFileStream.str().c_str());
+    rapidjson::Document& jsonDoc = json.GetDocument();
 
     if (!jsonDoc.IsObject()) {
         fprintf(stderr, "Error: Invalid JSON format\n");
@@ -424,6 +1221,10 @@ void convert(const char* path, int targetShaderVersion, int targetShaderSetVersi
 
     MultiShaderWrapperFileType_e fileType = (MultiShaderWrapperFileType_e)jsonDoc["type"].GetInt();
 
+    // The binary manifest is rewritten to match the converted data.json
+    ShaderManifest manifest;
+    bool hasManifest = false;
+
     // Prepare output JSON
     rapidjson::StringBuffer jsonBuf{};
     rapidjson::PrettyWriter<rapidjson::StringBuffer> jsonWriter{jsonBuf};
@@ -490,6 +1291,11 @@ void convert(const char* path, int targetShaderVersion, int targetShaderSetVersi
             }
         }
 
+        hasManifest = ShaderManifestFromJson(jsonDoc, manifest);
+        if (hasManifest) {
+            memcpy(manifest.features, features, sizeof(manifest.features));
+        }
+
         // Write features (always 7 bytes for MSW format)
         jsonWriter.Key("features");
         jsonWriter.StartArray();
@@ -689,32 +1495,30 @@ void convert(const char* path, int targetShaderVersion, int targetShaderSetVersi
     jsonOut.write(jsonBuf.GetString(), jsonBuf.GetSize());
     jsonOut.close();
 
-    printf("Written converted data to %s\n", outputPath.c_str());
+    if (hasManifest && WriteShaderManifest(path, manifest)) {
+        printf("Written converted data to %s (and %s)\n", outputPath.c_str(), SHADER_MANIFEST_FILE);
+    } else {
+        RemoveShaderManifest(path);
+        printf("Written converted data to %s\n", outputPath.c_str());
+    }
 }
 
 // Convert rex-rsx exported shader JSON to MSWUnPacker format
 // Input: rex-rsx JSON file (e.g., 0x3E3A804D0F4109F2.json)
 // Output: MSWUnPacker data.json in a new directory
 void convertRsx(const char* inputJsonPath, const char* outputDir, int targetVersion) {
+    ALLOC_CATEGORY(AllocCategory::Json);
     printf("Converting rex-rsx shader to MSWUnPacker format (target: v%d)\n", targetVersion);
     printf("Input: %s\n", inputJsonPath);
     printf("Output: %s\n", outputDir);
 
     // Read input JSON
-    std::ifstream jsonFile(inputJsonPath);
-    if (jsonFile.fail()) {
+    JsonFile json;
+    if (!json.Load(inputJsonPath)) {
         fprintf(stderr, "Error: Could not open %s\n", inputJsonPath);
         return;
     }
-
-    std::stringstream jsonFileStream;
-    while (jsonFile.peek() != EOF)
-        jsonFileStream << (char)jsonFile.get();
-    jsonFile.close();
-
-    rapidjson::Document jsonDoc;
-    jsonDoc.Parse<rapidjson::ParseFlag::kParseCommentsFlag | rapidjson::ParseFlag::kParseTrailingCommasFlag>(
-        jsonFileStream.str().c_str());
+    rapidjson::Document& jsonDoc = json.GetDocument();
 
     if (!jsonDoc.IsObject()) {
         fprintf(stderr, "Error: Invalid JSON format\n");
@@ -734,7 +1538,7 @@ void convertRsx(const char* inputJsonPath, const char* outputDir, int targetVers
     unsigned char features[7] = {0};
     if (jsonDoc.HasMember("features") && jsonDoc["features"].IsString()) {
         uint64_t featuresVal = ParseHexString(jsonDoc["features"].GetString());
-        printf("Features value: 0x%llX\n", featuresVal);
+        printf("Features value: 0x%llX\n", static_cast<unsigned long long>(featuresVal));
         // Extract 7 bytes from the value (little-endian in memory)
         for (int i = 0; i < 7; i++) {
             features[i] = (unsigned char)((featuresVal >> (i * 8)) & 0xFF);
@@ -803,6 +1607,57 @@ void convertRsx(const char* inputJsonPath, const char* outputDir, int targetVers
     fs::path inputPath(inputJsonPath);
     std::string shaderName = inputPath.stem().string();
 
+    // Copy FXC files from source directory
+    fs::path sourceDir = inputPath.parent_path();
+    std::string baseName = inputPath.stem().string();
+
+    int fxcCount = 0;
+    std::vector<int> missingFxcEntries; // Track entries that need references
+
+    for (int i = 0; i < (int)entryFlags.size(); i++) {
+        // Rex-rsx names FXC files as: {guid}_{index}.fxc
+        std::string srcFxcName = baseName + "_" + std::to_string(i) + ".fxc";
+        fs::path srcFxc = sourceDir / srcFxcName;
+
+        // MSWUnPacker expects: {index}.fxc
+        std::string dstFxcName = std::to_string(i) + ".fxc";
+        fs::path dstFxc = outPath / dstFxcName;
+
+        if (fs::exists(srcFxc)) {
+            try {
+                fs::copy_file(srcFxc, dstFxc, fs::copy_options::overwrite_existing);
+                printf("Copied: %s -> %s\n", srcFxcName.c_str(), dstFxcName.c_str());
+                fxcCount++;
+            } catch (const fs::filesystem_error& e) {
+                fprintf(stderr, "Error copying %s: %s\n", srcFxcName.c_str(), e.what());
+            }
+        } else {
+            // Check if this entry has a refIndex (references another shader's bytecode)
+            if (i < (int)refIndices.size() && refIndices[i] != 0xFFFF) {
+                printf("Entry %d references entry %d (no FXC file needed)\n", i, refIndices[i]);
+            } else {
+                // Rex-rsx may have deduplicated bytecode - track for reference assignment
+                missingFxcEntries.push_back(i);
+            }
+        }
+    }
+
+    // Handle missing FXC files by setting references to the first available entry,
+    // before data.json is written so it goes out complete in one pass
+    if (!missingFxcEntries.empty() && fxcCount > 0) {
+        printf("Note: %zu entries missing FXC files - setting as references to entry 0\n", missingFxcEntries.size());
+
+        refIndices.resize(entryFlags.size(), 0xFFFF);
+        for (int idx : missingFxcEntries) {
+            refIndices[idx] = 0;
+            printf("  Entry %d -> references entry 0\n", idx);
+        }
+    } else if (!missingFxcEntries.empty()) {
+        for (int idx : missingFxcEntries) {
+            fprintf(stderr, "Warning: Missing FXC file for entry %d: %s_%d.fxc\n", idx, baseName.c_str(), idx);
+        }
+    }
+
     // Write MSWUnPacker format data.json
     rapidjson::StringBuffer jsonBuf{};
     rapidjson::PrettyWriter<rapidjson::StringBuffer> jsonWriter{jsonBuf};
@@ -863,99 +1718,150 @@ void convertRsx(const char* inputJsonPath, const char* outputDir, int targetVers
 
     printf("Written: %s\n", outputJsonPath.c_str());
 
-    // Copy FXC files from source directory
-    fs::path sourceDir = inputPath.parent_path();
-    std::string baseName = inputPath.stem().string();
+    ShaderManifest manifest;
+    manifest.shaderType = shaderType;
+    manifest.name = shaderName;
+    memcpy(manifest.features, features, sizeof(manifest.features));
+    manifest.refIndices = refIndices;
+    manifest.refIndices.resize(entryFlags.size(), 0xFFFF);
+    for (const auto& entry : entryFlags) {
+        manifest.flags.push_back(entry.first);
+        manifest.flags.push_back(entry.second);
+    }
+    if (WriteShaderManifest(outPath, manifest)) {
+        printf("Written: %s\n", (outPath / SHADER_MANIFEST_FILE).string().c_str());
+    }
 
-    int fxcCount = 0;
-    std::vector<int> missingFxcEntries; // Track entries that need references
+    printf("\nConversion complete!\n");
+    printf("  Shader entries: %d\n", actualShaderCount);
+    printf("  FXC files copied: %d\n", fxcCount);
+    printf("  Output directory: %s\n", outputDir);
+    printf("\nNext steps:\n");
+    printf("  1. MSWUnPacker pack %s   (to create .msw file)\n", outputDir);
+    printf("  2. Use RePak to create r5sdk-compatible rpak\n");
+}
 
-    for (int i = 0; i < (int)entryFlags.size(); i++) {
-        // Rex-rsx names FXC files as: {guid}_{index}.fxc
-        std::string srcFxcName = baseName + "_" + std::to_string(i) + ".fxc";
-        fs::path srcFxc = sourceDir / srcFxcName;
+// --timings report: phase table over the whole run, plus the slowest files
+// when there is more than one
+void printTimings(const BatchResult& result) {
+    if (!TimingsEnabled()) {
+        return;
+    }
 
-        // MSWUnPacker expects: {index}.fxc
-        std::string dstFxcName = std::to_string(i) + ".fxc";
-        fs::path dstFxc = outPath / dstFxcName;
+    printf("\nPhase timings (%d file%s):\n", result.totalCount, result.totalCount == 1 ? "" : "s");
 
-        if (fs::exists(srcFxc)) {
-            try {
-                fs::copy_file(srcFxc, dstFxc, fs::copy_options::overwrite_existing);
-                printf("Copied: %s -> %s\n", srcFxcName.c_str(), dstFxcName.c_str());
-                fxcCount++;
-            } catch (const fs::filesystem_error& e) {
-                fprintf(stderr, "Error copying %s: %s\n", srcFxcName.c_str(), e.what());
-            }
-        } else {
-            // Check if this entry has a refIndex (references another shader's bytecode)
-            if (i < (int)refIndices.size() && refIndices[i] != 0xFFFF) {
-                printf("Entry %d references entry %d (no FXC file needed)\n", i, refIndices[i]);
-            } else {
-                // Rex-rsx may have deduplicated bytecode - track for reference assignment
-                missingFxcEntries.push_back(i);
-            }
+    // A single file has exact percentiles, the batch table is bucketed
+    if (result.files.size() == 1) {
+        PrintPhaseTable(result.files[0].phaseStats);
+        return;
+    }
+    PrintPhaseTable(result.phaseStats);
+
+    std::vector<std::pair<uint64_t, size_t>> fileTotals;
+    for (size_t i = 0; i < result.files.size(); i++) {
+        uint64_t total = 0;
+        for (const PhaseStats& row : result.files[i].phaseStats) {
+            total += row.totalNanoseconds;
         }
+        fileTotals.emplace_back(total, i);
     }
 
-    // Handle missing FXC files by setting references to the first available entry
-    if (!missingFxcEntries.empty() && fxcCount > 0) {
-        printf("Note: %zu entries missing FXC files - setting as references to entry 0\n", missingFxcEntries.size());
+    size_t shown = std::min<size_t>(fileTotals.size(), 10);
+    std::partial_sort(fileTotals.begin(), fileTotals.begin() + shown, fileTotals.end(),
+                      [](const std::pair<uint64_t, size_t>& a, const std::pair<uint64_t, size_t>& b) {
+                          return a.first > b.first;
+                      });
 
-        // Re-read the output JSON to add entryRefs
-        std::ifstream inJson(outputJsonPath);
-        std::stringstream ss;
-        while (inJson.peek() != EOF) ss << (char)inJson.get();
-        inJson.close();
+    printf("\nSlowest files (sum of phases, top phases):\n");
+    for (size_t i = 0; i < shown; i++) {
+        const BatchInput& input = result.inputs[fileTotals[i].second];
+        std::vector<PhaseStats> phases = result.files[fileTotals[i].second].phaseStats;
 
-        rapidjson::Document outDoc;
-        outDoc.Parse(ss.str().c_str());
+        std::sort(phases.begin(), phases.end(), [](const PhaseStats& a, const PhaseStats& b) {
+            return a.totalNanoseconds > b.totalNanoseconds;
+        });
 
-        // Update entryRefs
-        if (outDoc.HasMember("entryRefs") && outDoc["entryRefs"].IsObject()) {
-            for (int idx : missingFxcEntries) {
-                char key[8];
-                snprintf(key, sizeof(key), "%d", idx);
-                rapidjson::Value keyVal(key, outDoc.GetAllocator());
-                outDoc["entryRefs"].AddMember(keyVal, 0, outDoc.GetAllocator()); // Reference entry 0
-                printf("  Entry %d -> references entry 0\n", idx);
-            }
+        printf("  %10.3f ms  %s", fileTotals[i].first / 1e6, input.relativePath.c_str());
+        for (size_t p = 0; p < phases.size() && p < 3; p++) {
+            printf("%s%s %.3f ms", p ? ", " : " (", PhaseName(phases[p].phase), phases[p].totalNanoseconds / 1e6);
         }
+        printf("%s\n", phases.empty() ? "" : ")");
+    }
+}
+
+// --alloc-stats report: allocations by category over the whole run, plus
+// the files that allocated the most when there is more than one
+void printAllocStats(const BatchResult& result) {
+    if (!AllocStatsEnabled()) {
+        return;
+    }
 
-        // Write updated JSON
-        rapidjson::StringBuffer sb;
-        rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(sb);
-        outDoc.Accept(writer);
+    printf("\nAllocations (%d file%s):\n", result.totalCount, result.totalCount == 1 ? "" : "s");
+    PrintAllocTable(result.allocations);
+    printf("  Peak RSS: %.1f MB\n", result.peakResidentBytes / (1024.0 * 1024.0));
 
-        std::ofstream outJson(outputJsonPath);
-        outJson.write(sb.GetString(), sb.GetSize());
-        outJson.close();
-    } else if (!missingFxcEntries.empty()) {
-        for (int idx : missingFxcEntries) {
-            fprintf(stderr, "Warning: Missing FXC file for entry %d: %s_%d.fxc\n", idx, baseName.c_str(), idx);
-        }
+    if (result.files.size() <= 1) {
+        return;
     }
 
-    printf("\nConversion complete!\n");
-    printf("  Shader entries: %d\n", actualShaderCount);
-    printf("  FXC files copied: %d\n", fxcCount);
-    printf("  Output directory: %s\n", outputDir);
-    printf("\nNext steps:\n");
-    printf("  1. MSWUnPacker pack %s   (to create .msw file)\n", outputDir);
-    printf("  2. Use RePak to create r5sdk-compatible rpak\n");
+    std::vector<size_t> order(result.files.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+
+    size_t shown = std::min<size_t>(order.size(), 10);
+    std::partial_sort(order.begin(), order.begin() + shown, order.end(), [&](size_t a, size_t b) {
+        return result.files[a].allocations.Total().bytes > result.files[b].allocations.Total().bytes;
+    });
+
+    printf("\nMost allocating files (allocations, MB, peak heap):\n");
+    for (size_t i = 0; i < shown; i++) {
+        const BatchFileResult& file = result.files[order[i]];
+        AllocCounters total = file.allocations.Total();
+
+        printf("  %10llu %10.3f MB %8.1f MB  %s\n", static_cast<unsigned long long>(total.allocations),
+               total.bytes / (1024.0 * 1024.0), file.peakHeapBytes / (1024.0 * 1024.0),
+               result.inputs[order[i]].relativePath.c_str());
+    }
+}
+
+// --report: run the batch with a report streaming every file as it is written,
+// then append the summary. Returns false if the report could not be created.
+bool runReportedBatch(BatchInputSource& source, const BatchOptions& options, int knownTotal, const char* reportPath,
+                      const std::string& inputLabel, const std::string& outputLabel, BatchResult& result) {
+    if (!reportPath) {
+        result = RunLegacyBatch(source, options, knownTotal);
+        return true;
+    }
+
+    BatchReport report;
+    if (!report.Open(reportPath)) {
+        fprintf(stderr, "Error: Could not create report %s\n", reportPath);
+        return false;
+    }
+
+    BatchOptions reportOptions = options;
+    reportOptions.observer = &report;
+    result = RunLegacyBatch(source, reportOptions, knownTotal);
+
+    if (report.Finish(result, inputLabel, outputLabel)) {
+        printf("Report: %s\n", reportPath);
+    } else {
+        fprintf(stderr, "Error: Could not write report %s\n", reportPath);
+    }
+    return true;
 }
 
 // Convert S9 shader to legacy format with automatic CB2<->CB3 swap detection
 // This is the integrated version of the shader_patcher workflow
 // Returns: 0 = converted, 1 = used S7, -1 = error
-int convertLegacy(const char* inputPath, const char* outputPath) {
+int convertLegacy(const char* inputPath, const char* outputPath, const BatchOptions& options, const char* reportPath) {
     printf("=== S9 to Legacy Shader Converter ===\n");
     printf("Input: %s\n", inputPath);
 
     fs::path input(inputPath);
     fs::path tempDir;
     fs::path outputMsw;
-    bool createdTempDir = false;
 
     // Determine if input is MSW file or directory
     bool isMswFile = false;
@@ -988,21 +1894,41 @@ int convertLegacy(const char* inputPath, const char* outputPath) {
         return -1;
     }
 
-    // Set up working directory
+    printf("Output: %s\n", outputMsw.string().c_str());
+
+    // MSW files are converted in memory without the unpack/pack round trip.
+    // The entries are patched in parallel, so a large shader uses every core.
     if (isMswFile) {
-        // Unpack MSW to temp directory
-        tempDir = input.stem();
-        printf("Unpacking MSW to: %s\n", tempDir.string().c_str());
-        unpack(inputPath);
-        createdTempDir = true;
-    } else if (fs::is_directory(input)) {
-        tempDir = input;
-    } else {
-        fprintf(stderr, "Error: Input must be an MSW file or directory\n");
-        return -1;
+        std::vector<BatchInput> inputs(1);
+        inputs[0].inputPath = input;
+        inputs[0].outputPath = outputMsw;
+        inputs[0].relativePath = input.filename().generic_string();
+
+        VectorInputSource source(inputs);
+        BatchResult result;
+        if (!runReportedBatch(source, options, 1, reportPath, input.string(), outputMsw.string(), result)) {
+            return -1;
+        }
+
+        if (result.convertedCount != 1) {
+            fprintf(stderr, "\nError: Conversion failed\n");
+            return -1;
+        }
+
+        printTimings(result);
+        printAllocStats(result);
+
+        printf("\n=== Conversion Complete ===\n");
+        return 0;
     }
 
-    printf("Output: %s\n", outputMsw.string().c_str());
+    // Already unpacked shader directory
+    tempDir = input;
+
+    PhaseSamples timingSamples;
+    ScopedPhaseRecorder timingRecorder(&timingSamples);
+    AllocRecorder allocations;
+    ScopedAllocRecorder allocRecorder(&allocations);
 
     // Process each FXC file in the directory
     int fxcCount = 0;
@@ -1021,21 +1947,27 @@ int convertLegacy(const char* inputPath, const char* outputPath) {
         std::string fxcName = entry.path().filename().string();
 
         // Load FXC data
-        std::ifstream file(fxcPath, std::ios::binary | std::ios::ate);
-        if (!file) {
-            fprintf(stderr, "  [%s] Error: Could not open file\n", fxcName.c_str());
-            continue;
-        }
+        std::vector<uint8_t> fxcData;
+        {
+            TIME_PHASE(Phase::Read);
+            ALLOC_CATEGORY(AllocCategory::IO);
 
-        size_t fileSize = static_cast<size_t>(file.tellg());
-        file.seekg(0, std::ios::beg);
+            std::ifstream file(fxcPath, std::ios::binary | std::ios::ate);
+            if (!file) {
+                LOG_ERROR("  [%s] Error: Could not open file\n", fxcName.c_str());
+                continue;
+            }
 
-        std::vector<uint8_t> fxcData(fileSize);
-        if (!file.read(reinterpret_cast<char*>(fxcData.data()), fileSize)) {
-            fprintf(stderr, "  [%s] Error: Could not read file\n", fxcName.c_str());
-            continue;
+            size_t fileSize = static_cast<size_t>(file.tellg());
+            file.seekg(0, std::ios::beg);
+
+            fxcData.resize(fileSize);
+            if (!file.read(reinterpret_cast<char*>(fxcData.data()), fileSize)) {
+                LOG_ERROR("  [%s] Error: Could not read file\n", fxcName.c_str());
+                continue;
+            }
+            file.close();
         }
-        file.close();
 
         // ================================================================
         // PHASE 1: Detection (Read-Only)
@@ -1043,156 +1975,49 @@ int convertLegacy(const char* inputPath, const char* outputPath) {
         // S9: Camera=CB3, ModelInstance=CB2
         // S7: Camera=CB2, ModelInstance=CB3
         // ================================================================
-        dxbc::CBLayoutInfo layoutInfo = dxbc::DetectCBLayout(fxcData.data(), fxcData.size());
-
-        bool wasPatched = false;
-        int totalShexPatches = 0;
-        int totalRdefPatches = 0;
-        int totalSrvPatches = 0;
-        int sunDataPatches = 0;
-        int uberFlagsPatches = 0;
-        int featureFlagBit1Patches = 0;
-        int shadowBlendPatches = 0;
-
-        // ================================================================
-        // PHASE 2: Content Patches (BEFORE CB Swap!)
-        // These patches look for S9's original CB layout:
-        //   cb2 = CBufModelInstance (contains lighting.packedSunData at cb2[11].w)
-        //   cb3 = CBufCommonPerCamera
-        // We MUST patch these patterns BEFORE swapping CB2<->CB3!
-        // ================================================================
-
-        if (layoutInfo.needsSwap) {
-            printf("  [%s] %s\n", fxcName.c_str(), layoutInfo.reason.c_str());
-
-            // Patch 1: Sun Data Unpacking (CRITICAL - must be before CB swap)
-            // S9 shaders unpack packedSunData as integer with bit shifts:
-            //   ishr rX.w, cb2[11].w, l(16)   -> extract upper 16 bits (sun visibility)
-            //   and rX.w, cb2[11].w, l(0xFFFF) -> extract lower 16 bits (sun intensity)
-            //   mul rX.w, rX.w, l(0.00003052)  -> scale to 0-1
-            // R5SDK provides cb2[11].w as direct float (skyDirSunVis.w)
-            // This patch converts to direct float reads like S7 shaders do
-            // NOTE: We search for cb2[11].w because CB swap hasn't happened yet!
-            dxbc::PatchResult sunDataResult = dxbc::PatchSunDataUnpacking(fxcData);
-            if (sunDataResult.success && sunDataResult.shexPatches > 0) {
-                sunDataPatches = sunDataResult.shexPatches;
-                wasPatched = true;
-            }
-        }
-
-        // Patch 2: Uber Feature Flags - Bit 2 (detail texture blending)
-        // Patches "and rX.?, cb0[24].?, l(2)" to "mov rX.?, l(0)"
-        // Forces simple blending instead of overlay blending (fixes darker materials)
-        // cb0 is not affected by CB2<->CB3 swap
-        {
-            dxbc::PatchResult uberFlagsResult = dxbc::PatchUberFeatureFlags(fxcData);
-            if (uberFlagsResult.success && uberFlagsResult.shexPatches > 0) {
-                uberFlagsPatches = uberFlagsResult.shexPatches;
-                wasPatched = true;
-            }
-        }
-
-        // Patch 3: Feature Flag Bit 1 (cavity/AO blending mode)
-        // Patches "and rX.?, cb0[24].?, l(1)" to "mov rX.?, l(0)"
-        // Forces standard blending path
-        {
-            dxbc::PatchResult bit1Result = dxbc::PatchFeatureFlagBit1(fxcData);
-            if (bit1Result.success && bit1Result.shexPatches > 0) {
-                featureFlagBit1Patches = bit1Result.shexPatches;
-                wasPatched = true;
-            }
-        }
-
-        // Patch 4: Shadow Blend Multiply (CRITICAL for fixing sun flickering)
-        // S9 shaders have: mul r0.w, r0.w, r6.z (shadow_result * shadow_blend)
-        // After sun data patch, both r0.w and r6.z contain the same cb3[11].w value
-        // This causes sunVis * sunVis = sunVis^2 which:
-        //   1. Makes lighting darker (squared attenuation)
-        //   2. Amplifies frame-to-frame variations causing visible flickering
-        // S7 doesn't have this multiply, so we NOP it out
-        // TEMPORARILY DISABLED for testing
-        /*if (layoutInfo.needsSwap && sunDataPatches > 0) {
-            dxbc::PatchResult shadowBlendResult = dxbc::PatchShadowBlendMultiply(fxcData);
-            if (shadowBlendResult.success && shadowBlendResult.shexPatches > 0) {
-                shadowBlendPatches = shadowBlendResult.shexPatches;
-                wasPatched = true;
-            }
-        }*/
-
-        // ================================================================
-        // PHASE 3: SRV Slot Remapping
-        // Slot numbers are independent of CB swap
-        // t75 -> t61 (g_modelInst)
-        // t63 -> t1 (g_boneWeightsExtra)
-        // ================================================================
+        dxbc::CBLayoutInfo layoutInfo;
         {
-            dxbc::PatchResult srvResult = dxbc::PatchSRVSlots(fxcData, true);
-            if (srvResult.success && srvResult.srvPatches > 0) {
-                totalSrvPatches = srvResult.srvPatches;
-                wasPatched = true;
-            }
+            TIME_PHASE(Phase::Detect);
+            layoutInfo = dxbc::DetectCBLayout(fxcData.data(), fxcData.size());
         }
 
-        // ================================================================
-        // PHASE 3.5: Remove ClusteredLighting_t from CBufCommonPerCamera
-        // S11 shaders declare ClusteredLighting_t (32 bytes) but never use it
-        // This causes CBufCommonPerCamera to be 784 bytes instead of 752
-        // R5SDK provides 752-byte buffer, causing buffer binding mismatch
-        // ================================================================
-        int clusteredLightingPatches = 0;
-        {
-            dxbc::PatchResult clusteredResult = dxbc::PatchRemoveClusteredLighting(fxcData);
-            if (clusteredResult.success && clusteredResult.rdefPatches > 0) {
-                clusteredLightingPatches = clusteredResult.rdefPatches;
-                wasPatched = true;
-            }
+        if (layoutInfo.needsSwap) {
+            LOG_VERBOSE("  [%s] %s\n", fxcName.c_str(), layoutInfo.reason);
         }
 
         // ================================================================
-        // PHASE 4: CB2<->CB3 Swap (MUST BE LAST!)
-        // This swaps ALL cb2 and cb3 references in SHEX bytecode and RDEF
-        // After this swap:
-        //   cb2 = CBufCommonPerCamera (S7 layout)
-        //   cb3 = CBufModelInstance (S7 layout)
+        // PHASE 2-4: Content patches, SRV remapping and CB2<->CB3 swap
+        // See ApplyLegacyPatches for the order these have to run in
         // ================================================================
-        if (layoutInfo.needsSwap) {
-            dxbc::PatchResult patchResult = dxbc::SwapCB2CB3(fxcData);
+        LegacyPatchResult patchResult = ApplyLegacyPatches(fxcData, layoutInfo);
 
-            if (patchResult.success) {
-                totalShexPatches += patchResult.shexPatches;
-                totalRdefPatches += patchResult.rdefPatches;
-                wasPatched = true;
-            } else {
-                fprintf(stderr, "           CB Swap Error: %s\n", patchResult.error.c_str());
-            }
+        if (!patchResult.error.empty()) {
+            LOG_ERROR("  [%s] CB Swap Error: %s\n", fxcName.c_str(), patchResult.error.c_str());
         }
 
         // ================================================================
-        // PHASE 5: Finalize and Write
+        // PHASE 5: Write
         // ================================================================
-        if (wasPatched) {
-            // Ensure hash is updated (individual patches update it, but be safe)
-            dxbc::UpdateHash(fxcData);
-
+        if (patchResult.wasPatched) {
             if (!layoutInfo.needsSwap) {
-                printf("  [%s] Patches applied (S7 layout, no CB swap)\n", fxcName.c_str());
+                LOG_VERBOSE("  [%s] Patches applied (S7 layout, no CB swap)\n", fxcName.c_str());
             }
-            printf("           Patched: %d SHEX, %d RDEF, %d SRV, %d CLT, %d UBR, %d BIT1, %d SUN, %d SHDW\n",
-                   totalShexPatches, totalRdefPatches, totalSrvPatches, clusteredLightingPatches,
-                   uberFlagsPatches, featureFlagBit1Patches, sunDataPatches, shadowBlendPatches);
+            PrintLegacyPatchSummary(patchResult);
 
             // Write patched FXC back
+            TIME_PHASE(Phase::Write);
+            ALLOC_CATEGORY(AllocCategory::IO);
             std::ofstream outFile(fxcPath, std::ios::binary);
             if (outFile) {
                 outFile.write(reinterpret_cast<const char*>(fxcData.data()), fxcData.size());
                 outFile.close();
                 patchedCount++;
             } else {
-                fprintf(stderr, "           Error: Could not write patched file\n");
+                LOG_ERROR("  [%s] Error: Could not write patched file\n", fxcName.c_str());
             }
         } else {
-            printf("  [%s] %s (no patch needed)\n", fxcName.c_str(),
-                   layoutInfo.needsSwap ? layoutInfo.reason.c_str() : "S7 layout");
+            LOG_VERBOSE("  [%s] %s (no patch needed)\n", fxcName.c_str(),
+                        layoutInfo.needsSwap ? layoutInfo.reason : "S7 layout");
             skippedCount++;
         }
     }
@@ -1202,11 +2027,19 @@ int convertLegacy(const char* inputPath, const char* outputPath) {
 
     // Convert data.json to legacy version
     printf("\nConverting to legacy format (shader v12, shaderset v11)...\n");
-    convert(tempDir.string().c_str(), SHADER_VERSION_LEGACY, SHADERSET_VERSION_LEGACY);
+    {
+        TIME_PHASE(Phase::Convert);
+        convert(tempDir.string().c_str(), SHADER_VERSION_LEGACY, SHADERSET_VERSION_LEGACY);
+    }
 
     // Repack to MSW
     printf("\nRepacking to MSW...\n");
-    pack(tempDir.string().c_str());
+    {
+        TIME_PHASE(Phase::Pack);
+        PackOptions packOptions;
+        packOptions.mswVersion = MSW_FILE_VER_32;
+        pack(tempDir.string().c_str(), packOptions);
+    }
 
     // Move output MSW to final location
     fs::path packedMsw = tempDir.string() + ".msw";
@@ -1232,78 +2065,108 @@ int convertLegacy(const char* inputPath, const char* outputPath) {
         fprintf(stderr, "Error: Packed MSW not created\n");
     }
 
-    // Cleanup temp directory if we created it
-    if (createdTempDir && fs::exists(tempDir)) {
-        try {
-            fs::remove_all(tempDir);
-            printf("Cleaned up temp directory\n");
-        } catch (const fs::filesystem_error& e) {
-            fprintf(stderr, "Warning: Could not clean up temp directory: %s\n", e.what());
-        }
+    if (TimingsEnabled()) {
+        printf("\nPhase timings:\n");
+        PrintPhaseTable(SummarizePhases(timingSamples));
+    }
+    if (AllocStatsEnabled()) {
+        printf("\nAllocations:\n");
+        PrintAllocTable(allocations.Snapshot());
+        printf("  Peak RSS: %.1f MB\n", PeakResidentBytes() / (1024.0 * 1024.0));
     }
 
     printf("\n=== Conversion Complete ===\n");
     return 0;  // Converted successfully
 }
 
-// Batch convert all MSW files in a directory to legacy format
-void convertLegacyBatch(const char* inputDir, const char* outputDir) {
+// Batch convert MSW files to legacy format
+// Files are converted while discovery is still finding more (see discovery.h)
+// and patched in memory by the read/patch/write pipeline (see pipeline.h).
+// With a shard spec only the files hashing to that shard are converted.
+// Returns 0 if every file converted
+int convertLegacyBatch(InputDiscovery& discovery, const char* inputLabel, const char* outputDir,
+                       const BatchOptions& options, const ShardSpec& shard, const char* reportPath) {
     printf("=== Batch S9 to Legacy Shader Converter ===\n");
-    printf("Input directory: %s\n", inputDir);
+    printf("Input: %s\n", inputLabel);
     printf("Output directory: %s\n", outputDir);
+    if (shard.IsSharded()) {
+        printf("Shard: %d/%d\n", shard.index, shard.count);
+    }
 
-    // Create output directory if needed
-    fs::create_directories(outputDir);
-
-    int totalCount = 0;
-    int convertedCount = 0;
-    int failedCount = 0;
-
-    for (const auto& entry : fs::directory_iterator(inputDir)) {
-        if (!entry.is_regular_file()) continue;
-
-        std::string ext = entry.path().extension().string();
-        for (char& c : ext) c = static_cast<char>(tolower(c));
-        if (ext != ".msw") continue;
-
-        totalCount++;
-        std::string inputMsw = entry.path().string();
-        std::string outputMsw = (fs::path(outputDir) / entry.path().filename()).string();
-
-        printf("\n[%d] Processing: %s\n", totalCount, entry.path().filename().string().c_str());
-        printf("----------------------------------------\n");
+    BatchResult result;
+    if (!runReportedBatch(discovery, options, -1, reportPath, inputLabel, outputDir, result)) {
+        return 1;
+    }
 
-        try {
-            int result = convertLegacy(inputMsw.c_str(), outputMsw.c_str());
-            if (result == 0) {
-                convertedCount++;
-            } else {
-                failedCount++;
-            }
-        } catch (const std::exception& e) {
-            fprintf(stderr, "Error: %s\n", e.what());
-            failedCount++;
-        }
+    if (result.totalCount == 0) {
+        fprintf(stderr, "\nError: No MSW files found\n");
+        return 1;
     }
 
     printf("\n========================================\n");
     printf("Batch Conversion Complete\n");
     printf("========================================\n");
-    printf("Total: %d\n", totalCount);
-    printf("  Converted: %d\n", convertedCount);
-    printf("  Failed:    %d\n", failedCount);
+    printf("Total: %d\n", result.totalCount);
+    printf("  Converted: %d\n", result.convertedCount);
+    printf("  Failed:    %d\n", result.failedCount);
+    if (shard.IsSharded()) {
+        printf("  Other shards: %zu\n", discovery.OtherShardCount());
+    }
+    if (discovery.OutsideRootCount()) {
+        printf("  Skipped:   %zu (outside --root)\n", discovery.OutsideRootCount());
+    }
+    printf("Elapsed: %.2fs, peak in flight: %.1f MB\n", result.elapsedSeconds,
+           result.peakBytesInFlight / (1024.0 * 1024.0));
+
+    // Busy time against wall time shows how well the batch scaled
+    printf("Worker utilization:\n");
+    for (size_t i = 0; i < result.workerStats.size(); i++) {
+        const WorkerStats& stats = result.workerStats[i];
+        double utilization = result.elapsedSeconds > 0.0 ? 100.0 * stats.busySeconds / result.elapsedSeconds : 0.0;
+
+        printf("  [%2zu] %6llu tasks (%llu stolen), busy %.2fs (%5.1f%%)\n", i,
+               static_cast<unsigned long long>(stats.tasksRun),
+               static_cast<unsigned long long>(stats.tasksStolen),
+               stats.busySeconds, utilization);
+    }
     printf("Output directory: %s\n", outputDir);
+
+    printTimings(result);
+    printAllocStats(result);
+
+    if (shard.IsSharded()) {
+        fs::path manifestPath = fs::path(outputDir) / ShardManifestName(shard);
+        if (WriteShardManifest(manifestPath, shard, inputLabel, result)) {
+            printf("Manifest: %s\n", manifestPath.string().c_str());
+        } else {
+            fprintf(stderr, "Error: Could not write manifest %s\n", manifestPath.string().c_str());
+        }
+    }
+
+    return result.failedCount == 0 && discovery.OutsideRootCount() == 0 ? 0 : 1;
 }
 
 void printUsage() {
     printf("MSWUnPacker - MultiShaderWrapper Pack/Unpack/Convert Tool\n\n");
     printf("Usage:\n");
     printf("  MSWUnPacker unpack <msw_file>           - Unpack .msw file to directory\n");
+    printf("  MSWUnPacker unpack --entries 0,4,8 | --flags-mask <mask>[:<value>] <msw_file|directory>...\n");
+    printf("                                          - Write only the selected entries' .fxc files\n");
     printf("  MSWUnPacker pack <directory>            - Pack directory to .msw file\n");
+    printf("  MSWUnPacker pack --msw-version 4 <dir>  - Pack with 64-bit offsets (default: only past 4 GB)\n");
+    printf("  MSWUnPacker pack --align 16|64 <dir>    - Start every buffer at a multiple of 16 or 64 bytes\n");
     printf("  MSWUnPacker convert <directory> [version] - Convert data.json to target version\n");
+    printf("  MSWUnPacker info [--json] [-r] [-j N] <msw_file|directory|wildcard>... - List MSW contents from headers\n");
     printf("  MSWUnPacker convert-legacy <input> [output] - S9->S3 with auto CB2/CB3 swap\n");
     printf("  MSWUnPacker convert-rsx <json> <outdir> [version] - Convert rex-rsx export to MSW format\n");
     printf("\n");
+    printf("Bundles (many shaders and shader sets in one MSW file instead of a directory each):\n");
+    printf("  MSWUnPacker unpack --bundle <bundle> <msw_file|directory>... - Unpack MSWs into a bundle\n");
+    printf("  MSWUnPacker pack --from-bundle <bundle> <outdir> [name...]   - Pack MSWs from a bundle\n");
+    printf("  MSWUnPacker extract <bundle>                      - List the contents of a bundle\n");
+    printf("  MSWUnPacker extract <bundle> <name> [outdir]      - Unpack one shader or set to <outdir>/<name>\n");
+    printf("  MSWUnPacker extract <bundle> <name>:<entry> [out.fxc] - Write one entry's bytecode\n");
+    printf("\n");
     printf("Convert versions:\n");
     printf("  legacy  - Shader v12, ShaderSet v11 (r5sdk/S3 compatible)\n");
     printf("  s9      - Shader v12, ShaderSet v12 (S9-S10 compatible)\n");
@@ -1325,6 +2188,35 @@ void printUsage() {
     printf("  MSWUnPacker convert-legacy shader.msw out.msw      # Single file with output\n");
     printf("  MSWUnPacker convert-legacy ./shader_dir            # Directory\n");
     printf("  MSWUnPacker convert-legacy ./s9_shaders/ ./out/    # Batch directory\n");
+    printf("  find dump -name '*.msw' | MSWUnPacker convert-legacy --from-list - ./out/\n");
+    printf("\n");
+    printf("Output options (any command):\n");
+    printf("  -v, --verbose         Per-entry patch results, repeat (or -vv) for every patch site\n");
+    printf("  -q, --quiet           Only warnings, errors and the final summary\n");
+    printf("\n");
+    printf("Batch options (also used for single MSW files):\n");
+    printf("  --jobs, -j <n>        Patch worker threads (default: one per CPU)\n");
+    printf("  --max-memory <MB>     Cap on MSW data held in memory at once (default: 512)\n");
+    printf("  --stream              Read, patch and write one entry at a time, one file per worker:\n");
+    printf("                        memory per worker is bounded by the largest entry, not the file\n");
+    printf("  --shard <i>/<N>       Only convert shard i (0-based) of N, split by a hash of the\n");
+    printf("                        relative path. Writes manifest.shard-<i>-of-<N>.json\n");
+    printf("  --recursive, -r       Also convert MSW files in subdirectories, the output mirrors the tree\n");
+    printf("  --from-list <file|->  Convert the paths listed in file (one per line) or read from stdin.\n");
+    printf("                        The only positional argument is then the output directory\n");
+    printf("  --root <dir>          Directory list paths are relative to (default: current directory),\n");
+    printf("                        listed paths outside it are skipped\n");
+    printf("  --timings             Time each phase (read, detect, each patch, hash, write, ...) and\n");
+    printf("                        print count/total/p50/p99/max per phase at the end\n");
+    printf("  --alloc-stats         Count heap allocations by category (io, reflection, patch, json)\n");
+    printf("                        and track peak heap per file, printed and added to --report\n");
+    printf("  --report <file.json>  Write per-file and per-entry results (patch counts, sizes, timings,\n");
+    printf("                        failures) and a summary as compact JSON\n");
+    printf("  --trace <file.json>   Record a Chrome/Perfetto trace: one track per worker, spans per\n");
+    printf("                        file, entry and phase, write queue and memory counters\n");
+    printf("\n");
+    printf("Sharded runs:\n");
+    printf("  MSWUnPacker merge-manifests <merged.json> <shard.json>... - Combine shard manifests\n");
     printf("\n");
     printf("The convert-legacy command automatically:\n");
     printf("  1. Detects S9 CB layout (CBufCommonPerCamera at CB3)\n");
@@ -1340,24 +2232,140 @@ void printUsage() {
 
 int main(int argc, char** argv)
 {
+    // Log level flags apply to every command, strip them before dispatch
+    int argCount = 1;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-v") || !strcmp(argv[i], "--verbose")) {
+            SetLogLevel(LogEnabled(LogLevel::Verbose) ? LogLevel::Debug : LogLevel::Verbose);
+        }
+        else if (!strcmp(argv[i], "-vv")) {
+            SetLogLevel(LogLevel::Debug);
+        }
+        else if (!strcmp(argv[i], "-q") || !strcmp(argv[i], "--quiet")) {
+            SetLogLevel(LogLevel::Warning);
+        }
+        else {
+            argv[argCount++] = argv[i];
+        }
+    }
+    argc = argCount;
+
     if (argc < 2) {
         printUsage();
         return 1;
     }
 
     if (!strncmp(argv[1], "unpack", 7)) {
-        if (argc != 3) {
+        if (argc >= 5 && !strcmp(argv[2], "--bundle")) {
+            std::vector<std::string> inputs(argv + 4, argv + argc);
+            return unpackBundle(argv[3], inputs);
+        }
+
+        EntryFilter filter;
+        std::vector<std::string> inputs;
+        bool selective = false;
+        for (int i = 2; i < argc; i++) {
+            if (!strcmp(argv[i], "--entries") && i + 1 < argc) {
+                if (!parseEntryList(argv[++i], filter.ranges)) {
+                    fprintf(stderr, "Invalid entry list: %s (expected e.g. 0,4,8 or 0-3)\n", argv[i]);
+                    return 1;
+                }
+                selective = true;
+            }
+            else if (!strcmp(argv[i], "--flags-mask") && i + 1 < argc) {
+                if (!parseFlagsMask(argv[++i], filter)) {
+                    fprintf(stderr, "Invalid flags mask: %s (expected <mask> or <mask>:<value>)\n", argv[i]);
+                    return 1;
+                }
+                selective = true;
+            }
+            else {
+                inputs.push_back(argv[i]);
+            }
+        }
+        if (selective && !inputs.empty()) {
+            return unpackSelected(inputs, filter);
+        }
+
+        if (argc != 3 || selective) {
             fprintf(stderr, "Usage: MSWUnPacker unpack <msw_file>\n");
+            fprintf(stderr, "       MSWUnPacker unpack [--entries 0,4,8] [--flags-mask <mask>[:<value>]] <msw_file|directory|wildcard>...\n");
+            fprintf(stderr, "       MSWUnPacker unpack --bundle <bundle> <msw_file|directory>...\n");
             return 1;
         }
         unpack(argv[2]);
     }
     else if (!strncmp(argv[1], "pack", 5)) {
+        // Write options go before the inputs, strip them first
+        PackOptions packOptions;
+        int packArgCount = 2;
+        for (int i = 2; i < argc; i++) {
+            if (!strcmp(argv[i], "--msw-version") && i + 1 < argc) {
+                packOptions.mswVersion = static_cast<unsigned int>(atoi(argv[++i]));
+                if (packOptions.mswVersion != MSW_FILE_VER_32 && packOptions.mswVersion != MSW_FILE_VER) {
+                    fprintf(stderr, "Invalid MSW version: %s (expected %d or %d)\n", argv[i], MSW_FILE_VER_32, MSW_FILE_VER);
+                    return 1;
+                }
+            }
+            else if (!strcmp(argv[i], "--align") && i + 1 < argc) {
+                packOptions.bufferAlignment = static_cast<unsigned int>(atoi(argv[++i]));
+                if (packOptions.bufferAlignment != 16 && packOptions.bufferAlignment != 64) {
+                    fprintf(stderr, "Invalid alignment: %s (expected 16 or 64)\n", argv[i]);
+                    return 1;
+                }
+            }
+            else {
+                argv[packArgCount++] = argv[i];
+            }
+        }
+        argc = packArgCount;
+
+        if (argc >= 5 && !strcmp(argv[2], "--from-bundle")) {
+            std::vector<std::string> names(argv + 5, argv + argc);
+            return packFromBundle(argv[3], argv[4], names, packOptions);
+        }
         if (argc != 3) {
-            fprintf(stderr, "Usage: MSWUnPacker pack <directory>\n");
+            fprintf(stderr, "Usage: MSWUnPacker pack [--msw-version 3|4] [--align 16|64] <directory>\n");
+            fprintf(stderr, "       MSWUnPacker pack [--msw-version 3|4] [--align 16|64] --from-bundle <bundle> <outdir> [name...]\n");
+            return 1;
+        }
+        pack(argv[2], packOptions);
+    }
+    else if (!strncmp(argv[1], "info", 5)) {
+        std::vector<std::string> inputs;
+        bool recursive = false;
+        bool json = false;
+        int numWorkers = 0;
+        for (int i = 2; i < argc; i++) {
+            if ((!strcmp(argv[i], "--jobs") || !strcmp(argv[i], "-j")) && i + 1 < argc) {
+                numWorkers = atoi(argv[++i]);
+            }
+            else if (!strcmp(argv[i], "--recursive") || !strcmp(argv[i], "-r")) {
+                recursive = true;
+            }
+            else if (!strcmp(argv[i], "--json")) {
+                json = true;
+            }
+            else if (argv[i][0] == '-' && argv[i][1] == '-') {
+                fprintf(stderr, "Unknown option: %s\n", argv[i]);
+                return 1;
+            }
+            else {
+                inputs.push_back(argv[i]);
+            }
+        }
+        if (inputs.empty()) {
+            fprintf(stderr, "Usage: MSWUnPacker info [--json] [-r] [-j N] <msw_file|directory|wildcard>...\n");
+            return 1;
+        }
+        return infoCommand(inputs, recursive, json, numWorkers);
+    }
+    else if (!strncmp(argv[1], "extract", 8)) {
+        if (argc < 3 || argc > 5) {
+            fprintf(stderr, "Usage: MSWUnPacker extract <bundle> [name[:entry] [output]]\n");
             return 1;
         }
-        pack(argv[2]);
+        return extractFromBundle(argv[2], argc > 3 ? argv[3] : nullptr, argc > 4 ? argv[4] : nullptr);
     }
     else if (!strncmp(argv[1], "convert", 8)) {
         if (argc < 3) {
@@ -1402,47 +2410,116 @@ int main(int argc, char** argv)
         convert(argv[2], targetShaderVer, targetShaderSetVer);
     }
     else if (!strncmp(argv[1], "convert-legacy", 15)) {
-        if (argc < 3) {
-            fprintf(stderr, "Usage: MSWUnPacker convert-legacy <input.msw|dir> [output.msw|dir]\n");
-            return 1;
+        const char* inputArg = nullptr;
+        const char* outputArg = nullptr;
+        const char* listArg = nullptr;
+        const char* rootArg = ".";
+        const char* reportArg = nullptr;
+        BatchOptions batchOptions;
+        DiscoveryOptions discoveryOptions;
+
+        for (int i = 2; i < argc; i++) {
+            if ((!strcmp(argv[i], "--jobs") || !strcmp(argv[i], "-j")) && i + 1 < argc) {
+                batchOptions.numWorkers = atoi(argv[++i]);
+            }
+            else if (!strcmp(argv[i], "--max-memory") && i + 1 < argc) {
+                batchOptions.maxMemoryBytes = static_cast<size_t>(atoll(argv[++i])) * 1024 * 1024;
+            }
+            else if (!strcmp(argv[i], "--shard") && i + 1 < argc) {
+                if (!ParseShardSpec(argv[++i], discoveryOptions.shard)) {
+                    fprintf(stderr, "Invalid shard: %s (expected i/N with 0 <= i < N)\n", argv[i]);
+                    return 1;
+                }
+            }
+            else if (!strcmp(argv[i], "--stream")) {
+                batchOptions.streaming = true;
+            }
+            else if (!strcmp(argv[i], "--timings")) {
+                EnableTimings(true);
+            }
+            else if (!strcmp(argv[i], "--alloc-stats")) {
+                EnableAllocStats(true);
+            }
+            else if (!strcmp(argv[i], "--report") && i + 1 < argc) {
+                reportArg = argv[++i];
+            }
+            else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+                EnableTrace(argv[++i]);
+                TraceSetThreadName("main");
+            }
+            else if (!strcmp(argv[i], "--recursive") || !strcmp(argv[i], "-r")) {
+                discoveryOptions.recursive = true;
+            }
+            else if (!strcmp(argv[i], "--from-list") && i + 1 < argc) {
+                listArg = argv[++i];
+            }
+            else if (!strcmp(argv[i], "--root") && i + 1 < argc) {
+                rootArg = argv[++i];
+            }
+            else if (argv[i][0] == '-' && argv[i][1] == '-') {
+                fprintf(stderr, "Unknown option: %s\n", argv[i]);
+                return 1;
+            }
+            else if (!inputArg) {
+                inputArg = argv[i];
+            }
+            else if (!outputArg) {
+                outputArg = argv[i];
+            }
+        }
+
+        const ShardSpec& shard = discoveryOptions.shard;
+
+        // Work list: the only positional argument is the output directory
+        if (listArg) {
+            if (outputArg) {
+                fprintf(stderr, "Error: --from-list takes only an output directory\n");
+                return 1;
+            }
+
+            const char* outputDir = inputArg ? inputArg : "converted";
+            fs::create_directories(outputDir);
+
+            InputDiscovery discovery;
+            discovery.StartList(listArg, rootArg, outputDir, discoveryOptions);
+            return convertLegacyBatch(discovery, !strcmp(listArg, "-") ? "<stdin>" : listArg, outputDir, batchOptions, shard, reportArg);
         }
 
-        const char* inputArg = argv[2];
-        const char* outputArg = (argc >= 4) ? argv[3] : nullptr;
+        if (!inputArg) {
+            fprintf(stderr, "Usage: MSWUnPacker convert-legacy <input.msw|dir> [output.msw|dir] [--jobs N] [--max-memory MB] [--stream] [--shard i/N] [--recursive]\n");
+            fprintf(stderr, "       MSWUnPacker convert-legacy --from-list <file|-> [output_dir] [--root dir] [options]\n");
+            return 1;
+        }
 
-        // Check if input is a directory with MSW files (batch mode)
         fs::path input(inputArg);
         if (fs::is_directory(input)) {
-            // Check if it contains .msw files (batch mode) or just data files (single dir mode)
-            bool hasMswFiles = false;
-            bool hasDataJson = fs::exists(input / "data.json");
-
-            for (const auto& entry : fs::directory_iterator(input)) {
-                if (entry.is_regular_file()) {
-                    std::string ext = entry.path().extension().string();
-                    for (char& c : ext) c = static_cast<char>(tolower(c));
-                    if (ext == ".msw") {
-                        hasMswFiles = true;
-                        break;
-                    }
+            // An unpacked shader has a data.json, anything else is a batch of MSW files.
+            // Deciding this doesn't need a directory listing, discovery does that
+            // while the batch is already running.
+            if (!discoveryOptions.recursive && fs::exists(input / "data.json")) {
+                if (shard.IsSharded() || reportArg || batchOptions.streaming) {
+                    fprintf(stderr, "Error: --shard, --report and --stream only apply to MSW files\n");
+                    return 1;
                 }
-            }
 
-            if (hasMswFiles) {
-                // Batch mode: directory contains MSW files
-                std::string defaultOutput = std::string(inputArg) + "/converted";
-                const char* outputDir = outputArg ? outputArg : defaultOutput.c_str();
-                convertLegacyBatch(inputArg, outputDir);
-            } else if (hasDataJson) {
                 // Single directory mode: already unpacked shader
-                convertLegacy(inputArg, outputArg);
-            } else {
-                fprintf(stderr, "Error: Directory does not contain MSW files or data.json\n");
-                return 1;
+                return convertLegacy(inputArg, outputArg, batchOptions, reportArg) < 0 ? 1 : 0;
             }
+
+            // Batch mode: directory contains MSW files
+            std::string defaultOutput = std::string(inputArg) + "/converted";
+            const char* outputDir = outputArg ? outputArg : defaultOutput.c_str();
+            fs::create_directories(outputDir);
+
+            InputDiscovery discovery;
+            discovery.StartDirectory(input, outputDir, discoveryOptions);
+            return convertLegacyBatch(discovery, inputArg, outputDir, batchOptions, shard, reportArg);
+        } else if (shard.IsSharded() || discoveryOptions.recursive) {
+            fprintf(stderr, "Error: --shard and --recursive only apply to a batch of MSW files\n");
+            return 1;
         } else {
             // Single file mode
-            convertLegacy(inputArg, outputArg);
+            return convertLegacy(inputArg, outputArg, batchOptions, reportArg) < 0 ? 1 : 0;
         }
     }
     else if (!strncmp(argv[1], "convert-rsx", 12)) {
@@ -1471,6 +2548,15 @@ int main(int argc, char** argv)
 
         convertRsx(argv[2], argv[3], targetShaderVer);
     }
+    else if (!strncmp(argv[1], "merge-manifests", 16)) {
+        if (argc < 4) {
+            fprintf(stderr, "Usage: MSWUnPacker merge-manifests <merged.json> <shard.json>...\n");
+            return 1;
+        }
+
+        std::vector<fs::path> manifestPaths(argv + 3, argv + argc);
+        return MergeManifests(argv[2], manifestPaths);
+    }
     else if (!strncmp(argv[1], "help", 5) || !strncmp(argv[1], "-h", 3) || !strncmp(argv[1], "--help", 7)) {
         printUsage();
     }
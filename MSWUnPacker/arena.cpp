@@ -0,0 +1,58 @@
+/*
+ * Bump Arena
+ */
+
+#include "arena.h"
+#include <algorithm>
+
+Arena::Arena(size_t chunkBytes) : _chunk(0), _offset(0), _chunkBytes(chunkBytes) {}
+
+Arena::~Arena() {
+    Release();
+}
+
+void Arena::Release() {
+    for (Chunk& chunk : _chunks) {
+        ::operator delete(chunk.data);
+    }
+    _chunks.clear();
+    _chunk = 0;
+    _offset = 0;
+}
+
+size_t Arena::BytesReserved() const {
+    size_t total = 0;
+    for (const Chunk& chunk : _chunks) {
+        total += chunk.size;
+    }
+    return total;
+}
+
+void* Arena::AllocateSlow(size_t bytes, size_t alignment) {
+    // Chunks past the current one are left over from before the last rewind,
+    // take the first that fits. The ones skipped come back on the next rewind.
+    for (size_t i = _chunk + 1; i < _chunks.size(); i++) {
+        size_t offset = AlignedOffset(_chunks[i], 0, alignment);
+        if (offset + bytes <= _chunks[i].size) {
+            _chunk = i;
+            _offset = offset + bytes;
+            return _chunks[i].data + offset;
+        }
+    }
+
+    // Oversized requests get a chunk of their own
+    Chunk chunk;
+    chunk.size = std::max(_chunkBytes, bytes + alignment);
+    chunk.data = static_cast<uint8_t*>(::operator new(chunk.size));
+    _chunks.push_back(chunk);
+
+    _chunk = _chunks.size() - 1;
+    size_t offset = AlignedOffset(chunk, 0, alignment);
+    _offset = offset + bytes;
+    return chunk.data + offset;
+}
+
+Arena& ThreadScratchArena() {
+    thread_local Arena arena;
+    return arena;
+}
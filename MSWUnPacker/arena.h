@@ -0,0 +1,141 @@
+#pragma once
+/*
+ * Bump Arena
+ *
+ * Hands out memory from a list of chunks by bumping an offset. Nothing is
+ * freed on its own: Reset rewinds to the first chunk in O(1) and keeps every
+ * chunk, so an arena that is reused for similar work (one file after another,
+ * one entry after another) stops allocating once it has grown to fit.
+ *
+ * Used for MSW entry buffers (one arena per file in flight, see pipeline.cpp)
+ * and for patch scratch memory (one arena per thread, see ThreadScratchArena).
+ * Not thread-safe, an arena belongs to one thread at a time.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+class Arena {
+public:
+    explicit Arena(size_t chunkBytes = 64 * 1024);
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* Allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+        if (_chunk < _chunks.size()) {
+            Chunk& chunk = _chunks[_chunk];
+            size_t offset = AlignedOffset(chunk, _offset, alignment);
+            if (offset + bytes <= chunk.size) {
+                _offset = offset + bytes;
+                return chunk.data + offset;
+            }
+        }
+        return AllocateSlow(bytes, alignment);
+    }
+
+    template <typename T>
+    T* AllocateArray(size_t count) {
+        return static_cast<T*>(Allocate(count * sizeof(T), alignof(T)));
+    }
+
+    // A position to rewind to, everything allocated after it is released
+    struct Mark {
+        size_t chunk;
+        size_t offset;
+    };
+
+    Mark GetMark() const { return Mark{ _chunk, _offset }; }
+    void Rewind(const Mark& mark) { _chunk = mark.chunk; _offset = mark.offset; }
+
+    // Releases everything, keeps the chunks for reuse
+    void Reset() { _chunk = 0; _offset = 0; }
+
+    // Frees the chunks as well
+    void Release();
+
+    size_t BytesReserved() const;
+
+private:
+    struct Chunk {
+        uint8_t* data;
+        size_t size;
+    };
+
+    static size_t AlignedOffset(const Chunk& chunk, size_t offset, size_t alignment) {
+        uintptr_t address = reinterpret_cast<uintptr_t>(chunk.data) + offset;
+        return offset + (((address + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1)) - address);
+    }
+
+    void* AllocateSlow(size_t bytes, size_t alignment);
+
+    std::vector<Chunk> _chunks;
+    size_t _chunk;
+    size_t _offset;
+    size_t _chunkBytes;
+};
+
+// ============================================================================
+// Standard Containers
+// ============================================================================
+
+// Allocates from an arena, deallocate is a no-op (the memory comes back when
+// the arena is rewound or reset). Vectors that grow leave their old storage
+// behind until then, reserve up front where the size is known.
+template <typename T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+
+    explicit ArenaAllocator(Arena& arena) : _arena(&arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : _arena(other.GetArena()) {}
+
+    T* allocate(size_t count) { return _arena->AllocateArray<T>(count); }
+    void deallocate(T*, size_t) {}
+
+    Arena* GetArena() const { return _arena; }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return _arena == other.GetArena(); }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return _arena != other.GetArena(); }
+
+private:
+    Arena* _arena;
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+// ============================================================================
+// Scratch Memory
+// ============================================================================
+
+// The calling thread's arena for short-lived working memory
+Arena& ThreadScratchArena();
+
+// Rewinds the thread's scratch arena to where it was when this was created,
+// so nested users (the patch chain calling into dxbc) each give back their
+// own allocations
+class ScopedScratch {
+public:
+    ScopedScratch() : _arena(ThreadScratchArena()), _mark(_arena.GetMark()) {}
+    ~ScopedScratch() { _arena.Rewind(_mark); }
+
+    ScopedScratch(const ScopedScratch&) = delete;
+    ScopedScratch& operator=(const ScopedScratch&) = delete;
+
+    Arena& GetArena() { return _arena; }
+
+    template <typename T>
+    ArenaVector<T> MakeVector() { return ArenaVector<T>(ArenaAllocator<T>(_arena)); }
+
+private:
+    Arena& _arena;
+    Arena::Mark _mark;
+};
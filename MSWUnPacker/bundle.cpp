@@ -0,0 +1,516 @@
+/*
+ * MSW Bundles
+ */
+
+#include "bundle.h"
+#include <algorithm>
+#include <cstring>
+#include "platform.h"
+#include "shard.h"
+
+namespace {
+
+template <typename T>
+void Append(std::vector<char>& out, const T& value) {
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+bool Take(const std::vector<char>& in, size_t& cursor, T& value) {
+    if (in.size() - cursor < sizeof(T)) {
+        return false;
+    }
+    memcpy(&value, in.data() + cursor, sizeof(T));
+    cursor += sizeof(T);
+    return true;
+}
+
+bool TakeName(const std::vector<char>& in, size_t& cursor, uint16_t length, std::string& name) {
+    if (in.size() - cursor < length) {
+        return false;
+    }
+    name.assign(in.data() + cursor, length);
+    cursor += length;
+    return true;
+}
+
+bool IndexLess(const BundleIndexRecord& a, const BundleIndexRecord& b) {
+    return a.key != b.key ? a.key < b.key : a.kind < b.kind;
+}
+
+bool ParseShader(const std::vector<char>& in, size_t& cursor, BundleShader& shader) {
+    BundleShaderRecord record;
+    if (!Take(in, cursor, record)) {
+        return false;
+    }
+
+    shader.shaderType = static_cast<MultiShaderWrapperShaderType_e>(record.shaderType);
+    memcpy(shader.features, record.features, sizeof(shader.features));
+
+    shader.entries.resize(record.entryCount);
+    for (BundleEntry& entry : shader.entries) {
+        BundleEntryRecord entryRecord;
+        if (!Take(in, cursor, entryRecord)) {
+            return false;
+        }
+        entry.flags[0] = entryRecord.flags[0];
+        entry.flags[1] = entryRecord.flags[1];
+        entry.offset = entryRecord.offset;
+        entry.size = entryRecord.size;
+        entry.refIndex = entryRecord.refIndex;
+        entry.standard = entryRecord.standard != 0;
+    }
+
+    return TakeName(in, cursor, record.nameLength, shader.name);
+}
+
+bool ParseShaderSet(const std::vector<char>& in, size_t& cursor, BundleShaderSet& shaderSet) {
+    BundleShaderSetRecord record;
+    if (!Take(in, cursor, record)) {
+        return false;
+    }
+
+    CMultiShaderWrapperIO::ShaderSet_t& header = shaderSet.header;
+    header.pixelShaderGuid = record.pixelShaderGuid;
+    header.vertexShaderGuid = record.vertexShaderGuid;
+    header.numPixelShaderTextures = record.numPixelShaderTextures;
+    header.numVertexShaderTextures = record.numVertexShaderTextures;
+    header.numSamplers = record.numSamplers;
+    header.firstResourceBindPoint = record.firstResourceBindPoint;
+    header.numResources = record.numResources;
+
+    return TakeName(in, cursor, record.nameLength, shaderSet.name);
+}
+
+} // namespace
+
+uint64_t BundleKey(const std::string& name) {
+    return StableHash64(name);
+}
+
+// ============================================================================
+// Writer
+// ============================================================================
+
+BundleWriter::BundleWriter()
+    : _file(nullptr), _shaderCount(0), _shaderSetCount(0), _offset(0), _blobBytes(0), _dedupedBytes(0),
+      _dedupedEntries(0) {}
+
+BundleWriter::~BundleWriter() {
+    if (_file) {
+        fclose(_file);
+    }
+}
+
+bool BundleWriter::Open(const fs::path& path) {
+    // Read back as well, to confirm a hash match before sharing bytecode
+    if (fopen_s(&_file, path.string().c_str(), "w+b") != 0 || !_file) {
+        _file = nullptr;
+        return false;
+    }
+
+    // Written again by Finish once the counts and offsets are known
+    MultiShaderWrapper_Header_t fileHeader = {};
+    fileHeader.magic = MSW_FILE_MAGIC;
+    fileHeader.version = MSW_FILE_VER;
+    fileHeader.fileType = MultiShaderWrapperFileType_e::BUNDLE;
+
+    BundleHeader header = {};
+    _offset = sizeof(fileHeader) + sizeof(header);
+    return fwrite(&fileHeader, sizeof(fileHeader), 1, _file) == 1 && fwrite(&header, sizeof(header), 1, _file) == 1;
+}
+
+uint64_t BundleWriter::FindBlob(const char* data, uint32_t size, uint64_t hash) {
+    auto range = _blobs.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second.size != size) {
+            continue;
+        }
+
+        _compare.resize(size);
+        bool same = fseek64(_file, static_cast<int64_t>(it->second.offset), SEEK_SET) == 0 &&
+                    fread(_compare.data(), 1, size, _file) == size && memcmp(_compare.data(), data, size) == 0;
+        fseek64(_file, static_cast<int64_t>(_offset), SEEK_SET);
+        if (same) {
+            return it->second.offset;
+        }
+    }
+    return 0;
+}
+
+bool BundleWriter::AddRecord(BundleItemKind kind, const std::string& name) {
+    if (!_file || name.empty() || name.size() > 0xFFFF) {
+        return false;
+    }
+    std::unordered_set<std::string>& names = kind == BundleItemKind::Shader ? _shaderNames : _shaderSetNames;
+    if (!names.insert(name).second) {
+        return false;
+    }
+
+    BundleIndexRecord indexRecord = {};
+    indexRecord.key = BundleKey(name);
+    indexRecord.recordOffset = _records.size();
+    indexRecord.kind = static_cast<uint32_t>(kind);
+    _index.push_back(indexRecord);
+    return true;
+}
+
+bool BundleWriter::AddShader(const CMultiShaderWrapperIO::Shader_t& shader) {
+    if (shader.entries.size() > 0xFFFF || !AddRecord(BundleItemKind::Shader, shader.name)) {
+        return false;
+    }
+
+    BundleShaderRecord record = {};
+    record.shaderType = static_cast<uint32_t>(shader.shaderType);
+    record.entryCount = static_cast<uint16_t>(shader.entries.size());
+    record.nameLength = static_cast<uint16_t>(shader.name.size());
+    memcpy(record.features, shader.features, sizeof(record.features));
+    Append(_records, record);
+
+    for (const CMultiShaderWrapperIO::ShaderEntry_t& entry : shader.entries) {
+        BundleEntryRecord entryRecord = {};
+        entryRecord.flags[0] = entry.flags[0];
+        entryRecord.flags[1] = entry.flags[1];
+        entryRecord.refIndex = entry.buffer ? 0xFFFF : entry.refIndex;
+
+        if (entry.buffer) {
+            uint64_t hash = StableHash64(entry.buffer, entry.size);
+            uint64_t offset = FindBlob(entry.buffer, entry.size, hash);
+            if (offset) {
+                _dedupedBytes += entry.size;
+                _dedupedEntries++;
+            } else {
+                if (fwrite(entry.buffer, 1, entry.size, _file) != entry.size) {
+                    return false;
+                }
+                offset = _offset;
+                _blobs.emplace(hash, Blob{ offset, entry.size });
+                _offset += entry.size;
+                _blobBytes += entry.size;
+            }
+
+            entryRecord.offset = offset;
+            entryRecord.size = entry.size;
+            entryRecord.standard = 1;
+        }
+        Append(_records, entryRecord);
+    }
+
+    _records.insert(_records.end(), shader.name.begin(), shader.name.end());
+    _shaderCount++;
+    return true;
+}
+
+bool BundleWriter::AddShaderSet(const std::string& name, const CMultiShaderWrapperIO::ShaderSet_t& shaderSet) {
+    if (!AddRecord(BundleItemKind::ShaderSet, name)) {
+        return false;
+    }
+
+    BundleShaderSetRecord record = {};
+    record.pixelShaderGuid = shaderSet.pixelShaderGuid;
+    record.vertexShaderGuid = shaderSet.vertexShaderGuid;
+    record.numPixelShaderTextures = shaderSet.numPixelShaderTextures;
+    record.numVertexShaderTextures = shaderSet.numVertexShaderTextures;
+    record.numSamplers = shaderSet.numSamplers;
+    record.firstResourceBindPoint = shaderSet.firstResourceBindPoint;
+    record.numResources = shaderSet.numResources;
+    record.nameLength = static_cast<uint16_t>(name.size());
+    Append(_records, record);
+
+    _records.insert(_records.end(), name.begin(), name.end());
+    _shaderSetCount++;
+    return true;
+}
+
+bool BundleWriter::HasShader(const std::string& name) const {
+    return _shaderNames.count(name) != 0;
+}
+
+bool BundleWriter::HasShaderSet(const std::string& name) const {
+    return _shaderSetNames.count(name) != 0;
+}
+
+bool BundleWriter::Finish() {
+    if (!_file) {
+        return false;
+    }
+
+    uint64_t recordsOffset = _offset;
+    for (BundleIndexRecord& record : _index) {
+        record.recordOffset += recordsOffset;
+    }
+    std::sort(_index.begin(), _index.end(), IndexLess);
+
+    bool ok = fseek64(_file, static_cast<int64_t>(_offset), SEEK_SET) == 0;
+    ok = ok && fwrite(_records.data(), 1, _records.size(), _file) == _records.size();
+    ok = ok && fwrite(_index.data(), sizeof(BundleIndexRecord), _index.size(), _file) == _index.size();
+
+    MultiShaderWrapper_Header_t fileHeader = {};
+    fileHeader.magic = MSW_FILE_MAGIC;
+    fileHeader.version = MSW_FILE_VER;
+    fileHeader.fileType = MultiShaderWrapperFileType_e::BUNDLE;
+
+    BundleHeader header = {};
+    header.version = BUNDLE_VERSION;
+    header.headerSize = sizeof(BundleHeader);
+    header.shaderCount = _shaderCount;
+    header.shaderSetCount = _shaderSetCount;
+    header.recordsOffset = recordsOffset;
+    header.indexOffset = recordsOffset + _records.size();
+    header.blobBytes = _blobBytes;
+    header.dedupedBytes = _dedupedBytes;
+
+    ok = ok && fseek64(_file, 0, SEEK_SET) == 0;
+    ok = ok && fwrite(&fileHeader, sizeof(fileHeader), 1, _file) == 1;
+    ok = ok && fwrite(&header, sizeof(header), 1, _file) == 1;
+
+    if (fclose(_file) != 0) {
+        ok = false;
+    }
+    _file = nullptr;
+    return ok;
+}
+
+// ============================================================================
+// Reader
+// ============================================================================
+
+BundleReader::BundleReader() : _file(nullptr), _header{} {}
+
+BundleReader::~BundleReader() {
+    if (_file) {
+        fclose(_file);
+    }
+}
+
+bool BundleReader::Open(const fs::path& path) {
+    if (fopen_s(&_file, path.string().c_str(), "rb") != 0 || !_file) {
+        _file = nullptr;
+        return false;
+    }
+
+    MultiShaderWrapper_Header_t fileHeader = {};
+    if (fread(&fileHeader, sizeof(fileHeader), 1, _file) != 1 || fileHeader.magic != MSW_FILE_MAGIC ||
+        fileHeader.fileType != MultiShaderWrapperFileType_e::BUNDLE) {
+        return false;
+    }
+
+    return fread(&_header, sizeof(_header), 1, _file) == 1 && _header.version == BUNDLE_VERSION &&
+           _header.headerSize >= sizeof(_header) && _header.indexOffset != 0;
+}
+
+bool BundleReader::ReadIndexSlot(uint64_t slot, BundleIndexRecord& record) {
+    return fseek64(_file, static_cast<int64_t>(_header.indexOffset + slot * sizeof(record)), SEEK_SET) == 0 &&
+           fread(&record, sizeof(record), 1, _file) == 1;
+}
+
+bool BundleReader::LowerBound(const BundleIndexRecord& target, uint64_t& slot) {
+    uint64_t low = 0;
+    uint64_t high = static_cast<uint64_t>(_header.shaderCount) + _header.shaderSetCount;
+    while (low < high) {
+        uint64_t middle = low + (high - low) / 2;
+        BundleIndexRecord record;
+        if (!ReadIndexSlot(middle, record)) {
+            return false;
+        }
+        if (IndexLess(record, target)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    slot = low;
+    return true;
+}
+
+uint64_t BundleReader::Find(BundleItemKind kind, uint64_t key) {
+    if (!_file) {
+        return 0;
+    }
+
+    BundleIndexRecord target = {};
+    target.key = key;
+    target.kind = static_cast<uint32_t>(kind);
+
+    uint64_t slot;
+    BundleIndexRecord record;
+    if (!LowerBound(target, slot) || slot >= static_cast<uint64_t>(_header.shaderCount) + _header.shaderSetCount ||
+        !ReadIndexSlot(slot, record) || record.key != key || record.kind != target.kind) {
+        return 0;
+    }
+    return record.recordOffset;
+}
+
+uint64_t BundleReader::FindNamed(BundleItemKind kind, const std::string& name) {
+    if (!_file) {
+        return 0;
+    }
+
+    BundleIndexRecord target = {};
+    target.key = BundleKey(name);
+    target.kind = static_cast<uint32_t>(kind);
+
+    uint64_t low;
+    if (!LowerBound(target, low)) {
+        return 0;
+    }
+
+    // Names that share a key sit next to each other
+    uint64_t count = static_cast<uint64_t>(_header.shaderCount) + _header.shaderSetCount;
+    for (uint64_t slot = low; slot < count; slot++) {
+        BundleIndexRecord record;
+        if (!ReadIndexSlot(slot, record) || record.key != target.key || record.kind != target.kind) {
+            return 0;
+        }
+
+        std::vector<char> fixed(kind == BundleItemKind::Shader ? sizeof(BundleShaderRecord) : sizeof(BundleShaderSetRecord));
+        if (fseek64(_file, static_cast<int64_t>(record.recordOffset), SEEK_SET) != 0 ||
+            fread(fixed.data(), 1, fixed.size(), _file) != fixed.size()) {
+            return 0;
+        }
+
+        uint16_t nameLength;
+        uint64_t nameOffset = record.recordOffset + fixed.size();
+        if (kind == BundleItemKind::Shader) {
+            BundleShaderRecord shaderRecord;
+            memcpy(&shaderRecord, fixed.data(), sizeof(shaderRecord));
+            nameLength = shaderRecord.nameLength;
+            nameOffset += shaderRecord.entryCount * sizeof(BundleEntryRecord);
+        } else {
+            BundleShaderSetRecord setRecord;
+            memcpy(&setRecord, fixed.data(), sizeof(setRecord));
+            nameLength = setRecord.nameLength;
+        }
+
+        std::string recordName(nameLength, '\0');
+        if (fseek64(_file, static_cast<int64_t>(nameOffset), SEEK_SET) != 0 ||
+            fread(recordName.data(), 1, nameLength, _file) != nameLength) {
+            return 0;
+        }
+        if (recordName == name) {
+            return record.recordOffset;
+        }
+    }
+    return 0;
+}
+
+bool BundleReader::FindShader(const std::string& name, BundleShader& shader) {
+    return ReadShaderRecord(FindNamed(BundleItemKind::Shader, name), shader);
+}
+
+bool BundleReader::FindShaderSet(const std::string& name, BundleShaderSet& shaderSet) {
+    return ReadShaderSetRecord(FindNamed(BundleItemKind::ShaderSet, name), shaderSet);
+}
+
+bool BundleReader::ReadShaderRecord(uint64_t offset, BundleShader& shader) {
+    if (!_file || !offset) {
+        return false;
+    }
+
+    BundleShaderRecord record;
+    if (fseek64(_file, static_cast<int64_t>(offset), SEEK_SET) != 0 || fread(&record, sizeof(record), 1, _file) != 1) {
+        return false;
+    }
+
+    std::vector<char> data(sizeof(record) + record.entryCount * sizeof(BundleEntryRecord) + record.nameLength);
+    memcpy(data.data(), &record, sizeof(record));
+    if (fread(data.data() + sizeof(record), 1, data.size() - sizeof(record), _file) != data.size() - sizeof(record)) {
+        return false;
+    }
+
+    size_t cursor = 0;
+    return ParseShader(data, cursor, shader);
+}
+
+bool BundleReader::ReadShaderSetRecord(uint64_t offset, BundleShaderSet& shaderSet) {
+    if (!_file || !offset) {
+        return false;
+    }
+
+    BundleShaderSetRecord record;
+    if (fseek64(_file, static_cast<int64_t>(offset), SEEK_SET) != 0 || fread(&record, sizeof(record), 1, _file) != 1) {
+        return false;
+    }
+
+    std::vector<char> data(sizeof(record) + record.nameLength);
+    memcpy(data.data(), &record, sizeof(record));
+    if (fread(data.data() + sizeof(record), 1, record.nameLength, _file) != record.nameLength) {
+        return false;
+    }
+
+    size_t cursor = 0;
+    return ParseShaderSet(data, cursor, shaderSet);
+}
+
+bool BundleReader::ReadAll(std::vector<BundleShader>& shaders, std::vector<BundleShaderSet>& shaderSets) {
+    if (!_file || _header.indexOffset < _header.recordsOffset) {
+        return false;
+    }
+
+    // The records are in the order they were added, the index tells their kinds
+    uint64_t count = static_cast<uint64_t>(_header.shaderCount) + _header.shaderSetCount;
+    std::vector<BundleIndexRecord> index(static_cast<size_t>(count));
+    std::vector<char> records(static_cast<size_t>(_header.indexOffset - _header.recordsOffset));
+    if (fseek64(_file, static_cast<int64_t>(_header.recordsOffset), SEEK_SET) != 0 ||
+        fread(records.data(), 1, records.size(), _file) != records.size() ||
+        fread(index.data(), sizeof(BundleIndexRecord), index.size(), _file) != index.size()) {
+        return false;
+    }
+
+    std::sort(index.begin(), index.end(), [](const BundleIndexRecord& a, const BundleIndexRecord& b) {
+        return a.recordOffset < b.recordOffset;
+    });
+
+    shaders.clear();
+    shaderSets.clear();
+    shaders.reserve(_header.shaderCount);
+    shaderSets.reserve(_header.shaderSetCount);
+    for (const BundleIndexRecord& record : index) {
+        size_t cursor = static_cast<size_t>(record.recordOffset - _header.recordsOffset);
+        bool ok = record.kind == static_cast<uint32_t>(BundleItemKind::Shader)
+                      ? ParseShader(records, cursor, shaders.emplace_back())
+                      : ParseShaderSet(records, cursor, shaderSets.emplace_back());
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BundleReader::ReadEntry(const BundleEntry& entry, std::vector<char>& data) {
+    if (!_file || !entry.standard) {
+        return false;
+    }
+    data.resize(entry.size);
+    return fseek64(_file, static_cast<int64_t>(entry.offset), SEEK_SET) == 0 &&
+           fread(data.data(), 1, data.size(), _file) == data.size();
+}
+
+bool BundleReader::ReadShader(const BundleShader& bundleShader, CMultiShaderWrapperIO::Shader_t& shader) {
+    shader.shaderType = bundleShader.shaderType;
+    shader.name = bundleShader.name;
+    memcpy(shader.features, bundleShader.features, sizeof(shader.features));
+
+    shader.entries.clear();
+    shader.entries.reserve(bundleShader.entries.size());
+    for (const BundleEntry& bundleEntry : bundleShader.entries) {
+        CMultiShaderWrapperIO::ShaderEntry_t& entry = shader.entries.emplace_back();
+        entry.flags[0] = bundleEntry.flags[0];
+        entry.flags[1] = bundleEntry.flags[1];
+        entry.refIndex = bundleEntry.refIndex;
+
+        if (bundleEntry.standard) {
+            char* buffer = new char[bundleEntry.size ? bundleEntry.size : 1];
+            entry.buffer = buffer;
+            entry.size = bundleEntry.size;
+            entry.deleteBuffer = true;
+
+            if (fseek64(_file, static_cast<int64_t>(bundleEntry.offset), SEEK_SET) != 0 ||
+                fread(buffer, 1, bundleEntry.size, _file) != bundleEntry.size) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,230 @@
+#pragma once
+/*
+ * MSW Bundles
+ *
+ * An MSW file of type BUNDLE holds many shaders and shader sets: the entry
+ * bytecode, one record per shader (what data.json would hold: type, name,
+ * features, entry flags and references, plus where each entry's bytecode
+ * is) or shader set (its header, like an unpack + pack round trip), and an
+ * index of the records sorted by key. A record's key is the 64-bit FNV-1a
+ * hash of its name (BundleKey).
+ *
+ * unpack --bundle writes one instead of a directory per MSW, pack
+ * --from-bundle turns it back into MSWs and extract pulls single shaders,
+ * sets or entries out.
+ *
+ * Bytecode is stored once per bundle: an entry whose bytes match one already
+ * written points at the earlier copy. The writer streams bytecode out as
+ * shaders are added and keeps only the records in memory. The reader starts
+ * from the header alone and finds a record by binary search over the index
+ * on disk, so a lookup reads O(log n) index slots and the one record.
+ *
+ *   MultiShaderWrapper_Header_t   fileType BUNDLE
+ *   BundleHeader
+ *   bytecode                      unique entry buffers, in the order added
+ *   records                       BundleShaderRecord + BundleEntryRecord[] + name,
+ *                                 or BundleShaderSetRecord + name
+ *   index                         BundleIndexRecord[shaderCount + shaderSetCount]
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <filesystem>
+#include "multishader.h"
+
+namespace fs = std::filesystem;
+
+#define BUNDLE_VERSION 2
+
+enum class BundleItemKind : uint32_t {
+    Shader = 0,
+    ShaderSet = 1,
+};
+
+#pragma pack(push, 1)
+struct BundleHeader {
+    uint16_t version;
+    uint16_t headerSize;
+    uint32_t shaderCount;
+    uint32_t shaderSetCount;
+    uint32_t reserved;
+    uint64_t recordsOffset;     // Absolute
+    uint64_t indexOffset;       // Absolute, 0 until the writer has finished
+    uint64_t blobBytes;         // Unique bytecode stored
+    uint64_t dedupedBytes;      // Bytecode that pointed at an earlier copy instead
+};
+
+struct BundleIndexRecord {
+    uint64_t key;
+    uint64_t recordOffset;      // Absolute
+    uint32_t kind;              // BundleItemKind
+    uint32_t reserved;
+};
+
+struct BundleShaderRecord {
+    uint32_t shaderType;
+    uint16_t entryCount;
+    uint16_t nameLength;        // Not terminated
+    uint8_t features[7];
+    uint8_t reserved;
+};
+
+struct BundleEntryRecord {
+    uint64_t flags[2];
+    uint64_t offset;            // Absolute, standard entries only
+    uint32_t size;
+    uint16_t refIndex;          // 0xFFFF = none
+    uint16_t standard;          // 1 if the entry has its own bytecode
+};
+
+struct BundleShaderSetRecord {
+    uint64_t pixelShaderGuid;
+    uint64_t vertexShaderGuid;
+    uint16_t numPixelShaderTextures;
+    uint16_t numVertexShaderTextures;
+    uint16_t numSamplers;
+    uint8_t firstResourceBindPoint;
+    uint8_t numResources;
+    uint16_t nameLength;        // Not terminated
+    uint16_t reserved;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(BundleHeader) == 48, "BundleHeader layout changed");
+static_assert(sizeof(BundleIndexRecord) == 24, "BundleIndexRecord layout changed");
+static_assert(sizeof(BundleShaderRecord) == 16, "BundleShaderRecord layout changed");
+static_assert(sizeof(BundleEntryRecord) == 32, "BundleEntryRecord layout changed");
+static_assert(sizeof(BundleShaderSetRecord) == 28, "BundleShaderSetRecord layout changed");
+
+// The key a shader or shader set is stored and looked up under
+uint64_t BundleKey(const std::string& name);
+
+struct BundleEntry {
+    uint64_t flags[2];
+    uint64_t offset;
+    uint32_t size;
+    uint16_t refIndex;
+    bool standard;
+};
+
+struct BundleShader {
+    std::string name;
+    MultiShaderWrapperShaderType_e shaderType;
+    uint8_t features[7];
+    std::vector<BundleEntry> entries;
+};
+
+struct BundleShaderSet {
+    std::string name;
+    CMultiShaderWrapperIO::ShaderSet_t header;  // No shaders, see WriteLegacyMsw
+};
+
+class BundleWriter {
+public:
+    BundleWriter();
+    ~BundleWriter();
+
+    BundleWriter(const BundleWriter&) = delete;
+    BundleWriter& operator=(const BundleWriter&) = delete;
+
+    bool Open(const fs::path& path);
+
+    // Writes the shader's new bytecode and queues its record. The name must
+    // be set and not taken by another shader (see HasShader). False on a
+    // missing or taken name, or on a write error after which the bundle
+    // cannot be finished.
+    bool AddShader(const CMultiShaderWrapperIO::Shader_t& shader);
+    bool AddShaderSet(const std::string& name, const CMultiShaderWrapperIO::ShaderSet_t& shaderSet);
+
+    bool HasShader(const std::string& name) const;
+    bool HasShaderSet(const std::string& name) const;
+
+    // Writes the records and the sorted index and completes the header.
+    // Without it the file is not a valid bundle.
+    bool Finish();
+
+    uint32_t ShaderCount() const { return _shaderCount; }
+    uint32_t ShaderSetCount() const { return _shaderSetCount; }
+    uint64_t BlobBytes() const { return _blobBytes; }
+    uint64_t DedupedBytes() const { return _dedupedBytes; }
+    uint64_t DedupedEntries() const { return _dedupedEntries; }
+
+private:
+    struct Blob {
+        uint64_t offset;
+        uint32_t size;
+    };
+
+    // Where identical bytes were written before, 0 if they were not
+    uint64_t FindBlob(const char* data, uint32_t size, uint64_t hash);
+
+    bool AddRecord(BundleItemKind kind, const std::string& name);
+
+    FILE* _file;
+    uint32_t _shaderCount;
+    uint32_t _shaderSetCount;
+    uint64_t _offset;
+    uint64_t _blobBytes;
+    uint64_t _dedupedBytes;
+    uint64_t _dedupedEntries;
+    std::vector<char> _records;
+    std::vector<BundleIndexRecord> _index;   // recordOffset relative to _records until Finish
+    std::unordered_set<std::string> _shaderNames;
+    std::unordered_set<std::string> _shaderSetNames;
+    std::unordered_multimap<uint64_t, Blob> _blobs;
+    std::vector<char> _compare;
+};
+
+class BundleReader {
+public:
+    BundleReader();
+    ~BundleReader();
+
+    BundleReader(const BundleReader&) = delete;
+    BundleReader& operator=(const BundleReader&) = delete;
+
+    // Reads the headers only
+    bool Open(const fs::path& path);
+
+    uint32_t ShaderCount() const { return _header.shaderCount; }
+    uint32_t ShaderSetCount() const { return _header.shaderSetCount; }
+    const BundleHeader& GetHeader() const { return _header; }
+
+    // Binary search over the index, reads only what it visits
+    bool FindShader(const std::string& name, BundleShader& shader);
+    bool FindShaderSet(const std::string& name, BundleShaderSet& shaderSet);
+
+    // Offset of the first record of this kind stored under key, 0 if there is
+    // none. Names that share a key sit right after it, the name lookups above
+    // tell them apart.
+    uint64_t Find(BundleItemKind kind, uint64_t key);
+
+    // The record at an offset from Find, false for 0
+    bool ReadShaderRecord(uint64_t offset, BundleShader& shader);
+    bool ReadShaderSetRecord(uint64_t offset, BundleShaderSet& shaderSet);
+
+    // Every record, in one read, in the order they were added
+    bool ReadAll(std::vector<BundleShader>& shaders, std::vector<BundleShaderSet>& shaderSets);
+
+    bool ReadEntry(const BundleEntry& entry, std::vector<char>& data);
+
+    // Fills shader with the entries and their bytecode, the buffers are owned
+    // by the entries
+    bool ReadShader(const BundleShader& bundleShader, CMultiShaderWrapperIO::Shader_t& shader);
+
+private:
+    bool ReadIndexSlot(uint64_t slot, BundleIndexRecord& record);
+
+    // First index slot not less than target
+    bool LowerBound(const BundleIndexRecord& target, uint64_t& slot);
+
+    // Offset of the record with this kind and name, 0 if there is none
+    uint64_t FindNamed(BundleItemKind kind, const std::string& name);
+
+    FILE* _file;
+    BundleHeader _header;
+};
@@ -0,0 +1,155 @@
+/*
+ * Batch Input Discovery
+ */
+
+#include "discovery.h"
+#include "trace.h"
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+bool HasMswExtension(const fs::path& path) {
+    std::string ext = path.extension().string();
+    for (char& c : ext) c = static_cast<char>(tolower(c));
+    return ext == ".msw";
+}
+
+InputDiscovery::InputDiscovery(size_t queueCapacity)
+    : _queue(queueCapacity)
+    , _found(0)
+    , _otherShard(0)
+    , _outsideRoot(0)
+{}
+
+InputDiscovery::~InputDiscovery() {
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+}
+
+void InputDiscovery::StartDirectory(const fs::path& inputDir, const fs::path& outputDir, const DiscoveryOptions& options) {
+    _thread = std::thread(&InputDiscovery::ScanDirectory, this, inputDir, outputDir, options);
+}
+
+void InputDiscovery::StartList(const std::string& listPath, const fs::path& root, const fs::path& outputDir,
+                               const DiscoveryOptions& options) {
+    _thread = std::thread(&InputDiscovery::ReadList, this, listPath, root, outputDir, options);
+}
+
+bool InputDiscovery::Next(BatchInput& input) {
+    return _queue.Pop(input);
+}
+
+bool InputDiscovery::TryNext(BatchInput& input) {
+    return _queue.TryPop(input);
+}
+
+void InputDiscovery::Emit(const fs::path& inputPath, const std::string& relativePath, const fs::path& outputDir,
+                          const ShardSpec& shard) {
+    if (!ShardContains(shard, relativePath)) {
+        _otherShard.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    BatchInput input;
+    input.inputPath = inputPath;
+    input.outputPath = outputDir / fs::path(relativePath);
+    input.relativePath = relativePath;
+
+    _found.fetch_add(1, std::memory_order_relaxed);
+    _queue.Push(std::move(input));
+}
+
+void InputDiscovery::ScanDirectory(fs::path inputDir, fs::path outputDir, DiscoveryOptions options) {
+    TraceSetThreadName("discovery");
+    std::error_code ec;
+
+    try {
+        if (options.recursive) {
+            fs::recursive_directory_iterator it(inputDir, fs::directory_options::skip_permission_denied, ec);
+
+            for (; !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+                const fs::directory_entry& entry = *it;
+                std::error_code entryEc;
+
+                if (entry.is_directory(entryEc)) {
+                    // Don't pick up our own output when it is written inside the input tree
+                    if (fs::equivalent(entry.path(), outputDir, entryEc)) {
+                        it.disable_recursion_pending();
+                    }
+                    continue;
+                }
+
+                if (!entry.is_regular_file(entryEc) || !HasMswExtension(entry.path())) continue;
+
+                Emit(entry.path(), entry.path().lexically_relative(inputDir).generic_string(), outputDir, options.shard);
+            }
+        } else {
+            fs::directory_iterator it(inputDir, ec);
+
+            for (; !ec && it != fs::directory_iterator(); it.increment(ec)) {
+                const fs::directory_entry& entry = *it;
+                std::error_code entryEc;
+                if (!entry.is_regular_file(entryEc) || !HasMswExtension(entry.path())) continue;
+
+                Emit(entry.path(), entry.path().filename().generic_string(), outputDir, options.shard);
+            }
+        }
+
+        if (ec) {
+            fprintf(stderr, "Error: Could not read %s: %s\n", inputDir.string().c_str(), ec.message().c_str());
+        }
+    } catch (const std::exception& e) {
+        fprintf(stderr, "Error: Directory scan failed: %s\n", e.what());
+    }
+
+    _queue.Close();
+}
+
+void InputDiscovery::ReadList(std::string listPath, fs::path root, fs::path outputDir, DiscoveryOptions options) {
+    TraceSetThreadName("discovery");
+    std::ifstream listFile;
+    std::istream* in = &std::cin;
+
+    if (listPath != "-") {
+        listFile.open(listPath);
+        if (!listFile) {
+            fprintf(stderr, "Error: Could not open list %s\n", listPath.c_str());
+            _queue.Close();
+            return;
+        }
+        in = &listFile;
+    }
+
+    try {
+        root = fs::absolute(root);
+
+        std::string line;
+        while (std::getline(*in, line)) {
+            // Tolerate CRLF lists and surrounding blanks
+            size_t begin = line.find_first_not_of(" \t\r");
+            size_t end = line.find_last_not_of(" \t\r");
+            if (begin == std::string::npos || line[begin] == '#') continue;
+
+            fs::path listed = line.substr(begin, end - begin + 1);
+            fs::path inputPath = (listed.is_absolute() ? listed : root / listed).lexically_normal();
+
+            // Outputs mirror the tree below root. A path outside it has no place in
+            // that tree, and its bare file name could land on another input's output.
+            fs::path relative = inputPath.lexically_relative(root.lexically_normal());
+            if (relative.empty() || *relative.begin() == "..") {
+                fprintf(stderr, "Error: %s is outside the root %s, skipped (set --root)\n",
+                        inputPath.string().c_str(), root.string().c_str());
+                _outsideRoot.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            Emit(inputPath, relative.generic_string(), outputDir, options.shard);
+        }
+    } catch (const std::exception& e) {
+        fprintf(stderr, "Error: Reading list failed: %s\n", e.what());
+    }
+
+    _queue.Close();
+}
@@ -0,0 +1,68 @@
+#pragma once
+/*
+ * Batch Input Discovery
+ *
+ * Finds the MSW files of a batch on a background thread and hands them to
+ * the pipeline through a bounded queue, so conversion starts on the first
+ * file found instead of after the whole tree has been listed. Inputs come
+ * from a directory walk or from a list of paths (a file or stdin).
+ */
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <filesystem>
+#include "pipeline.h"
+#include "shard.h"
+
+namespace fs = std::filesystem;
+
+// .msw in any case, the way batch inputs are picked out of a directory
+bool HasMswExtension(const fs::path& path);
+
+struct DiscoveryOptions {
+    bool recursive;             // Walk subdirectories, outputs mirror the tree
+    ShardSpec shard;            // Only keep inputs belonging to this shard
+
+    DiscoveryOptions() : recursive(false) {}
+};
+
+class InputDiscovery : public BatchInputSource {
+public:
+    explicit InputDiscovery(size_t queueCapacity = 4096);
+    ~InputDiscovery();
+
+    InputDiscovery(const InputDiscovery&) = delete;
+    InputDiscovery& operator=(const InputDiscovery&) = delete;
+
+    // Start collecting the .msw files in inputDir. outputDir is skipped if it
+    // lies inside the tree.
+    void StartDirectory(const fs::path& inputDir, const fs::path& outputDir, const DiscoveryOptions& options);
+
+    // Start reading one path per line from listPath, or stdin for "-".
+    // Relative paths are resolved against root, and outputs are placed
+    // under outputDir by their path relative to root. Paths outside root are
+    // reported and skipped.
+    void StartList(const std::string& listPath, const fs::path& root, const fs::path& outputDir,
+                   const DiscoveryOptions& options);
+
+    bool Next(BatchInput& input) override;
+    bool TryNext(BatchInput& input) override;
+
+    // Valid once Next has returned false
+    size_t FoundCount() const { return _found.load(std::memory_order_relaxed); }
+    size_t OtherShardCount() const { return _otherShard.load(std::memory_order_relaxed); }
+    size_t OutsideRootCount() const { return _outsideRoot.load(std::memory_order_relaxed); }
+
+private:
+    void ScanDirectory(fs::path inputDir, fs::path outputDir, DiscoveryOptions options);
+    void ReadList(std::string listPath, fs::path root, fs::path outputDir, DiscoveryOptions options);
+    void Emit(const fs::path& inputPath, const std::string& relativePath, const fs::path& outputDir,
+              const ShardSpec& shard);
+
+    BoundedQueue<BatchInput> _queue;
+    std::thread _thread;
+    std::atomic<size_t> _found;
+    std::atomic<size_t> _otherShard;
+    std::atomic<size_t> _outsideRoot;
+};
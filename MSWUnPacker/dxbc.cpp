@@ -6,6 +6,9 @@
  */
 
 #include "dxbc.h"
+#include "arena.h"
+#include "log.h"
+#include "memstats.h"
 #include <array>
 #include <algorithm>
 
@@ -25,7 +28,7 @@ namespace dxbc {
 // Based on the implementation from HLSLDecompiler/Assembler.cpp
 // ============================================================================
 
-static std::array<uint32_t, 4> ComputeHash(const uint8_t* input, uint32_t size) {
+std::array<uint32_t, 4> ComputeHash(const uint8_t* input, uint32_t size) {
     uint32_t esi;
     uint32_t ebx;
     uint32_t i = 0;
@@ -162,37 +165,37 @@ static std::array<uint32_t, 4> ComputeHash(const uint8_t* input, uint32_t size)
     return { h[0], h[1], h[2], h[3] };
 }
 
-void UpdateHash(std::vector<uint8_t>& data) {
-    if (data.size() < 20) {
+void UpdateHash(uint8_t* data, size_t size) {
+    if (size < 20) {
         return;  // Invalid DXBC
     }
 
     // Compute hash on data after the hash field (offset 20+)
-    auto hash = ComputeHash(data.data() + 20,
-                            static_cast<uint32_t>(data.size() - 20));
+    auto hash = ComputeHash(data + 20,
+                            static_cast<uint32_t>(size - 20));
 
     // Write hash to bytes 4-19
-    std::memcpy(data.data() + 4, hash.data(), 16);
+    std::memcpy(data + 4, hash.data(), 16);
 }
 
-bool VerifyHash(const std::vector<uint8_t>& data) {
-    if (data.size() < 20) {
+bool VerifyHash(const uint8_t* data, size_t size) {
+    if (size < 20) {
         return false;
     }
 
     // Compute expected hash
-    auto computed = ComputeHash(data.data() + 20,
-                                static_cast<uint32_t>(data.size() - 20));
+    auto computed = ComputeHash(data + 20,
+                                static_cast<uint32_t>(size - 20));
 
     // Compare with stored hash
-    return std::memcmp(data.data() + 4, computed.data(), 16) == 0;
+    return std::memcmp(data + 4, computed.data(), 16) == 0;
 }
 
 // ============================================================================
 // Helper: Read null-terminated string from RDEF chunk
 // ============================================================================
 
-static std::string ReadRDEFString(const uint8_t* rdefData, size_t rdefSize, uint32_t offset) {
+static std::string_view ReadRDEFString(const uint8_t* rdefData, size_t rdefSize, uint32_t offset) {
     if (offset >= rdefSize) {
         return "";
     }
@@ -206,7 +209,7 @@ static std::string ReadRDEFString(const uint8_t* rdefData, size_t rdefSize, uint
         len++;
     }
 
-    return std::string(str, len);
+    return std::string_view(str, len);
 }
 
 // ============================================================================
@@ -215,6 +218,7 @@ static std::string ReadRDEFString(const uint8_t* rdefData, size_t rdefSize, uint
 // ============================================================================
 
 CBLayoutInfo DetectCBLayout(const uint8_t* data, size_t size) {
+    ALLOC_CATEGORY(AllocCategory::Reflection);
     CBLayoutInfo info = { -1, -1, false, "" };
 
     // Find RDEF chunk
@@ -255,7 +259,7 @@ CBLayoutInfo DetectCBLayout(const uint8_t* data, size_t size) {
         }
 
         // Read the name
-        std::string name = ReadRDEFString(rdefData, rdefSize, bindDesc->nameOffset);
+        std::string_view name = ReadRDEFString(rdefData, rdefSize, bindDesc->nameOffset);
 
         // Check for CBufCommonPerCamera
         if (name == "CBufCommonPerCamera") {
@@ -286,8 +290,19 @@ CBLayoutInfo DetectCBLayout(const uint8_t* data, size_t size) {
         info.needsSwap = false;
         info.reason = "CBufCommonPerCamera not found";
     } else {
+        // D3D11 has 14 constant buffer slots, CB2 and CB3 are handled above
+        static const char* const kUnknownLayoutReasons[] = {
+            "Unknown layout (Camera=CB0)", "Unknown layout (Camera=CB1)", "", "",
+            "Unknown layout (Camera=CB4)", "Unknown layout (Camera=CB5)", "Unknown layout (Camera=CB6)",
+            "Unknown layout (Camera=CB7)", "Unknown layout (Camera=CB8)", "Unknown layout (Camera=CB9)",
+            "Unknown layout (Camera=CB10)", "Unknown layout (Camera=CB11)", "Unknown layout (Camera=CB12)",
+            "Unknown layout (Camera=CB13)",
+        };
+        const int reasonCount = static_cast<int>(sizeof(kUnknownLayoutReasons) / sizeof(kUnknownLayoutReasons[0]));
+
         info.needsSwap = false;
-        info.reason = "Unknown layout (Camera=CB" + std::to_string(info.cameraSlot) + ")";
+        info.reason = info.cameraSlot >= 0 && info.cameraSlot < reasonCount ? kUnknownLayoutReasons[info.cameraSlot]
+                                                                            : "Unknown layout (Camera=CB out of range)";
     }
 
     return info;
@@ -298,57 +313,57 @@ CBLayoutInfo DetectCBLayout(const uint8_t* data, size_t size) {
 // Swap all CB2 and CB3 references in both SHEX and RDEF chunks
 // ============================================================================
 
-PatchResult SwapCB2CB3(std::vector<uint8_t>& data) {
+PatchResult SwapCB2CB3(uint8_t* data, size_t size) {
     PatchResult result = { true, 0, 0, 0, "" };
 
-    if (data.size() < sizeof(DXBCHeader)) {
+    if (size < sizeof(DXBCHeader)) {
         result.success = false;
         result.error = "Data too small to be valid DXBC";
         return result;
     }
 
     // Verify DXBC magic
-    if (memcmp(data.data(), "DXBC", 4) != 0) {
+    if (memcmp(data, "DXBC", 4) != 0) {
         result.success = false;
         result.error = "Invalid DXBC magic";
         return result;
     }
 
-    const DXBCHeader* header = reinterpret_cast<const DXBCHeader*>(data.data());
+    const DXBCHeader* header = reinterpret_cast<const DXBCHeader*>(data);
     uint32_t chunkCount = header->chunkCount;
 
-    if (data.size() < sizeof(DXBCHeader) + chunkCount * sizeof(uint32_t)) {
+    if (size < sizeof(DXBCHeader) + chunkCount * sizeof(uint32_t)) {
         result.success = false;
         result.error = "Data too small for chunk offsets";
         return result;
     }
 
-    const uint32_t* offsets = reinterpret_cast<const uint32_t*>(data.data() + sizeof(DXBCHeader));
+    const uint32_t* offsets = reinterpret_cast<const uint32_t*>(data + sizeof(DXBCHeader));
 
     // Process each chunk
     for (uint32_t i = 0; i < chunkCount; i++) {
         uint32_t offset = offsets[i];
-        if (offset + sizeof(ChunkHeader) > data.size()) continue;
+        if (offset + sizeof(ChunkHeader) > size) continue;
 
-        const ChunkHeader* chunk = reinterpret_cast<const ChunkHeader*>(data.data() + offset);
+        const ChunkHeader* chunk = reinterpret_cast<const ChunkHeader*>(data + offset);
         size_t chunkDataOffset = offset + sizeof(ChunkHeader);
         uint32_t chunkSize = chunk->size;
 
-        if (chunkDataOffset + chunkSize > data.size()) continue;
+        if (chunkDataOffset + chunkSize > size) continue;
 
         // Process SHEX or SHDR chunks
         if (memcmp(chunk->fourCC, "SHEX", 4) == 0 || memcmp(chunk->fourCC, "SHDR", 4) == 0) {
-            result.shexPatches += PatchSHEXSwap(data.data() + chunkDataOffset, chunkSize);
+            result.shexPatches += PatchSHEXSwap(data + chunkDataOffset, chunkSize);
         }
         // Process RDEF chunk
         else if (memcmp(chunk->fourCC, "RDEF", 4) == 0) {
-            result.rdefPatches += PatchRDEFSwap(data.data() + chunkDataOffset, chunkSize);
+            result.rdefPatches += PatchRDEFSwap(data + chunkDataOffset, chunkSize);
         }
     }
 
     // Update hash after patching
     if (result.shexPatches > 0 || result.rdefPatches > 0) {
-        UpdateHash(data);
+        UpdateHash(data, size);
     }
 
     return result;
@@ -367,8 +382,9 @@ static uint32_t PatchSHEXSwap(uint8_t* shexData, size_t shexSize) {
     size_t dwordCount = shexSize / 4;
 
     // Collect CB2 and CB3 positions for swap
-    std::vector<size_t> cb2Positions;
-    std::vector<size_t> cb3Positions;
+    ScopedScratch scratch;
+    ArenaVector<size_t> cb2Positions = scratch.MakeVector<size_t>();
+    ArenaVector<size_t> cb3Positions = scratch.MakeVector<size_t>();
 
     // Skip version and length tokens
     size_t pos = 2;
@@ -452,8 +468,9 @@ static uint32_t PatchRDEFSwap(uint8_t* rdefData, size_t rdefSize) {
     }
 
     // Collect CB2 and CB3 bindings for swap
-    std::vector<ShaderInputBindDesc*> cb2Bindings;
-    std::vector<ShaderInputBindDesc*> cb3Bindings;
+    ScopedScratch scratch;
+    ArenaVector<ShaderInputBindDesc*> cb2Bindings = scratch.MakeVector<ShaderInputBindDesc*>();
+    ArenaVector<ShaderInputBindDesc*> cb3Bindings = scratch.MakeVector<ShaderInputBindDesc*>();
 
     for (uint32_t i = 0; i < bindingCount; i++) {
         uint32_t bindDescOffset = bindingOffset + i * BIND_DESC_SIZE;
@@ -517,7 +534,7 @@ bool ShouldRemapSRV(uint32_t slot, uint32_t& newSlot, bool srvLegacyMode,
 
 // Check if an SRV should be remapped based on resource name (more precise)
 // Used for RDEF patching where we have access to resource names
-bool ShouldRemapSRVByName(const std::string& name, uint32_t slot, uint32_t& newSlot, bool srvLegacyMode) {
+bool ShouldRemapSRVByName(std::string_view name, uint32_t slot, uint32_t& newSlot, bool srvLegacyMode) {
     if (!srvLegacyMode) {
         return false;
     }
@@ -543,9 +560,12 @@ bool ShouldRemapSRVByName(const std::string& name, uint32_t slot, uint32_t& newS
 // Patch SRV references in RDEF chunk
 // ============================================================================
 
+// Source slot -> target slot, in patch scratch memory
+typedef ArenaVector<std::pair<uint32_t, uint32_t>> SlotMappings;
+
 static uint32_t PatchSRVInRDEF(uint8_t* rdefData, size_t rdefSize, bool srvLegacyMode,
                                const std::vector<SRVRemap>& customRemaps,
-                               std::vector<std::pair<uint32_t, uint32_t>>* remappedSlots = nullptr) {
+                               SlotMappings* remappedSlots = nullptr) {
     if (rdefSize < sizeof(RDEFHeader)) {
         return 0;
     }
@@ -577,7 +597,7 @@ static uint32_t PatchSRVInRDEF(uint8_t* rdefData, size_t rdefSize, bool srvLegac
         }
 
         // Read the resource name
-        std::string resourceName = ReadRDEFString(rdefData, rdefSize, bindDesc->nameOffset);
+        std::string_view resourceName = ReadRDEFString(rdefData, rdefSize, bindDesc->nameOffset);
         uint32_t originalSlot = bindDesc->bindPoint;
         uint32_t newSlot;
 
@@ -609,7 +629,7 @@ static uint32_t PatchSRVInRDEF(uint8_t* rdefData, size_t rdefSize, bool srvLegac
 
 // Check if a slot should be remapped based on explicit slot mappings (from RDEF analysis)
 static bool ShouldRemapSlot(uint32_t slot, uint32_t& newSlot,
-                            const std::vector<std::pair<uint32_t, uint32_t>>& slotMappings,
+                            const SlotMappings& slotMappings,
                             bool srvLegacyMode,
                             const std::vector<SRVRemap>& customRemaps) {
     // First check explicit mappings from RDEF (most accurate)
@@ -626,7 +646,7 @@ static bool ShouldRemapSlot(uint32_t slot, uint32_t& newSlot,
 
 static uint32_t PatchSRVInSHEX(uint8_t* shexData, size_t shexSize, bool srvLegacyMode,
                                const std::vector<SRVRemap>& customRemaps,
-                               const std::vector<std::pair<uint32_t, uint32_t>>& slotMappings = {}) {
+                               const SlotMappings& slotMappings) {
     if (shexSize < 8) {
         return 0;
     }
@@ -705,51 +725,52 @@ static uint32_t PatchSRVInSHEX(uint8_t* shexData, size_t shexSize, bool srvLegac
 // Main SRV Patching Function
 // ============================================================================
 
-PatchResult PatchSRVSlots(std::vector<uint8_t>& data, bool srvLegacyMode,
+PatchResult PatchSRVSlots(uint8_t* data, size_t size, bool srvLegacyMode,
                           const std::vector<SRVRemap>& customRemaps) {
     PatchResult result = { true, 0, 0, 0, "" };
 
-    if (data.size() < sizeof(DXBCHeader)) {
+    if (size < sizeof(DXBCHeader)) {
         result.success = false;
         result.error = "Data too small to be valid DXBC";
         return result;
     }
 
     // Verify DXBC magic
-    if (memcmp(data.data(), "DXBC", 4) != 0) {
+    if (memcmp(data, "DXBC", 4) != 0) {
         result.success = false;
         result.error = "Invalid DXBC magic";
         return result;
     }
 
-    const DXBCHeader* header = reinterpret_cast<const DXBCHeader*>(data.data());
+    const DXBCHeader* header = reinterpret_cast<const DXBCHeader*>(data);
     uint32_t chunkCount = header->chunkCount;
 
-    if (data.size() < sizeof(DXBCHeader) + chunkCount * sizeof(uint32_t)) {
+    if (size < sizeof(DXBCHeader) + chunkCount * sizeof(uint32_t)) {
         result.success = false;
         result.error = "Data too small for chunk offsets";
         return result;
     }
 
-    const uint32_t* offsets = reinterpret_cast<const uint32_t*>(data.data() + sizeof(DXBCHeader));
+    const uint32_t* offsets = reinterpret_cast<const uint32_t*>(data + sizeof(DXBCHeader));
 
     // Track slot mappings determined from RDEF (using resource names for accuracy)
-    std::vector<std::pair<uint32_t, uint32_t>> slotMappings;
+    ScopedScratch scratch;
+    SlotMappings slotMappings = scratch.MakeVector<std::pair<uint32_t, uint32_t>>();
 
     // First pass: Process RDEF chunk to determine slot mappings based on resource names
     for (uint32_t i = 0; i < chunkCount; i++) {
         uint32_t offset = offsets[i];
-        if (offset + sizeof(ChunkHeader) > data.size()) continue;
+        if (offset + sizeof(ChunkHeader) > size) continue;
 
-        const ChunkHeader* chunk = reinterpret_cast<const ChunkHeader*>(data.data() + offset);
+        const ChunkHeader* chunk = reinterpret_cast<const ChunkHeader*>(data + offset);
         size_t chunkDataOffset = offset + sizeof(ChunkHeader);
         uint32_t chunkSize = chunk->size;
 
-        if (chunkDataOffset + chunkSize > data.size()) continue;
+        if (chunkDataOffset + chunkSize > size) continue;
 
         // Process RDEF chunk first to get slot mappings
         if (memcmp(chunk->fourCC, "RDEF", 4) == 0) {
-            result.srvPatches += PatchSRVInRDEF(data.data() + chunkDataOffset, chunkSize,
+            result.srvPatches += PatchSRVInRDEF(data + chunkDataOffset, chunkSize,
                                                  srvLegacyMode, customRemaps, &slotMappings);
         }
     }
@@ -757,24 +778,24 @@ PatchResult PatchSRVSlots(std::vector<uint8_t>& data, bool srvLegacyMode,
     // Second pass: Process SHEX/SHDR chunks using the slot mappings from RDEF
     for (uint32_t i = 0; i < chunkCount; i++) {
         uint32_t offset = offsets[i];
-        if (offset + sizeof(ChunkHeader) > data.size()) continue;
+        if (offset + sizeof(ChunkHeader) > size) continue;
 
-        const ChunkHeader* chunk = reinterpret_cast<const ChunkHeader*>(data.data() + offset);
+        const ChunkHeader* chunk = reinterpret_cast<const ChunkHeader*>(data + offset);
         size_t chunkDataOffset = offset + sizeof(ChunkHeader);
         uint32_t chunkSize = chunk->size;
 
-        if (chunkDataOffset + chunkSize > data.size()) continue;
+        if (chunkDataOffset + chunkSize > size) continue;
 
         // Process SHEX or SHDR chunks using slot mappings
         if (memcmp(chunk->fourCC, "SHEX", 4) == 0 || memcmp(chunk->fourCC, "SHDR", 4) == 0) {
-            result.srvPatches += PatchSRVInSHEX(data.data() + chunkDataOffset, chunkSize,
+            result.srvPatches += PatchSRVInSHEX(data + chunkDataOffset, chunkSize,
                                                  srvLegacyMode, customRemaps, slotMappings);
         }
     }
 
     // Update hash after patching
     if (result.srvPatches > 0) {
-        UpdateHash(data);
+        UpdateHash(data, size);
     }
 
     return result;
@@ -891,16 +912,16 @@ static uint32_t PatchSubsurfaceInSHEX(uint8_t* shexData, size_t shexSize) {
     return patchCount;
 }
 
-PatchResult PatchSubsurfaceMaterialID(std::vector<uint8_t>& data) {
+PatchResult PatchSubsurfaceMaterialID(uint8_t* data, size_t size) {
     PatchResult result = { true, 0, 0, 0, "" };
 
-    if (data.size() < sizeof(DXBCHeader)) {
+    if (size < sizeof(DXBCHeader)) {
         result.success = false;
         result.error = "Data too small for DXBC header";
         return result;
     }
 
-    const DXBCHeader* header = reinterpret_cast<const DXBCHeader*>(data.data());
+    const DXBCHeader* header = reinterpret_cast<const DXBCHeader*>(data);
     if (memcmp(header->magic, "DXBC", 4) != 0) {
         result.success = false;
         result.error = "Invalid DXBC magic";
@@ -908,33 +929,33 @@ PatchResult PatchSubsurfaceMaterialID(std::vector<uint8_t>& data) {
     }
 
     uint32_t chunkCount = header->chunkCount;
-    if (data.size() < sizeof(DXBCHeader) + chunkCount * sizeof(uint32_t)) {
+    if (size < sizeof(DXBCHeader) + chunkCount * sizeof(uint32_t)) {
         result.success = false;
         result.error = "Invalid chunk count";
         return result;
     }
 
-    const uint32_t* offsets = reinterpret_cast<const uint32_t*>(data.data() + sizeof(DXBCHeader));
+    const uint32_t* offsets = reinterpret_cast<const uint32_t*>(data + sizeof(DXBCHeader));
 
     // Process SHEX/SHDR chunks
     for (uint32_t i = 0; i < chunkCount; i++) {
         uint32_t offset = offsets[i];
-        if (offset + sizeof(ChunkHeader) > data.size()) continue;
+        if (offset + sizeof(ChunkHeader) > size) continue;
 
-        const ChunkHeader* chunk = reinterpret_cast<const ChunkHeader*>(data.data() + offset);
+        const ChunkHeader* chunk = reinterpret_cast<const ChunkHeader*>(data + offset);
         size_t chunkDataOffset = offset + sizeof(ChunkHeader);
         uint32_t chunkSize = chunk->size;
 
-        if (chunkDataOffset + chunkSize > data.size()) continue;
+        if (chunkDataOffset + chunkSize > size) continue;
 
         if (memcmp(chunk->fourCC, "SHEX", 4) == 0 || memcmp(chunk->fourCC, "SHDR", 4) == 0) {
-            result.shexPatches += PatchSubsurfaceInSHEX(data.data() + chunkDataOffset, chunkSize);
+            result.shexPatches += PatchSubsurfaceInSHEX(data + chunkDataOffset, chunkSize);
         }
     }
 
     // Update hash after patching
     if (result.shexPatches > 0) {
-        UpdateHash(data);
+        UpdateHash(data, size);
     }
 
     return result;
@@ -1188,7 +1209,7 @@ static uint32_t PatchUberFlagsInSHEX(uint8_t* shexData, size_t shexSize) {
                             }
 
                             patchCount++;
-                            printf("           -> Patched AND cb0[24] @ offset %zu\n", pos * 4);
+                            LOG_DEBUG("           -> Patched AND cb0[24] @ offset %zu\n", pos * 4);
                         }
                     }
                 }
@@ -1201,16 +1222,16 @@ static uint32_t PatchUberFlagsInSHEX(uint8_t* shexData, size_t shexSize) {
     return patchCount;
 }
 
-PatchResult PatchUberFeatureFlags(std::vector<uint8_t>& data) {
+PatchResult PatchUberFeatureFlags(uint8_t* data, size_t size) {
     PatchResult result = { true, 0, 0, 0, "" };
 
-    if (data.size() < sizeof(DXBCHeader)) {
+    if (size < sizeof(DXBCHeader)) {
         result.success = false;
         result.error = "Data too small for DXBC header";
         return result;
     }
 
-    const DXBCHeader* header = reinterpret_cast<const DXBCHeader*>(data.data());
+    const DXBCHeader* header = reinterpret_cast<const DXBCHeader*>(data);
     if (memcmp(header->magic, "DXBC", 4) != 0) {
         result.success = false;
         result.error = "Invalid DXBC magic";
@@ -1218,33 +1239,33 @@ PatchResult PatchUberFeatureFlags(std::vector<uint8_t>& data) {
     }
 
     uint32_t chunkCount = header->chunkCount;
-    if (data.size() < sizeof(DXBCHeader) + chunkCount * sizeof(uint32_t)) {
+    if (size < sizeof(DXBCHeader) + chunkCount * sizeof(uint32_t)) {
         result.success = false;
         result.error = "Invalid chunk count";
         return result;
     }
 
-    const uint32_t* offsets = reinterpret_cast<const uint32_t*>(data.data() + sizeof(DXBCHeader));
+    const uint32_t* offsets = reinterpret_cast<const uint32_t*>(data + sizeof(DXBCHeader));
 
     // Process SHEX/SHDR chunks
     for (uint32_t i = 0; i < chunkCount; i++) {
         uint32_t offset = offsets[i];
-        if (offset + sizeof(ChunkHeader) > data.size()) continue;
+        if (offset + sizeof(ChunkHeader) > size) continue;
 
-        const ChunkHeader* chunk = reinterpret_cast<const ChunkHeader*>(data.data() + offset);
+        const ChunkHeader* chunk = reinterpret_cast<const ChunkHeader*>(data + offset);
         size_t chunkDataOffset = offset + sizeof(ChunkHeader);
         uint32_t chunkSize = chunk->size;
 
-        if (chunkDataOffset + chunkSize > data.size()) continue;
+        if (chunkDataOffset + chunkSize > size) continue;
 
         if (memcmp(chunk->fourCC, "SHEX", 4) == 0 || memcmp(chunk->fourCC, "SHDR", 4) == 0) {
-            result.shexPatches += PatchUberFlagsInSHEX(data.data() + chunkDataOffset, chunkSize);
+            result.shexPatches += PatchUberFlagsInSHEX(data + chunkDataOffset, chunkSize);
         }
     }
 
     // Update hash after patching
     if (result.shexPatches > 0) {
-        UpdateHash(data);
+        UpdateHash(data, size);
     }
 
     return result;
@@ -1326,7 +1347,7 @@ static uint32_t PatchFeatureFlagBit1InSHEX(uint8_t* shexData, size_t shexSize) {
                             }
 
                             patchCount++;
-                            printf("           -> Patched AND cb0[24] & 1 @ offset %zu\n", pos * 4);
+                            LOG_DEBUG("           -> Patched AND cb0[24] & 1 @ offset %zu\n", pos * 4);
                         }
                     }
                 }
@@ -1339,16 +1360,16 @@ static uint32_t PatchFeatureFlagBit1InSHEX(uint8_t* shexData, size_t shexSize) {
     return patchCount;
 }
 
-PatchResult PatchFeatureFlagBit1(std::vector<uint8_t>& data) {
+PatchResult PatchFeatureFlagBit1(uint8_t* data, size_t size) {
     PatchResult result = { true, 0, 0, 0, "" };
 
-    if (data.size() < sizeof(DXBCHeader)) {
+    if (size < sizeof(DXBCHeader)) {
         result.success = false;
         result.error = "Data too small for DXBC header";
         return result;
     }
 
-    const DXBCHeader* header = reinterpret_cast<const DXBCHeader*>(data.data());
+    const DXBCHeader* header = reinterpret_cast<const DXBCHeader*>(data);
     if (memcmp(header->magic, "DXBC", 4) != 0) {
         result.success = false;
         result.error = "Invalid DXBC magic";
@@ -1356,33 +1377,33 @@ PatchResult PatchFeatureFlagBit1(std::vector<uint8_t>& data) {
     }
 
     uint32_t chunkCount = header->chunkCount;
-    if (data.size() < sizeof(DXBCHeader) + chunkCount * sizeof(uint32_t)) {
+    if (size < sizeof(DXBCHeader) + chunkCount * sizeof(uint32_t)) {
         result.success = false;
         result.error = "Invalid chunk count";
         return result;
     }
 
-    const uint32_t* offsets = reinterpret_cast<const uint32_t*>(data.data() + sizeof(DXBCHeader));
+    const uint32_t* offsets = reinterpret_cast<const uint32_t*>(data + sizeof(DXBCHeader));
 
     // Process SHEX/SHDR chunks
     for (uint32_t i = 0; i < chunkCount; i++) {
         uint32_t offset = offsets[i];
-        if (offset + sizeof(ChunkHeader) > data.size()) continue;
+        if (offset + sizeof(ChunkHeader) > size) continue;
 
-        const ChunkHeader* chunk = reinterpret_cast<const ChunkHeader*>(data.data() + offset);
+        const ChunkHeader* chunk = reinterpret_cast<const ChunkHeader*>(data + offset);
         size_t chunkDataOffset = offset + sizeof(ChunkHeader);
         uint32_t chunkSize = chunk->size;
 
-        if (chunkDataOffset + chunkSize > data.size()) continue;
+        if (chunkDataOffset + chunkSize > size) continue;
 
         if (memcmp(chunk->fourCC, "SHEX", 4) == 0 || memcmp(chunk->fourCC, "SHDR", 4) == 0) {
-            result.shexPatches += PatchFeatureFlagBit1InSHEX(data.data() + chunkDataOffset, chunkSize);
+            result.shexPatches += PatchFeatureFlagBit1InSHEX(data + chunkDataOffset, chunkSize);
         }
     }
 
     // Update hash after patching
     if (result.shexPatches > 0) {
-        UpdateHash(data);
+        UpdateHash(data, size);
     }
 
     return result;
@@ -1928,12 +1949,12 @@ static uint32_t PatchSunDataInSHEX(uint8_t* shexData, size_t shexSize) {
 
             patchCount++;
             if (sequences[i].isTempRegSource) {
-                printf("           -> [SUN] Patched %s -> MOV from r%u.w @ offset %zu (r%u.%c) [instanced]\n",
+                LOG_DEBUG("           -> [SUN] Patched %s -> MOV from r%u.w @ offset %zu (r%u.%c) [instanced]\n",
                        extractType, sequences[i].srcRegIndex, extractPos * 4,
                        sequences[i].destRegIndex,
                        "xyzw"[sequences[i].destComponent]);
             } else {
-                printf("           -> [SUN] Patched %s -> MOV from cb2[11].w @ offset %zu (r%u.%c)\n",
+                LOG_DEBUG("           -> [SUN] Patched %s -> MOV from cb2[11].w @ offset %zu (r%u.%c)\n",
                        extractType, extractPos * 4,
                        sequences[i].destRegIndex,
                        "xyzw"[sequences[i].destComponent]);
@@ -1952,7 +1973,7 @@ static uint32_t PatchSunDataInSHEX(uint8_t* shexData, size_t shexSize) {
             }
 
             patchCount++;
-            printf("           -> [SUN] NOPed ITOF/UTOF @ offset %zu\n", convertPos * 4);
+            LOG_DEBUG("           -> [SUN] NOPed ITOF/UTOF @ offset %zu\n", convertPos * 4);
         }
 
         // Patch 3: Handle MUL scale factor
@@ -1968,7 +1989,7 @@ static uint32_t PatchSunDataInSHEX(uint8_t* shexData, size_t shexSize) {
             dwords[scalePos] = 0x3F800000;  // 1.0f
 
             patchCount++;
-            printf("           -> [SUN] Patched MUL scale %.8e -> 1.0 @ offset %zu (%s)\n",
+            LOG_DEBUG("           -> [SUN] Patched MUL scale %.8e -> 1.0 @ offset %zu (%s)\n",
                    oldValue, sequences[i].mulPos * 4,
                    sequences[i].isUpperBits ? "sun_vis" : "sun_intensity");
         }
@@ -2043,7 +2064,7 @@ static uint32_t PatchSunDataInSHEX(uint8_t* shexData, size_t shexSize) {
                     // Change src0 register from shadowReg to destIndex
                     dwords[src0IndexPos] = destIndex;
                     patchCount++;
-                    printf("           -> [SUN] Fixed shadow multiply: r%u -> r%u @ offset %zu\n",
+                    LOG_DEBUG("           -> [SUN] Fixed shadow multiply: r%u -> r%u @ offset %zu\n",
                            shadowReg, destIndex, pos * 4);
                     break;
                 }
@@ -2053,7 +2074,7 @@ static uint32_t PatchSunDataInSHEX(uint8_t* shexData, size_t shexSize) {
                     // Change src1 register from shadowReg to destIndex
                     dwords[src1IndexPos] = destIndex;
                     patchCount++;
-                    printf("           -> [SUN] Fixed shadow multiply: r%u -> r%u @ offset %zu\n",
+                    LOG_DEBUG("           -> [SUN] Fixed shadow multiply: r%u -> r%u @ offset %zu\n",
                            shadowReg, destIndex, pos * 4);
                     break;
                 }
@@ -2067,16 +2088,16 @@ static uint32_t PatchSunDataInSHEX(uint8_t* shexData, size_t shexSize) {
     return patchCount;
 }
 
-PatchResult PatchSunDataUnpacking(std::vector<uint8_t>& data) {
+PatchResult PatchSunDataUnpacking(uint8_t* data, size_t size) {
     PatchResult result = { true, 0, 0, 0, "" };
 
-    if (data.size() < sizeof(DXBCHeader)) {
+    if (size < sizeof(DXBCHeader)) {
         result.success = false;
         result.error = "Data too small for DXBC header";
         return result;
     }
 
-    const DXBCHeader* header = reinterpret_cast<const DXBCHeader*>(data.data());
+    const DXBCHeader* header = reinterpret_cast<const DXBCHeader*>(data);
     if (memcmp(header->magic, "DXBC", 4) != 0) {
         result.success = false;
         result.error = "Invalid DXBC magic";
@@ -2084,33 +2105,33 @@ PatchResult PatchSunDataUnpacking(std::vector<uint8_t>& data) {
     }
 
     uint32_t chunkCount = header->chunkCount;
-    if (data.size() < sizeof(DXBCHeader) + chunkCount * sizeof(uint32_t)) {
+    if (size < sizeof(DXBCHeader) + chunkCount * sizeof(uint32_t)) {
         result.success = false;
         result.error = "Invalid chunk count";
         return result;
     }
 
-    const uint32_t* offsets = reinterpret_cast<const uint32_t*>(data.data() + sizeof(DXBCHeader));
+    const uint32_t* offsets = reinterpret_cast<const uint32_t*>(data + sizeof(DXBCHeader));
 
     // Process SHEX/SHDR chunks
     for (uint32_t i = 0; i < chunkCount; i++) {
         uint32_t offset = offsets[i];
-        if (offset + sizeof(ChunkHeader) > data.size()) continue;
+        if (offset + sizeof(ChunkHeader) > size) continue;
 
-        const ChunkHeader* chunk = reinterpret_cast<const ChunkHeader*>(data.data() + offset);
+        const ChunkHeader* chunk = reinterpret_cast<const ChunkHeader*>(data + offset);
         size_t chunkDataOffset = offset + sizeof(ChunkHeader);
         uint32_t chunkSize = chunk->size;
 
-        if (chunkDataOffset + chunkSize > data.size()) continue;
+        if (chunkDataOffset + chunkSize > size) continue;
 
         if (memcmp(chunk->fourCC, "SHEX", 4) == 0 || memcmp(chunk->fourCC, "SHDR", 4) == 0) {
-            result.shexPatches += PatchSunDataInSHEX(data.data() + chunkDataOffset, chunkSize);
+            result.shexPatches += PatchSunDataInSHEX(data + chunkDataOffset, chunkSize);
         }
     }
 
     // Update hash after patching
     if (result.shexPatches > 0) {
-        UpdateHash(data);
+        UpdateHash(data, size);
     }
 
     return result;
@@ -2226,7 +2247,7 @@ static bool IsShadowBlendMultiply(const uint32_t* dwords, size_t pos, size_t ins
     // Both components must be .w (component 3)
     if (src1Comp != 3 || src2Comp != 3) {
         if (debug) {
-            printf("             [SKIP] Not all .w components: src1=%c, src2=%c\n",
+            LOG_DEBUG("             [SKIP] Not all .w components: src1=%c, src2=%c\n",
                    "xyzw"[src1Comp >= 0 ? src1Comp : 0],
                    "xyzw"[src2Comp >= 0 ? src2Comp : 0]);
         }
@@ -2238,10 +2259,10 @@ static bool IsShadowBlendMultiply(const uint32_t* dwords, size_t pos, size_t ins
     bool patternB = (src1RegIndex == destRegIndex && src2RegIndex != destRegIndex);
 
     if (debug) {
-        printf("             dest=r%u.w, src1=r%u.%c, src2=r%u.%c\n",
+        LOG_DEBUG("             dest=r%u.w, src1=r%u.%c, src2=r%u.%c\n",
                destRegIndex, src1RegIndex, "xyzw"[src1Comp >= 0 ? src1Comp : 0],
                src2RegIndex, "xyzw"[src2Comp >= 0 ? src2Comp : 0]);
-        printf("             patternA=%d (dest=src2), patternB=%d (dest=src1)\n", patternA, patternB);
+        LOG_DEBUG("             patternA=%d (dest=src2), patternB=%d (dest=src1)\n", patternA, patternB);
     }
 
     // Found the pattern: mul rX.w, rY.w, rX.w OR mul rX.w, rX.w, rY.w
@@ -2299,7 +2320,7 @@ static uint32_t PatchShadowBlendMultiplyInSHEX(uint8_t* shexData, size_t shexSiz
                 }
 
                 patchCount++;
-                printf("           -> [SHADOW_BLEND] NOPed MUL r%u.w, r%u.%c, r%u.%c @ offset %zu\n",
+                LOG_DEBUG("           -> [SHADOW_BLEND] NOPed MUL r%u.w, r%u.%c, r%u.%c @ offset %zu\n",
                        destRegIndex, src1RegIndex, "xyzw"[src1Comp >= 0 ? src1Comp : 0],
                        src2RegIndex, "xyzw"[src2Comp >= 0 ? src2Comp : 0], pos * 4);
             }
@@ -2311,16 +2332,16 @@ static uint32_t PatchShadowBlendMultiplyInSHEX(uint8_t* shexData, size_t shexSiz
     return patchCount;
 }
 
-PatchResult PatchShadowBlendMultiply(std::vector<uint8_t>& data) {
+PatchResult PatchShadowBlendMultiply(uint8_t* data, size_t size) {
     PatchResult result = { true, 0, 0, 0, "" };
 
-    if (data.size() < sizeof(DXBCHeader)) {
+    if (size < sizeof(DXBCHeader)) {
         result.success = false;
         result.error = "Data too small for DXBC header";
         return result;
     }
 
-    const DXBCHeader* header = reinterpret_cast<const DXBCHeader*>(data.data());
+    const DXBCHeader* header = reinterpret_cast<const DXBCHeader*>(data);
     if (memcmp(header->magic, "DXBC", 4) != 0) {
         result.success = false;
         result.error = "Invalid DXBC magic";
@@ -2328,33 +2349,33 @@ PatchResult PatchShadowBlendMultiply(std::vector<uint8_t>& data) {
     }
 
     uint32_t chunkCount = header->chunkCount;
-    if (data.size() < sizeof(DXBCHeader) + chunkCount * sizeof(uint32_t)) {
+    if (size < sizeof(DXBCHeader) + chunkCount * sizeof(uint32_t)) {
         result.success = false;
         result.error = "Invalid chunk count";
         return result;
     }
 
-    const uint32_t* offsets = reinterpret_cast<const uint32_t*>(data.data() + sizeof(DXBCHeader));
+    const uint32_t* offsets = reinterpret_cast<const uint32_t*>(data + sizeof(DXBCHeader));
 
     // Process SHEX/SHDR chunks
     for (uint32_t i = 0; i < chunkCount; i++) {
         uint32_t offset = offsets[i];
-        if (offset + sizeof(ChunkHeader) > data.size()) continue;
+        if (offset + sizeof(ChunkHeader) > size) continue;
 
-        const ChunkHeader* chunk = reinterpret_cast<const ChunkHeader*>(data.data() + offset);
+        const ChunkHeader* chunk = reinterpret_cast<const ChunkHeader*>(data + offset);
         size_t chunkDataOffset = offset + sizeof(ChunkHeader);
         uint32_t chunkSize = chunk->size;
 
-        if (chunkDataOffset + chunkSize > data.size()) continue;
+        if (chunkDataOffset + chunkSize > size) continue;
 
         if (memcmp(chunk->fourCC, "SHEX", 4) == 0 || memcmp(chunk->fourCC, "SHDR", 4) == 0) {
-            result.shexPatches += PatchShadowBlendMultiplyInSHEX(data.data() + chunkDataOffset, chunkSize);
+            result.shexPatches += PatchShadowBlendMultiplyInSHEX(data + chunkDataOffset, chunkSize);
         }
     }
 
     // Update hash after patching
     if (result.shexPatches > 0) {
-        UpdateHash(data);
+        UpdateHash(data, size);
     }
 
     return result;
@@ -2378,7 +2399,7 @@ struct CBufDesc {
 };
 #pragma pack(pop)
 
-PatchResult PatchRemoveClusteredLighting(std::vector<uint8_t>& data) {
+PatchResult PatchRemoveClusteredLighting(uint8_t* data, size_t size) {
     PatchResult result = { true, 0, 0, 0, "" };
 
     // S11 CBufCommonPerCamera size with ClusteredLighting_t
@@ -2386,13 +2407,13 @@ PatchResult PatchRemoveClusteredLighting(std::vector<uint8_t>& data) {
     // S7/R5SDK CBufCommonPerCamera size without ClusteredLighting_t
     constexpr uint32_t S7_CAMERA_BUFFER_SIZE = 752;
 
-    if (data.size() < sizeof(DXBCHeader)) {
+    if (size < sizeof(DXBCHeader)) {
         result.success = false;
         result.error = "Data too small for DXBC header";
         return result;
     }
 
-    const DXBCHeader* header = reinterpret_cast<const DXBCHeader*>(data.data());
+    const DXBCHeader* header = reinterpret_cast<const DXBCHeader*>(data);
     if (memcmp(header->magic, "DXBC", 4) != 0) {
         result.success = false;
         result.error = "Invalid DXBC magic";
@@ -2400,20 +2421,20 @@ PatchResult PatchRemoveClusteredLighting(std::vector<uint8_t>& data) {
     }
 
     // Find RDEF chunk
-    size_t rdefOffset = FindChunk(data.data(), data.size(), "RDEF");
+    size_t rdefOffset = FindChunk(data, size, "RDEF");
     if (rdefOffset == 0) {
         // No RDEF chunk - nothing to patch
         return result;
     }
 
-    uint32_t rdefSize = GetChunkSize(data.data(), data.size(), "RDEF");
+    uint32_t rdefSize = GetChunkSize(data, size, "RDEF");
     if (rdefSize < sizeof(RDEFHeader)) {
         result.success = false;
         result.error = "RDEF chunk too small";
         return result;
     }
 
-    uint8_t* rdefData = data.data() + rdefOffset;
+    uint8_t* rdefData = data + rdefOffset;
     const RDEFHeader* rdefHeader = reinterpret_cast<const RDEFHeader*>(rdefData);
 
     uint32_t cbufferCount = rdefHeader->cbufferCount;
@@ -2434,7 +2455,7 @@ PatchResult PatchRemoveClusteredLighting(std::vector<uint8_t>& data) {
         CBufDesc* cbufDesc = reinterpret_cast<CBufDesc*>(rdefData + cbufDescOffset);
 
         // Read the name
-        std::string name = ReadRDEFString(rdefData, rdefSize, cbufDesc->nameOffset);
+        std::string_view name = ReadRDEFString(rdefData, rdefSize, cbufDesc->nameOffset);
 
         if (name == "CBufCommonPerCamera") {
             // Check if it has the S11 size (784 bytes)
@@ -2457,7 +2478,7 @@ PatchResult PatchRemoveClusteredLighting(std::vector<uint8_t>& data) {
 
     // Update hash after patching
     if (result.rdefPatches > 0) {
-        UpdateHash(data);
+        UpdateHash(data, size);
     }
 
     return result;
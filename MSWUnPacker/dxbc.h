@@ -5,9 +5,11 @@
  * Handles constant buffer layout conversion and shader compatibility fixes.
  */
 
+#include <array>
 #include <cstdint>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <cstring>
 
 namespace dxbc {
@@ -97,7 +99,7 @@ struct CBLayoutInfo {
     int cameraSlot;             // CBufCommonPerCamera slot (-1 if not found)
     int modelInstanceSlot;      // CBufModelInstance slot (-1 if not found)
     bool needsSwap;             // True if CB2<->CB3 swap needed
-    std::string reason;
+    const char* reason;         // Static text, detection runs once per entry and shouldn't allocate
 };
 
 CBLayoutInfo DetectCBLayout(const uint8_t* data, size_t size);
@@ -119,42 +121,90 @@ struct SRVRemap {
     uint32_t targetSlot;
 };
 
+// The patches work on a shader in place and never change its size. Each
+// takes the bytecode as pointer and size (an MSW entry buffer, an arena
+// copy), the std::vector overloads forward to those.
+
 // Swap CB2<->CB3 references in both SHEX and RDEF
-PatchResult SwapCB2CB3(std::vector<uint8_t>& data);
+PatchResult SwapCB2CB3(uint8_t* data, size_t size);
 
 // Remap SRV slots (e.g., t75->t61 for g_modelInst)
-PatchResult PatchSRVSlots(std::vector<uint8_t>& data, bool srvLegacyMode = true,
+PatchResult PatchSRVSlots(uint8_t* data, size_t size, bool srvLegacyMode = true,
                           const std::vector<SRVRemap>& customRemaps = {});
 
 bool ShouldRemapSRV(uint32_t slot, uint32_t& newSlot, bool srvLegacyMode,
                     const std::vector<SRVRemap>& customRemaps);
 
-bool ShouldRemapSRVByName(const std::string& name, uint32_t slot, uint32_t& newSlot, bool srvLegacyMode);
+bool ShouldRemapSRVByName(std::string_view name, uint32_t slot, uint32_t& newSlot, bool srvLegacyMode);
 
 // Neutralize subsurface material ID extraction (fixes darker rendering)
-PatchResult PatchSubsurfaceMaterialID(std::vector<uint8_t>& data);
+PatchResult PatchSubsurfaceMaterialID(uint8_t* data, size_t size);
 
 // Force simple blending mode (fixes detail texture overlay issues)
-PatchResult PatchUberFeatureFlags(std::vector<uint8_t>& data);
+PatchResult PatchUberFeatureFlags(uint8_t* data, size_t size);
 
 // Force standard cavity/AO blending (fixes blending mode issues)
-PatchResult PatchFeatureFlagBit1(std::vector<uint8_t>& data);
+PatchResult PatchFeatureFlagBit1(uint8_t* data, size_t size);
 
 // Fix packed sun data reads (converts bit unpacking to direct float read)
-PatchResult PatchSunDataUnpacking(std::vector<uint8_t>& data);
+PatchResult PatchSunDataUnpacking(uint8_t* data, size_t size);
 
 // Remove shadow blend multiply (fixes sun flickering)
-PatchResult PatchShadowBlendMultiply(std::vector<uint8_t>& data);
+PatchResult PatchShadowBlendMultiply(uint8_t* data, size_t size);
 
 // Remove ClusteredLighting_t from CBufCommonPerCamera (784->752 bytes)
-PatchResult PatchRemoveClusteredLighting(std::vector<uint8_t>& data);
+PatchResult PatchRemoveClusteredLighting(uint8_t* data, size_t size);
+
+inline PatchResult SwapCB2CB3(std::vector<uint8_t>& data) {
+    return SwapCB2CB3(data.data(), data.size());
+}
+
+inline PatchResult PatchSRVSlots(std::vector<uint8_t>& data, bool srvLegacyMode = true,
+                                 const std::vector<SRVRemap>& customRemaps = {}) {
+    return PatchSRVSlots(data.data(), data.size(), srvLegacyMode, customRemaps);
+}
+
+inline PatchResult PatchSubsurfaceMaterialID(std::vector<uint8_t>& data) {
+    return PatchSubsurfaceMaterialID(data.data(), data.size());
+}
+
+inline PatchResult PatchUberFeatureFlags(std::vector<uint8_t>& data) {
+    return PatchUberFeatureFlags(data.data(), data.size());
+}
+
+inline PatchResult PatchFeatureFlagBit1(std::vector<uint8_t>& data) {
+    return PatchFeatureFlagBit1(data.data(), data.size());
+}
+
+inline PatchResult PatchSunDataUnpacking(std::vector<uint8_t>& data) {
+    return PatchSunDataUnpacking(data.data(), data.size());
+}
+
+inline PatchResult PatchShadowBlendMultiply(std::vector<uint8_t>& data) {
+    return PatchShadowBlendMultiply(data.data(), data.size());
+}
+
+inline PatchResult PatchRemoveClusteredLighting(std::vector<uint8_t>& data) {
+    return PatchRemoveClusteredLighting(data.data(), data.size());
+}
 
 // ============================================================================
 // Hash Functions
 // ============================================================================
 
-void UpdateHash(std::vector<uint8_t>& data);
-bool VerifyHash(const std::vector<uint8_t>& data);
+// Container checksum over size bytes, UpdateHash runs it from offset 20
+std::array<uint32_t, 4> ComputeHash(const uint8_t* input, uint32_t size);
+
+void UpdateHash(uint8_t* data, size_t size);
+bool VerifyHash(const uint8_t* data, size_t size);
+
+inline void UpdateHash(std::vector<uint8_t>& data) {
+    UpdateHash(data.data(), data.size());
+}
+
+inline bool VerifyHash(const std::vector<uint8_t>& data) {
+    return VerifyHash(data.data(), data.size());
+}
 
 // Internal helpers
 static uint32_t PatchSHEXSwap(uint8_t* shexData, size_t shexSize);
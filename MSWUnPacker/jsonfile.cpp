@@ -0,0 +1,41 @@
+/*
+ * JSON File Loading
+ */
+
+#include "jsonfile.h"
+#include <cstdio>
+#include "platform.h"
+
+bool ReadTextFile(const fs::path& path, std::vector<char>& text) {
+    ALLOC_CATEGORY(AllocCategory::IO);
+
+    std::error_code ec;
+    uintmax_t size = fs::file_size(path, ec);
+    if (ec) {
+        return false;
+    }
+
+    FILE* file = nullptr;
+    if (fopen_s(&file, path.string().c_str(), "rb") != 0 || !file) {
+        return false;
+    }
+
+    text.resize(static_cast<size_t>(size) + 1);
+    size_t read = size ? fread(text.data(), 1, static_cast<size_t>(size), file) : 0;
+    fclose(file);
+
+    if (read != size) {
+        return false;
+    }
+    text[read] = '\0';
+    return true;
+}
+
+bool JsonFile::Load(const fs::path& path) {
+    if (!ReadTextFile(path, _text)) {
+        return false;
+    }
+
+    _doc.ParseInsitu<rapidjson::kParseCommentsFlag | rapidjson::kParseTrailingCommasFlag>(_text.data());
+    return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+/*
+ * JSON File Loading
+ *
+ * Reads a JSON file with a single read into a buffer it owns and parses it
+ * in place (rapidjson ParseInsitu), so strings in the document point into
+ * the buffer instead of being copied. Keep the JsonFile alive as long as the
+ * document is in use.
+ */
+
+#include <filesystem>
+#include <vector>
+#include "memstats.h"
+#define RAPIDJSON_HAS_STDSTRING 1
+#include "rapidjson/document.h"
+
+namespace fs = std::filesystem;
+
+// Whole file into text, NUL-terminated. False if it could not be opened or read.
+bool ReadTextFile(const fs::path& path, std::vector<char>& text);
+
+class JsonFile {
+public:
+    // Comments and trailing commas are accepted, the way the hand-edited
+    // data.json files have always been read. False if the file could not be
+    // read; a parse error leaves a document that is not an object.
+    bool Load(const fs::path& path);
+
+    rapidjson::Document& GetDocument() { return _doc; }
+
+private:
+    std::vector<char> _text;
+    rapidjson::Document _doc;
+};
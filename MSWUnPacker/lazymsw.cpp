@@ -0,0 +1,331 @@
+/*
+ * Lazy MSW Reading and Streaming Writing
+ */
+
+#include "lazymsw.h"
+#include <cstring>
+#include "platform.h"
+
+namespace {
+
+// One page covers the headers and the descriptor table of shaders with up to
+// 169 entries (version 3) or 127 (version 4), larger tables take a second read
+constexpr size_t kHeadBytes = 4096;
+
+} // namespace
+
+LazyMswReader::LazyMswReader()
+    : _file(nullptr), _fileSize(0), _bytesRead(0), _type(MultiShaderWrapperFileType_e::SHADER), _version(0) {}
+
+LazyMswReader::~LazyMswReader() {
+    if (_file) {
+        fclose(_file);
+    }
+}
+
+bool LazyMswReader::Open(const fs::path& path) {
+    if (fopen_s(&_file, path.string().c_str(), "rb") != 0 || !_file) {
+        _file = nullptr;
+        return false;
+    }
+
+    if (fseek64(_file, 0, SEEK_END) != 0) {
+        return false;
+    }
+    _fileSize = static_cast<uint64_t>(ftell64(_file));
+    fseek64(_file, 0, SEEK_SET);
+
+    _head.resize(static_cast<size_t>(_fileSize < kHeadBytes ? _fileSize : kHeadBytes));
+    if (fread(_head.data(), 1, _head.size(), _file) != _head.size()) {
+        return false;
+    }
+    _bytesRead += _head.size();
+
+    MultiShaderWrapper_Header_t fileHeader = {};
+    if (_head.size() < sizeof(fileHeader)) {
+        return false;
+    }
+    memcpy(&fileHeader, _head.data(), sizeof(fileHeader));
+    if (fileHeader.magic != MSW_FILE_MAGIC || fileHeader.version > MSW_FILE_VER) {
+        return false;
+    }
+    _type = fileHeader.fileType;
+    _version = fileHeader.version;
+
+    if (_type == MultiShaderWrapperFileType_e::SHADER) {
+        _shader = ParseShader(sizeof(fileHeader));
+        return _shader != nullptr;
+    }
+
+    if (_type == MultiShaderWrapperFileType_e::SHADERSET) {
+        char header[sizeof(MultiShaderWrapper_ShaderSet64_t)] = {};
+        if (!Fetch(sizeof(fileHeader), MSW_ShaderSetHeaderSize(_version), header)) {
+            return false;
+        }
+
+        const MultiShaderWrapper_ShaderSet64_t shds = MSW_DecodeShaderSetHeader(header, _version);
+        _shaderSet.pixelShaderGuid = shds.pixelShaderGuid;
+        _shaderSet.vertexShaderGuid = shds.vertexShaderGuid;
+        _shaderSet.numPixelShaderTextures = shds.numPixelShaderTextures;
+        _shaderSet.numVertexShaderTextures = shds.numVertexShaderTextures;
+        _shaderSet.numSamplers = shds.numSamplers;
+        _shaderSet.firstResourceBindPoint = shds.firstResourceBindPoint;
+        _shaderSet.numResources = shds.numResources;
+
+        if (shds.pixelShaderOffset && !(_pixelShader = ParseShader(shds.pixelShaderOffset))) {
+            return false;
+        }
+        if (shds.vertexShaderOffset && !(_vertexShader = ParseShader(shds.vertexShaderOffset))) {
+            return false;
+        }
+        return true;
+    }
+
+    // Bundles are left to BundleReader, only the type is reported
+    return true;
+}
+
+bool LazyMswReader::Fetch(uint64_t offset, size_t size, void* out) {
+    if (offset > _fileSize || size > _fileSize - offset) {
+        return false;
+    }
+    if (offset + size <= _head.size()) {
+        memcpy(out, _head.data() + offset, size);
+        return true;
+    }
+
+    if (fseek64(_file, static_cast<int64_t>(offset), SEEK_SET) != 0 || fread(out, 1, size, _file) != size) {
+        return false;
+    }
+    _bytesRead += size;
+    return true;
+}
+
+std::unique_ptr<LazyMswShader> LazyMswReader::ParseShader(uint64_t offset) {
+    char header[sizeof(MultiShaderWrapper_Shader64_t)] = {};
+    const size_t headerSize = MSW_ShaderHeaderSize(_version);
+    if (!Fetch(offset, headerSize, header)) {
+        return nullptr;
+    }
+    const MultiShaderWrapper_Shader64_t shdr = MSW_DecodeShaderHeader(header, _version);
+
+    const uint64_t descStartOffset = offset + headerSize;
+    const size_t descSize = MSW_DescriptorSize(_version);
+    std::vector<char> descriptors(shdr.numShaderDescriptors * descSize);
+    if (!Fetch(descStartOffset, descriptors.size(), descriptors.data())) {
+        return nullptr;
+    }
+
+    auto shader = std::make_unique<LazyMswShader>();
+    memcpy(shader->features, &shdr, sizeof(shader->features));
+    shader->bufferAlignment = shdr.bufferAlignment;
+
+    shader->entries.resize(shdr.numShaderDescriptors);
+    for (size_t i = 0; i < shader->entries.size(); i++) {
+        MultiShaderWrapper_ShaderDesc64_t desc = {};
+        LazyMswEntry& entry = shader->entries[i];
+        entry.type = MSW_DecodeDescriptor(descriptors.data() + i * descSize, _version, desc);
+        entry.flags[0] = desc.inputFlags[0];
+        entry.flags[1] = desc.inputFlags[1];
+        entry.offset = 0;
+        entry.size = 0;
+        entry.refIndex = UINT16_MAX;
+
+        if (entry.type == MultiShaderWrapperDescType_e::STANDARD) {
+            entry.offset = descStartOffset + i * descSize + desc.u_standard.bufferOffset;
+            entry.size = static_cast<uint32_t>(desc.u_standard.bufferLength);
+        } else if (entry.type == MultiShaderWrapperDescType_e::REFERENCE) {
+            entry.refIndex = static_cast<uint16_t>(desc.u_ref.bufferIndex);
+        }
+    }
+
+    // The name comes last in the shader block, the terminator is not kept
+    if (shdr.nameLength > 0) {
+        shader->name.resize(shdr.nameLength);
+        if (!Fetch(shdr.nameOffset, shdr.nameLength, shader->name.data())) {
+            return nullptr;
+        }
+        shader->name.resize(shdr.nameLength - 1);
+    }
+
+    return shader;
+}
+
+const LazyMswEntry* LazyMswReader::GetEntry(LazyMswShader& shader, size_t index) {
+    if (index >= shader.entries.size()) {
+        return nullptr;
+    }
+
+    LazyMswEntry* entry = &shader.entries[index];
+    if (entry->type == MultiShaderWrapperDescType_e::REFERENCE) {
+        if (entry->refIndex >= shader.entries.size()) {
+            return nullptr;
+        }
+        entry = &shader.entries[entry->refIndex];
+    }
+    if (entry->type != MultiShaderWrapperDescType_e::STANDARD) {
+        return nullptr;
+    }
+
+    if (!entry->data) {
+        std::unique_ptr<char[]> data(new char[entry->size ? entry->size : 1]);
+        if (!Fetch(entry->offset, entry->size, data.get())) {
+            return nullptr;
+        }
+        entry->data = std::move(data);
+    }
+    return entry;
+}
+
+bool LazyMswReader::ReadEntry(const LazyMswEntry& entry, std::vector<char>& data) {
+    if (entry.type != MultiShaderWrapperDescType_e::STANDARD) {
+        return false;
+    }
+    data.resize(entry.size);
+    return Fetch(entry.offset, entry.size, data.data());
+}
+
+bool LazyMswReader::ReadShader(LazyMswShader& lazyShader, CMultiShaderWrapperIO::Shader_t& shader) {
+    // shader type isn't saved, same as CMultiShaderWrapperIO::ReadShader
+    shader.shaderType = MultiShaderWrapperShaderType_e::INVALID;
+    shader.name = lazyShader.name;
+    shader.bufferAlignment = lazyShader.bufferAlignment;
+    memcpy(shader.features, lazyShader.features, sizeof(shader.features));
+
+    shader.entries.clear();
+    shader.entries.reserve(lazyShader.entries.size());
+    for (size_t i = 0; i < lazyShader.entries.size(); i++) {
+        LazyMswEntry& lazyEntry = lazyShader.entries[i];
+        CMultiShaderWrapperIO::ShaderEntry_t& entry = shader.entries.emplace_back();
+        entry.flags[0] = lazyEntry.flags[0];
+        entry.flags[1] = lazyEntry.flags[1];
+        entry.refIndex = lazyEntry.refIndex;
+
+        if (lazyEntry.type == MultiShaderWrapperDescType_e::STANDARD) {
+            if (!GetEntry(lazyShader, i)) {
+                return false;
+            }
+
+            // The bytecode moves to the shader, GetEntry reads it again if asked
+            entry.buffer = lazyEntry.data.release();
+            entry.size = lazyEntry.size;
+            entry.deleteBuffer = true;
+        }
+    }
+    return true;
+}
+
+// ============================================================================
+// MswStreamWriter
+// ============================================================================
+
+MswStreamWriter::MswStreamWriter()
+    : _file(nullptr), _version(MSW_FILE_VER_32), _entryCount(0), _shaderOffset(0), _descStartOffset(0), _offset(0) {}
+
+MswStreamWriter::~MswStreamWriter() {
+    Close();
+}
+
+void MswStreamWriter::Close() {
+    if (_file) {
+        fclose(_file);
+        _file = nullptr;
+    }
+}
+
+bool MswStreamWriter::Open(const fs::path& path, unsigned int version, size_t entryCount) {
+    if (fopen_s(&_file, path.string().c_str(), "wb") != 0 || !_file) {
+        _file = nullptr;
+        return false;
+    }
+
+    _version = version;
+    _entryCount = entryCount;
+    _descriptors.clear();
+    _descriptors.reserve(entryCount);
+
+    MultiShaderWrapper_Header_t fileHeader = {};
+    fileHeader.magic = MSW_FILE_MAGIC;
+    fileHeader.version = version;
+    fileHeader.fileType = MultiShaderWrapperFileType_e::SHADER;
+    if (fwrite(&fileHeader, sizeof(fileHeader), 1, _file) != 1) {
+        return false;
+    }
+
+    // Bytecode starts after the header and descriptors, both written by Finish
+    _shaderOffset = sizeof(fileHeader);
+    _descStartOffset = _shaderOffset + MSW_ShaderHeaderSize(version);
+    _offset = _descStartOffset + entryCount * MSW_DescriptorSize(version);
+    return fseek64(_file, static_cast<int64_t>(_offset), SEEK_SET) == 0;
+}
+
+bool MswStreamWriter::AddDescriptor(MultiShaderWrapper_ShaderDesc64_t& desc, const uint64_t flags[2]) {
+    if (!_file || _descriptors.size() >= _entryCount) {
+        return false;
+    }
+    desc.inputFlags[0] = flags[0];
+    desc.inputFlags[1] = flags[1];
+    _descriptors.push_back(desc);
+    return true;
+}
+
+bool MswStreamWriter::AddEntry(const uint64_t flags[2], const void* data, uint32_t size) {
+    const uint64_t descOffset = _descStartOffset + _descriptors.size() * MSW_DescriptorSize(_version);
+    if (_version < 4 && _offset + size > UINT32_MAX) {
+        return false;
+    }
+
+    MultiShaderWrapper_ShaderDesc64_t desc = {};
+    desc.u_standard.bufferLength = size;
+    desc.u_standard.bufferOffset = _offset - descOffset;
+    if (!AddDescriptor(desc, flags) || fwrite(data, 1, size, _file) != size) {
+        return false;
+    }
+    _offset += size;
+    return true;
+}
+
+bool MswStreamWriter::AddReference(const uint64_t flags[2], uint16_t refIndex) {
+    MultiShaderWrapper_ShaderDesc64_t desc = {};
+    desc.u_ref.bufferIndex = refIndex;
+    return AddDescriptor(desc, flags);
+}
+
+bool MswStreamWriter::AddNull(const uint64_t flags[2]) {
+    MultiShaderWrapper_ShaderDesc64_t desc = {};
+    desc.u_ref.bufferIndex = UINT64_MAX;
+    desc.u_ref._reserved = UINT64_MAX;
+    return AddDescriptor(desc, flags);
+}
+
+bool MswStreamWriter::Finish(const unsigned char features[7], const std::string& name) {
+    if (!_file || _descriptors.size() != _entryCount) {
+        return false;
+    }
+
+    const unsigned int nameLength = static_cast<unsigned int>(name.length());
+    MultiShaderWrapper_Shader64_t shdr = {};
+    memcpy(&shdr, features, 7);
+    shdr.numShaderDescriptors = _entryCount;
+    shdr.nameLength = nameLength ? nameLength + 1 : 0;
+    shdr.nameOffset = nameLength ? _offset : 0;
+
+    bool ok = !nameLength || fwrite(name.c_str(), nameLength + 1, 1, _file) == 1;
+    _offset += shdr.nameLength;
+
+    // The descriptors and the header are small, build them in one block
+    std::vector<char> head(MSW_ShaderHeaderSize(_version) + _entryCount * MSW_DescriptorSize(_version));
+    MSW_EncodeShaderHeader(shdr, _version, head.data());
+    for (size_t i = 0; i < _descriptors.size(); i++) {
+        MSW_EncodeDescriptor(_descriptors[i], _version,
+                             head.data() + MSW_ShaderHeaderSize(_version) + i * MSW_DescriptorSize(_version));
+    }
+
+    ok = ok && fseek64(_file, static_cast<int64_t>(_shaderOffset), SEEK_SET) == 0 &&
+         fwrite(head.data(), 1, head.size(), _file) == head.size();
+    if (fclose(_file) != 0) {
+        ok = false;
+    }
+    _file = nullptr;
+    return ok;
+}
@@ -0,0 +1,142 @@
+#pragma once
+/*
+ * Lazy MSW Reading and Streaming Writing
+ *
+ * CMultiShaderWrapperIO::ReadFile reads every entry's bytecode up front.
+ * LazyMswReader reads the headers and descriptor table in one read of the
+ * start of the file (plus the name, which comes last) and leaves the file
+ * open, so commands that only look at types, names, features, flags, entry
+ * counts or shader set GUIDs never touch the bytecode. GetEntry reads an
+ * entry's bytecode the first time it is asked for and keeps it.
+ *
+ * MswStreamWriter writes a shader file an entry at a time: each entry's
+ * bytecode goes to the file as it is added and only the descriptors are
+ * kept, to be written with the shader header once the name is known. With
+ * LazyMswReader::ReadEntry a file can be rewritten holding no more than one
+ * entry's bytecode.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include "multishader.h"
+
+namespace fs = std::filesystem;
+
+struct LazyMswEntry {
+    uint64_t flags[2];
+    uint64_t offset;                // Absolute, standard entries only
+    uint32_t size;
+    uint16_t refIndex;              // 0xFFFF = none
+    MultiShaderWrapperDescType_e type;
+    std::unique_ptr<char[]> data;   // Set by GetEntry
+};
+
+struct LazyMswShader {
+    std::string name;
+    unsigned char features[7];
+    unsigned int bufferAlignment;
+    std::vector<LazyMswEntry> entries;
+};
+
+class LazyMswReader {
+public:
+    LazyMswReader();
+    ~LazyMswReader();
+
+    LazyMswReader(const LazyMswReader&) = delete;
+    LazyMswReader& operator=(const LazyMswReader&) = delete;
+
+    // Reads the headers and descriptors. False if the file can't be read or
+    // is not an MSW file of a version this tool knows.
+    bool Open(const fs::path& path);
+
+    MultiShaderWrapperFileType_e GetType() const { return _type; }
+    unsigned int GetVersion() const { return _version; }
+    uint64_t GetFileSize() const { return _fileSize; }
+
+    // The shader of a shader file, null for other types
+    LazyMswShader* GetShader() { return _shader.get(); }
+
+    // A shader set's header, and the shaders embedded in it (usually none)
+    const CMultiShaderWrapperIO::ShaderSet_t& GetShaderSet() const { return _shaderSet; }
+    LazyMswShader* GetPixelShader() { return _pixelShader.get(); }
+    LazyMswShader* GetVertexShader() { return _vertexShader.get(); }
+
+    // The entry that holds index's bytecode, with the bytecode read: the entry
+    // itself, or the one a reference points at. Null for null entries, bad
+    // references and read errors.
+    const LazyMswEntry* GetEntry(LazyMswShader& shader, size_t index);
+
+    // An entry's own bytecode into data, without keeping it. False for
+    // reference and null entries.
+    bool ReadEntry(const LazyMswEntry& entry, std::vector<char>& data);
+
+    // Fills shader with the entries and their bytecode (read now if GetEntry
+    // has not), the buffers are owned by the entries
+    bool ReadShader(LazyMswShader& lazyShader, CMultiShaderWrapperIO::Shader_t& shader);
+
+    // Bytes read from the file so far
+    uint64_t BytesRead() const { return _bytesRead; }
+
+private:
+    // size bytes at offset, from the start of the file read by Open if they
+    // are in it, from the file otherwise
+    bool Fetch(uint64_t offset, size_t size, void* out);
+
+    std::unique_ptr<LazyMswShader> ParseShader(uint64_t offset);
+
+    FILE* _file;
+    uint64_t _fileSize;
+    uint64_t _bytesRead;
+    std::vector<char> _head;
+    MultiShaderWrapperFileType_e _type;
+    unsigned int _version;
+    std::unique_ptr<LazyMswShader> _shader;
+    std::unique_ptr<LazyMswShader> _pixelShader;
+    std::unique_ptr<LazyMswShader> _vertexShader;
+    CMultiShaderWrapperIO::ShaderSet_t _shaderSet;
+};
+
+class MswStreamWriter {
+public:
+    MswStreamWriter();
+    ~MswStreamWriter();
+
+    MswStreamWriter(const MswStreamWriter&) = delete;
+    MswStreamWriter& operator=(const MswStreamWriter&) = delete;
+
+    // Writes the file header of a shader file of this version and leaves room
+    // for the shader header and entryCount descriptors
+    bool Open(const fs::path& path, unsigned int version, size_t entryCount);
+
+    // Entries in order, exactly entryCount of them. False on a write error or
+    // an offset version 3 can't hold.
+    bool AddEntry(const uint64_t flags[2], const void* data, uint32_t size);
+    bool AddReference(const uint64_t flags[2], uint16_t refIndex);
+    bool AddNull(const uint64_t flags[2]);
+
+    // Writes the name, then goes back for the descriptors and the shader
+    // header. The same bytes CMultiShaderWrapperIO::WriteFile would write for
+    // the shader (without buffer alignment). Closes the file.
+    bool Finish(const unsigned char features[7], const std::string& name);
+
+    // Gives up on an unfinished file, what was written is not a valid MSW
+    void Close();
+
+    uint64_t BytesWritten() const { return _offset; }
+
+private:
+    bool AddDescriptor(MultiShaderWrapper_ShaderDesc64_t& desc, const uint64_t flags[2]);
+
+    FILE* _file;
+    unsigned int _version;
+    size_t _entryCount;
+    uint64_t _shaderOffset;
+    uint64_t _descStartOffset;
+    uint64_t _offset;
+    std::vector<MultiShaderWrapper_ShaderDesc64_t> _descriptors;
+};
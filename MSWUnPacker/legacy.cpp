@@ -0,0 +1,457 @@
+/*
+ * S9 -> Legacy Conversion Helpers
+ *
+ * Patch chain and header fixups used by convert-legacy.
+ */
+
+#include "legacy.h"
+#include "arena.h"
+#include "lazymsw.h"
+#include "log.h"
+#include "memstats.h"
+#include "timings.h"
+#include <cstdio>
+#include <cstring>
+
+// ============================================================================
+// Per-Entry Patching
+// ============================================================================
+
+LegacyPatchResult ApplyLegacyPatches(uint8_t* fxcData, size_t fxcSize, const dxbc::CBLayoutInfo& layoutInfo) {
+    ALLOC_CATEGORY(AllocCategory::Patch);
+    LegacyPatchResult result = { false, 0, 0, 0, 0, 0, 0, 0, 0, "" };
+
+    // ================================================================
+    // PHASE 2: Content Patches (BEFORE CB Swap!)
+    // These patches look for S9's original CB layout:
+    //   cb2 = CBufModelInstance (contains lighting.packedSunData at cb2[11].w)
+    //   cb3 = CBufCommonPerCamera
+    // We MUST patch these patterns BEFORE swapping CB2<->CB3!
+    // ================================================================
+
+    if (layoutInfo.needsSwap) {
+        // Patch 1: Sun Data Unpacking (CRITICAL - must be before CB swap)
+        // S9 shaders unpack packedSunData as integer with bit shifts:
+        //   ishr rX.w, cb2[11].w, l(16)   -> extract upper 16 bits (sun visibility)
+        //   and rX.w, cb2[11].w, l(0xFFFF) -> extract lower 16 bits (sun intensity)
+        //   mul rX.w, rX.w, l(0.00003052)  -> scale to 0-1
+        // R5SDK provides cb2[11].w as direct float (skyDirSunVis.w)
+        // This patch converts to direct float reads like S7 shaders do
+        // NOTE: We search for cb2[11].w because CB swap hasn't happened yet!
+        TIME_PHASE(Phase::SunData);
+        dxbc::PatchResult sunDataResult = dxbc::PatchSunDataUnpacking(fxcData, fxcSize);
+        if (sunDataResult.success && sunDataResult.shexPatches > 0) {
+            result.sunDataPatches = sunDataResult.shexPatches;
+            result.wasPatched = true;
+        }
+    }
+
+    // Patch 2: Uber Feature Flags - Bit 2 (detail texture blending)
+    // Patches "and rX.?, cb0[24].?, l(2)" to "mov rX.?, l(0)"
+    // Forces simple blending instead of overlay blending (fixes darker materials)
+    // cb0 is not affected by CB2<->CB3 swap
+    {
+        TIME_PHASE(Phase::UberFlags);
+        dxbc::PatchResult uberFlagsResult = dxbc::PatchUberFeatureFlags(fxcData, fxcSize);
+        if (uberFlagsResult.success && uberFlagsResult.shexPatches > 0) {
+            result.uberFlagsPatches = uberFlagsResult.shexPatches;
+            result.wasPatched = true;
+        }
+    }
+
+    // Patch 3: Feature Flag Bit 1 (cavity/AO blending mode)
+    // Patches "and rX.?, cb0[24].?, l(1)" to "mov rX.?, l(0)"
+    // Forces standard blending path
+    {
+        TIME_PHASE(Phase::FeatureFlagBit1);
+        dxbc::PatchResult bit1Result = dxbc::PatchFeatureFlagBit1(fxcData, fxcSize);
+        if (bit1Result.success && bit1Result.shexPatches > 0) {
+            result.featureFlagBit1Patches = bit1Result.shexPatches;
+            result.wasPatched = true;
+        }
+    }
+
+    // Patch 4: Shadow Blend Multiply (CRITICAL for fixing sun flickering)
+    // S9 shaders have: mul r0.w, r0.w, r6.z (shadow_result * shadow_blend)
+    // After sun data patch, both r0.w and r6.z contain the same cb3[11].w value
+    // This causes sunVis * sunVis = sunVis^2 which:
+    //   1. Makes lighting darker (squared attenuation)
+    //   2. Amplifies frame-to-frame variations causing visible flickering
+    // S7 doesn't have this multiply, so we NOP it out
+    // TEMPORARILY DISABLED for testing
+    /*if (layoutInfo.needsSwap && result.sunDataPatches > 0) {
+        TIME_PHASE(Phase::ShadowBlend);
+        dxbc::PatchResult shadowBlendResult = dxbc::PatchShadowBlendMultiply(fxcData, fxcSize);
+        if (shadowBlendResult.success && shadowBlendResult.shexPatches > 0) {
+            result.shadowBlendPatches = shadowBlendResult.shexPatches;
+            result.wasPatched = true;
+        }
+    }*/
+
+    // ================================================================
+    // PHASE 3: SRV Slot Remapping
+    // Slot numbers are independent of CB swap
+    // t75 -> t61 (g_modelInst)
+    // t63 -> t1 (g_boneWeightsExtra)
+    // ================================================================
+    {
+        TIME_PHASE(Phase::SRVSlots);
+        dxbc::PatchResult srvResult = dxbc::PatchSRVSlots(fxcData, fxcSize, true);
+        if (srvResult.success && srvResult.srvPatches > 0) {
+            result.srvPatches = srvResult.srvPatches;
+            result.wasPatched = true;
+        }
+    }
+
+    // ================================================================
+    // PHASE 3.5: Remove ClusteredLighting_t from CBufCommonPerCamera
+    // S11 shaders declare ClusteredLighting_t (32 bytes) but never use it
+    // This causes CBufCommonPerCamera to be 784 bytes instead of 752
+    // R5SDK provides 752-byte buffer, causing buffer binding mismatch
+    // ================================================================
+    {
+        TIME_PHASE(Phase::ClusteredLighting);
+        dxbc::PatchResult clusteredResult = dxbc::PatchRemoveClusteredLighting(fxcData, fxcSize);
+        if (clusteredResult.success && clusteredResult.rdefPatches > 0) {
+            result.clusteredLightingPatches = clusteredResult.rdefPatches;
+            result.wasPatched = true;
+        }
+    }
+
+    // ================================================================
+    // PHASE 4: CB2<->CB3 Swap (MUST BE LAST!)
+    // This swaps ALL cb2 and cb3 references in SHEX bytecode and RDEF
+    // After this swap:
+    //   cb2 = CBufCommonPerCamera (S7 layout)
+    //   cb3 = CBufModelInstance (S7 layout)
+    // ================================================================
+    if (layoutInfo.needsSwap) {
+        TIME_PHASE(Phase::SwapCB);
+        dxbc::PatchResult patchResult = dxbc::SwapCB2CB3(fxcData, fxcSize);
+
+        if (patchResult.success) {
+            result.shexPatches += patchResult.shexPatches;
+            result.rdefPatches += patchResult.rdefPatches;
+            result.wasPatched = true;
+        } else {
+            result.error = patchResult.error;
+        }
+    }
+
+    // ================================================================
+    // PHASE 5: Finalize
+    // ================================================================
+    if (result.wasPatched) {
+        // Ensure hash is updated (individual patches update it, but be safe)
+        TIME_PHASE(Phase::Hash);
+        dxbc::UpdateHash(fxcData, fxcSize);
+    }
+
+    return result;
+}
+
+void PrintLegacyPatchSummary(const LegacyPatchResult& result) {
+    LOG_VERBOSE("           Patched: %d SHEX, %d RDEF, %d SRV, %d CLT, %d UBR, %d BIT1, %d SUN, %d SHDW\n",
+           result.shexPatches, result.rdefPatches, result.srvPatches, result.clusteredLightingPatches,
+           result.uberFlagsPatches, result.featureFlagBit1Patches, result.sunDataPatches, result.shadowBlendPatches);
+}
+
+// ============================================================================
+// Shader Header Conversion
+// ============================================================================
+
+int CalculateShaderCount_v12(const unsigned char features[7]) {
+    if (features[0] != 0xFF) {
+        return features[0];
+    }
+
+    int v6 = 2 * ((features[1] != 0) + 1);
+    if (!features[2])
+        v6 = (features[1] != 0) + 1;
+
+    int v7 = v6;
+    if (features[3])
+        v7 *= 2;
+
+    int numShaders = 2 * v7;
+    if (!features[6])
+        numShaders = v7;
+
+    return numShaders;
+}
+
+bool ConvertFeaturesToLegacy(unsigned char features[7], int actualShaderCount) {
+    // For v12, we need to ensure the calculated count matches actual count
+    // If not, force direct count mode by setting features[0]
+    if (CalculateShaderCount_v12(features) == actualShaderCount || actualShaderCount > 255) {
+        return false;
+    }
+
+    features[0] = static_cast<unsigned char>(actualShaderCount);
+    return true;
+}
+
+// ============================================================================
+// In-Memory MSW Conversion
+// ============================================================================
+
+LegacyPatchResult PatchLegacyEntry(CMultiShaderWrapperIO::ShaderEntry_t& entry, dxbc::CBLayoutInfo* outLayout,
+                                   char* writable) {
+    ALLOC_CATEGORY(AllocCategory::Patch);
+    LegacyPatchResult result = { false, 0, 0, 0, 0, 0, 0, 0, 0, "" };
+
+    // Reference and null entries have no bytecode of their own
+    if (!entry.buffer) {
+        return result;
+    }
+
+    const bool owned = entry.deleteBuffer || entry.arenaBuffer;
+    if (!owned && !writable) {
+        result.error = "Read-only entry without writable memory to patch it in";
+        return result;
+    }
+
+    // The chain works on a copy, the entry only changes if a patch applied: scratch
+    // memory for buffers the entry owns, the memory set aside for views
+    ScopedScratch scratch;
+    uint8_t* fxcData = owned ? static_cast<uint8_t*>(scratch.GetArena().Allocate(entry.size, MSW_BUFFER_MEMORY_ALIGNMENT))
+                             : reinterpret_cast<uint8_t*>(writable);
+    memcpy(fxcData, entry.buffer, entry.size);
+
+    dxbc::CBLayoutInfo layoutInfo;
+    {
+        TIME_PHASE(Phase::Detect);
+        layoutInfo = dxbc::DetectCBLayout(fxcData, entry.size);
+    }
+    result = ApplyLegacyPatches(fxcData, entry.size, layoutInfo);
+
+    if (result.wasPatched) {
+        // Patches never change the size of the bytecode, so the entry buffer can be reused
+        // when we own it (or its arena does). A view moves to the patched copy, which
+        // lives in the caller's arena; unpatched entries stay views.
+        if (owned) {
+            memcpy(const_cast<char*>(entry.buffer), fxcData, entry.size);
+        } else {
+            entry.buffer = writable;
+            entry.arenaBuffer = true;
+        }
+    }
+
+    if (outLayout) {
+        *outLayout = layoutInfo;
+    }
+
+    return result;
+}
+
+void FinalizeLegacyShader(CMultiShaderWrapperIO::Shader_t* shader, const fs::path& inputPath) {
+    TIME_PHASE(Phase::Finalize);
+
+    // unpack names the output after the input file if the shader has no embedded name,
+    // and pack then writes that name into the MSW
+    if (shader->name.empty()) {
+        shader->name = inputPath.stem().string();
+    }
+
+    ConvertFeaturesToLegacy(shader->features, static_cast<int>(shader->entries.size()));
+}
+
+bool WriteLegacyMsw(CMultiShaderWrapperIO::ShaderCache_t& shaderCache, const fs::path& outputPath,
+                    const MappedFile* source) {
+    TIME_PHASE(Phase::Write);
+    ALLOC_CATEGORY(AllocCategory::IO);
+    CMultiShaderWrapperIO writer{};
+    writer.SetMapping(source);
+
+    // The legacy runtime only loads version 3
+    writer.SetFileVersion(MSW_FILE_VER_32);
+
+    if (shaderCache.type == MultiShaderWrapperFileType_e::SHADER) {
+        if (!shaderCache.shader) {
+            return false;
+        }
+
+        writer.SetFileType(MultiShaderWrapperFileType_e::SHADER);
+        writer.SetShader(shaderCache.shader);
+        return writer.WriteFile(outputPath.string().c_str());
+    }
+
+    if (shaderCache.type == MultiShaderWrapperFileType_e::SHADERSET) {
+        // Only the header is carried over, same as an unpack + pack round trip.
+        // The set references its shaders by GUID, see WriteShaderSet.
+        const CMultiShaderWrapperIO::ShaderSet_t& src = shaderCache.shaderSet;
+
+        writer.SetFileType(MultiShaderWrapperFileType_e::SHADERSET);
+        writer.SetShaderSetHeader(src.pixelShaderGuid, src.vertexShaderGuid,
+                                  src.numPixelShaderTextures, src.numVertexShaderTextures,
+                                  src.numSamplers, src.firstResourceBindPoint, src.numResources);
+        return writer.WriteFile(outputPath.string().c_str());
+    }
+
+    return false;
+}
+
+// ============================================================================
+// Streaming MSW Conversion
+// ============================================================================
+
+// The output is written next to where it goes and renamed over it once it is
+// complete, so a failed conversion never truncates or removes an existing file
+static fs::path StreamTempPath(const fs::path& outputPath) {
+    fs::path tempPath = outputPath;
+    tempPath += ".partial";
+    return tempPath;
+}
+
+static bool CommitStreamOutput(const fs::path& tempPath, const fs::path& outputPath) {
+    std::error_code ec;
+    fs::rename(tempPath, outputPath, ec);
+    if (ec) {
+        fs::remove(tempPath, ec);
+        return false;
+    }
+    return true;
+}
+
+bool StreamLegacyMsw(const fs::path& inputPath, const fs::path& outputPath, LegacyStreamResult& result) {
+    result.type = MultiShaderWrapperFileType_e::SHADER;
+    result.entries.clear();
+    result.largestEntry = 0;
+    result.bytesOut = 0;
+    result.error.clear();
+
+    LazyMswReader reader;
+    {
+        TIME_PHASE(Phase::Read);
+        ALLOC_CATEGORY(AllocCategory::IO);
+        if (!reader.Open(inputPath)) {
+            result.error = "Failed to load MSW file";
+            return false;
+        }
+    }
+    result.type = reader.GetType();
+
+    if (result.type == MultiShaderWrapperFileType_e::SHADERSET) {
+        // Header only, nothing to stream
+        CMultiShaderWrapperIO::ShaderCache_t shaderCache;
+        shaderCache.type = MultiShaderWrapperFileType_e::SHADERSET;
+        shaderCache.shaderSet = reader.GetShaderSet();
+
+        const fs::path tempPath = StreamTempPath(outputPath);
+        if (!WriteLegacyMsw(shaderCache, tempPath) || !CommitStreamOutput(tempPath, outputPath)) {
+            std::error_code ec;
+            fs::remove(tempPath, ec);
+            result.error = "Could not write " + outputPath.string();
+            return false;
+        }
+        return true;
+    }
+
+    if (result.type == MultiShaderWrapperFileType_e::BUNDLE) {
+        result.error = "MSW bundle, write its shaders out with pack --from-bundle first";
+        return false;
+    }
+
+    LazyMswShader* shader = reader.GetShader();
+    if (!shader) {
+        result.error = "Unknown MSW file type " + std::to_string(static_cast<int>(result.type));
+        return false;
+    }
+
+    const fs::path tempPath = StreamTempPath(outputPath);
+    MswStreamWriter writer;
+    bool ok = false;
+    {
+        TIME_PHASE(Phase::Write);
+        ALLOC_CATEGORY(AllocCategory::IO);
+        ok = writer.Open(tempPath, MSW_FILE_VER_32, shader->entries.size());
+    }
+
+    // The entry as read and the copy the chain patches, reused for every entry.
+    // The original is what gets written unless a patch applied, as with PatchLegacyEntry.
+    std::vector<char> source;
+    std::vector<char> patched;
+
+    result.entries.resize(shader->entries.size());
+    for (size_t i = 0; ok && i < shader->entries.size(); i++) {
+        const LazyMswEntry& entry = shader->entries[i];
+        LegacyStreamEntry& streamEntry = result.entries[i];
+        streamEntry.type = entry.type;
+        streamEntry.refIndex = entry.refIndex;
+        streamEntry.size = entry.size;
+        streamEntry.layout = dxbc::CBLayoutInfo();
+        streamEntry.patch = LegacyPatchResult();
+        streamEntry.patchNanoseconds = 0;
+
+        if (entry.type == MultiShaderWrapperDescType_e::REFERENCE) {
+            TIME_PHASE(Phase::Write);
+            ok = writer.AddReference(entry.flags, entry.refIndex);
+            continue;
+        }
+        if (entry.type == MultiShaderWrapperDescType_e::NONE) {
+            TIME_PHASE(Phase::Write);
+            ok = writer.AddNull(entry.flags);
+            continue;
+        }
+
+        {
+            TIME_PHASE(Phase::Read);
+            ALLOC_CATEGORY(AllocCategory::IO);
+            ok = reader.ReadEntry(entry, source);
+        }
+        if (!ok) {
+            result.error = "Failed to read entry " + std::to_string(i);
+            break;
+        }
+
+        {
+            ALLOC_CATEGORY(AllocCategory::Patch);
+            patched.assign(source.begin(), source.end());
+        }
+        uint8_t* fxcData = reinterpret_cast<uint8_t*>(patched.data());
+
+        uint64_t start = TimingClockNanoseconds();
+        {
+            TIME_PHASE(Phase::Detect);
+            streamEntry.layout = dxbc::DetectCBLayout(fxcData, entry.size);
+        }
+        streamEntry.patch = ApplyLegacyPatches(fxcData, entry.size, streamEntry.layout);
+        streamEntry.patchNanoseconds = TimingClockNanoseconds() - start;
+
+        if (entry.size > result.largestEntry) {
+            result.largestEntry = entry.size;
+        }
+
+        TIME_PHASE(Phase::Write);
+        ok = writer.AddEntry(entry.flags, streamEntry.patch.wasPatched ? patched.data() : source.data(), entry.size);
+    }
+
+    if (ok) {
+        // Named like unpack + pack would, see FinalizeLegacyShader
+        unsigned char features[7];
+        std::string name;
+        {
+            TIME_PHASE(Phase::Finalize);
+            memcpy(features, shader->features, sizeof(features));
+            ConvertFeaturesToLegacy(features, static_cast<int>(shader->entries.size()));
+            name = shader->name.empty() ? inputPath.stem().string() : shader->name;
+        }
+
+        TIME_PHASE(Phase::Write);
+        ok = writer.Finish(features, name) && CommitStreamOutput(tempPath, outputPath);
+    }
+
+    if (!ok) {
+        if (result.error.empty()) {
+            result.error = "Could not write " + outputPath.string();
+        }
+        // Only ever the temporary file, outputPath may be an earlier good output
+        writer.Close();
+        std::error_code ec;
+        fs::remove(tempPath, ec);
+        return false;
+    }
+
+    result.bytesOut = writer.BytesWritten();
+    return true;
+}
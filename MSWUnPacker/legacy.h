@@ -0,0 +1,100 @@
+#pragma once
+/*
+ * S9 -> Legacy Conversion Helpers
+ *
+ * The convert-legacy patch chain, shared by the single file path and the
+ * batch pipeline so both produce identical bytecode.
+ */
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include "multishader.h"
+#include "dxbc.h"
+
+// ============================================================================
+// Per-Entry Patching
+// ============================================================================
+
+struct LegacyPatchResult {
+    bool wasPatched;
+    int shexPatches;                // CB2<->CB3 swap in SHEX
+    int rdefPatches;                // CB2<->CB3 swap in RDEF
+    int srvPatches;
+    int clusteredLightingPatches;
+    int uberFlagsPatches;
+    int featureFlagBit1Patches;
+    int sunDataPatches;
+    int shadowBlendPatches;
+    std::string error;              // CB swap error, if any
+};
+
+// Apply the full patch chain to one DXBC shader in place. layoutInfo must come
+// from DetectCBLayout on the same (unpatched) data, the order of the patches matters.
+LegacyPatchResult ApplyLegacyPatches(uint8_t* fxcData, size_t fxcSize, const dxbc::CBLayoutInfo& layoutInfo);
+
+inline LegacyPatchResult ApplyLegacyPatches(std::vector<uint8_t>& fxcData, const dxbc::CBLayoutInfo& layoutInfo) {
+    return ApplyLegacyPatches(fxcData.data(), fxcData.size(), layoutInfo);
+}
+
+// Logs the "Patched: ..." summary line for a patched entry (verbose level)
+void PrintLegacyPatchSummary(const LegacyPatchResult& result);
+
+// ============================================================================
+// Shader Header Conversion
+// ============================================================================
+
+// Calculate shader count using v12 algorithm (7-byte features)
+int CalculateShaderCount_v12(const unsigned char features[7]);
+
+// Force direct count mode when the v12 count does not match the real entry count
+// Returns true if features were changed
+bool ConvertFeaturesToLegacy(unsigned char features[7], int actualShaderCount);
+
+// ============================================================================
+// In-Memory MSW Conversion
+// ============================================================================
+
+// Patch a single standard entry. Copy on write: an entry that owns its buffer is
+// patched on scratch memory and written back only if a patch applied. A read-only
+// view (see SetMapping) is copied into writable, entry.size bytes of the caller's
+// arena set aside for it, patched there and pointed at it only if a patch applied;
+// views without writable memory are left alone with an error. Reference and null
+// entries are left alone.
+LegacyPatchResult PatchLegacyEntry(CMultiShaderWrapperIO::ShaderEntry_t& entry, dxbc::CBLayoutInfo* outLayout = nullptr,
+                                   char* writable = nullptr);
+
+// Header fixups that convert + pack apply after the entries have been patched
+void FinalizeLegacyShader(CMultiShaderWrapperIO::Shader_t* shader, const fs::path& inputPath);
+
+// Write the converted shader cache as an MSW file. Entries still pointing into
+// source (the input's mapping) are copied from the input file as they are.
+bool WriteLegacyMsw(CMultiShaderWrapperIO::ShaderCache_t& shaderCache, const fs::path& outputPath,
+                    const MappedFile* source = nullptr);
+
+// ============================================================================
+// Streaming MSW Conversion
+// ============================================================================
+
+struct LegacyStreamEntry {
+    MultiShaderWrapperDescType_e type;
+    uint16_t refIndex;              // Reference entries only
+    uint32_t size;                  // Standard entries only
+    dxbc::CBLayoutInfo layout;      // Standard entries only
+    LegacyPatchResult patch;
+    uint64_t patchNanoseconds;
+};
+
+struct LegacyStreamResult {
+    MultiShaderWrapperFileType_e type;
+    std::vector<LegacyStreamEntry> entries;     // Empty for shader sets
+    uint32_t largestEntry;                      // The most bytecode held at once is twice this
+    uint64_t bytesOut;
+    std::string error;
+};
+
+// ReadFile + PatchLegacyEntry + FinalizeLegacyShader + WriteLegacyMsw without
+// holding the shader: each entry is read, patched and written before the next
+// one is read, and the descriptors and header are written at the end. Memory
+// is bounded by the largest entry instead of the file. Same output bytes.
+bool StreamLegacyMsw(const fs::path& inputPath, const fs::path& outputPath, LegacyStreamResult& result);
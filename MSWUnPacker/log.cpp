@@ -0,0 +1,92 @@
+/*
+ * Leveled Logging
+ */
+
+#include "log.h"
+#include <cstdarg>
+#include <cstdio>
+#include <string>
+
+std::atomic<int> g_logLevel(static_cast<int>(LogLevel::Info));
+
+namespace {
+
+// Flush early so one chatty file doesn't hold an unbounded buffer
+const size_t kMaxBufferedBytes = 64 * 1024;
+
+struct ThreadLogBuffer {
+    std::string text;
+    int depth;                  // Nested ScopedLogBuffers
+
+    ThreadLogBuffer() : depth(0) {}
+
+    // Threads that exit with output still buffered write it out
+    ~ThreadLogBuffer() { Flush(); }
+
+    void Flush() {
+        if (!text.empty()) {
+            fwrite(text.data(), 1, text.size(), stdout);
+            text.clear();
+        }
+    }
+};
+
+thread_local ThreadLogBuffer t_buffer;
+
+} // namespace
+
+void LogWrite(LogLevel level, const char* format, ...) {
+    char stackText[512];
+
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(stackText, sizeof(stackText), format, args);
+    va_end(args);
+
+    if (length < 0) {
+        return;
+    }
+
+    std::string heapText;
+    const char* text = stackText;
+
+    if (static_cast<size_t>(length) >= sizeof(stackText)) {
+        heapText.resize(static_cast<size_t>(length) + 1);
+        va_start(args, format);
+        vsnprintf(&heapText[0], heapText.size(), format, args);
+        va_end(args);
+        text = heapText.c_str();
+    }
+
+    if (level <= LogLevel::Warning) {
+        // Keep this thread's earlier output ahead of the error
+        t_buffer.Flush();
+        fflush(stdout);
+        fwrite(text, 1, static_cast<size_t>(length), stderr);
+        return;
+    }
+
+    if (t_buffer.depth == 0) {
+        fwrite(text, 1, static_cast<size_t>(length), stdout);
+        return;
+    }
+
+    t_buffer.text.append(text, static_cast<size_t>(length));
+    if (t_buffer.text.size() >= kMaxBufferedBytes) {
+        t_buffer.Flush();
+    }
+}
+
+void LogFlush() {
+    t_buffer.Flush();
+}
+
+ScopedLogBuffer::ScopedLogBuffer() {
+    t_buffer.depth++;
+}
+
+ScopedLogBuffer::~ScopedLogBuffer() {
+    if (--t_buffer.depth == 0) {
+        t_buffer.Flush();
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+/*
+ * Leveled Logging
+ *
+ * LOG_* macros check the level before evaluating their arguments, so a
+ * disabled message costs one relaxed load and a branch. Messages go to
+ * stdout (errors and warnings to stderr) as whole writes, so lines from
+ * different threads never interleave mid-line.
+ *
+ * A thread can hold a ScopedLogBuffer to collect its messages and write them
+ * in one go, e.g. all lines about one file. That keeps the batch workers
+ * from fighting over the console.
+ */
+
+#include <atomic>
+
+enum class LogLevel : int {
+    Error = 0,
+    Warning,
+    Info,       // Default: one line per file, summaries
+    Verbose,    // Per-entry results
+    Debug,      // Individual patch sites in the dxbc patchers
+};
+
+extern std::atomic<int> g_logLevel;
+
+inline bool LogEnabled(LogLevel level) {
+    return static_cast<int>(level) <= g_logLevel.load(std::memory_order_relaxed);
+}
+
+inline void SetLogLevel(LogLevel level) {
+    g_logLevel.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+void LogWrite(LogLevel level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+#else
+void LogWrite(LogLevel level, const char* format, ...);
+#endif
+
+// Write out anything the calling thread has buffered
+void LogFlush();
+
+// Buffers the calling thread's stdout messages until it goes out of scope.
+// Errors and warnings are still written immediately.
+class ScopedLogBuffer {
+public:
+    ScopedLogBuffer();
+    ~ScopedLogBuffer();
+
+    ScopedLogBuffer(const ScopedLogBuffer&) = delete;
+    ScopedLogBuffer& operator=(const ScopedLogBuffer&) = delete;
+};
+
+#define LOG_AT(level, ...) \
+    do { if (LogEnabled(level)) LogWrite(level, __VA_ARGS__); } while (0)
+
+#define LOG_ERROR(...)   LOG_AT(LogLevel::Error, __VA_ARGS__)
+#define LOG_WARNING(...) LOG_AT(LogLevel::Warning, __VA_ARGS__)
+#define LOG_INFO(...)    LOG_AT(LogLevel::Info, __VA_ARGS__)
+#define LOG_VERBOSE(...) LOG_AT(LogLevel::Verbose, __VA_ARGS__)
+#define LOG_DEBUG(...)   LOG_AT(LogLevel::Debug, __VA_ARGS__)
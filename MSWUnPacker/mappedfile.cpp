@@ -0,0 +1,150 @@
+/*
+ * Read-Only File Mapping
+ */
+
+#include "mappedfile.h"
+#include "platform.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+#endif
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile() : _data(nullptr), _size(0), _file(INVALID_HANDLE_VALUE), _mapping(nullptr) {}
+
+bool MappedFile::Open(const std::filesystem::path& path) {
+    Close();
+
+    _file = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                        FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER size = {};
+    if (_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(_file, &size) || size.QuadPart == 0) {
+        Close();
+        return false;
+    }
+
+    _mapping = CreateFileMappingW(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    _data = _mapping ? static_cast<const char*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+    if (!_data) {
+        Close();
+        return false;
+    }
+    _size = static_cast<uint64_t>(size.QuadPart);
+    return true;
+}
+
+void MappedFile::Close() {
+    if (_data) {
+        UnmapViewOfFile(_data);
+    }
+    if (_mapping) {
+        CloseHandle(_mapping);
+    }
+    if (_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(_file);
+    }
+    _data = nullptr;
+    _size = 0;
+    _mapping = nullptr;
+    _file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MappedFile::MappedFile() : _data(nullptr), _size(0), _fd(-1) {}
+
+bool MappedFile::Open(const std::filesystem::path& path) {
+    Close();
+
+    _fd = open(path.c_str(), O_RDONLY);
+    struct stat st = {};
+    if (_fd < 0 || fstat(_fd, &st) != 0 || st.st_size == 0) {
+        Close();
+        return false;
+    }
+
+    void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, _fd, 0);
+    if (data == MAP_FAILED) {
+        Close();
+        return false;
+    }
+    _data = static_cast<const char*>(data);
+    _size = static_cast<uint64_t>(st.st_size);
+    return true;
+}
+
+void MappedFile::Close() {
+    if (_data) {
+        munmap(const_cast<char*>(_data), static_cast<size_t>(_size));
+    }
+    if (_fd >= 0) {
+        close(_fd);
+    }
+    _data = nullptr;
+    _size = 0;
+    _fd = -1;
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+bool MappedFile::CopyTo(FILE* out, uint64_t offset, uint64_t size) const {
+    if (!_data || !Contains(offset, size)) {
+        return false;
+    }
+
+#if defined(__linux__)
+    // The kernel writes at the descriptor, so whatever the FILE has buffered goes first
+    const int64_t start = ftell64(out);
+    if (start >= 0 && fflush(out) == 0) {
+        const int outFd = fileno(out);
+        off_t inOffset = static_cast<off_t>(offset);
+        off_t outOffset = static_cast<off_t>(start);
+        uint64_t left = size;
+
+        while (left > 0) {
+            ssize_t copied = copy_file_range(_fd, &inOffset, outFd, &outOffset, static_cast<size_t>(left), 0);
+            if (copied <= 0) {
+                break;
+            }
+            left -= static_cast<uint64_t>(copied);
+        }
+
+        // Older kernels can't copy_file_range across file systems, sendfile
+        // writes at the descriptor's own offset
+        if (left > 0 && lseek(outFd, outOffset, SEEK_SET) == outOffset) {
+            while (left > 0) {
+                ssize_t copied = sendfile(outFd, _fd, &inOffset, static_cast<size_t>(left));
+                if (copied <= 0) {
+                    break;
+                }
+                left -= static_cast<uint64_t>(copied);
+            }
+        }
+
+        // Carry on after what was copied, the FILE doesn't know the kernel wrote
+        // anything. What neither call managed is written from the mapping below.
+        const uint64_t copied = size - left;
+        if (fseek64(out, start + static_cast<int64_t>(copied), SEEK_SET) != 0) {
+            return false;
+        }
+        offset += copied;
+        size = left;
+    }
+#endif
+
+    return size == 0 || fwrite(_data + offset, 1, static_cast<size_t>(size), out) == size;
+}
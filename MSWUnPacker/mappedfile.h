@@ -0,0 +1,52 @@
+#pragma once
+/*
+ * Read-Only File Mapping
+ *
+ * MappedFile maps a whole file read-only, so MSW entries can be used where
+ * they are instead of being read into buffers of their own (see
+ * CMultiShaderWrapperIO::SetMapping). CopyTo writes a range of the file to
+ * another one without passing it through user memory where the OS can:
+ * copy_file_range, then sendfile, on Linux. Elsewhere, or if both fail, it is
+ * an fwrite from the mapping.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // False if the file can't be opened or mapped (empty files can't be)
+    bool Open(const std::filesystem::path& path);
+    void Close();
+
+    bool IsOpen() const { return _data != nullptr; }
+    const char* Data() const { return _data; }
+    uint64_t Size() const { return _size; }
+
+    bool Contains(uint64_t offset, uint64_t size) const { return offset <= _size && size <= _size - offset; }
+    bool Contains(const void* data, uint64_t size) const {
+        const char* p = static_cast<const char*>(data);
+        return _data && p >= _data && Contains(static_cast<uint64_t>(p - _data), size);
+    }
+
+    // Writes size bytes from offset at out's current position and moves past
+    // them. False on a write error.
+    bool CopyTo(FILE* out, uint64_t offset, uint64_t size) const;
+
+private:
+    const char* _data;
+    uint64_t _size;
+#if defined(_WIN32)
+    void* _file;
+    void* _mapping;
+#else
+    int _fd;
+#endif
+};
@@ -0,0 +1,339 @@
+/*
+ * Allocation Statistics
+ */
+
+#include "memstats.h"
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <malloc.h>
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#include <sys/resource.h>
+#else
+#include <malloc.h>
+#include <sys/resource.h>
+#endif
+
+std::atomic<bool> g_allocStatsEnabled(false);
+
+namespace {
+
+std::atomic<uint64_t> g_allocations(0);
+std::atomic<uint64_t> g_allocatedBytes(0);
+std::atomic<int64_t> g_liveBytes(0);
+std::atomic<int64_t> g_peakLiveBytes(0);
+
+const int kCategoryCount = static_cast<int>(AllocCategory::Count);
+
+std::atomic<uint64_t> g_categoryAllocations[kCategoryCount];
+std::atomic<uint64_t> g_categoryBytes[kCategoryCount];
+
+// Plain pointers and enums, so reading them from operator new never allocates
+thread_local AllocCategory t_category = AllocCategory::Other;
+thread_local AllocRecorder* t_allocRecorder = nullptr;
+
+const char* const kCategoryNames[] = {
+    "other",
+    "io",
+    "reflection",
+    "patch",
+    "json",
+};
+
+static_assert(sizeof(kCategoryNames) / sizeof(kCategoryNames[0]) == kCategoryCount, "Missing category name");
+
+// What malloc actually handed out, so a free subtracts exactly what its
+// allocation added without keeping a header in front of every block
+size_t UsableSize(void* ptr) {
+#if defined(_WIN32)
+    return _msize(ptr);
+#elif defined(__APPLE__)
+    return malloc_size(ptr);
+#else
+    return malloc_usable_size(ptr);
+#endif
+}
+
+void RaisePeak(int64_t live) {
+    int64_t peak = g_peakLiveBytes.load(std::memory_order_relaxed);
+    while (live > peak && !g_peakLiveBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+void CountAllocation(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    g_allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+
+    int category = static_cast<int>(t_category);
+    g_categoryAllocations[category].fetch_add(1, std::memory_order_relaxed);
+    g_categoryBytes[category].fetch_add(size, std::memory_order_relaxed);
+    if (t_allocRecorder) {
+        t_allocRecorder->Add(t_category, size);
+    }
+}
+
+void* CountedAlloc(size_t size) {
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr) {
+        return nullptr;
+    }
+
+    if (AllocStatsEnabled()) {
+        CountAllocation(size);
+
+        int64_t usable = static_cast<int64_t>(UsableSize(ptr));
+        RaisePeak(g_liveBytes.fetch_add(usable, std::memory_order_relaxed) + usable);
+        if (t_allocRecorder) {
+            t_allocRecorder->AddLive(usable);
+        }
+    }
+    return ptr;
+}
+
+} // namespace
+
+void* CountedMalloc(size_t size) {
+    return CountedAlloc(size);
+}
+
+// Counted as a new allocation of the full size, the way a growing buffer
+// would be counted if it were reallocated with new[]
+void* CountedRealloc(void* ptr, size_t size) {
+    if (!ptr) {
+        return CountedAlloc(size);
+    }
+    if (!AllocStatsEnabled()) {
+        return realloc(ptr, size ? size : 1);
+    }
+
+    int64_t before = static_cast<int64_t>(UsableSize(ptr));
+    void* result = realloc(ptr, size ? size : 1);
+    if (!result) {
+        return nullptr;
+    }
+
+    CountAllocation(size);
+
+    int64_t grown = static_cast<int64_t>(UsableSize(result)) - before;
+    RaisePeak(g_liveBytes.fetch_add(grown, std::memory_order_relaxed) + grown);
+    if (t_allocRecorder) {
+        t_allocRecorder->AddLive(grown);
+    }
+    return result;
+}
+
+void CountedFree(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    if (AllocStatsEnabled()) {
+        int64_t usable = static_cast<int64_t>(UsableSize(ptr));
+        g_liveBytes.fetch_sub(usable, std::memory_order_relaxed);
+        if (t_allocRecorder) {
+            t_allocRecorder->AddLive(-usable);
+        }
+    }
+    free(ptr);
+}
+
+void EnableAllocStats(bool enable) {
+    g_allocStatsEnabled.store(enable, std::memory_order_relaxed);
+}
+
+AllocCounters AllocTotals() {
+    AllocCounters counters;
+    counters.allocations = g_allocations.load(std::memory_order_relaxed);
+    counters.bytes = g_allocatedBytes.load(std::memory_order_relaxed);
+    return counters;
+}
+
+const char* AllocCategoryName(AllocCategory category) {
+    int index = static_cast<int>(category);
+    return index >= 0 && index < kCategoryCount ? kCategoryNames[index] : "unknown";
+}
+
+AllocBreakdown::AllocBreakdown() {
+    for (AllocCounters& counters : categories) {
+        counters.allocations = 0;
+        counters.bytes = 0;
+    }
+}
+
+AllocCounters AllocBreakdown::Total() const {
+    AllocCounters total = { 0, 0 };
+    for (const AllocCounters& counters : categories) {
+        total.allocations += counters.allocations;
+        total.bytes += counters.bytes;
+    }
+    return total;
+}
+
+AllocBreakdown AllocBreakdown::Since(const AllocBreakdown& base) const {
+    AllocBreakdown delta;
+    for (int i = 0; i < kCategoryCount; i++) {
+        delta.categories[i].allocations = categories[i].allocations - base.categories[i].allocations;
+        delta.categories[i].bytes = categories[i].bytes - base.categories[i].bytes;
+    }
+    return delta;
+}
+
+AllocBreakdown AllocCategoryTotals() {
+    AllocBreakdown totals;
+    for (int i = 0; i < kCategoryCount; i++) {
+        totals.categories[i].allocations = g_categoryAllocations[i].load(std::memory_order_relaxed);
+        totals.categories[i].bytes = g_categoryBytes[i].load(std::memory_order_relaxed);
+    }
+    return totals;
+}
+
+ScopedAllocCategory::ScopedAllocCategory(AllocCategory category) : _previous(t_category) {
+    t_category = category;
+}
+
+ScopedAllocCategory::~ScopedAllocCategory() {
+    t_category = _previous;
+}
+
+AllocRecorder::AllocRecorder() : _liveBytes(0), _peakLiveBytes(0) {
+    for (int i = 0; i < kCategoryCount; i++) {
+        _allocations[i].store(0, std::memory_order_relaxed);
+        _bytes[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void AllocRecorder::Add(AllocCategory category, uint64_t bytes) {
+    int index = static_cast<int>(category);
+    _allocations[index].fetch_add(1, std::memory_order_relaxed);
+    _bytes[index].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void AllocRecorder::AddLive(int64_t bytes) {
+    int64_t live = _liveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    int64_t peak = _peakLiveBytes.load(std::memory_order_relaxed);
+    while (live > peak && !_peakLiveBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+int64_t AllocRecorder::PeakLiveBytes() const {
+    return _peakLiveBytes.load(std::memory_order_relaxed);
+}
+
+AllocBreakdown AllocRecorder::Snapshot() const {
+    AllocBreakdown breakdown;
+    for (int i = 0; i < kCategoryCount; i++) {
+        breakdown.categories[i].allocations = _allocations[i].load(std::memory_order_relaxed);
+        breakdown.categories[i].bytes = _bytes[i].load(std::memory_order_relaxed);
+    }
+    return breakdown;
+}
+
+ScopedAllocRecorder::ScopedAllocRecorder(AllocRecorder* recorder) : _previous(t_allocRecorder) {
+    t_allocRecorder = recorder;
+}
+
+ScopedAllocRecorder::~ScopedAllocRecorder() {
+    t_allocRecorder = _previous;
+}
+
+void PrintAllocTable(const AllocBreakdown& breakdown) {
+    AllocCounters total = breakdown.Total();
+
+    printf("  %-20s %12s %12s %8s\n", "Category", "Allocations", "MB", "Bytes %");
+    for (int i = 0; i < kCategoryCount; i++) {
+        const AllocCounters& row = breakdown.categories[i];
+        if (!row.allocations) continue;
+
+        printf("  %-20s %12llu %12.3f %7.1f%%\n", kCategoryNames[i], static_cast<unsigned long long>(row.allocations),
+               row.bytes / (1024.0 * 1024.0), total.bytes ? row.bytes * 100.0 / total.bytes : 0.0);
+    }
+    printf("  %-20s %12llu %12.3f\n", "total", static_cast<unsigned long long>(total.allocations),
+           total.bytes / (1024.0 * 1024.0));
+}
+
+int64_t LiveHeapBytes() {
+    return g_liveBytes.load(std::memory_order_relaxed);
+}
+
+int64_t PeakHeapBytes() {
+    return g_peakLiveBytes.load(std::memory_order_relaxed);
+}
+
+void ResetPeakHeap() {
+    g_peakLiveBytes.store(g_liveBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+uint64_t PeakResidentBytes() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters = {};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    struct rusage usage = {};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    return static_cast<uint64_t>(usage.ru_maxrss);          // Bytes
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;   // Kilobytes
+#endif
+#endif
+}
+
+// ============================================================================
+// Replacement Operators
+// ============================================================================
+
+void* operator new(size_t size) {
+    void* ptr = CountedAlloc(size);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return CountedAlloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return CountedAlloc(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    CountedFree(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    CountedFree(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    CountedFree(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    CountedFree(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    CountedFree(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    CountedFree(ptr);
+}
@@ -0,0 +1,159 @@
+#pragma once
+/*
+ * Allocation Statistics
+ *
+ * Replaces the global operator new/delete to count allocations and track the
+ * heap high-water mark while enabled (bench, convert-legacy --alloc-stats).
+ * Disabled, an allocation costs one relaxed load over plain malloc. Also
+ * reads the process peak resident set.
+ *
+ * Allocations are counted under the category of the innermost
+ * ALLOC_CATEGORY scope on the allocating thread, and additionally into the
+ * AllocRecorder the thread has been pointed at with a ScopedAllocRecorder,
+ * the same way phase samples are routed (see timings.h).
+ *
+ * The replacement operators live in memstats.cpp, they are linked into
+ * every program that calls something declared here, which includes anything
+ * using the conversion code (it marks its categories).
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+extern std::atomic<bool> g_allocStatsEnabled;
+
+inline bool AllocStatsEnabled() {
+    return g_allocStatsEnabled.load(std::memory_order_relaxed);
+}
+
+void EnableAllocStats(bool enable = true);
+
+struct AllocCounters {
+    uint64_t allocations;
+    uint64_t bytes;             // As requested, not as rounded up by malloc
+};
+
+// Everything counted since the program started
+AllocCounters AllocTotals();
+
+// ============================================================================
+// Categories
+// ============================================================================
+
+enum class AllocCategory : int {
+    Other,
+    IO,             // Reading and writing MSW, FXC and JSON files
+    Reflection,     // RDEF parsing, CB layout detection
+    Patch,          // Entry copies and the patch chain
+    Json,           // DOM, string buffers and writers
+    Count
+};
+
+const char* AllocCategoryName(AllocCategory category);
+
+struct AllocBreakdown {
+    AllocCounters categories[static_cast<int>(AllocCategory::Count)];
+
+    AllocBreakdown();
+
+    const AllocCounters& operator[](AllocCategory category) const {
+        return categories[static_cast<int>(category)];
+    }
+
+    AllocCounters Total() const;
+
+    // Counted since base was taken
+    AllocBreakdown Since(const AllocBreakdown& base) const;
+};
+
+// Everything counted since the program started, by category
+AllocBreakdown AllocCategoryTotals();
+
+// Counts allocations under category until this goes out of scope
+class ScopedAllocCategory {
+public:
+    explicit ScopedAllocCategory(AllocCategory category);
+    ~ScopedAllocCategory();
+
+    ScopedAllocCategory(const ScopedAllocCategory&) = delete;
+    ScopedAllocCategory& operator=(const ScopedAllocCategory&) = delete;
+
+private:
+    AllocCategory _previous;
+};
+
+#define ALLOC_CATEGORY_CONCAT2(a, b) a##b
+#define ALLOC_CATEGORY_CONCAT(a, b) ALLOC_CATEGORY_CONCAT2(a, b)
+#define ALLOC_CATEGORY(category) ScopedAllocCategory ALLOC_CATEGORY_CONCAT(allocCategory_, __LINE__)(category)
+
+// ============================================================================
+// Recording
+// ============================================================================
+
+// Counters for one unit of work, e.g. a file. Several threads can record
+// into the same recorder at once (the entries of one file are patched in
+// parallel).
+class AllocRecorder {
+public:
+    AllocRecorder();
+
+    void Add(AllocCategory category, uint64_t bytes);
+    AllocBreakdown Snapshot() const;
+
+    // Heap bytes allocated and freed while recording, by malloc's usable size.
+    // The peak is the most this unit of work held at once, memory it keeps
+    // from before recording started is not in it.
+    void AddLive(int64_t bytes);
+    int64_t PeakLiveBytes() const;
+
+private:
+    std::atomic<uint64_t> _allocations[static_cast<int>(AllocCategory::Count)];
+    std::atomic<uint64_t> _bytes[static_cast<int>(AllocCategory::Count)];
+    std::atomic<int64_t> _liveBytes;
+    std::atomic<int64_t> _peakLiveBytes;
+};
+
+// Send the calling thread's allocations to recorder as well until this goes
+// out of scope
+class ScopedAllocRecorder {
+public:
+    explicit ScopedAllocRecorder(AllocRecorder* recorder);
+    ~ScopedAllocRecorder();
+
+    ScopedAllocRecorder(const ScopedAllocRecorder&) = delete;
+    ScopedAllocRecorder& operator=(const ScopedAllocRecorder&) = delete;
+
+private:
+    AllocRecorder* _previous;
+};
+
+// ============================================================================
+// rapidjson
+// rapidjson allocates with malloc/realloc, these route it through the same
+// counters. Include memstats.h before any rapidjson header.
+// ============================================================================
+
+void* CountedMalloc(size_t size);
+void* CountedRealloc(void* ptr, size_t size);
+void CountedFree(void* ptr);
+
+#ifndef RAPIDJSON_MALLOC
+#define RAPIDJSON_MALLOC(size) CountedMalloc(size)
+#define RAPIDJSON_REALLOC(ptr, newSize) CountedRealloc(ptr, newSize)
+#define RAPIDJSON_FREE(ptr) CountedFree(ptr)
+#endif
+
+// Prints one row per category with allocations: count, MB, share of bytes
+void PrintAllocTable(const AllocBreakdown& breakdown);
+
+// Heap bytes allocated while enabled and not yet freed (can dip below zero
+// when memory allocated before enabling is freed)
+int64_t LiveHeapBytes();
+
+// Highest LiveHeapBytes since the last ResetPeakHeap
+int64_t PeakHeapBytes();
+void ResetPeakHeap();
+
+// Peak resident set of the process, 0 where unsupported
+uint64_t PeakResidentBytes();
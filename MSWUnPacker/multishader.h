@@ -1,8 +1,14 @@
 #pragma once
 #include <stdlib.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <vector> // this will be removed eventuallytm
 #include <string>
 #include <filesystem>
+#include "platform.h"
+#include "arena.h"
+#include "mappedfile.h"
 
 #undef DOMAIN // go away
 
@@ -19,6 +25,9 @@
 // - ShaderSet
 //   - Stores information for both of the shaders referenced by the game asset.
 //   - Ultimately points to two Shader data headers, as if the file contained two separate "Shader" MSW files.
+// - Bundle
+//   - Many shaders and shader sets in one file, with a sorted table of contents and shared shader buffers.
+//   - Read and written by BundleReader/BundleWriter (bundle.h), CMultiShaderWrapperIO only identifies it.
 
 
 // Shader files:
@@ -27,6 +36,13 @@
 // Shader Header      - MultiShaderWrapper_Shader_t       - Defines shader-specific information.
 // Shader Descriptors - MultiShaderWrapper_ShaderDesc_t[] - Describes location of individual shader files within the wrapper.
 //                                                        - Array size depends on Shader Header variable.
+//
+// Version 4 has the same layout with 64-bit offsets (the *64_t structs), for files past 4 GB.
+// The writer still produces version 3 unless a file needs them or SetFileVersion asks for 4.
+//
+// SetBufferAlignment pads so that every standard buffer starts at a multiple of the alignment
+// from the start of the file, for mapped access. Readers just follow the offsets; version 4
+// records the alignment in the shader header.
 
 namespace fs = std::filesystem;
 
@@ -37,12 +53,19 @@ namespace fs = std::filesystem;
 #define MSW_FILE_MAGIC ('M' | ('S' << 8) | ('W' << 16))
 
 // Only updated for breaking changes.
-#define MSW_FILE_VER 3
+#define MSW_FILE_VER 4
+
+// Last version with 32-bit offsets, what tools that predate version 4 load
+#define MSW_FILE_VER_32 3
+
+// Entry buffers read into memory start at a multiple of this, whatever the file's alignment
+#define MSW_BUFFER_MEMORY_ALIGNMENT 16
 
 enum class MultiShaderWrapperFileType_e : unsigned char
 {
 	SHADER = 0,
 	SHADERSET = 1,
+	BUNDLE = 2,
 };
 
 enum class MultiShaderWrapperShaderType_e : unsigned char
@@ -69,8 +92,8 @@ struct MultiShaderWrapper_ShaderSet_t
 {
 	// For R5-exported assets, these should both always be set, but in the event that a shaderset doesn't have one of the shader types,
 	// we need to make sure that the parser only tries to read valid data.
-	unsigned __int64 pixelShaderGuid;
-	unsigned __int64 vertexShaderGuid;
+	uint64_t pixelShaderGuid;
+	uint64_t vertexShaderGuid;
 
 	unsigned short numPixelShaderTextures;
 	unsigned short numVertexShaderTextures;
@@ -87,17 +110,49 @@ struct MultiShaderWrapper_ShaderSet_t
 };
 static_assert(sizeof(MultiShaderWrapper_ShaderSet_t) == 32);
 
+// Version 4
+struct MultiShaderWrapper_ShaderSet64_t
+{
+	uint64_t pixelShaderGuid;
+	uint64_t vertexShaderGuid;
+
+	unsigned short numPixelShaderTextures;
+	unsigned short numVertexShaderTextures;
+
+	unsigned short numSamplers;
+
+	unsigned char firstResourceBindPoint;
+	unsigned char numResources;
+
+	uint64_t pixelShaderOffset;
+	uint64_t vertexShaderOffset;
+};
+static_assert(sizeof(MultiShaderWrapper_ShaderSet64_t) == 40);
+
 struct MultiShaderWrapper_Shader_t
 {
 	// shaderFeatures MUST be the first member of this struct! see WriteShader.
-	unsigned __int64 shaderFeatures : 56; // Defines some shader counts.
-	unsigned __int64 numShaderDescriptors : 8;  // Number of MultiShaderWrapper_ShaderDesc_t struct instances before file data.
+	uint64_t shaderFeatures : 56; // Defines some shader counts.
+	uint64_t numShaderDescriptors : 8;  // Number of MultiShaderWrapper_ShaderDesc_t struct instances before file data.
 
 	unsigned int nameLength;
 	unsigned int nameOffset;
 };
 static_assert(sizeof(MultiShaderWrapper_Shader_t) == 16);
 
+// Version 4
+struct MultiShaderWrapper_Shader64_t
+{
+	// shaderFeatures MUST be the first member of this struct! see WriteShader.
+	uint64_t shaderFeatures : 56;
+	uint64_t numShaderDescriptors : 8;
+
+	unsigned int nameLength;
+	unsigned int bufferAlignment; // 0 if the buffers are packed back to back, see SetBufferAlignment
+	uint64_t nameOffset;
+};
+static_assert(sizeof(MultiShaderWrapper_Shader64_t) == 24);
+
 struct MultiShaderWrapper_ShaderDesc_t
 {
 	// Represents a regular shader entry. These shaders have their own file data, pointed to by the "bufferOffset" member.
@@ -126,10 +181,164 @@ struct MultiShaderWrapper_ShaderDesc_t
 		_ReferenceShader u_ref;
 	};
 
-	unsigned __int64 inputFlags[2];
+	uint64_t inputFlags[2];
 };
+static_assert(sizeof(MultiShaderWrapper_ShaderDesc_t) == 24);
+
+// Version 4, told apart the same way: a reference has a zero upper QWORD, a null entry has both set to UINT64_MAX.
+struct MultiShaderWrapper_ShaderDesc64_t
+{
+	struct _StandardShader
+	{
+		uint64_t bufferLength;
+		uint64_t bufferOffset; // Relative to the start of the descriptor
+	};
+
+	struct _ReferenceShader
+	{
+		uint64_t bufferIndex;
+		uint64_t _reserved;
+	};
+
+	union
+	{
+		_StandardShader u_standard;
+		_ReferenceShader u_ref;
+	};
+
+	uint64_t inputFlags[2];
+};
+static_assert(sizeof(MultiShaderWrapper_ShaderDesc64_t) == 32);
 #pragma pack(pop)
 
+enum class MultiShaderWrapperDescType_e : unsigned char
+{
+	STANDARD = 0,
+	REFERENCE = 1,
+	NONE = 2,
+};
+
+// Header and descriptor sizes, decoding and encoding for either version, widened to and narrowed from the
+// version 4 structs. Used by CMultiShaderWrapperIO and by readers and writers that work a piece at a time
+// (LazyMswReader, MswStreamWriter).
+
+static inline size_t MSW_ShaderSetHeaderSize(const unsigned int version)
+{
+	return version >= 4 ? sizeof(MultiShaderWrapper_ShaderSet64_t) : sizeof(MultiShaderWrapper_ShaderSet_t);
+}
+
+static inline size_t MSW_ShaderHeaderSize(const unsigned int version)
+{
+	return version >= 4 ? sizeof(MultiShaderWrapper_Shader64_t) : sizeof(MultiShaderWrapper_Shader_t);
+}
+
+static inline size_t MSW_DescriptorSize(const unsigned int version)
+{
+	return version >= 4 ? sizeof(MultiShaderWrapper_ShaderDesc64_t) : sizeof(MultiShaderWrapper_ShaderDesc_t);
+}
+
+static inline MultiShaderWrapper_ShaderSet64_t MSW_DecodeShaderSetHeader(const void* const data, const unsigned int version)
+{
+	MultiShaderWrapper_ShaderSet64_t shds = {};
+	if (version >= 4)
+	{
+		memcpy(&shds, data, sizeof(shds));
+		return shds;
+	}
+
+	// Same fields up to the offsets
+	MultiShaderWrapper_ShaderSet_t shds32 = {};
+	memcpy(&shds32, data, sizeof(shds32));
+
+	memcpy(&shds, &shds32, offsetof(MultiShaderWrapper_ShaderSet_t, pixelShaderOffset));
+	shds.pixelShaderOffset = shds32.pixelShaderOffset;
+	shds.vertexShaderOffset = shds32.vertexShaderOffset;
+	return shds;
+}
+
+static inline MultiShaderWrapper_Shader64_t MSW_DecodeShaderHeader(const void* const data, const unsigned int version)
+{
+	MultiShaderWrapper_Shader64_t shdr = {};
+	if (version >= 4)
+	{
+		memcpy(&shdr, data, sizeof(shdr));
+		return shdr;
+	}
+
+	MultiShaderWrapper_Shader_t shdr32 = {};
+	memcpy(&shdr32, data, sizeof(shdr32));
+
+	memcpy(&shdr, &shdr32, sizeof(uint64_t)); // features and descriptor count
+	shdr.nameLength = shdr32.nameLength;
+	shdr.nameOffset = shdr32.nameOffset;
+	return shdr;
+}
+
+// For STANDARD, desc.u_standard is set (bufferOffset relative to the descriptor), for REFERENCE desc.u_ref.bufferIndex.
+static inline MultiShaderWrapperDescType_e MSW_DecodeDescriptor(const void* const data, const unsigned int version,
+	MultiShaderWrapper_ShaderDesc64_t& desc)
+{
+	MultiShaderWrapperDescType_e type = MultiShaderWrapperDescType_e::STANDARD;
+	if (version >= 4)
+	{
+		memcpy(&desc, data, sizeof(desc));
+
+		if (desc.u_ref.bufferIndex == UINT64_MAX && desc.u_ref._reserved == UINT64_MAX)
+			type = MultiShaderWrapperDescType_e::NONE;
+		else if (desc.u_ref._reserved == 0 && desc.u_ref.bufferIndex != UINT64_MAX)
+			type = MultiShaderWrapperDescType_e::REFERENCE;
+		return type;
+	}
+
+	MultiShaderWrapper_ShaderDesc_t desc32 = {};
+	memcpy(&desc32, data, sizeof(desc32));
+
+	if (desc32.u_ref.bufferIndex == UINT32_MAX && desc32.u_ref._reserved == UINT32_MAX)
+		type = MultiShaderWrapperDescType_e::NONE;
+	else if (desc32.u_ref._reserved == 0 && desc32.u_ref.bufferIndex != UINT32_MAX)
+		type = MultiShaderWrapperDescType_e::REFERENCE;
+
+	desc.u_standard.bufferLength = desc32.u_standard.bufferLength;
+	desc.u_standard.bufferOffset = desc32.u_standard.bufferOffset;
+	desc.inputFlags[0] = desc32.inputFlags[0];
+	desc.inputFlags[1] = desc32.inputFlags[1];
+	return type;
+}
+
+// Writes MSW_ShaderHeaderSize(version) bytes to out
+static inline void MSW_EncodeShaderHeader(const MultiShaderWrapper_Shader64_t& shdr, const unsigned int version, void* const out)
+{
+	if (version >= 4)
+	{
+		memcpy(out, &shdr, sizeof(shdr));
+		return;
+	}
+
+	MultiShaderWrapper_Shader_t shdr32 = {};
+	memcpy(&shdr32, &shdr, sizeof(uint64_t)); // features and descriptor count
+	shdr32.nameLength = shdr.nameLength;
+	shdr32.nameOffset = static_cast<unsigned int>(shdr.nameOffset);
+	memcpy(out, &shdr32, sizeof(shdr32));
+}
+
+// Writes MSW_DescriptorSize(version) bytes to out
+static inline void MSW_EncodeDescriptor(const MultiShaderWrapper_ShaderDesc64_t& desc, const unsigned int version, void* const out)
+{
+	if (version >= 4)
+	{
+		memcpy(out, &desc, sizeof(desc));
+		return;
+	}
+
+	// The markers narrow to their 32-bit forms: UINT64_MAX to UINT32_MAX, 0 to 0
+	MultiShaderWrapper_ShaderDesc_t desc32 = {};
+	desc32.u_standard.bufferLength = static_cast<unsigned int>(desc.u_standard.bufferLength);
+	desc32.u_standard.bufferOffset = static_cast<unsigned int>(desc.u_standard.bufferOffset);
+	desc32.inputFlags[0] = desc.inputFlags[0];
+	desc32.inputFlags[1] = desc.inputFlags[1];
+	memcpy(out, &desc32, sizeof(desc32));
+}
+
 // class for handling reading/writing of MSW files from memory structures
 class CMultiShaderWrapperIO
 {
@@ -142,6 +351,7 @@ public:
 			size = 0;
 			refIndex = 0;
 			deleteBuffer = false;
+			arenaBuffer = false;
 			flags[0] = 0;
 			flags[1] = 0;
 		}
@@ -157,6 +367,7 @@ public:
 			, size(o.size)
 			, refIndex(o.refIndex)
 			, deleteBuffer(o.deleteBuffer)
+			, arenaBuffer(o.arenaBuffer)
 		{
 			flags[0] = o.flags[0];
 			flags[1] = o.flags[1];
@@ -169,19 +380,22 @@ public:
 		unsigned int size;
 		unsigned short refIndex; // if this shader entry is a reference. do not set "buffer" if this is used
 		bool deleteBuffer;
+		bool arenaBuffer; // buffer lives in the arena the file was read with, writable and freed with the arena
+		                  // (neither flag: someone else's memory, e.g. a read-only view into a SetMapping mapping)
 
-		unsigned __int64 flags[2]; // the input flags
+		uint64_t flags[2]; // the input flags
 	};
 
 	struct Shader_t
 	{
-		Shader_t() : shaderType(MultiShaderWrapperShaderType_e::INVALID), features{} {};
-		Shader_t(MultiShaderWrapperShaderType_e type) : shaderType(type), features{} {};
+		Shader_t() : shaderType(MultiShaderWrapperShaderType_e::INVALID), features{}, bufferAlignment(0) {};
+		Shader_t(MultiShaderWrapperShaderType_e type) : shaderType(type), features{}, bufferAlignment(0) {};
 
 		std::vector<ShaderEntry_t> entries;
 		std::string name;
 		MultiShaderWrapperShaderType_e shaderType;
 		unsigned char features[7];
+		unsigned int bufferAlignment; // As recorded in the file read, 0 if packed or not recorded (version 3)
 	};
 
 	struct ShaderSet_t
@@ -215,8 +429,8 @@ public:
 		Shader_t* pixelShader;
 		Shader_t* vertexShader;
 
-		unsigned __int64 pixelShaderGuid;
-		unsigned __int64 vertexShaderGuid;
+		uint64_t pixelShaderGuid;
+		uint64_t vertexShaderGuid;
 
 		unsigned short numPixelShaderTextures;
 		unsigned short numVertexShaderTextures;
@@ -234,6 +448,7 @@ public:
 		ShaderCache_t()
 			: shader(0)
 			, type(MultiShaderWrapperFileType_e::SHADER)
+			, deleteShader(false)
 		{}
 
 		~ShaderCache_t()
@@ -282,7 +497,7 @@ public:
 		writtenAnything = true;
 	}
 
-	inline void SetShaderSetHeader(const unsigned __int64 pixelShaderGuid, const unsigned __int64 vertexShaderGuid,
+	inline void SetShaderSetHeader(const uint64_t pixelShaderGuid, const uint64_t vertexShaderGuid,
 		const unsigned short numPixelShaderTextures, const unsigned short numVertexShaderTextures,
 		const unsigned short numSamplers, const unsigned char firstResourceBindPoint, const unsigned char numResources)
 	{
@@ -303,6 +518,27 @@ public:
 		_storedShaders.shaderSet = shaderSet;
 	}
 
+	// Read entry buffers into arena instead of giving each its own allocation.
+	// The arena must outlive the shaders read with it.
+	inline void SetArena(Arena* arena) { _arena = arena; }
+
+	// ReadFile points standard entries into mapping (a mapping of the file being read) instead of reading
+	// them, the entries are read-only views and the mapping must outlive them. WriteFile copies entries
+	// that still point into mapping from the mapped file to the output without reading them (MappedFile::CopyTo).
+	inline void SetMapping(const MappedFile* mapping) { _mapping = mapping; }
+
+	// 0 writes the oldest version that can hold the file: MSW_FILE_VER_32 unless an offset needs 64 bits
+	// or the buffers are aligned (only version 4 can record that). WriteFile fails instead of truncating
+	// offsets when MSW_FILE_VER_32 is requested for a file over 4 GB.
+	inline void SetFileVersion(unsigned int version) { _requestedVersion = version; }
+
+	// Start every standard buffer at a multiple of alignment (a power of two) from the start of
+	// the file, padding with zeros. 0 or 1 packs them back to back.
+	inline void SetBufferAlignment(unsigned int alignment) { _bufferAlignment = alignment > 1 ? alignment : 0; }
+
+	// Zero bytes WriteFile added for SetBufferAlignment
+	inline uint64_t GetPaddingBytes() const { return _paddingBytes; }
+
 	bool ReadFile(const char* filePath, ShaderCache_t* outCache)
 	{
 		if (!outCache)
@@ -316,11 +552,14 @@ public:
 
 			fread(&fileHeader, sizeof(fileHeader), 1, f);
 
-			//if (fileHeader.magic != MSW_FILE_MAGIC)
-			//	Error("Attempted to load an invalid MSW file (expected magic %x, got %x).\n", MSW_FILE_MAGIC, fileHeader.magic);
+			if (fileHeader.magic != MSW_FILE_MAGIC || fileHeader.version > MSW_FILE_VER)
+			{
+				fclose(f);
+				return false;
+			}
 
-			//if (fileHeader.version != MSW_FILE_VER)
-			//	Error("Attempted to load an unsupported MSW file (expected version %u, got %u).\n", MSW_FILE_VER, fileHeader.version);
+			// Older versions are read with the version 3 layout, as before version 4 existed
+			_version = fileHeader.version;
 
 			outCache->type = fileHeader.fileType;
 
@@ -335,7 +574,9 @@ public:
 			{
 				ReadShaderSet(f, outCache);
 			}
+			// bundles are left to BundleReader, only the type is reported
 
+			fclose(f);
 			return true;
 		}
 		else
@@ -344,8 +585,10 @@ public:
 
 	void ReadShaderSet(FILE* const f, ShaderCache_t* const shaderCache)
 	{
-		MultiShaderWrapper_ShaderSet_t shds;
-		fread(&shds, sizeof(shds), 1, f);
+		char header[sizeof(MultiShaderWrapper_ShaderSet64_t)] = {};
+		fread(header, MSW_ShaderSetHeaderSize(_version), 1, f);
+
+		const MultiShaderWrapper_ShaderSet64_t shds = MSW_DecodeShaderSetHeader(header, _version);
 
 		shaderCache->shaderSet.pixelShaderGuid = shds.pixelShaderGuid;
 		shaderCache->shaderSet.vertexShaderGuid = shds.vertexShaderGuid;
@@ -360,7 +603,7 @@ public:
 
 		if (shds.pixelShaderOffset)
 		{
-			fseek(f, shds.pixelShaderOffset, SEEK_SET);
+			fseek64(f, static_cast<int64_t>(shds.pixelShaderOffset), SEEK_SET);
 
 			shaderCache->shaderSet.pixelShader = new Shader_t;
 			ReadShader(f, shaderCache->shaderSet.pixelShader);
@@ -368,7 +611,7 @@ public:
 
 		if (shds.vertexShaderOffset)
 		{
-			fseek(f, shds.vertexShaderOffset, SEEK_SET);
+			fseek64(f, static_cast<int64_t>(shds.vertexShaderOffset), SEEK_SET);
 
 			shaderCache->shaderSet.vertexShader = new Shader_t;
 			ReadShader(f, shaderCache->shaderSet.vertexShader);
@@ -380,54 +623,51 @@ public:
 	// Allocate a shader before calling this
 	void ReadShader(FILE* const f, Shader_t* const shader)
 	{
-		MultiShaderWrapper_Shader_t shdr = {};
+		char header[sizeof(MultiShaderWrapper_Shader64_t)] = {};
+		fread(header, MSW_ShaderHeaderSize(_version), 1, f);
 
-		fread(&shdr, sizeof(shdr), 1, f);
+		const MultiShaderWrapper_Shader64_t shdr = MSW_DecodeShaderHeader(header, _version);
+		shader->bufferAlignment = shdr.bufferAlignment;
 
-		const size_t descStartOffset = ftell(f);
+		const int64_t descStartOffset = ftell64(f);
+		const size_t descSize = MSW_DescriptorSize(_version);
 
-		MultiShaderWrapper_ShaderDesc_t* const descriptors = new MultiShaderWrapper_ShaderDesc_t[shdr.numShaderDescriptors];
+		shader->entries.reserve(shader->entries.size() + shdr.numShaderDescriptors);
 		for (int i = 0; i < shdr.numShaderDescriptors; ++i)
 		{
-			const size_t thisDescOffset = descStartOffset + (i * sizeof(MultiShaderWrapper_ShaderDesc_t));
+			const int64_t thisDescOffset = descStartOffset + static_cast<int64_t>(i * descSize);
 
-			fseek(f, static_cast<long>(thisDescOffset), SEEK_SET);
-
-			MultiShaderWrapper_ShaderDesc_t* desc = &descriptors[i];
-			fread(desc, sizeof(MultiShaderWrapper_ShaderDesc_t), 1, f);
+			fseek64(f, thisDescOffset, SEEK_SET);
 
 			ShaderEntry_t& entry = shader->entries.emplace_back();
 
-			if (desc->u_ref.bufferIndex == UINT32_MAX && desc->u_ref._reserved == UINT32_MAX)
-			{
-				// null shader entry
-				entry.refIndex = UINT16_MAX;
-			}
-			else if (desc->u_ref._reserved == 0 && desc->u_ref.bufferIndex != UINT32_MAX)
-			{
-				entry.refIndex = static_cast<unsigned short>(desc->u_ref.bufferIndex);
-			}
-			else
+			uint64_t bufferOffset = 0;
+			if (ReadDescriptor(f, entry, bufferOffset))
 			{
+				const uint64_t bufferPos = static_cast<uint64_t>(thisDescOffset) + bufferOffset;
+				if (_mapping && _mapping->Contains(bufferPos, entry.size))
+				{
+					entry.buffer = _mapping->Data() + bufferPos;
+					entry.refIndex = UINT16_MAX;
+					continue;
+				}
+
 				// regular shader - get buffer and allocate it some new space to go into the shader entry vector
-				fseek(f, static_cast<long>(thisDescOffset + desc->u_standard.bufferOffset), SEEK_SET);
+				fseek64(f, thisDescOffset + static_cast<int64_t>(bufferOffset), SEEK_SET);
 
-				char* buffer = new char[desc->u_standard.bufferLength];
+				// operator new[] already aligns to at least MSW_BUFFER_MEMORY_ALIGNMENT on 64-bit targets
+				char* buffer = _arena ? static_cast<char*>(_arena->Allocate(entry.size, MSW_BUFFER_MEMORY_ALIGNMENT))
+				                      : new char[entry.size];
 
-				fread(buffer, sizeof(char), desc->u_standard.bufferLength, f);
+				fread(buffer, sizeof(char), entry.size, f);
 
 				entry.buffer = buffer;
-				entry.size = desc->u_standard.bufferLength;
 				entry.refIndex = UINT16_MAX;
-				entry.deleteBuffer = true;
+				entry.deleteBuffer = !_arena;
+				entry.arenaBuffer = _arena != nullptr;
 			}
-
-			entry.flags[0] = desc->inputFlags[0];
-			entry.flags[1] = desc->inputFlags[1];
 		}
 
-		delete[] descriptors;
-
 		// shader type isn't saved, so it has to be found from the shader bytecode separately
 		shader->shaderType = MultiShaderWrapperShaderType_e::INVALID;
 		memcpy(shader->features, &shdr, sizeof(shader->features));
@@ -438,12 +678,12 @@ public:
 			shader->name.resize(shdr.nameLength - 1);
 
 			// The name comes last in the shader block.
-			fseek(f, shdr.nameOffset, SEEK_SET);
+			fseek64(f, static_cast<int64_t>(shdr.nameOffset), SEEK_SET);
 			fread(shader->name.data(), shdr.nameLength, 1, f);
 		}
 	}
 
-	__forceinline bool WriteFile(const char* filePath)
+	inline bool WriteFile(const char* filePath)
 	{
 		if (!writtenAnything && (_fileType == MultiShaderWrapperFileType_e::SHADER))
 		{
@@ -451,6 +691,14 @@ public:
 			return false;
 		}
 
+		const uint64_t storedSize = GetStoredSize();
+		_version = _requestedVersion;
+		if (!_version)
+			_version = _bufferAlignment || storedSize > UINT32_MAX ? MSW_FILE_VER : MSW_FILE_VER_32;
+		else if (_version < MSW_FILE_VER && storedSize > UINT32_MAX)
+			return false; // Offsets only have 32 bits before version 4
+		_paddingBytes = 0;
+
 		FILE* f = NULL;
 
 		if (fopen_s(&f, filePath, "wb") == 0)
@@ -458,27 +706,86 @@ public:
 			MultiShaderWrapper_Header_t fileHeader =
 			{
 				.magic = MSW_FILE_MAGIC,
-				.version = MSW_FILE_VER,
+				.version = _version,
 				.fileType = this->_fileType
 			};
 
 			fwrite(&fileHeader, sizeof(MultiShaderWrapper_Header_t), 1, f);
 
+			bool ok = true;
 			if (_fileType == MultiShaderWrapperFileType_e::SHADER)
-				WriteShader(f, _storedShaders.shader);
+				ok = WriteShader(f, _storedShaders.shader);
 			else if (_fileType == MultiShaderWrapperFileType_e::SHADERSET)
-				WriteShaderSet(f);
+				ok = WriteShaderSet(f);
 
-			fclose(f);
-			return true;
+			ok = !ferror(f) && ok;
+			if (fclose(f) != 0)
+				ok = false;
+
+			// A failed copy from the mapping leaves a hole where the bytecode goes, don't leave that behind
+			if (!ok)
+				remove(filePath);
+			return ok;
 		}
 		return false;
 	}
 
+	// Version of the file last read or written
+	inline unsigned int GetFileVersion() const { return _version; }
+
 private:
-	inline void WriteShaderSet(FILE* f)
+	// Reads the descriptor at the current position into entry. True for a standard
+	// entry, with its size set and bufferOffset relative to the descriptor.
+	bool ReadDescriptor(FILE* const f, ShaderEntry_t& entry, uint64_t& bufferOffset)
+	{
+		char data[sizeof(MultiShaderWrapper_ShaderDesc64_t)] = {};
+		fread(data, MSW_DescriptorSize(_version), 1, f);
+
+		MultiShaderWrapper_ShaderDesc64_t desc = {};
+		const MultiShaderWrapperDescType_e type = MSW_DecodeDescriptor(data, _version, desc);
+
+		entry.flags[0] = desc.inputFlags[0];
+		entry.flags[1] = desc.inputFlags[1];
+
+		if (type == MultiShaderWrapperDescType_e::NONE)
+			entry.refIndex = UINT16_MAX; // null shader entry
+		else if (type == MultiShaderWrapperDescType_e::REFERENCE)
+			entry.refIndex = static_cast<unsigned short>(desc.u_ref.bufferIndex);
+		else
+		{
+			entry.size = static_cast<unsigned int>(desc.u_standard.bufferLength);
+			bufferOffset = desc.u_standard.bufferOffset;
+			return true;
+		}
+		return false;
+	}
+
+	// Upper bound of the file size WriteFile will produce, with the version 4 layout
+	uint64_t GetShaderStoredSize(const Shader_t* shader) const
 	{
-		MultiShaderWrapper_ShaderSet_t shaderSet =
+		if (!shader)
+			return 0;
+
+		uint64_t size = sizeof(MultiShaderWrapper_Shader64_t) + shader->name.length() + 1;
+		for (const ShaderEntry_t& entry : shader->entries)
+			size += sizeof(MultiShaderWrapper_ShaderDesc64_t) + (entry.buffer ? entry.size + _bufferAlignment : 0);
+		return size;
+	}
+
+	uint64_t GetStoredSize() const
+	{
+		uint64_t size = sizeof(MultiShaderWrapper_Header_t);
+		if (_fileType == MultiShaderWrapperFileType_e::SHADER)
+			size += GetShaderStoredSize(_storedShaders.shader);
+		else if (_fileType == MultiShaderWrapperFileType_e::SHADERSET)
+			size += sizeof(MultiShaderWrapper_ShaderSet64_t) + GetShaderStoredSize(_storedShaders.shaderSet.pixelShader) +
+			        GetShaderStoredSize(_storedShaders.shaderSet.vertexShader);
+		return size;
+	}
+
+	inline bool WriteShaderSet(FILE* f)
+	{
+		MultiShaderWrapper_ShaderSet64_t shaderSet =
 		{
 			.pixelShaderGuid = _storedShaders.shaderSet.pixelShaderGuid,
 			.vertexShaderGuid = _storedShaders.shaderSet.vertexShaderGuid,
@@ -495,9 +802,11 @@ private:
 			.vertexShaderOffset = 0
 		};
 
+		const size_t headerSize = _version >= 4 ? sizeof(MultiShaderWrapper_ShaderSet64_t) : sizeof(MultiShaderWrapper_ShaderSet_t);
+
 		// Skip MSW header and shader set header for later.
-		const int curPos = ftell(f);
-		fseek(f, curPos + sizeof(shaderSet), SEEK_SET);
+		const int64_t curPos = ftell64(f);
+		fseek64(f, curPos + static_cast<int64_t>(headerSize), SEEK_SET);
 
 		// note: we can write shader sets without the shaders them selfs.
 		// shader sets simply just reverence the pixel and vertex shader
@@ -505,60 +814,98 @@ private:
 		// repak will add it into the pak if its not already added.
 		if (_storedShaders.shaderSet.pixelShader)
 		{
-			shaderSet.pixelShaderOffset = ftell(f);
-			this->WriteShader(f, _storedShaders.shaderSet.pixelShader);
+			shaderSet.pixelShaderOffset = ftell64(f);
+			if (!this->WriteShader(f, _storedShaders.shaderSet.pixelShader))
+				return false;
 		}
 		if (_storedShaders.shaderSet.vertexShader)
 		{
-			shaderSet.vertexShaderOffset = ftell(f);
-			this->WriteShader(f, _storedShaders.shaderSet.vertexShader);
+			shaderSet.vertexShaderOffset = ftell64(f);
+			if (!this->WriteShader(f, _storedShaders.shaderSet.vertexShader))
+				return false;
 		}
 
 		// Store the header now.
-		fseek(f, curPos, SEEK_SET);
-		fwrite(&shaderSet, sizeof(shaderSet), 1, f);
+		fseek64(f, curPos, SEEK_SET);
+		if (_version >= 4)
+		{
+			fwrite(&shaderSet, sizeof(shaderSet), 1, f);
+		}
+		else
+		{
+			MultiShaderWrapper_ShaderSet_t shaderSet32 = {};
+			memcpy(&shaderSet32, &shaderSet, offsetof(MultiShaderWrapper_ShaderSet_t, pixelShaderOffset));
+			shaderSet32.pixelShaderOffset = static_cast<unsigned int>(shaderSet.pixelShaderOffset);
+			shaderSet32.vertexShaderOffset = static_cast<unsigned int>(shaderSet.vertexShaderOffset);
+			fwrite(&shaderSet32, sizeof(shaderSet32), 1, f);
+		}
+		return true;
 	}
 
-	inline void WriteShader(FILE* f, const Shader_t* shader)
+	// False if an entry couldn't be copied from the mapping, the file is incomplete
+	inline bool WriteShader(FILE* f, const Shader_t* shader)
 	{
 		const unsigned int nameLen = static_cast<unsigned int>(shader->name.length());
 
-		MultiShaderWrapper_Shader_t shdr =
+		MultiShaderWrapper_Shader64_t shdr =
 		{
 			.numShaderDescriptors = shader->entries.size(),
 			.nameLength = nameLen ? nameLen+1 : 0,
+			.bufferAlignment = _bufferAlignment,
 			.nameOffset = 0
 		};
 
 		// Copy to the start of the struct, since we can't copy directly to a bitfield
-		memcpy_s(&shdr, sizeof(shader->features), shader->features, sizeof(shader->features));
+		memcpy(&shdr, shader->features, sizeof(shader->features));
+
+		const size_t shdrSize = MSW_ShaderHeaderSize(_version);
+		const size_t descSize = MSW_DescriptorSize(_version);
 
-		const int headerHeaderPos = ftell(f);
-		fseek(f, sizeof(shdr), SEEK_CUR);
+		const int64_t headerHeaderPos = ftell64(f);
+		fseek64(f, static_cast<int64_t>(shdrSize), SEEK_CUR);
 
-		const size_t descStartOffset = ftell(f);
-		size_t bufferWriteOffset = descStartOffset + (shader->entries.size() * sizeof(MultiShaderWrapper_ShaderDesc_t));
+		const int64_t descStartOffset = ftell64(f);
+		int64_t bufferWriteOffset = descStartOffset + static_cast<int64_t>(shader->entries.size() * descSize);
 
 		// Skip the description structs for now, since we can write those at the same time as the buffers.
 		// Buffer writing has to come back here to set the offset, so we might as well do it all in one go!
-		fseek(f, static_cast<long>(bufferWriteOffset), SEEK_SET);
+		fseek64(f, bufferWriteOffset, SEEK_SET);
 
 		size_t entryIndex = 0;
 		for (auto& entry : shader->entries)
 		{
-			const size_t thisDescOffset = descStartOffset + (entryIndex * sizeof(MultiShaderWrapper_ShaderDesc_t));
+			const int64_t thisDescOffset = descStartOffset + static_cast<int64_t>(entryIndex * descSize);
 
-			MultiShaderWrapper_ShaderDesc_t desc = {};
+			MultiShaderWrapper_ShaderDesc64_t desc = {};
 
 			// If there is a valid buffer pointer, this entry is standard.
 			if (entry.buffer)
 			{
 				// Seek to the position of the next shader buffer to write.
-				fseek(f, static_cast<long>(bufferWriteOffset), SEEK_SET);
-				fwrite(entry.buffer, sizeof(char), entry.size, f);
+				fseek64(f, bufferWriteOffset, SEEK_SET);
+
+				if (_bufferAlignment)
+				{
+					static const char zeros[4096] = {};
+					const int64_t mask = static_cast<int64_t>(_bufferAlignment) - 1;
+					int64_t padding = ((bufferWriteOffset + mask) & ~mask) - bufferWriteOffset;
+
+					_paddingBytes += padding;
+					bufferWriteOffset += padding;
+					for (; padding > 0; padding -= sizeof(zeros))
+						fwrite(zeros, 1, static_cast<size_t>(padding < static_cast<int64_t>(sizeof(zeros)) ? padding : sizeof(zeros)), f);
+				}
+
+				if (_mapping && _mapping->Contains(entry.buffer, entry.size))
+				{
+					if (!_mapping->CopyTo(f, static_cast<uint64_t>(entry.buffer - _mapping->Data()), entry.size))
+						return false;
+				}
+				else
+					fwrite(entry.buffer, sizeof(char), entry.size, f);
 
 				// Buffer offsets are relative to the start of the desc structure, so subtract one from the other.
-				desc.u_standard.bufferOffset = static_cast<unsigned int>(bufferWriteOffset - thisDescOffset);
+				desc.u_standard.bufferOffset = static_cast<uint64_t>(bufferWriteOffset - thisDescOffset);
 				desc.u_standard.bufferLength = entry.size;
 
 				bufferWriteOffset += entry.size;
@@ -569,44 +916,55 @@ private:
 			}
 			else // If there is no valid buffer and no valid reference, this is a null entry.
 			{
-				desc.u_ref.bufferIndex = UINT32_MAX;
-				desc.u_ref._reserved = UINT32_MAX;
+				desc.u_ref.bufferIndex = UINT64_MAX;
+				desc.u_ref._reserved = UINT64_MAX;
 			}
 
 			desc.inputFlags[0] = entry.flags[0];
 			desc.inputFlags[1] = entry.flags[1];
 
-			const int bufPos = ftell(f);
+			const int64_t bufPos = ftell64(f);
 
 			// Seek back to the desc location so we can write it now that the buffer is in place 
-			fseek(f, static_cast<long>(thisDescOffset), SEEK_SET);
-			fwrite(&desc, sizeof(desc), 1, f);
+			fseek64(f, thisDescOffset, SEEK_SET);
+			char descData[sizeof(MultiShaderWrapper_ShaderDesc64_t)];
+			MSW_EncodeDescriptor(desc, _version, descData);
+			fwrite(descData, descSize, 1, f);
 
 			// Seek back to the end of the stream
-			fseek(f, bufPos, SEEK_SET);
+			fseek64(f, bufPos, SEEK_SET);
 
 			entryIndex++;
 		}
 
 		if (nameLen)
 		{
-			shdr.nameOffset = ftell(f);
+			shdr.nameOffset = ftell64(f);
 			fwrite(shader->name.c_str(), nameLen + 1, 1, f);
 		}
 
-		const int curPos = ftell(f);
+		const int64_t curPos = ftell64(f);
 
-		fseek(f, headerHeaderPos, SEEK_SET);
-		fwrite(&shdr, sizeof(shdr), 1, f);
+		fseek64(f, headerHeaderPos, SEEK_SET);
+		char shdrData[sizeof(MultiShaderWrapper_Shader64_t)];
+		MSW_EncodeShaderHeader(shdr, _version, shdrData);
+		fwrite(shdrData, shdrSize, 1, f);
 
-		fseek(f, curPos, SEEK_SET);
+		fseek64(f, curPos, SEEK_SET);
+		return true;
 	}
 
 private:
 	ShaderCache_t _storedShaders;
 
 	MultiShaderWrapperFileType_e _fileType;
-	bool writtenAnything;
+	bool writtenAnything = false;
+	Arena* _arena = nullptr;
+	const MappedFile* _mapping = nullptr;
+	unsigned int _requestedVersion = 0;
+	unsigned int _version = MSW_FILE_VER_32;
+	unsigned int _bufferAlignment = 0;
+	uint64_t _paddingBytes = 0;
 };
 
 static inline const char* MSW_TypeToString(const MultiShaderWrapperFileType_e expectType)
@@ -615,6 +973,7 @@ static inline const char* MSW_TypeToString(const MultiShaderWrapperFileType_e ex
 	{
 	case MultiShaderWrapperFileType_e::SHADER: return "shader";
 	case MultiShaderWrapperFileType_e::SHADERSET: return "shader set";
+	case MultiShaderWrapperFileType_e::BUNDLE: return "bundle";
 	}
 
 	return "unknown";
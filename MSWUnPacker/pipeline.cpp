@@ -0,0 +1,771 @@
+/*
+ * Batch Conversion Pipeline
+ *
+ * Admit:   pulls inputs from the source (possibly still being discovered)
+ *          and submits one load task per file, largest first within each
+ *          window of ready inputs, as the memory budget allows.
+ * Read:    a pool worker loads the MSW and submits one patch task per
+ *          standard entry to its own deque.
+ * Patch:   pool workers run the legacy patch chain on single entries, so a
+ *          file with many entries is spread over every core. Whoever
+ *          finishes the last entry of a file hands it to the writer.
+ * Writer:  applies the header fixups, writes the MSW and prints the results.
+ *
+ * Streaming (BatchOptions::streaming) folds read, patch and write into one
+ * task per file (StreamLegacyMsw), the writer only prints the results.
+ */
+
+#include "pipeline.h"
+#include "arena.h"
+#include "legacy.h"
+#include "log.h"
+#include "memstats.h"
+#include "timings.h"
+#include "trace.h"
+#include <condition_variable>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <cstdio>
+
+namespace {
+
+// ============================================================================
+// Memory Budget
+// Bytes held by files between the reader and the writer. The reader blocks
+// in Acquire until enough has been released; a single file larger than the
+// whole budget is still let through on its own so the batch can't stall.
+// ============================================================================
+
+class MemoryBudget {
+public:
+    explicit MemoryBudget(size_t limit) : _limit(limit), _used(0), _peak(0) {}
+
+    void Acquire(size_t bytes) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [&] { return _used == 0 || _used + bytes <= _limit; });
+
+        _used += bytes;
+        if (_used > _peak) {
+            _peak = _used;
+        }
+        TraceCounter("bytes in flight", static_cast<int64_t>(_used));
+    }
+
+    void Release(size_t bytes) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _used -= bytes;
+            TraceCounter("bytes in flight", static_cast<int64_t>(_used));
+        }
+        _cv.notify_all();
+    }
+
+    size_t Peak() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _peak;
+    }
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    size_t _limit;
+    size_t _used;
+    size_t _peak;
+};
+
+// ============================================================================
+// Arena Pool
+// Entry buffers of files that could not be mapped are read into an arena per
+// file and released all at once when the file has been written. The arenas
+// are handed from file to file, so once there is one per file in flight (the
+// memory budget bounds that) and each has grown to fit, reading a file
+// allocates nothing.
+// ============================================================================
+
+class ArenaPool {
+public:
+    ArenaPool() {}
+
+    ArenaPool(const ArenaPool&) = delete;
+    ArenaPool& operator=(const ArenaPool&) = delete;
+
+    Arena* Acquire() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_free.empty()) {
+            _all.emplace_back(new Arena(1024 * 1024));
+            return _all.back().get();
+        }
+
+        Arena* arena = _free.back();
+        _free.pop_back();
+        return arena;
+    }
+
+    void Release(Arena* arena) {
+        arena->Reset();
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _free.push_back(arena);
+    }
+
+private:
+    std::mutex _mutex;
+    std::vector<std::unique_ptr<Arena>> _all;
+    std::vector<Arena*> _free;
+};
+
+// ============================================================================
+// Jobs
+// ============================================================================
+
+struct PipelineState;
+
+struct FileJob {
+    PipelineState* state;
+    const BatchInput* input;
+    int index;                      // 1-based position in discovery order
+    size_t inputBytes;
+    size_t chargedBytes;            // Held against the memory budget until written
+
+    bool loaded;
+    Arena* arena;                   // Entry buffers, from the pool until written
+    MappedFile mapping;             // The input, unpatched entries are views into it until written
+    CMultiShaderWrapperIO::ShaderCache_t shaderCache;
+
+    // Streaming: converted and written by the load task, shaderCache stays empty
+    bool streamed;
+    LegacyStreamResult stream;
+
+    // Indexed by entry: where a view into the mapping is patched (one arena block
+    // for the file, null for entries that own their buffer), set by the read stage
+    std::vector<char*> writable;
+
+    // Indexed by entry, filled in by the patch stage
+    std::vector<LegacyPatchResult> results;
+    std::vector<dxbc::CBLayoutInfo> layouts;
+    std::atomic<int> pendingEntries;
+    std::atomic<int> failedEntry;   // First entry whose patch threw, -1 if none
+
+    // --timings: read/write phases, and the patch phases of each entry
+    PhaseSamples samples;
+    std::vector<PhaseSamples> entrySamples;
+
+    // --alloc-stats: everything the stages allocate for this file
+    AllocRecorder allocations;
+
+    // Only with an observer: entry sizes before patching, and patch times
+    std::vector<uint32_t> entryBytesIn;
+    std::vector<uint64_t> entryNanoseconds;
+
+    uint64_t startNanoseconds;
+
+    FileJob()
+        : state(nullptr), input(nullptr), index(0), inputBytes(0), chargedBytes(0), loaded(false), arena(nullptr)
+        , streamed(false), pendingEntries(0), failedEntry(-1), startNanoseconds(0)
+    {}
+};
+
+struct PipelineState {
+    std::deque<BatchInput> inputs;  // Admitted so far, jobs point into it
+    WorkStealingPool pool;
+    TaskGroup tasks;                // Load and patch tasks of every file
+    BoundedQueue<FileJob*> writeQueue;
+    MemoryBudget budget;
+    ArenaPool arenas;
+    BatchObserver* observer;
+    bool streaming;
+
+    PipelineState(const BatchOptions& options)
+        : pool(options.numWorkers)
+        , writeQueue(options.queueCapacity)
+        , budget(options.maxMemoryBytes)
+        , observer(options.observer)
+        , streaming(options.streaming)
+    {}
+};
+
+// Hands a file to the writer, loaded and fully patched (or failed)
+static void PushToWriter(PipelineState& state, FileJob* job) {
+    state.writeQueue.Push(job);
+    TraceCounter("write queue", static_cast<int64_t>(state.writeQueue.SizeApprox()));
+}
+
+// ============================================================================
+// Patch Stage
+// ============================================================================
+
+static void PatchEntry(PipelineState& state, FileJob* job, uint32_t entryIndex) {
+    CMultiShaderWrapperIO::ShaderEntry_t& entry = job->shaderCache.shader->entries[entryIndex];
+
+    // Each task writes only its own slot, the writer reads them back in entry order
+    {
+        // Patch site details (debug level) come out together per entry
+        ScopedLogBuffer logBuffer;
+        ScopedTraceSpan span("patch entry", job->input->relativePath, entryIndex);
+        ScopedPhaseRecorder recorder(job->entrySamples.empty() ? nullptr : &job->entrySamples[entryIndex]);
+        ScopedAllocRecorder allocRecorder(&job->allocations);
+
+        try {
+            if (job->entryNanoseconds.empty()) {
+                job->results[entryIndex] = PatchLegacyEntry(entry, &job->layouts[entryIndex], job->writable[entryIndex]);
+            } else {
+                uint64_t start = TimingClockNanoseconds();
+                job->results[entryIndex] = PatchLegacyEntry(entry, &job->layouts[entryIndex], job->writable[entryIndex]);
+                job->entryNanoseconds[entryIndex] = TimingClockNanoseconds() - start;
+            }
+        } catch (const std::exception& e) {
+            // The entry may be half patched, the writer fails the whole file instead of writing it
+            job->results[entryIndex] = LegacyPatchResult();
+            job->results[entryIndex].error = e.what();
+
+            int none = -1;
+            job->failedEntry.compare_exchange_strong(none, static_cast<int>(entryIndex), std::memory_order_relaxed);
+        }
+    }
+
+    // The last entry to finish, failed or not, publishes the whole file to the writer
+    if (job->pendingEntries.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        PushToWriter(state, job);
+    }
+}
+
+// ============================================================================
+// Read Stage
+// ============================================================================
+
+static void LoadFile(PipelineState& state, FileJob* job) {
+    const BatchInput& input = *job->input;
+    ScopedTraceSpan span("load file", input.relativePath);
+    job->startNanoseconds = TimingClockNanoseconds();
+    ScopedAllocRecorder allocRecorder(&job->allocations);
+
+    try {
+        ScopedPhaseRecorder recorder(&job->samples);
+        TIME_PHASE(Phase::Read);
+        ALLOC_CATEGORY(AllocCategory::IO);
+
+        job->arena = state.arenas.Acquire();
+
+        CMultiShaderWrapperIO io;
+        io.SetArena(job->arena);
+
+        // Entries are read-only views of the mapped input, PatchLegacyEntry copies the
+        // ones it patches and the writer copies the rest from file to file. Not when the
+        // output replaces the input, writing it would pull the pages out from under the views.
+        std::error_code ec;
+        if (!std::filesystem::equivalent(input.inputPath, input.outputPath, ec) && job->mapping.Open(input.inputPath)) {
+            io.SetMapping(&job->mapping);
+        }
+
+        job->loaded = io.ReadFile(input.inputPath.string().c_str(), &job->shaderCache);
+    } catch (const std::exception& e) {
+        LOG_ERROR("Error reading %s: %s\n", input.inputPath.string().c_str(), e.what());
+        job->loaded = false;
+    }
+
+    CMultiShaderWrapperIO::Shader_t* shader = nullptr;
+    if (job->loaded && job->shaderCache.type == MultiShaderWrapperFileType_e::SHADER) {
+        shader = job->shaderCache.shader;
+    }
+
+    std::vector<uint32_t> standardEntries;
+    if (shader) {
+        standardEntries.reserve(shader->entries.size());
+        job->results.resize(shader->entries.size());
+        job->layouts.resize(shader->entries.size());
+        if (TimingsEnabled()) {
+            job->entrySamples.resize(shader->entries.size());
+        }
+        if (state.observer) {
+            job->entryNanoseconds.resize(shader->entries.size());
+            job->entryBytesIn.resize(shader->entries.size());
+            for (size_t e = 0; e < shader->entries.size(); e++) {
+                job->entryBytesIn[e] = shader->entries[e].size;
+            }
+        }
+
+        for (size_t e = 0; e < shader->entries.size(); e++) {
+            if (shader->entries[e].buffer) {
+                standardEntries.push_back(static_cast<uint32_t>(e));
+            }
+        }
+
+        // Views into the mapping are patched in one block of the file's arena, a slot
+        // per entry, so the arena pool still makes patching allocation-free once warm
+        const size_t align = MSW_BUFFER_MEMORY_ALIGNMENT;
+        size_t viewBytes = 0;
+        for (uint32_t e : standardEntries) {
+            const CMultiShaderWrapperIO::ShaderEntry_t& entry = shader->entries[e];
+            if (!entry.deleteBuffer && !entry.arenaBuffer) {
+                viewBytes += (entry.size + align - 1) & ~(align - 1);
+            }
+        }
+
+        job->writable.assign(shader->entries.size(), nullptr);
+        if (viewBytes) {
+            ALLOC_CATEGORY(AllocCategory::Patch);
+            char* slot = static_cast<char*>(job->arena->Allocate(viewBytes, align));
+            for (uint32_t e : standardEntries) {
+                const CMultiShaderWrapperIO::ShaderEntry_t& entry = shader->entries[e];
+                if (!entry.deleteBuffer && !entry.arenaBuffer) {
+                    job->writable[e] = slot;
+                    slot += (entry.size + align - 1) & ~(align - 1);
+                }
+            }
+        }
+    }
+
+    if (standardEntries.empty()) {
+        // Nothing to patch (shader set, only ref/null entries, or a load failure)
+        PushToWriter(state, job);
+        return;
+    }
+
+    // These land on this worker's own deque, idle workers steal from it. The
+    // task captures no more than a job pointer and an index, small enough for
+    // std::function to store without allocating.
+    job->pendingEntries.store(static_cast<int>(standardEntries.size()), std::memory_order_relaxed);
+    for (uint32_t entryIndex : standardEntries) {
+        state.pool.Submit(state.tasks, [job, entryIndex]() {
+            PatchEntry(*job->state, job, entryIndex);
+        });
+    }
+}
+
+// Streaming: the whole conversion in this task, the writer only reports it
+static void StreamFile(PipelineState& state, FileJob* job) {
+    const BatchInput& input = *job->input;
+
+    // Writing the output would truncate the input under the reader. The whole-file
+    // path reads it all before anything is written, and doesn't map it in this case.
+    std::error_code equivalentEc;
+    if (std::filesystem::equivalent(input.inputPath, input.outputPath, equivalentEc)) {
+        LoadFile(state, job);
+        return;
+    }
+
+    ScopedTraceSpan span("stream file", input.relativePath);
+    job->startNanoseconds = TimingClockNanoseconds();
+    ScopedAllocRecorder allocRecorder(&job->allocations);
+    job->streamed = true;
+
+    try {
+        ScopedPhaseRecorder recorder(&job->samples);
+
+        // Recursive batches mirror the input tree
+        std::error_code ec;
+        if (input.outputPath.has_parent_path()) {
+            std::filesystem::create_directories(input.outputPath.parent_path(), ec);
+        }
+        job->loaded = StreamLegacyMsw(input.inputPath, input.outputPath, job->stream);
+    } catch (const std::exception& e) {
+        LOG_ERROR("Error converting %s: %s\n", input.inputPath.string().c_str(), e.what());
+        job->stream.error = e.what();
+        job->loaded = false;
+    }
+
+    // Per-entry results go where the writer and observer look for them
+    job->results.resize(job->stream.entries.size());
+    job->layouts.resize(job->stream.entries.size());
+    for (size_t e = 0; e < job->stream.entries.size(); e++) {
+        job->results[e] = job->stream.entries[e].patch;
+        job->layouts[e] = job->stream.entries[e].layout;
+    }
+
+    PushToWriter(state, job);
+}
+
+// Submits one load task per file, largest file first so the big ones don't
+// end up as the long tail of the batch. Inputs that are still being
+// discovered are ordered within each window of what has arrived so far.
+// Blocks on the memory budget.
+static void AdmitFiles(BatchInputSource& source, PipelineState& state, size_t orderWindow) {
+    struct Pending {
+        const BatchInput* input;
+        int index;
+        size_t size;
+    };
+
+    std::vector<Pending> window;
+    BatchInput input;
+
+    while (source.Next(input)) {
+        window.clear();
+
+        // Take whatever else is ready without waiting for discovery
+        for (;;) {
+            BatchInput& stored = state.inputs.emplace_back(std::move(input));
+
+            std::error_code ec;
+            uintmax_t fileSize = std::filesystem::file_size(stored.inputPath, ec);
+            window.push_back(Pending{ &stored, static_cast<int>(state.inputs.size()), ec ? 0 : static_cast<size_t>(fileSize) });
+
+            if (window.size() >= orderWindow || !source.TryNext(input)) {
+                break;
+            }
+        }
+
+        std::stable_sort(window.begin(), window.end(), [](const Pending& a, const Pending& b) {
+            return a.size > b.size;
+        });
+
+        for (const Pending& pending : window) {
+            FileJob* job = new FileJob;
+            job->state = &state;
+            job->input = pending.input;
+            job->index = pending.index;
+            job->inputBytes = pending.size;
+
+            if (state.streaming) {
+                state.pool.Submit(state.tasks, [&state, job]() {
+                    StreamFile(state, job);
+                });
+                continue;
+            }
+
+            // Backpressure: wait for the writer to free up memory before loading more
+            job->chargedBytes = pending.size;
+            state.budget.Acquire(job->chargedBytes);
+
+            state.pool.Submit(state.tasks, [&state, job]() {
+                LoadFile(state, job);
+            });
+        }
+    }
+}
+
+// ============================================================================
+// Writer Stage
+// ============================================================================
+
+// Counts, CB swap errors and the summary line of a shader's entries, in entry
+// order. kindOf(i) tells what entry i is, job->results and job->layouts hold
+// the standard entries' patch results.
+template <typename KindOf>
+static void ReportEntries(const FileJob* job, size_t entryCount, KindOf kindOf, const char* progress,
+                          const std::string& displayName, BatchFileResult& fileResult) {
+    int standardCount = 0;
+    int refCount = 0;
+    int nullCount = 0;
+    int patchedCount = 0;
+
+    for (size_t i = 0; i < entryCount; i++) {
+        const BatchEntryKind kind = kindOf(i);
+        if (kind != BatchEntryKind::Standard) {
+            if (kind == BatchEntryKind::Reference) {
+                refCount++;
+            } else {
+                nullCount++;
+            }
+            continue;
+        }
+
+        standardCount++;
+
+        const LegacyPatchResult& result = job->results[i];
+        if (!result.error.empty()) {
+            LOG_ERROR("%s %s: [entry %zu] CB Swap Error: %s\n", progress, displayName.c_str(), i, result.error.c_str());
+        }
+        if (result.wasPatched) {
+            patchedCount++;
+        }
+    }
+
+    LOG_INFO("%s %s: %zu entries (%d standard, %d reference, %d null), %d patched\n",
+             progress, displayName.c_str(), entryCount,
+             standardCount, refCount, nullCount, patchedCount);
+
+    // Report in entry order regardless of which worker finished first
+    if (LogEnabled(LogLevel::Verbose)) {
+        for (size_t i = 0; i < entryCount; i++) {
+            if (kindOf(i) != BatchEntryKind::Standard || !job->results[i].wasPatched) continue;
+
+            const dxbc::CBLayoutInfo& layoutInfo = job->layouts[i];
+            LOG_VERBOSE("  [entry %zu] %s\n", i,
+                        layoutInfo.needsSwap ? layoutInfo.reason : "Patches applied (S7 layout, no CB swap)");
+            PrintLegacyPatchSummary(job->results[i]);
+        }
+    }
+
+    fileResult.entryCount = static_cast<int>(entryCount);
+    fileResult.standardCount = standardCount;
+    fileResult.referenceCount = refCount;
+    fileResult.nullCount = nullCount;
+    fileResult.patchedCount = patchedCount;
+}
+
+static BatchEntryKind StreamEntryKind(const LegacyStreamEntry& entry) {
+    if (entry.type == MultiShaderWrapperDescType_e::STANDARD) {
+        return BatchEntryKind::Standard;
+    }
+    return entry.type == MultiShaderWrapperDescType_e::REFERENCE ? BatchEntryKind::Reference : BatchEntryKind::Null;
+}
+
+// The streamed file is already written, only its results are left to report
+static bool ReportStreamedJob(FileJob* job, const char* progress, const std::string& displayName,
+                              BatchFileResult& fileResult) {
+    const BatchInput& input = *job->input;
+    const LegacyStreamResult& stream = job->stream;
+
+    if (!job->loaded) {
+        fileResult.error = stream.error.empty() ? "Failed to load MSW file" : stream.error;
+        LOG_ERROR("%s %s: Error: %s (\"%s\")\n", progress, displayName.c_str(), fileResult.error.c_str(),
+                  input.inputPath.string().c_str());
+        return false;
+    }
+
+    if (stream.type == MultiShaderWrapperFileType_e::SHADERSET) {
+        LOG_INFO("%s %s: shader set (header only)\n", progress, displayName.c_str());
+
+        std::error_code ec;
+        uintmax_t bytesOut = std::filesystem::file_size(input.outputPath, ec);
+        fileResult.bytesOut = ec ? 0 : static_cast<uint64_t>(bytesOut);
+    } else {
+        ReportEntries(job, stream.entries.size(), [&](size_t i) { return StreamEntryKind(stream.entries[i]); },
+                      progress, displayName, fileResult);
+        LOG_VERBOSE("  Largest entry: %u bytes\n", stream.largestEntry);
+        fileResult.bytesOut = stream.bytesOut;
+    }
+
+    LOG_VERBOSE("  Output: %s\n", input.outputPath.string().c_str());
+    return true;
+}
+
+static bool WriteJob(FileJob* job, int totalCount, BatchFileResult& fileResult) {
+    const BatchInput& input = *job->input;
+    std::string displayName = input.relativePath.empty() ? input.inputPath.filename().string() : input.relativePath;
+
+    // The total isn't known yet while inputs are still being discovered
+    char progress[32];
+    if (totalCount >= 0) {
+        snprintf(progress, sizeof(progress), "[%d/%d]", job->index, totalCount);
+    } else {
+        snprintf(progress, sizeof(progress), "[%d]", job->index);
+    }
+
+    fileResult.bytesIn = job->inputBytes;
+
+    if (job->streamed) {
+        return ReportStreamedJob(job, progress, displayName, fileResult);
+    }
+
+    if (!job->loaded) {
+        fileResult.error = "Failed to load MSW file";
+        LOG_ERROR("%s %s: Error: Failed to load MSW file \"%s\"\n", progress, displayName.c_str(),
+                  input.inputPath.string().c_str());
+        return false;
+    }
+
+    int failedEntry = job->failedEntry.load(std::memory_order_relaxed);
+    if (failedEntry >= 0) {
+        fileResult.error = "Failed to patch entry " + std::to_string(failedEntry) + ": " + job->results[failedEntry].error;
+        LOG_ERROR("%s %s: Error: %s\n", progress, displayName.c_str(), fileResult.error.c_str());
+        return false;
+    }
+
+    if (job->shaderCache.type == MultiShaderWrapperFileType_e::SHADER) {
+        CMultiShaderWrapperIO::Shader_t* shader = job->shaderCache.shader;
+
+        ReportEntries(job, shader->entries.size(), [&](size_t i) {
+            const CMultiShaderWrapperIO::ShaderEntry_t& entry = shader->entries[i];
+            if (entry.buffer) {
+                return BatchEntryKind::Standard;
+            }
+            return entry.refIndex != UINT16_MAX ? BatchEntryKind::Reference : BatchEntryKind::Null;
+        }, progress, displayName, fileResult);
+
+        FinalizeLegacyShader(shader, input.inputPath);
+    } else if (job->shaderCache.type == MultiShaderWrapperFileType_e::SHADERSET) {
+        LOG_INFO("%s %s: shader set (header only)\n", progress, displayName.c_str());
+    } else if (job->shaderCache.type == MultiShaderWrapperFileType_e::BUNDLE) {
+        fileResult.error = "MSW bundle, write its shaders out with pack --from-bundle first";
+        LOG_ERROR("%s %s: Error: %s\n", progress, displayName.c_str(), fileResult.error.c_str());
+        return false;
+    } else {
+        fileResult.error = "Unknown MSW file type " + std::to_string(static_cast<int>(job->shaderCache.type));
+        LOG_ERROR("%s %s: Error: %s\n", progress, displayName.c_str(), fileResult.error.c_str());
+        return false;
+    }
+
+    // Recursive batches mirror the input tree
+    std::error_code ec;
+    if (input.outputPath.has_parent_path()) {
+        std::filesystem::create_directories(input.outputPath.parent_path(), ec);
+    }
+
+    if (!WriteLegacyMsw(job->shaderCache, input.outputPath, job->mapping.IsOpen() ? &job->mapping : nullptr)) {
+        fileResult.error = "Could not write " + input.outputPath.string();
+        LOG_ERROR("%s %s: Error: %s\n", progress, displayName.c_str(), fileResult.error.c_str());
+        return false;
+    }
+
+    uintmax_t bytesOut = std::filesystem::file_size(input.outputPath, ec);
+    fileResult.bytesOut = ec ? 0 : static_cast<uint64_t>(bytesOut);
+
+    LOG_VERBOSE("  Output: %s\n", input.outputPath.string().c_str());
+    return true;
+}
+
+static void NotifyObserver(BatchObserver* observer, FileJob* job, const BatchFileResult& fileResult) {
+    std::vector<BatchEntryResult> entries;
+
+    if (job->streamed && job->loaded) {
+        entries.resize(job->stream.entries.size());
+        for (size_t i = 0; i < job->stream.entries.size(); i++) {
+            const LegacyStreamEntry& entry = job->stream.entries[i];
+            BatchEntryResult& entryResult = entries[i];
+
+            // Patches never change the size of the bytecode
+            entryResult.kind = StreamEntryKind(entry);
+            entryResult.refIndex = entry.refIndex;
+            entryResult.bytesIn = entryResult.kind == BatchEntryKind::Standard ? entry.size : 0;
+            entryResult.bytesOut = entryResult.bytesIn;
+            entryResult.needsSwap = entry.layout.needsSwap;
+            entryResult.patchNanoseconds = entry.patchNanoseconds;
+            entryResult.patch = entry.patch;
+        }
+    } else if (!job->streamed && job->loaded && job->shaderCache.type == MultiShaderWrapperFileType_e::SHADER) {
+        const CMultiShaderWrapperIO::Shader_t* shader = job->shaderCache.shader;
+        entries.resize(shader->entries.size());
+
+        for (size_t i = 0; i < shader->entries.size(); i++) {
+            const CMultiShaderWrapperIO::ShaderEntry_t& entry = shader->entries[i];
+            BatchEntryResult& entryResult = entries[i];
+
+            entryResult.refIndex = entry.refIndex;
+            entryResult.bytesIn = 0;
+            entryResult.bytesOut = 0;
+            entryResult.needsSwap = false;
+            entryResult.patchNanoseconds = 0;
+            entryResult.patch = LegacyPatchResult();
+
+            if (!entry.buffer) {
+                entryResult.kind = entry.refIndex != UINT16_MAX ? BatchEntryKind::Reference : BatchEntryKind::Null;
+                continue;
+            }
+
+            entryResult.kind = BatchEntryKind::Standard;
+            entryResult.bytesIn = job->entryBytesIn[i];
+            entryResult.bytesOut = entry.size;
+            entryResult.needsSwap = job->layouts[i].needsSwap;
+            entryResult.patchNanoseconds = job->entryNanoseconds[i];
+            entryResult.patch = job->results[i];
+        }
+    }
+
+    observer->FileDone(job->index, *job->input, fileResult, entries);
+}
+
+static void WriterStage(PipelineState& state, int totalCount, BatchResult& result) {
+    FileJob* job = nullptr;
+    PhaseHistogram batchTimings;
+
+    TraceSetThreadName("writer");
+
+    while (state.writeQueue.Pop(job)) {
+        bool ok = false;
+        ScopedTraceSpan span("write file", job->input->relativePath);
+        TraceCounter("write queue", static_cast<int64_t>(state.writeQueue.SizeApprox()));
+
+        // Only this thread touches result until the batch is done
+        if (result.files.size() < static_cast<size_t>(job->index)) {
+            result.files.resize(job->index);
+        }
+        BatchFileResult& fileResult = result.files[job->index - 1];
+
+        try {
+            // Everything about one file is written to the console in one piece
+            ScopedLogBuffer logBuffer;
+            ScopedPhaseRecorder recorder(&job->samples);
+            ScopedAllocRecorder allocRecorder(&job->allocations);
+            ok = WriteJob(job, totalCount, fileResult);
+        } catch (const std::exception& e) {
+            fileResult.error = e.what();
+            LOG_ERROR("Error: %s: %s\n", job->input->inputPath.string().c_str(), e.what());
+        }
+
+        fileResult.converted = ok;
+        fileResult.seconds = (TimingClockNanoseconds() - job->startNanoseconds) / 1e9;
+
+        if (TimingsEnabled()) {
+            for (const PhaseSamples& entrySamples : job->entrySamples) {
+                job->samples.insert(job->samples.end(), entrySamples.begin(), entrySamples.end());
+            }
+            fileResult.phaseStats = SummarizePhases(job->samples);
+            batchTimings.Add(job->samples);
+        }
+        if (AllocStatsEnabled()) {
+            fileResult.allocations = job->allocations.Snapshot();
+            fileResult.peakHeapBytes = job->allocations.PeakLiveBytes();
+        }
+        if (ok) {
+            result.convertedCount++;
+        } else {
+            result.failedCount++;
+        }
+
+        if (state.observer) {
+            NotifyObserver(state.observer, job, fileResult);
+        }
+
+        // Dropping the job frees its entry buffers, let the reader continue
+        size_t chargedBytes = job->chargedBytes;
+        Arena* arena = job->arena;
+        delete job;
+        if (arena) {
+            state.arenas.Release(arena);
+        }
+        state.budget.Release(chargedBytes);
+    }
+
+    result.phaseStats = batchTimings.Summarize();
+}
+
+} // namespace
+
+// ============================================================================
+// Entry Point
+// ============================================================================
+
+BatchResult RunLegacyBatch(BatchInputSource& source, const BatchOptions& options, int knownTotal) {
+    BatchResult result;
+    PipelineState state(options);
+
+    AllocBreakdown allocationsBefore = AllocCategoryTotals();
+    auto startTime = std::chrono::steady_clock::now();
+
+    std::thread writer(WriterStage, std::ref(state), knownTotal, std::ref(result));
+
+    AdmitFiles(source, state, options.orderWindow > 0 ? options.orderWindow : 1);
+
+    // Every file has been submitted, wait for the last load and patch tasks
+    state.pool.Wait(state.tasks);
+
+    // Both producers of the write queue are done
+    state.writeQueue.Close();
+    writer.join();
+
+    state.pool.Shutdown();
+    result.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    result.workerStats = state.pool.GetStats();
+    result.peakBytesInFlight = state.budget.Peak();
+    if (AllocStatsEnabled()) {
+        result.allocations = AllocCategoryTotals().Since(allocationsBefore);
+        result.peakResidentBytes = PeakResidentBytes();
+    }
+
+    result.totalCount = static_cast<int>(state.inputs.size());
+    result.inputs.assign(state.inputs.begin(), state.inputs.end());
+    result.files.resize(state.inputs.size());
+    return result;
+}
+
+BatchResult RunLegacyBatch(const std::vector<BatchInput>& inputs, const BatchOptions& options) {
+    // Everything is known up front, so order the whole list in one window
+    BatchOptions batchOptions = options;
+    batchOptions.orderWindow = inputs.size();
+
+    VectorInputSource source(inputs);
+    return RunLegacyBatch(source, batchOptions, static_cast<int>(inputs.size()));
+}
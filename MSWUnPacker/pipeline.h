@@ -0,0 +1,310 @@
+#pragma once
+/*
+ * Batch Conversion Pipeline
+ *
+ * Runs convert-legacy over many MSW files as three overlapping stages:
+ *   load (one task per file) -> patch (one task per shader entry) -> writer
+ * Load and patch tasks run on a work-stealing pool, largest files first, and
+ * finished files reach the writer through a bounded lock-free queue. A memory budget on the files in
+ * flight makes the reader wait when the later stages fall behind.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <filesystem>
+#include "scheduler.h"
+#include "timings.h"
+#include "memstats.h"
+#include "legacy.h"
+
+// ============================================================================
+// Bounded Lock-Free Queue
+// Multi-producer/multi-consumer ring buffer (Vyukov). Each cell carries a
+// sequence number that tells producers and consumers whose turn it is, so
+// TryPush/TryPop never take a lock.
+// ============================================================================
+
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) {
+        // Capacity must be a power of two so the index can be masked
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+
+        _mask = size - 1;
+        _cells.reset(new Cell[size]);
+        for (size_t i = 0; i < size; i++) {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        _enqueuePos.store(0, std::memory_order_relaxed);
+        _dequeuePos.store(0, std::memory_order_relaxed);
+        _closed.store(false, std::memory_order_relaxed);
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    bool TryPush(T& value) {
+        size_t pos = _enqueuePos.load(std::memory_order_relaxed);
+
+        for (;;) {
+            Cell& cell = _cells[pos & _mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+
+            if (diff == 0) {
+                if (_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // Full
+            } else {
+                pos = _enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool TryPop(T& value) {
+        size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+
+        for (;;) {
+            Cell& cell = _cells[pos & _mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+
+            if (diff == 0) {
+                if (_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.value);
+                    cell.sequence.store(pos + _mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // Empty
+            } else {
+                pos = _dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Blocking push, backs off while the queue is full
+    void Push(T value) {
+        for (int spins = 0; !TryPush(value); spins++) {
+            Backoff(spins);
+        }
+    }
+
+    // Blocking pop. Returns false once the queue is closed and drained.
+    bool Pop(T& value) {
+        for (int spins = 0; ; spins++) {
+            if (TryPop(value)) {
+                return true;
+            }
+
+            if (_closed.load(std::memory_order_acquire)) {
+                // Producers are done, anything pushed before Close() is visible now
+                return TryPop(value);
+            }
+
+            Backoff(spins);
+        }
+    }
+
+    // Called once all producers have finished pushing
+    void Close() { _closed.store(true, std::memory_order_release); }
+
+    size_t SizeApprox() const {
+        size_t enq = _enqueuePos.load(std::memory_order_relaxed);
+        size_t deq = _dequeuePos.load(std::memory_order_relaxed);
+        return enq > deq ? enq - deq : 0;
+    }
+
+private:
+    static void Backoff(int spins) {
+        if (spins < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    // Keep the producer and consumer cursors on separate cache lines
+    alignas(64) std::atomic<size_t> _enqueuePos;
+    alignas(64) std::atomic<size_t> _dequeuePos;
+    alignas(64) std::atomic<bool> _closed;
+
+    std::unique_ptr<Cell[]> _cells;
+    size_t _mask;
+};
+
+// ============================================================================
+// Batch Conversion
+// ============================================================================
+
+class BatchObserver;
+
+struct BatchOptions {
+    int numWorkers;             // Pool threads, 0 = one per hardware thread
+    size_t maxMemoryBytes;      // Cap on bytes held by files in flight
+    size_t queueCapacity;       // Slots in the write queue
+    size_t orderWindow;         // Discovered inputs sorted by size together
+    BatchObserver* observer;    // Optional, gets every file with per-entry details
+    bool streaming;             // One task per file through StreamLegacyMsw, see RunLegacyBatch
+
+    BatchOptions()
+        : numWorkers(0)
+        , maxMemoryBytes(512ull * 1024 * 1024)
+        , queueCapacity(256)
+        , orderWindow(1024)
+        , observer(nullptr)
+        , streaming(false)
+    {}
+};
+
+struct BatchInput {
+    std::filesystem::path inputPath;
+    std::filesystem::path outputPath;
+    std::string relativePath;   // '/'-separated, relative to the batch root
+};
+
+// Supplies the inputs of a batch, possibly while they are still being found
+class BatchInputSource {
+public:
+    virtual ~BatchInputSource() {}
+
+    // Wait for the next input. Returns false once there are no more.
+    virtual bool Next(BatchInput& input) = 0;
+
+    // Next input only if one is ready right now
+    virtual bool TryNext(BatchInput& input) = 0;
+};
+
+class VectorInputSource : public BatchInputSource {
+public:
+    explicit VectorInputSource(const std::vector<BatchInput>& inputs) : _inputs(inputs), _next(0) {}
+
+    bool Next(BatchInput& input) override { return TryNext(input); }
+
+    bool TryNext(BatchInput& input) override {
+        if (_next >= _inputs.size()) {
+            return false;
+        }
+        input = _inputs[_next++];
+        return true;
+    }
+
+private:
+    const std::vector<BatchInput>& _inputs;
+    size_t _next;
+};
+
+struct BatchFileResult {
+    bool converted;
+    int entryCount;
+    int standardCount;
+    int referenceCount;
+    int nullCount;
+    int patchedCount;
+    uint64_t bytesIn;                       // Input file size
+    uint64_t bytesOut;                      // Output file size, 0 if nothing was written
+    double seconds;                         // From the start of the read until written
+    std::string error;                      // Why the file failed
+    std::vector<PhaseStats> phaseStats;     // --timings only
+    AllocBreakdown allocations;             // --alloc-stats only, by this file's read, patch and write
+    int64_t peakHeapBytes;                  // --alloc-stats only, most heap this file's read, patch and write held at once
+
+    BatchFileResult()
+        : converted(false)
+        , entryCount(0)
+        , standardCount(0)
+        , referenceCount(0)
+        , nullCount(0)
+        , patchedCount(0)
+        , bytesIn(0)
+        , bytesOut(0)
+        , seconds(0.0)
+        , peakHeapBytes(0)
+    {}
+};
+
+enum class BatchEntryKind {
+    Standard,
+    Reference,
+    Null
+};
+
+struct BatchEntryResult {
+    BatchEntryKind kind;
+    uint16_t refIndex;              // Reference entries only
+    uint32_t bytesIn;               // Standard entries, before and after patching
+    uint32_t bytesOut;
+    bool needsSwap;                 // S9 CB layout detected
+    uint64_t patchNanoseconds;
+    LegacyPatchResult patch;
+};
+
+// Sees every file as the writer finishes it, in completion order. Called on
+// the writer thread only, so implementations need no locking.
+class BatchObserver {
+public:
+    virtual ~BatchObserver() {}
+
+    // entries is empty for files that failed to load and for shader sets
+    virtual void FileDone(int index, const BatchInput& input, const BatchFileResult& file,
+                          const std::vector<BatchEntryResult>& entries) = 0;
+};
+
+struct BatchResult {
+    int totalCount;
+    int convertedCount;
+    int failedCount;
+    size_t peakBytesInFlight;
+    double elapsedSeconds;
+    std::vector<WorkerStats> workerStats;
+    std::vector<BatchInput> inputs;         // In the order they were found
+    std::vector<BatchFileResult> files;     // Indexed like inputs
+    std::vector<PhaseStats> phaseStats;     // --timings only, over all files
+    AllocBreakdown allocations;             // --alloc-stats only, everything allocated during the batch
+    uint64_t peakResidentBytes;             // --alloc-stats only
+
+    BatchResult()
+        : totalCount(0)
+        , convertedCount(0)
+        , failedCount(0)
+        , peakBytesInFlight(0)
+        , elapsedSeconds(0.0)
+        , peakResidentBytes(0)
+    {}
+};
+
+// Convert every input to legacy format. Outputs are written as files complete,
+// which is not necessarily input order. Per-entry results are always reported
+// in entry order, whichever worker patched them.
+//
+// With options.streaming each file is read, patched and written by a single
+// task, an entry at a time, instead of being loaded whole and patched entry by
+// entry across workers. A worker then holds at most a couple of copies of the
+// file's largest entry, so the memory budget is not charged; the parallelism
+// comes from converting numWorkers files at once.
+BatchResult RunLegacyBatch(const std::vector<BatchInput>& inputs, const BatchOptions& options);
+
+// Same, pulling inputs from source as they become available. Pass knownTotal
+// if the number of inputs is known, progress is printed without it otherwise.
+BatchResult RunLegacyBatch(BatchInputSource& source, const BatchOptions& options, int knownTotal = -1);
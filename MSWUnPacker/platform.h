@@ -0,0 +1,37 @@
+#pragma once
+/*
+ * Platform Compatibility
+ *
+ * The MSVC CRT functions the tool uses, for GCC and Clang builds, and 64-bit
+ * file positions (long, which fseek/ftell use, is 32 bits on Windows).
+ */
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#ifndef _MSC_VER
+#include <sys/types.h>
+#endif
+
+#ifndef _MSC_VER
+inline int fopen_s(FILE** file, const char* path, const char* mode) {
+    *file = fopen(path, mode);
+    return *file ? 0 : errno;
+}
+#endif
+
+inline int fseek64(FILE* file, int64_t offset, int origin) {
+#ifdef _MSC_VER
+    return _fseeki64(file, offset, origin);
+#else
+    return fseeko(file, static_cast<off_t>(offset), origin);
+#endif
+}
+
+inline int64_t ftell64(FILE* file) {
+#ifdef _MSC_VER
+    return _ftelli64(file);
+#else
+    return static_cast<int64_t>(ftello(file));
+#endif
+}
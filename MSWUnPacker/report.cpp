@@ -0,0 +1,332 @@
+/*
+ * Batch Metrics Report (--report)
+ */
+
+#include "report.h"
+#include "memstats.h"
+#include "platform.h"
+#include <cstdio>
+#include <vector>
+#define RAPIDJSON_HAS_STDSTRING 1
+#include "rapidjson/writer.h"
+#include "rapidjson/filewritestream.h"
+
+namespace {
+
+typedef rapidjson::Writer<rapidjson::FileWriteStream> ReportWriter;
+
+// Same counters and names as the "Patched: ..." summary line
+struct PatchTotals {
+    uint64_t shex;
+    uint64_t rdef;
+    uint64_t srv;
+    uint64_t clt;
+    uint64_t ubr;
+    uint64_t bit1;
+    uint64_t sun;
+    uint64_t shdw;
+
+    PatchTotals() : shex(0), rdef(0), srv(0), clt(0), ubr(0), bit1(0), sun(0), shdw(0) {}
+
+    void Add(const LegacyPatchResult& result) {
+        shex += result.shexPatches;
+        rdef += result.rdefPatches;
+        srv += result.srvPatches;
+        clt += result.clusteredLightingPatches;
+        ubr += result.uberFlagsPatches;
+        bit1 += result.featureFlagBit1Patches;
+        sun += result.sunDataPatches;
+        shdw += result.shadowBlendPatches;
+    }
+
+    void Add(const PatchTotals& other) {
+        shex += other.shex;
+        rdef += other.rdef;
+        srv += other.srv;
+        clt += other.clt;
+        ubr += other.ubr;
+        bit1 += other.bit1;
+        sun += other.sun;
+        shdw += other.shdw;
+    }
+
+    void Write(ReportWriter& writer) const {
+        writer.StartObject();
+        writer.Key("shex"); writer.Uint64(shex);
+        writer.Key("rdef"); writer.Uint64(rdef);
+        writer.Key("srv"); writer.Uint64(srv);
+        writer.Key("clt"); writer.Uint64(clt);
+        writer.Key("ubr"); writer.Uint64(ubr);
+        writer.Key("bit1"); writer.Uint64(bit1);
+        writer.Key("sun"); writer.Uint64(sun);
+        writer.Key("shdw"); writer.Uint64(shdw);
+        writer.EndObject();
+    }
+};
+
+const char* EntryKindName(BatchEntryKind kind) {
+    switch (kind) {
+    case BatchEntryKind::Standard:  return "standard";
+    case BatchEntryKind::Reference: return "reference";
+    default:                        return "null";
+    }
+}
+
+void WritePhases(ReportWriter& writer, const std::vector<PhaseStats>& phases) {
+    writer.StartArray();
+    for (const PhaseStats& row : phases) {
+        writer.StartObject();
+        writer.Key("phase"); writer.String(PhaseName(row.phase));
+        writer.Key("count"); writer.Uint64(row.count);
+        writer.Key("totalNs"); writer.Uint64(row.totalNanoseconds);
+        writer.Key("p50Ns"); writer.Uint64(row.p50Nanoseconds);
+        writer.Key("p99Ns"); writer.Uint64(row.p99Nanoseconds);
+        writer.Key("maxNs"); writer.Uint64(row.maxNanoseconds);
+        writer.EndObject();
+    }
+    writer.EndArray();
+}
+
+void WriteAllocations(ReportWriter& writer, const AllocBreakdown& breakdown) {
+    writer.StartObject();
+    for (int i = 0; i < static_cast<int>(AllocCategory::Count); i++) {
+        const AllocCounters& counters = breakdown.categories[i];
+        writer.Key(AllocCategoryName(static_cast<AllocCategory>(i)));
+        writer.StartObject();
+        writer.Key("count"); writer.Uint64(counters.allocations);
+        writer.Key("bytes"); writer.Uint64(counters.bytes);
+        writer.EndObject();
+    }
+    writer.EndObject();
+}
+
+} // namespace
+
+struct BatchReport::Impl {
+    FILE* file;
+    std::vector<char> streamBuffer;
+    std::unique_ptr<rapidjson::FileWriteStream> stream;
+    std::unique_ptr<ReportWriter> writer;
+
+    // Summed over every file as it is reported
+    uint64_t bytesIn;
+    uint64_t bytesOut;
+    uint64_t standardEntries;
+    uint64_t referenceEntries;
+    uint64_t nullEntries;
+    uint64_t patchedEntries;
+    uint64_t s9LayoutEntries;
+    uint64_t entryErrors;
+    uint64_t patchNanoseconds;
+    PatchTotals patches;
+
+    Impl()
+        : file(nullptr)
+        , bytesIn(0)
+        , bytesOut(0)
+        , standardEntries(0)
+        , referenceEntries(0)
+        , nullEntries(0)
+        , patchedEntries(0)
+        , s9LayoutEntries(0)
+        , entryErrors(0)
+        , patchNanoseconds(0)
+    {}
+};
+
+BatchReport::BatchReport() : _impl(new Impl) {}
+
+BatchReport::~BatchReport() {
+    if (_impl->file) {
+        fclose(_impl->file);
+    }
+}
+
+bool BatchReport::Open(const std::string& path) {
+    if (fopen_s(&_impl->file, path.c_str(), "wb") != 0 || !_impl->file) {
+        _impl->file = nullptr;
+        return false;
+    }
+
+    _impl->streamBuffer.resize(64 * 1024);
+    _impl->stream.reset(new rapidjson::FileWriteStream(_impl->file, _impl->streamBuffer.data(), _impl->streamBuffer.size()));
+    _impl->writer.reset(new ReportWriter(*_impl->stream));
+
+    ReportWriter& writer = *_impl->writer;
+    writer.StartObject();
+    writer.Key("version"); writer.Int(1);
+    writer.Key("files");
+    writer.StartArray();
+    return true;
+}
+
+void BatchReport::FileDone(int index, const BatchInput& input, const BatchFileResult& file,
+                           const std::vector<BatchEntryResult>& entries) {
+    if (!_impl->writer) {
+        return;
+    }
+
+    ALLOC_CATEGORY(AllocCategory::Json);
+    Impl& impl = *_impl;
+    ReportWriter& writer = *impl.writer;
+
+    writer.StartObject();
+    writer.Key("index"); writer.Int(index);
+    writer.Key("path"); writer.String(input.relativePath.empty() ? input.inputPath.filename().generic_string() : input.relativePath);
+    writer.Key("status"); writer.String(file.converted ? "converted" : "failed");
+    if (!file.error.empty()) {
+        writer.Key("error"); writer.String(file.error);
+    }
+    writer.Key("bytesIn"); writer.Uint64(file.bytesIn);
+    writer.Key("bytesOut"); writer.Uint64(file.bytesOut);
+    writer.Key("seconds"); writer.Double(file.seconds);
+
+    writer.Key("entries");
+    writer.StartObject();
+    writer.Key("total"); writer.Int(file.entryCount);
+    writer.Key("standard"); writer.Int(file.standardCount);
+    writer.Key("reference"); writer.Int(file.referenceCount);
+    writer.Key("null"); writer.Int(file.nullCount);
+    writer.Key("patched"); writer.Int(file.patchedCount);
+    writer.EndObject();
+
+    if (!file.phaseStats.empty()) {
+        writer.Key("phases");
+        WritePhases(writer, file.phaseStats);
+    }
+
+    if (AllocStatsEnabled()) {
+        writer.Key("allocations");
+        WriteAllocations(writer, file.allocations);
+        writer.Key("peakHeapBytes"); writer.Int64(file.peakHeapBytes);
+    }
+
+    PatchTotals filePatches;
+
+    writer.Key("entryResults");
+    writer.StartArray();
+    for (size_t i = 0; i < entries.size(); i++) {
+        const BatchEntryResult& entry = entries[i];
+
+        writer.StartObject();
+        writer.Key("index"); writer.Uint64(i);
+        writer.Key("kind"); writer.String(EntryKindName(entry.kind));
+
+        if (entry.kind == BatchEntryKind::Reference) {
+            impl.referenceEntries++;
+            writer.Key("ref"); writer.Uint(entry.refIndex);
+        } else if (entry.kind == BatchEntryKind::Null) {
+            impl.nullEntries++;
+        } else {
+            impl.standardEntries++;
+            impl.patchNanoseconds += entry.patchNanoseconds;
+            if (entry.patch.wasPatched) impl.patchedEntries++;
+            if (entry.needsSwap) impl.s9LayoutEntries++;
+            if (!entry.patch.error.empty()) impl.entryErrors++;
+
+            filePatches.Add(entry.patch);
+
+            writer.Key("bytesIn"); writer.Uint(entry.bytesIn);
+            writer.Key("bytesOut"); writer.Uint(entry.bytesOut);
+            writer.Key("s9Layout"); writer.Bool(entry.needsSwap);
+            writer.Key("patched"); writer.Bool(entry.patch.wasPatched);
+            writer.Key("patchNs"); writer.Uint64(entry.patchNanoseconds);
+            writer.Key("patches");
+            PatchTotals entryPatches;
+            entryPatches.Add(entry.patch);
+            entryPatches.Write(writer);
+            if (!entry.patch.error.empty()) {
+                writer.Key("error"); writer.String(entry.patch.error);
+            }
+        }
+
+        writer.EndObject();
+    }
+    writer.EndArray();
+
+    writer.Key("patches");
+    filePatches.Write(writer);
+    writer.EndObject();
+
+    impl.bytesIn += file.bytesIn;
+    impl.bytesOut += file.bytesOut;
+    impl.patches.Add(filePatches);
+}
+
+bool BatchReport::Finish(const BatchResult& result, const std::string& inputLabel, const std::string& outputDir) {
+    if (!_impl->writer) {
+        return false;
+    }
+
+    ALLOC_CATEGORY(AllocCategory::Json);
+    Impl& impl = *_impl;
+    ReportWriter& writer = *impl.writer;
+
+    writer.EndArray();
+
+    double seconds = result.elapsedSeconds;
+
+    writer.Key("summary");
+    writer.StartObject();
+    writer.Key("input"); writer.String(inputLabel);
+    writer.Key("output"); writer.String(outputDir);
+    writer.Key("total"); writer.Int(result.totalCount);
+    writer.Key("converted"); writer.Int(result.convertedCount);
+    writer.Key("failed"); writer.Int(result.failedCount);
+    writer.Key("elapsedSeconds"); writer.Double(seconds);
+    writer.Key("peakBytesInFlight"); writer.Uint64(result.peakBytesInFlight);
+    writer.Key("bytesIn"); writer.Uint64(impl.bytesIn);
+    writer.Key("bytesOut"); writer.Uint64(impl.bytesOut);
+    writer.Key("filesPerSecond"); writer.Double(seconds > 0.0 ? result.totalCount / seconds : 0.0);
+    writer.Key("mbPerSecond"); writer.Double(seconds > 0.0 ? impl.bytesIn / (1024.0 * 1024.0) / seconds : 0.0);
+    writer.Key("shadersPerSecond"); writer.Double(seconds > 0.0 ? impl.standardEntries / seconds : 0.0);
+
+    writer.Key("entries");
+    writer.StartObject();
+    writer.Key("standard"); writer.Uint64(impl.standardEntries);
+    writer.Key("reference"); writer.Uint64(impl.referenceEntries);
+    writer.Key("null"); writer.Uint64(impl.nullEntries);
+    writer.Key("patched"); writer.Uint64(impl.patchedEntries);
+    writer.Key("s9Layout"); writer.Uint64(impl.s9LayoutEntries);
+    writer.Key("errors"); writer.Uint64(impl.entryErrors);
+    writer.Key("patchNs"); writer.Uint64(impl.patchNanoseconds);
+    writer.EndObject();
+
+    writer.Key("patches");
+    impl.patches.Write(writer);
+
+    writer.Key("workers");
+    writer.StartArray();
+    for (const WorkerStats& stats : result.workerStats) {
+        writer.StartObject();
+        writer.Key("tasks"); writer.Uint64(stats.tasksRun);
+        writer.Key("stolen"); writer.Uint64(stats.tasksStolen);
+        writer.Key("busySeconds"); writer.Double(stats.busySeconds);
+        writer.EndObject();
+    }
+    writer.EndArray();
+
+    if (!result.phaseStats.empty()) {
+        writer.Key("phases");
+        WritePhases(writer, result.phaseStats);
+    }
+
+    if (AllocStatsEnabled()) {
+        writer.Key("allocations");
+        WriteAllocations(writer, result.allocations);
+        writer.Key("peakRssBytes"); writer.Uint64(result.peakResidentBytes);
+    }
+
+    writer.EndObject();
+    writer.EndObject();
+    impl.stream->Flush();
+
+    bool ok = !ferror(impl.file);
+    if (fclose(impl.file) != 0) {
+        ok = false;
+    }
+    impl.file = nullptr;
+    impl.writer.reset();
+    impl.stream.reset();
+    return ok;
+}
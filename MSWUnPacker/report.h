@@ -0,0 +1,49 @@
+#pragma once
+/*
+ * Batch Metrics Report (--report)
+ *
+ * Machine-readable results of a convert-legacy run: per-file and per-entry
+ * patch counters, sizes before and after, timings and failures, plus a
+ * summary. Files are streamed out as the writer finishes them (compact JSON,
+ * no DOM), so the report costs the same per file for 10 or 100k files.
+ *
+ * {
+ *   "version": 1,
+ *   "files": [ { "index", "path", "status", "error"?, "bytesIn", "bytesOut",
+ *                "seconds", "entries": {...}, "patches": {...},
+ *                "phases"?: [...], "allocations"?: {...}, "peakHeapBytes"?,
+ *                "entryResults": [...] }, ... ],
+ *   "summary": { ... }
+ * }
+ *
+ * "phases" is only there with --timings. "allocations" (count and bytes per
+ * category) and "peakHeapBytes" (the most heap the file held at once) are
+ * only there with --alloc-stats.
+ */
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "pipeline.h"
+
+class BatchReport : public BatchObserver {
+public:
+    BatchReport();
+    ~BatchReport();
+
+    BatchReport(const BatchReport&) = delete;
+    BatchReport& operator=(const BatchReport&) = delete;
+
+    // Creates the file and starts the files array
+    bool Open(const std::string& path);
+
+    void FileDone(int index, const BatchInput& input, const BatchFileResult& file,
+                  const std::vector<BatchEntryResult>& entries) override;
+
+    // Appends the summary and closes the file
+    bool Finish(const BatchResult& result, const std::string& inputLabel, const std::string& outputDir);
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> _impl;
+};
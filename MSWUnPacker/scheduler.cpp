@@ -0,0 +1,221 @@
+/*
+ * Work-Stealing Scheduler
+ */
+
+#include "scheduler.h"
+#include "trace.h"
+#include <chrono>
+#include <string>
+
+namespace {
+
+// Which pool/worker the current thread belongs to, so Submit and Wait can
+// use the caller's own deque
+thread_local const WorkStealingPool* t_pool = nullptr;
+thread_local int t_workerIndex = -1;
+
+} // namespace
+
+WorkStealingPool::WorkStealingPool(int numWorkers)
+    : _queued(0)
+    , _stopping(false)
+{
+    if (numWorkers <= 0) {
+        numWorkers = static_cast<int>(std::thread::hardware_concurrency());
+        if (numWorkers <= 0) {
+            numWorkers = 1;
+        }
+    }
+
+    // Create every deque before any thread starts stealing from them
+    for (int i = 0; i < numWorkers; i++) {
+        _workers.emplace_back(new Worker);
+    }
+
+    for (int i = 0; i < numWorkers; i++) {
+        _workers[i]->thread = std::thread(&WorkStealingPool::WorkerLoop, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    Shutdown();
+}
+
+void WorkStealingPool::Shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _stopping.store(true, std::memory_order_release);
+    }
+    _sleepCv.notify_all();
+
+    for (auto& worker : _workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+std::vector<WorkerStats> WorkStealingPool::GetStats() const {
+    std::vector<WorkerStats> stats(_workers.size());
+
+    for (size_t i = 0; i < _workers.size(); i++) {
+        const Worker& worker = *_workers[i];
+        stats[i].tasksRun = worker.tasksRun.load(std::memory_order_relaxed);
+        stats[i].tasksStolen = worker.tasksStolen.load(std::memory_order_relaxed);
+        stats[i].busySeconds = worker.busyNanoseconds.load(std::memory_order_relaxed) / 1e9;
+    }
+
+    return stats;
+}
+
+int WorkStealingPool::CurrentWorkerIndex() const {
+    return t_pool == this ? t_workerIndex : -1;
+}
+
+void WorkStealingPool::Submit(Task task) {
+    int self = CurrentWorkerIndex();
+
+    if (self >= 0) {
+        std::lock_guard<std::mutex> lock(_workers[self]->mutex);
+        _workers[self]->tasks.push_back(std::move(task));
+    } else {
+        std::lock_guard<std::mutex> lock(_injectedMutex);
+        _injected.push_back(std::move(task));
+    }
+    _queued.fetch_add(1, std::memory_order_release);
+
+    // Taking the lock orders this against a worker that is about to sleep
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+    }
+    _sleepCv.notify_one();
+}
+
+void WorkStealingPool::Submit(TaskGroup& group, Task task) {
+    group._pending.fetch_add(1, std::memory_order_relaxed);
+
+    Submit([&group, task = std::move(task)]() {
+        task();
+        group._pending.fetch_sub(1, std::memory_order_acq_rel);
+    });
+}
+
+void WorkStealingPool::Wait(TaskGroup& group) {
+    int self = CurrentWorkerIndex();
+
+    for (int spins = 0; !group.Done(); ) {
+        if (self >= 0 && RunOne(self)) {
+            spins = 0;
+            continue;
+        }
+
+        // Nothing to help with, the group's last tasks are running elsewhere
+        if (++spins < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+}
+
+bool WorkStealingPool::PopLocal(int index, Task& task) {
+    Worker& worker = *_workers[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+
+    if (worker.tasks.empty()) {
+        return false;
+    }
+
+    // Newest first: the owner keeps working on what it just split up
+    task = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::PopInjected(Task& task) {
+    std::lock_guard<std::mutex> lock(_injectedMutex);
+
+    if (_injected.empty()) {
+        return false;
+    }
+
+    // Submission order, callers rely on this to start big jobs first
+    task = std::move(_injected.front());
+    _injected.pop_front();
+    return true;
+}
+
+bool WorkStealingPool::Steal(int thief, Task& task) {
+    size_t count = _workers.size();
+
+    for (size_t i = 1; i < count; i++) {
+        Worker& victim = *_workers[(thief + i) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+
+        if (!victim.tasks.empty()) {
+            // Oldest first: the victim is least likely to get to it soon
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool WorkStealingPool::RunOne(int self) {
+    if (_queued.load(std::memory_order_acquire) == 0) {
+        return false;
+    }
+
+    Worker& worker = *_workers[self];
+    Task task;
+    bool stolen = false;
+
+    if (!PopLocal(self, task) && !PopInjected(task)) {
+        if (!Steal(self, task)) {
+            return false;
+        }
+        stolen = true;
+    }
+
+    _queued.fetch_sub(1, std::memory_order_relaxed);
+
+    auto start = std::chrono::steady_clock::now();
+    task();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    worker.tasksRun.fetch_add(1, std::memory_order_relaxed);
+    if (stolen) {
+        worker.tasksStolen.fetch_add(1, std::memory_order_relaxed);
+    }
+    worker.busyNanoseconds.fetch_add(
+        static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()),
+        std::memory_order_relaxed);
+
+    return true;
+}
+
+void WorkStealingPool::WorkerLoop(int index) {
+    t_pool = this;
+    t_workerIndex = index;
+    TraceSetThreadName("worker " + std::to_string(index));
+
+    for (;;) {
+        if (RunOne(index)) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        if (_stopping.load(std::memory_order_acquire) && _queued.load(std::memory_order_acquire) == 0) {
+            break;
+        }
+
+        _sleepCv.wait(lock, [&] {
+            return _queued.load(std::memory_order_acquire) > 0 || _stopping.load(std::memory_order_acquire);
+        });
+    }
+
+    t_pool = nullptr;
+    t_workerIndex = -1;
+}
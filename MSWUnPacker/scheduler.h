@@ -0,0 +1,118 @@
+#pragma once
+/*
+ * Work-Stealing Scheduler
+ *
+ * Fixed pool of worker threads, each owning a deque of tasks. A worker runs
+ * its own tasks newest first. Once it runs dry it takes the oldest task
+ * submitted from outside the pool, then steals the oldest task from another
+ * worker. Outside submissions are started in the order they were made.
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ============================================================================
+// Task Group
+// Counts the outstanding tasks of one batch so a caller can wait on just
+// those tasks while the pool keeps running everything else.
+// ============================================================================
+
+class TaskGroup {
+public:
+    TaskGroup() : _pending(0) {}
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    bool Done() const { return _pending.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class WorkStealingPool;
+    std::atomic<int> _pending;
+};
+
+// ============================================================================
+// Work-Stealing Pool
+// ============================================================================
+
+struct WorkerStats {
+    uint64_t tasksRun;
+    uint64_t tasksStolen;       // Taken from another worker's deque
+    double busySeconds;         // Time spent inside tasks
+};
+
+class WorkStealingPool {
+public:
+    typedef std::function<void()> Task;
+
+    // numWorkers <= 0 uses one worker per hardware thread
+    explicit WorkStealingPool(int numWorkers);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    int NumWorkers() const { return static_cast<int>(_workers.size()); }
+
+    // Queue a task. From a worker it goes on that worker's own deque,
+    // otherwise on the shared FIFO that idle workers take from.
+    void Submit(Task task);
+
+    // Queue a task that counts against group
+    void Submit(TaskGroup& group, Task task);
+
+    // Block until every task in group has finished. A worker calling this
+    // runs queued tasks while it waits. Other threads just wait, the pool
+    // already has a thread per core.
+    void Wait(TaskGroup& group);
+
+    // Finish all queued tasks and join the workers. Called by the destructor
+    // if needed, call it first to read final stats.
+    void Shutdown();
+
+    // Per-worker counters, indexed by worker
+    std::vector<WorkerStats> GetStats() const;
+
+    // Index of the pool worker running the calling thread, -1 if it isn't one
+    int CurrentWorkerIndex() const;
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+
+        // Only written by the owning thread
+        std::atomic<uint64_t> tasksRun;
+        std::atomic<uint64_t> tasksStolen;
+        std::atomic<uint64_t> busyNanoseconds;
+
+        Worker() : tasksRun(0), tasksStolen(0), busyNanoseconds(0) {}
+    };
+
+    void WorkerLoop(int index);
+    bool PopLocal(int index, Task& task);
+    bool PopInjected(Task& task);
+    bool Steal(int thief, Task& task);
+    bool RunOne(int self);
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+
+    // Tasks submitted from outside the pool
+    std::mutex _injectedMutex;
+    std::deque<Task> _injected;
+
+    std::atomic<size_t> _queued;            // Tasks sitting in any deque
+    std::atomic<bool> _stopping;
+
+    // Idle workers sleep here instead of spinning on empty deques
+    std::mutex _sleepMutex;
+    std::condition_variable _sleepCv;
+};
@@ -0,0 +1,311 @@
+/*
+ * Sharded Batch Runs
+ */
+
+#include "shard.h"
+#include "memstats.h"
+#include "jsonfile.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#define RAPIDJSON_HAS_STDSTRING 1
+#include "rapidjson/prettywriter.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/document.h"
+
+namespace {
+
+struct ManifestEntry {
+    std::string status;             // "converted" or "failed"
+    int entries;
+    int standard;
+    int reference;
+    int null;
+    int patched;
+};
+
+struct ManifestSummary {
+    int total;
+    int converted;
+    int failed;
+    int entries;
+    int patched;
+    double elapsedSeconds;
+};
+
+typedef rapidjson::PrettyWriter<rapidjson::StringBuffer> JsonWriter;
+
+ManifestSummary Summarize(const std::map<std::string, ManifestEntry>& files, double elapsedSeconds) {
+    ManifestSummary summary = { 0, 0, 0, 0, 0, elapsedSeconds };
+
+    for (const auto& file : files) {
+        summary.total++;
+        if (file.second.status == "converted") {
+            summary.converted++;
+        } else {
+            summary.failed++;
+        }
+        summary.entries += file.second.entries;
+        summary.patched += file.second.patched;
+    }
+
+    return summary;
+}
+
+void WriteSummary(JsonWriter& writer, const ManifestSummary& summary) {
+    writer.Key("summary");
+    writer.StartObject();
+    writer.Key("total");
+    writer.Int(summary.total);
+    writer.Key("converted");
+    writer.Int(summary.converted);
+    writer.Key("failed");
+    writer.Int(summary.failed);
+    writer.Key("entries");
+    writer.Int(summary.entries);
+    writer.Key("patched");
+    writer.Int(summary.patched);
+    writer.Key("elapsedSeconds");
+    writer.Double(summary.elapsedSeconds);
+    writer.EndObject();
+}
+
+void WriteFiles(JsonWriter& writer, const std::map<std::string, ManifestEntry>& files) {
+    writer.Key("files");
+    writer.StartArray();
+    for (const auto& file : files) {
+        writer.StartObject();
+        writer.Key("path");
+        writer.String(file.first);
+        writer.Key("status");
+        writer.String(file.second.status);
+        writer.Key("entries");
+        writer.Int(file.second.entries);
+        writer.Key("standard");
+        writer.Int(file.second.standard);
+        writer.Key("reference");
+        writer.Int(file.second.reference);
+        writer.Key("null");
+        writer.Int(file.second.null);
+        writer.Key("patched");
+        writer.Int(file.second.patched);
+        writer.EndObject();
+    }
+    writer.EndArray();
+}
+
+bool WriteJsonFile(const fs::path& path, const rapidjson::StringBuffer& buffer) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        return false;
+    }
+
+    out.write(buffer.GetString(), buffer.GetSize());
+    return static_cast<bool>(out);
+}
+
+int GetInt(const rapidjson::Value& object, const char* name, int fallback) {
+    if (object.HasMember(name) && object[name].IsInt()) {
+        return object[name].GetInt();
+    }
+    return fallback;
+}
+
+} // namespace
+
+bool ParseShardSpec(const char* text, ShardSpec& spec) {
+    const char* slash = strchr(text, '/');
+    if (!slash || slash == text || !slash[1]) {
+        return false;
+    }
+
+    char* end = nullptr;
+    long index = strtol(text, &end, 10);
+    if (end != slash) {
+        return false;
+    }
+
+    long count = strtol(slash + 1, &end, 10);
+    if (*end != '\0') {
+        return false;
+    }
+
+    if (count < 1 || index < 0 || index >= count) {
+        return false;
+    }
+
+    spec.index = static_cast<int>(index);
+    spec.count = static_cast<int>(count);
+    return true;
+}
+
+uint64_t StableHash64(const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+uint64_t StableHash64(const std::string& text) {
+    return StableHash64(text.data(), text.size());
+}
+
+bool ShardContains(const ShardSpec& spec, const std::string& relativePath) {
+    if (!spec.IsSharded()) {
+        return true;
+    }
+    return StableHash64(relativePath) % static_cast<uint64_t>(spec.count) == static_cast<uint64_t>(spec.index);
+}
+
+std::string ShardManifestName(const ShardSpec& spec) {
+    return "manifest.shard-" + std::to_string(spec.index) + "-of-" + std::to_string(spec.count) + ".json";
+}
+
+bool WriteShardManifest(const fs::path& manifestPath, const ShardSpec& spec, const fs::path& inputRoot,
+                        const BatchResult& result) {
+    // Keyed by path so the manifest is the same however the batch was scheduled
+    std::map<std::string, ManifestEntry> files;
+    for (size_t i = 0; i < result.inputs.size() && i < result.files.size(); i++) {
+        const BatchFileResult& file = result.files[i];
+        files[result.inputs[i].relativePath] = ManifestEntry{
+            file.converted ? "converted" : "failed",
+            file.entryCount, file.standardCount, file.referenceCount, file.nullCount, file.patchedCount
+        };
+    }
+
+    rapidjson::StringBuffer jsonBuf{};
+    JsonWriter jsonWriter{ jsonBuf };
+    jsonWriter.StartObject();
+    jsonWriter.Key("shard");
+    jsonWriter.Int(spec.index);
+    jsonWriter.Key("shardCount");
+    jsonWriter.Int(spec.count);
+    jsonWriter.Key("inputRoot");
+    jsonWriter.String(inputRoot.generic_string());
+    WriteSummary(jsonWriter, Summarize(files, result.elapsedSeconds));
+    WriteFiles(jsonWriter, files);
+    jsonWriter.EndObject();
+
+    return WriteJsonFile(manifestPath, jsonBuf);
+}
+
+int MergeManifests(const fs::path& outputPath, const std::vector<fs::path>& manifestPaths) {
+    int shardCount = 0;
+    int errors = 0;
+    double elapsedSeconds = 0.0;
+    std::vector<bool> seenShards;
+    std::map<std::string, ManifestEntry> files;
+
+    for (const fs::path& manifestPath : manifestPaths) {
+        JsonFile json;
+        if (!json.Load(manifestPath)) {
+            fprintf(stderr, "Error: Could not open %s\n", manifestPath.string().c_str());
+            errors++;
+            continue;
+        }
+        const rapidjson::Document& jsonDoc = json.GetDocument();
+
+        if (!jsonDoc.IsObject() || !jsonDoc.HasMember("files") || !jsonDoc["files"].IsArray()) {
+            fprintf(stderr, "Error: %s is not a shard manifest\n", manifestPath.string().c_str());
+            errors++;
+            continue;
+        }
+
+        int shard = GetInt(jsonDoc, "shard", -1);
+        int count = GetInt(jsonDoc, "shardCount", 0);
+
+        if (shardCount == 0 && count > 0) {
+            shardCount = count;
+            seenShards.assign(shardCount, false);
+        }
+
+        if (count != shardCount || shard < 0 || shard >= shardCount) {
+            fprintf(stderr, "Error: %s is shard %d/%d, expected a shard of %d\n",
+                    manifestPath.string().c_str(), shard, count, shardCount);
+            errors++;
+            continue;
+        }
+
+        if (seenShards[shard]) {
+            fprintf(stderr, "Warning: Shard %d given more than once, %s ignored\n", shard, manifestPath.string().c_str());
+            continue;
+        }
+        seenShards[shard] = true;
+
+        if (jsonDoc.HasMember("summary") && jsonDoc["summary"].IsObject()) {
+            const rapidjson::Value& summary = jsonDoc["summary"];
+            // Shards run side by side, the batch took as long as the slowest one
+            if (summary.HasMember("elapsedSeconds") && summary["elapsedSeconds"].IsNumber()) {
+                elapsedSeconds = std::max(elapsedSeconds, summary["elapsedSeconds"].GetDouble());
+            }
+        }
+
+        for (const auto& file : jsonDoc["files"].GetArray()) {
+            if (!file.IsObject() || !file.HasMember("path") || !file["path"].IsString()) {
+                continue;
+            }
+
+            std::string path = file["path"].GetString();
+            if (files.count(path)) {
+                // Only possible if the shards were run against different trees
+                fprintf(stderr, "Error: %s appears in more than one shard\n", path.c_str());
+                errors++;
+                continue;
+            }
+
+            ManifestEntry& entry = files[path];
+            entry.status = file.HasMember("status") && file["status"].IsString() ? file["status"].GetString() : "failed";
+            entry.entries = GetInt(file, "entries", 0);
+            entry.standard = GetInt(file, "standard", 0);
+            entry.reference = GetInt(file, "reference", 0);
+            entry.null = GetInt(file, "null", 0);
+            entry.patched = GetInt(file, "patched", 0);
+        }
+    }
+
+    std::vector<int> missingShards;
+    for (int i = 0; i < shardCount; i++) {
+        if (!seenShards[i]) {
+            missingShards.push_back(i);
+        }
+    }
+
+    ManifestSummary summary = Summarize(files, elapsedSeconds);
+
+    rapidjson::StringBuffer jsonBuf{};
+    JsonWriter jsonWriter{ jsonBuf };
+    jsonWriter.StartObject();
+    jsonWriter.Key("shardCount");
+    jsonWriter.Int(shardCount);
+    jsonWriter.Key("missingShards");
+    jsonWriter.StartArray();
+    for (int shard : missingShards) {
+        jsonWriter.Int(shard);
+    }
+    jsonWriter.EndArray();
+    WriteSummary(jsonWriter, summary);
+    WriteFiles(jsonWriter, files);
+    jsonWriter.EndObject();
+
+    if (!WriteJsonFile(outputPath, jsonBuf)) {
+        fprintf(stderr, "Error: Could not write %s\n", outputPath.string().c_str());
+        return 1;
+    }
+
+    printf("Merged %zu manifest(s) into %s\n", manifestPaths.size(), outputPath.string().c_str());
+    printf("  Shards: %d of %d\n", shardCount - static_cast<int>(missingShards.size()), shardCount);
+    for (int shard : missingShards) {
+        printf("  Missing shard: %d\n", shard);
+    }
+    printf("  Total: %d, Converted: %d, Failed: %d\n", summary.total, summary.converted, summary.failed);
+    printf("  Entries: %d, Patched: %d\n", summary.entries, summary.patched);
+    printf("  Elapsed (slowest shard): %.2fs\n", summary.elapsedSeconds);
+
+    return errors == 0 && missingShards.empty() && shardCount > 0 ? 0 : 1;
+}
@@ -0,0 +1,48 @@
+#pragma once
+/*
+ * Sharded Batch Runs
+ *
+ * Splits a batch over several machines without any coordination. Every node
+ * sees the same input tree and keeps the files whose relative path hashes to
+ * its shard. Each node writes a manifest of its results and merge-manifests
+ * combines them afterwards.
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include "pipeline.h"
+
+namespace fs = std::filesystem;
+
+struct ShardSpec {
+    int index;      // 0-based
+    int count;
+
+    ShardSpec() : index(0), count(1) {}
+
+    bool IsSharded() const { return count > 1; }
+};
+
+// Parse "i/N" with 0 <= i < N
+bool ParseShardSpec(const char* text, ShardSpec& spec);
+
+// 64-bit FNV-1a, identical on every platform and build
+uint64_t StableHash64(const void* data, size_t size);
+uint64_t StableHash64(const std::string& text);
+
+// relativePath must use '/' separators (fs::path::generic_string) so Windows
+// and Linux nodes agree on the partition
+bool ShardContains(const ShardSpec& spec, const std::string& relativePath);
+
+// File name of the manifest a shard writes into the output directory
+std::string ShardManifestName(const ShardSpec& spec);
+
+// Write the results of one shard, keyed by each input's relative path
+bool WriteShardManifest(const fs::path& manifestPath, const ShardSpec& spec, const fs::path& inputRoot,
+                        const BatchResult& result);
+
+// Combine shard manifests into one. Returns 0 if every shard was present and
+// consistent, 1 otherwise (the merged manifest is still written).
+int MergeManifests(const fs::path& outputPath, const std::vector<fs::path>& manifestPaths);
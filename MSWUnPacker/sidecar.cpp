@@ -0,0 +1,172 @@
+/*
+ * Binary Shader Manifest
+ */
+
+#include "sidecar.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "platform.h"
+
+namespace {
+
+bool StatJson(const fs::path& dir, uint64_t& size, int64_t& writeTime) {
+    std::error_code ec;
+    fs::path jsonPath = dir / "data.json";
+    size = fs::file_size(jsonPath, ec);
+    if (ec) {
+        return false;
+    }
+    writeTime = static_cast<int64_t>(fs::last_write_time(jsonPath, ec).time_since_epoch().count());
+    return !ec;
+}
+
+} // namespace
+
+void ShaderManifestFromShader(const CMultiShaderWrapperIO::Shader_t& shader, ShaderManifest& manifest) {
+    manifest.shaderType = shader.shaderType;
+    manifest.name = shader.name;
+    memcpy(manifest.features, shader.features, sizeof(manifest.features));
+
+    manifest.flags.resize(shader.entries.size() * 2);
+    manifest.refIndices.resize(shader.entries.size());
+    for (size_t i = 0; i < shader.entries.size(); i++) {
+        const CMultiShaderWrapperIO::ShaderEntry_t& entry = shader.entries[i];
+        manifest.flags[i * 2] = entry.flags[0];
+        manifest.flags[i * 2 + 1] = entry.flags[1];
+        manifest.refIndices[i] = entry.buffer ? 0xFFFF : entry.refIndex;
+    }
+}
+
+bool ShaderManifestFromJson(const rapidjson::Value& jsonDoc, ShaderManifest& manifest) {
+    if (!jsonDoc.IsObject() || !jsonDoc.HasMember("shaderType") || !jsonDoc["shaderType"].IsInt() ||
+        !jsonDoc.HasMember("name") || !jsonDoc["name"].IsString() ||
+        !jsonDoc.HasMember("features") || !jsonDoc["features"].IsArray() ||
+        !jsonDoc.HasMember("entryFlags") || !jsonDoc["entryFlags"].IsArray()) {
+        return false;
+    }
+
+    manifest.shaderType = (MultiShaderWrapperShaderType_e)jsonDoc["shaderType"].GetInt();
+    manifest.name.assign(jsonDoc["name"].GetString(), jsonDoc["name"].GetStringLength());
+
+    auto features = jsonDoc["features"].GetArray();
+    if (features.Size() != 7) {
+        return false;
+    }
+    for (int i = 0; i < 7; i++) {
+        if (!features[i].IsInt()) {
+            return false;
+        }
+        manifest.features[i] = static_cast<uint8_t>(features[i].GetInt());
+    }
+
+    auto entries = jsonDoc["entryFlags"].GetArray();
+    manifest.flags.resize(entries.Size() * 2);
+    manifest.refIndices.assign(entries.Size(), 0xFFFF);
+    for (rapidjson::SizeType i = 0; i < entries.Size(); i++) {
+        if (!entries[i].IsArray() || entries[i].Size() < 2 || !entries[i][0].IsUint64() || !entries[i][1].IsUint64()) {
+            return false;
+        }
+        manifest.flags[i * 2] = entries[i][0].GetUint64();
+        manifest.flags[i * 2 + 1] = entries[i][1].GetUint64();
+    }
+
+    if (jsonDoc.HasMember("entryRefs") && jsonDoc["entryRefs"].IsObject()) {
+        for (auto& ref : jsonDoc["entryRefs"].GetObject()) {
+            char* end = nullptr;
+            unsigned long index = strtoul(ref.name.GetString(), &end, 10);
+            if (*end == '\0' && index < manifest.refIndices.size() && ref.value.IsInt()) {
+                manifest.refIndices[index] = static_cast<uint16_t>(ref.value.GetInt());
+            }
+        }
+    }
+    return true;
+}
+
+bool WriteShaderManifest(const fs::path& dir, const ShaderManifest& manifest) {
+    if (manifest.EntryCount() > 0xFFFF || manifest.name.size() > 0xFFFF ||
+        manifest.flags.size() != manifest.EntryCount() * 2) {
+        return false;
+    }
+
+    ShaderManifestHeader header = {};
+    header.magic = SHADER_MANIFEST_MAGIC;
+    header.version = SHADER_MANIFEST_VERSION;
+    header.headerSize = sizeof(ShaderManifestHeader);
+    if (!StatJson(dir, header.jsonSize, header.jsonWriteTime)) {
+        return false;
+    }
+    header.shaderType = static_cast<uint32_t>(manifest.shaderType);
+    header.entryCount = static_cast<uint16_t>(manifest.EntryCount());
+    header.nameLength = static_cast<uint16_t>(manifest.name.size());
+    memcpy(header.features, manifest.features, sizeof(header.features));
+
+    FILE* file = nullptr;
+    if (fopen_s(&file, (dir / SHADER_MANIFEST_FILE).string().c_str(), "wb") != 0 || !file) {
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && fwrite(manifest.flags.data(), sizeof(uint64_t), manifest.flags.size(), file) == manifest.flags.size();
+    ok = ok && fwrite(manifest.refIndices.data(), sizeof(uint16_t), manifest.refIndices.size(), file) == manifest.refIndices.size();
+    ok = ok && fwrite(manifest.name.data(), 1, manifest.name.size(), file) == manifest.name.size();
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+
+    if (!ok) {
+        RemoveShaderManifest(dir);
+    }
+    return ok;
+}
+
+ManifestStatus ReadShaderManifest(const fs::path& dir, ShaderManifest& manifest) {
+    std::vector<char> data;
+    if (!ReadTextFile(dir / SHADER_MANIFEST_FILE, data)) {
+        return ManifestStatus::Missing;
+    }
+    size_t size = data.size() - 1;  // Without the terminator ReadTextFile adds
+
+    ShaderManifestHeader header;
+    if (size < sizeof(header)) {
+        return ManifestStatus::Invalid;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+
+    if (header.magic != SHADER_MANIFEST_MAGIC || header.version != SHADER_MANIFEST_VERSION ||
+        header.headerSize < sizeof(header)) {
+        return ManifestStatus::Invalid;
+    }
+
+    size_t flagsBytes = header.entryCount * 2 * sizeof(uint64_t);
+    size_t refsBytes = header.entryCount * sizeof(uint16_t);
+    if (size != header.headerSize + flagsBytes + refsBytes + header.nameLength) {
+        return ManifestStatus::Invalid;
+    }
+
+    uint64_t jsonSize = 0;
+    int64_t jsonWriteTime = 0;
+    if (!StatJson(dir, jsonSize, jsonWriteTime) || jsonSize != header.jsonSize || jsonWriteTime != header.jsonWriteTime) {
+        return ManifestStatus::Stale;
+    }
+
+    const char* cursor = data.data() + header.headerSize;
+    manifest.shaderType = static_cast<MultiShaderWrapperShaderType_e>(header.shaderType);
+    memcpy(manifest.features, header.features, sizeof(manifest.features));
+
+    manifest.flags.resize(header.entryCount * 2);
+    memcpy(manifest.flags.data(), cursor, flagsBytes);
+    cursor += flagsBytes;
+
+    manifest.refIndices.resize(header.entryCount);
+    memcpy(manifest.refIndices.data(), cursor, refsBytes);
+    cursor += refsBytes;
+
+    manifest.name.assign(cursor, header.nameLength);
+    return ManifestStatus::Loaded;
+}
+
+void RemoveShaderManifest(const fs::path& dir) {
+    std::error_code ec;
+    fs::remove(dir / SHADER_MANIFEST_FILE, ec);
+}
@@ -0,0 +1,82 @@
+#pragma once
+/*
+ * Binary Shader Manifest
+ *
+ * unpack writes data.bin next to data.json: the same fields pack needs
+ * (shader type, name, features, entry flags and reference indices) in a
+ * fixed layout, so pack loads them with one read instead of parsing JSON
+ * and looking up a stringified key per entry. data.json stays the file to
+ * edit. The manifest records the size and write time data.json had when it
+ * was written, and is ignored once either changes.
+ *
+ * Only shader directories get one, shader sets are a handful of fields.
+ *
+ *   header      ShaderManifestHeader (40 bytes)
+ *   flags       uint64_t[entryCount][2]
+ *   refIndices  uint16_t[entryCount], 0xFFFF = none
+ *   name        char[nameLength], not terminated
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include "multishader.h"
+#include "jsonfile.h"
+
+namespace fs = std::filesystem;
+
+#define SHADER_MANIFEST_FILE "data.bin"
+#define SHADER_MANIFEST_MAGIC 0x4D57534D     // 'MSWM'
+#define SHADER_MANIFEST_VERSION 1
+
+#pragma pack(push, 1)
+struct ShaderManifestHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t headerSize;
+    uint64_t jsonSize;          // data.json as written alongside
+    int64_t jsonWriteTime;      // fs::last_write_time ticks, same platform only
+    uint32_t shaderType;
+    uint16_t entryCount;
+    uint16_t nameLength;
+    uint8_t features[7];
+    uint8_t reserved;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(ShaderManifestHeader) == 40, "ShaderManifestHeader layout changed");
+
+struct ShaderManifest {
+    MultiShaderWrapperShaderType_e shaderType;
+    std::string name;
+    uint8_t features[7];
+    std::vector<uint64_t> flags;            // Two per entry
+    std::vector<uint16_t> refIndices;
+
+    ShaderManifest() : shaderType(MultiShaderWrapperShaderType_e::INVALID), features{} {}
+
+    size_t EntryCount() const { return refIndices.size(); }
+};
+
+enum class ManifestStatus {
+    Loaded,
+    Missing,
+    Stale,          // data.json changed since the manifest was written
+    Invalid,
+};
+
+// Fills manifest from a shader (entries without a buffer keep their refIndex)
+void ShaderManifestFromShader(const CMultiShaderWrapperIO::Shader_t& shader, ShaderManifest& manifest);
+
+// Fills manifest from a shader data.json. False if a field pack needs is
+// missing or malformed.
+bool ShaderManifestFromJson(const rapidjson::Value& jsonDoc, ShaderManifest& manifest);
+
+// Writes dir/data.bin, call after dir/data.json has been written
+bool WriteShaderManifest(const fs::path& dir, const ShaderManifest& manifest);
+
+ManifestStatus ReadShaderManifest(const fs::path& dir, ShaderManifest& manifest);
+
+// Removes dir/data.bin, for when data.json is rewritten without one
+void RemoveShaderManifest(const fs::path& dir);
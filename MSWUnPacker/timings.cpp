@@ -0,0 +1,197 @@
+/*
+ * Phase Timings (--timings)
+ */
+
+#include "timings.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+std::atomic<bool> g_timingsEnabled(false);
+
+namespace {
+
+thread_local PhaseSamples* t_recorder = nullptr;
+
+const char* const kPhaseNames[] = {
+    "read",
+    "detect",
+    "sun-data",
+    "uber-flags",
+    "flag-bit1",
+    "shadow-blend",
+    "srv-slots",
+    "clustered-lighting",
+    "cb-swap",
+    "hash",
+    "finalize",
+    "write",
+    "convert",
+    "pack",
+};
+
+static_assert(sizeof(kPhaseNames) / sizeof(kPhaseNames[0]) == static_cast<size_t>(Phase::Count),
+              "kPhaseNames out of sync with Phase");
+
+double ToMilliseconds(uint64_t nanoseconds) {
+    return nanoseconds / 1e6;
+}
+
+} // namespace
+
+const char* PhaseName(Phase phase) {
+    int index = static_cast<int>(phase);
+    return index >= 0 && index < static_cast<int>(Phase::Count) ? kPhaseNames[index] : "?";
+}
+
+uint64_t TimingClockNanoseconds() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// ============================================================================
+// Recording
+// ============================================================================
+
+ScopedPhaseRecorder::ScopedPhaseRecorder(PhaseSamples* samples) : _previous(t_recorder) {
+    t_recorder = samples;
+}
+
+ScopedPhaseRecorder::~ScopedPhaseRecorder() {
+    t_recorder = _previous;
+}
+
+void RecordPhase(Phase phase, uint64_t nanoseconds) {
+    if (t_recorder) {
+        t_recorder->push_back(PhaseSample{ phase, nanoseconds });
+    }
+}
+
+// ============================================================================
+// Aggregation
+// ============================================================================
+
+std::vector<PhaseStats> SummarizePhases(const PhaseSamples& samples) {
+    std::vector<std::vector<uint64_t>> byPhase(static_cast<size_t>(Phase::Count));
+    for (const PhaseSample& sample : samples) {
+        byPhase[static_cast<size_t>(sample.phase)].push_back(sample.nanoseconds);
+    }
+
+    std::vector<PhaseStats> stats;
+    for (size_t i = 0; i < byPhase.size(); i++) {
+        std::vector<uint64_t>& values = byPhase[i];
+        if (values.empty()) continue;
+
+        std::sort(values.begin(), values.end());
+
+        PhaseStats row = { static_cast<Phase>(i), values.size(), 0, 0, 0, values.back() };
+        for (uint64_t value : values) {
+            row.totalNanoseconds += value;
+        }
+
+        // Nearest-rank percentiles
+        row.p50Nanoseconds = values[(values.size() - 1) * 50 / 100];
+        row.p99Nanoseconds = values[(values.size() - 1) * 99 / 100];
+        stats.push_back(row);
+    }
+
+    return stats;
+}
+
+PhaseHistogram::PhaseHistogram() : _phases(static_cast<size_t>(Phase::Count)) {
+    for (PhaseData& data : _phases) {
+        data.count = 0;
+        data.total = 0;
+        data.max = 0;
+    }
+}
+
+int PhaseHistogram::BucketIndex(uint64_t value) {
+    if (value < kSubBuckets) {
+        return static_cast<int>(value);
+    }
+
+    int msb = 63;
+    while (!(value >> msb)) {
+        msb--;
+    }
+
+    // Top 5 bits of the value: the leading 1 plus 4 bits of sub-bucket
+    int sub = static_cast<int>((value >> (msb - 4)) & (kSubBuckets - 1));
+    return (msb - 3) * kSubBuckets + sub;
+}
+
+uint64_t PhaseHistogram::BucketValue(int index) {
+    if (index < kSubBuckets) {
+        return static_cast<uint64_t>(index);
+    }
+
+    int msb = index / kSubBuckets + 3;
+    uint64_t sub = static_cast<uint64_t>(index % kSubBuckets);
+
+    // Middle of the bucket, buckets just above kSubBuckets are 1 wide
+    uint64_t low = (uint64_t(1) << msb) | (sub << (msb - 4));
+    return msb > 4 ? low + (uint64_t(1) << (msb - 5)) : low;
+}
+
+void PhaseHistogram::Add(Phase phase, uint64_t nanoseconds) {
+    PhaseData& data = _phases[static_cast<size_t>(phase)];
+
+    if (data.buckets.empty()) {
+        data.buckets.resize(kBuckets);
+    }
+
+    data.count++;
+    data.total += nanoseconds;
+    data.max = std::max(data.max, nanoseconds);
+    data.buckets[BucketIndex(nanoseconds)]++;
+}
+
+void PhaseHistogram::Add(const PhaseSamples& samples) {
+    for (const PhaseSample& sample : samples) {
+        Add(sample.phase, sample.nanoseconds);
+    }
+}
+
+std::vector<PhaseStats> PhaseHistogram::Summarize() const {
+    std::vector<PhaseStats> stats;
+
+    for (size_t i = 0; i < _phases.size(); i++) {
+        const PhaseData& data = _phases[i];
+        if (!data.count) continue;
+
+        PhaseStats row = { static_cast<Phase>(i), data.count, data.total, 0, 0, data.max };
+
+        uint64_t rank50 = (data.count - 1) * 50 / 100;
+        uint64_t rank99 = (data.count - 1) * 99 / 100;
+        uint64_t seen = 0;
+        bool have50 = false;
+
+        for (int b = 0; b < kBuckets; b++) {
+            seen += data.buckets[b];
+            if (!have50 && seen > rank50) {
+                row.p50Nanoseconds = std::min(BucketValue(b), data.max);
+                have50 = true;
+            }
+            if (seen > rank99) {
+                row.p99Nanoseconds = std::min(BucketValue(b), data.max);
+                break;
+            }
+        }
+
+        stats.push_back(row);
+    }
+
+    return stats;
+}
+
+void PrintPhaseTable(const std::vector<PhaseStats>& stats) {
+    printf("  %-20s %10s %12s %10s %10s %10s\n", "Phase", "Count", "Total ms", "p50 ms", "p99 ms", "Max ms");
+
+    for (const PhaseStats& row : stats) {
+        printf("  %-20s %10llu %12.3f %10.3f %10.3f %10.3f\n", PhaseName(row.phase),
+               static_cast<unsigned long long>(row.count), ToMilliseconds(row.totalNanoseconds),
+               ToMilliseconds(row.p50Nanoseconds), ToMilliseconds(row.p99Nanoseconds),
+               ToMilliseconds(row.maxNanoseconds));
+    }
+}
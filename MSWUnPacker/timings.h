@@ -0,0 +1,153 @@
+#pragma once
+/*
+ * Phase Timings (--timings)
+ *
+ * TIME_PHASE(phase) times the rest of the enclosing scope. The sample goes to
+ * whatever PhaseSamples the current thread has been pointed at with a
+ * ScopedPhaseRecorder, e.g. the entry a batch worker is patching. With
+ * --trace the same timer also emits a trace span. With both off a timer is
+ * two relaxed loads and never reads the clock.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "trace.h"
+
+enum class Phase : int {
+    Read,
+    Detect,
+    SunData,
+    UberFlags,
+    FeatureFlagBit1,
+    ShadowBlend,
+    SRVSlots,
+    ClusteredLighting,
+    SwapCB,
+    Hash,
+    Finalize,
+    Write,
+    Convert,
+    Pack,
+    Count
+};
+
+const char* PhaseName(Phase phase);
+
+extern std::atomic<bool> g_timingsEnabled;
+
+inline bool TimingsEnabled() {
+    return g_timingsEnabled.load(std::memory_order_relaxed);
+}
+
+inline void EnableTimings(bool enabled) {
+    g_timingsEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+// ============================================================================
+// Recording
+// ============================================================================
+
+struct PhaseSample {
+    Phase phase;
+    uint64_t nanoseconds;
+};
+
+typedef std::vector<PhaseSample> PhaseSamples;
+
+uint64_t TimingClockNanoseconds();
+
+// Send the calling thread's samples to samples until this goes out of scope
+class ScopedPhaseRecorder {
+public:
+    explicit ScopedPhaseRecorder(PhaseSamples* samples);
+    ~ScopedPhaseRecorder();
+
+    ScopedPhaseRecorder(const ScopedPhaseRecorder&) = delete;
+    ScopedPhaseRecorder& operator=(const ScopedPhaseRecorder&) = delete;
+
+private:
+    PhaseSamples* _previous;
+};
+
+// Records into the current thread's recorder, dropped if there is none
+void RecordPhase(Phase phase, uint64_t nanoseconds);
+
+class ScopedPhaseTimer {
+public:
+    explicit ScopedPhaseTimer(Phase phase)
+        : _phase(phase)
+        , _start(TimingsEnabled() || TraceEnabled() ? TimingClockNanoseconds() : 0)
+    {}
+
+    ~ScopedPhaseTimer() {
+        if (_start) {
+            uint64_t end = TimingClockNanoseconds();
+            if (TimingsEnabled()) {
+                RecordPhase(_phase, end - _start);
+            }
+            if (TraceEnabled()) {
+                TraceSpan(PhaseName(_phase), _start, end);
+            }
+        }
+    }
+
+    ScopedPhaseTimer(const ScopedPhaseTimer&) = delete;
+    ScopedPhaseTimer& operator=(const ScopedPhaseTimer&) = delete;
+
+private:
+    Phase _phase;
+    uint64_t _start;
+};
+
+#define TIME_PHASE_CONCAT2(a, b) a##b
+#define TIME_PHASE_CONCAT(a, b) TIME_PHASE_CONCAT2(a, b)
+#define TIME_PHASE(phase) ScopedPhaseTimer TIME_PHASE_CONCAT(phaseTimer_, __LINE__)(phase)
+
+// ============================================================================
+// Aggregation
+// ============================================================================
+
+struct PhaseStats {
+    Phase phase;
+    uint64_t count;
+    uint64_t totalNanoseconds;
+    uint64_t p50Nanoseconds;
+    uint64_t p99Nanoseconds;
+    uint64_t maxNanoseconds;
+};
+
+// Exact stats for each phase that has samples, in Phase order
+std::vector<PhaseStats> SummarizePhases(const PhaseSamples& samples);
+
+// Batch-wide aggregate. Percentiles come from log-scale buckets (16 per
+// power of two, within ~6%), count, total and max are exact.
+class PhaseHistogram {
+public:
+    PhaseHistogram();
+
+    void Add(const PhaseSamples& samples);
+    void Add(Phase phase, uint64_t nanoseconds);
+
+    std::vector<PhaseStats> Summarize() const;
+
+private:
+    static const int kSubBuckets = 16;
+    static const int kBuckets = 64 * kSubBuckets;
+
+    static int BucketIndex(uint64_t value);
+    static uint64_t BucketValue(int index);
+
+    struct PhaseData {
+        uint64_t count;
+        uint64_t total;
+        uint64_t max;
+        std::vector<uint64_t> buckets;
+    };
+
+    std::vector<PhaseData> _phases;
+};
+
+// Prints one row per phase: count, total, p50, p99, max
+void PrintPhaseTable(const std::vector<PhaseStats>& stats);
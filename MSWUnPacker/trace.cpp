@@ -0,0 +1,234 @@
+/*
+ * Trace Export (--trace)
+ */
+
+#include "trace.h"
+#include "timings.h"
+#include "memstats.h"
+#include "platform.h"
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+#define RAPIDJSON_HAS_STDSTRING 1
+#include "rapidjson/writer.h"
+#include "rapidjson/filewritestream.h"
+
+std::atomic<bool> g_traceEnabled(false);
+
+namespace {
+
+struct TraceEvent {
+    char type;                  // 'X' complete span, 'C' counter
+    const char* name;
+    uint64_t start;             // Nanoseconds since EnableTrace
+    uint64_t duration;
+    int64_t value;              // Entry index of a span (-1 for none), counter value
+    std::string detail;
+};
+
+// Owned by the registry rather than the thread, so events survive the
+// thread exiting. Only the owning thread touches it until WriteTrace.
+struct ThreadTraceBuffer {
+    int tid;
+    std::string name;
+    std::deque<TraceEvent> events;  // Grows without moving what is recorded
+};
+
+std::mutex g_registryMutex;
+std::vector<std::unique_ptr<ThreadTraceBuffer>> g_buffers;
+uint64_t g_traceStart = 0;
+std::string g_tracePath;
+
+thread_local ThreadTraceBuffer* t_traceBuffer = nullptr;
+
+// The registry lock is only taken on a thread's first event
+ThreadTraceBuffer& ThreadBuffer() {
+    if (!t_traceBuffer) {
+        std::lock_guard<std::mutex> lock(g_registryMutex);
+        g_buffers.emplace_back(new ThreadTraceBuffer);
+        t_traceBuffer = g_buffers.back().get();
+        t_traceBuffer->tid = static_cast<int>(g_buffers.size());
+        t_traceBuffer->name = "thread " + std::to_string(t_traceBuffer->tid);
+    }
+    return *t_traceBuffer;
+}
+
+uint64_t SinceStart(uint64_t nanoseconds) {
+    return nanoseconds > g_traceStart ? nanoseconds - g_traceStart : 0;
+}
+
+// Trace timestamps are in microseconds
+double ToMicroseconds(uint64_t nanoseconds) {
+    return nanoseconds / 1000.0;
+}
+
+void WriteTraceAtExit() {
+    if (WriteTrace(g_tracePath)) {
+        printf("Trace written to %s\n", g_tracePath.c_str());
+    }
+}
+
+} // namespace
+
+void EnableTrace(const std::string& path) {
+    g_tracePath = path;
+    g_traceStart = TimingClockNanoseconds();
+    g_traceEnabled.store(true, std::memory_order_release);
+    atexit(WriteTraceAtExit);
+}
+
+void TraceSetThreadName(const std::string& name) {
+    if (TraceEnabled()) {
+        ThreadBuffer().name = name;
+    }
+}
+
+void TraceSpan(const char* name, uint64_t startNanoseconds, uint64_t endNanoseconds,
+               const std::string& detail, int64_t index) {
+    TraceEvent event;
+    event.type = 'X';
+    event.name = name;
+    event.start = SinceStart(startNanoseconds);
+    event.duration = endNanoseconds > startNanoseconds ? endNanoseconds - startNanoseconds : 0;
+    event.value = index;
+    event.detail = detail;
+
+    ThreadBuffer().events.push_back(std::move(event));
+}
+
+void TraceCounter(const char* name, int64_t value) {
+    if (!TraceEnabled()) {
+        return;
+    }
+
+    TraceEvent event;
+    event.type = 'C';
+    event.name = name;
+    event.start = SinceStart(TimingClockNanoseconds());
+    event.duration = 0;
+    event.value = value;
+
+    ThreadBuffer().events.push_back(std::move(event));
+}
+
+ScopedTraceSpan::ScopedTraceSpan(const char* name, const std::string& detail, int64_t index)
+    : _name(name)
+    , _detail(detail)
+    , _index(index)
+    , _start(TraceEnabled() ? TimingClockNanoseconds() : 0)
+{}
+
+ScopedTraceSpan::~ScopedTraceSpan() {
+    if (_start) {
+        TraceSpan(_name, _start, TimingClockNanoseconds(), _detail, _index);
+    }
+}
+
+// ============================================================================
+// Export
+// ============================================================================
+
+bool WriteTrace(const std::string& path) {
+    FILE* file = nullptr;
+    if (fopen_s(&file, path.c_str(), "wb") != 0 || !file) {
+        fprintf(stderr, "Error: Could not write trace %s\n", path.c_str());
+        return false;
+    }
+
+    // Streamed straight to the file, a long batch can have millions of events
+    std::vector<char> streamBuffer(64 * 1024);
+    rapidjson::FileWriteStream stream(file, streamBuffer.data(), streamBuffer.size());
+    rapidjson::Writer<rapidjson::FileWriteStream> writer(stream);
+
+    std::lock_guard<std::mutex> lock(g_registryMutex);
+
+    writer.StartObject();
+    writer.Key("displayTimeUnit");
+    writer.String("ms");
+    writer.Key("traceEvents");
+    writer.StartArray();
+
+    writer.StartObject();
+    writer.Key("name"); writer.String("process_name");
+    writer.Key("ph"); writer.String("M");
+    writer.Key("pid"); writer.Int(1);
+    writer.Key("args");
+    writer.StartObject();
+    writer.Key("name"); writer.String("MSWUnPacker");
+    writer.EndObject();
+    writer.EndObject();
+
+    for (const std::unique_ptr<ThreadTraceBuffer>& buffer : g_buffers) {
+        // Track label, and keep the tracks in the order the threads started
+        writer.StartObject();
+        writer.Key("name"); writer.String("thread_name");
+        writer.Key("ph"); writer.String("M");
+        writer.Key("pid"); writer.Int(1);
+        writer.Key("tid"); writer.Int(buffer->tid);
+        writer.Key("args");
+        writer.StartObject();
+        writer.Key("name"); writer.String(buffer->name);
+        writer.EndObject();
+        writer.EndObject();
+
+        writer.StartObject();
+        writer.Key("name"); writer.String("thread_sort_index");
+        writer.Key("ph"); writer.String("M");
+        writer.Key("pid"); writer.Int(1);
+        writer.Key("tid"); writer.Int(buffer->tid);
+        writer.Key("args");
+        writer.StartObject();
+        writer.Key("sort_index"); writer.Int(buffer->tid);
+        writer.EndObject();
+        writer.EndObject();
+
+        for (const TraceEvent& event : buffer->events) {
+            writer.StartObject();
+            writer.Key("name"); writer.String(event.name);
+            writer.Key("ph"); writer.String(event.type == 'X' ? "X" : "C");
+            writer.Key("ts"); writer.Double(ToMicroseconds(event.start));
+            writer.Key("pid"); writer.Int(1);
+            writer.Key("tid"); writer.Int(buffer->tid);
+
+            if (event.type == 'X') {
+                writer.Key("dur"); writer.Double(ToMicroseconds(event.duration));
+
+                if (!event.detail.empty() || event.value >= 0) {
+                    writer.Key("args");
+                    writer.StartObject();
+                    if (!event.detail.empty()) {
+                        writer.Key("file"); writer.String(event.detail);
+                    }
+                    if (event.value >= 0) {
+                        writer.Key("entry"); writer.Int64(event.value);
+                    }
+                    writer.EndObject();
+                }
+            } else {
+                writer.Key("args");
+                writer.StartObject();
+                writer.Key("value"); writer.Int64(event.value);
+                writer.EndObject();
+            }
+
+            writer.EndObject();
+        }
+    }
+
+    writer.EndArray();
+    writer.EndObject();
+    stream.Flush();
+
+    bool ok = !ferror(file);
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Error: Could not write trace %s\n", path.c_str());
+    }
+    return ok;
+}
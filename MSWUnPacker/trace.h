@@ -0,0 +1,59 @@
+#pragma once
+/*
+ * Trace Export (--trace)
+ *
+ * Records spans and counters in the Chrome trace-event format, which loads
+ * in chrome://tracing and ui.perfetto.dev. Every thread appends to its own
+ * buffer without taking a lock, so each worker shows up as one track. The
+ * buffers are only read by WriteTrace once every thread has finished.
+ *
+ * Phase timers (TIME_PHASE) emit a span each when tracing is on, file and
+ * entry spans around them come from ScopedTraceSpan.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+extern std::atomic<bool> g_traceEnabled;
+
+inline bool TraceEnabled() {
+    return g_traceEnabled.load(std::memory_order_relaxed);
+}
+
+// Starts recording, timestamps are relative to this call. The trace is
+// written to path when the process exits (after main returns, by which time
+// the batch threads have been joined).
+void EnableTrace(const std::string& path);
+
+// Label of the calling thread's track
+void TraceSetThreadName(const std::string& name);
+
+// name must outlive the trace (a string literal), detail is copied.
+// Times are TimingClockNanoseconds() values.
+void TraceSpan(const char* name, uint64_t startNanoseconds, uint64_t endNanoseconds,
+               const std::string& detail = std::string(), int64_t index = -1);
+
+// Sample of a counter track, e.g. queue depth
+void TraceCounter(const char* name, int64_t value);
+
+// Span over the rest of the enclosing scope. detail and index go into the
+// event's args (file name, entry number), detail must outlive the span.
+class ScopedTraceSpan {
+public:
+    ScopedTraceSpan(const char* name, const std::string& detail, int64_t index = -1);
+    ~ScopedTraceSpan();
+
+    ScopedTraceSpan(const ScopedTraceSpan&) = delete;
+    ScopedTraceSpan& operator=(const ScopedTraceSpan&) = delete;
+
+private:
+    const char* _name;
+    const std::string& _detail;
+    int64_t _index;
+    uint64_t _start;
+};
+
+// Writes every thread's events as one JSON file. Call after all threads that
+// recorded events have been joined.
+bool WriteTrace(const std::string& path);
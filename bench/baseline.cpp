@@ -0,0 +1,209 @@
+/*
+ * Benchmark Baselines
+ */
+
+#include "baseline.h"
+#include <cmath>
+#include <cstdio>
+#include "memstats.h"
+#include "jsonfile.h"
+#include "platform.h"
+#define RAPIDJSON_HAS_STDSTRING 1
+#include "rapidjson/prettywriter.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/document.h"
+
+namespace {
+
+// A difference under 3 MADs of either run is noise. 1.4826 scales a MAD
+// to the standard deviation of a normal distribution.
+constexpr double NOISE_MADS = 3.0 * 1.4826;
+
+constexpr int64_t HEAP_SLACK_BYTES = 64 * 1024;
+
+// Peak RSS is the whole process: page cache touched by the benchmark files,
+// allocator growth and, in compare mode, the baseline that was loaded first.
+// Only growth past this counts, on top of the threshold.
+constexpr int64_t RSS_SLACK_BYTES = 8 * 1024 * 1024;
+
+const BenchResult* FindResult(const BenchBaseline& baseline, const std::string& name) {
+    for (const BenchResult& result : baseline.results) {
+        if (result.name == name) {
+            return &result;
+        }
+    }
+    return nullptr;
+}
+
+uint64_t GetUint64(const rapidjson::Value& object, const char* key) {
+    return object.HasMember(key) && object[key].IsUint64() ? object[key].GetUint64() : 0;
+}
+
+int64_t GetInt64(const rapidjson::Value& object, const char* key) {
+    return object.HasMember(key) && object[key].IsInt64() ? object[key].GetInt64() : 0;
+}
+
+double GetDouble(const rapidjson::Value& object, const char* key) {
+    return object.HasMember(key) && object[key].IsNumber() ? object[key].GetDouble() : 0.0;
+}
+
+double PercentChange(double base, double current) {
+    return base > 0.0 ? (current - base) * 100.0 / base : 0.0;
+}
+
+bool OverThreshold(double base, double current, double thresholdPercent) {
+    return current > base * (1.0 + thresholdPercent / 100.0);
+}
+
+} // namespace
+
+bool SaveBaseline(const std::string& path, const BenchBaseline& baseline) {
+    rapidjson::StringBuffer jsonBuf{};
+    rapidjson::PrettyWriter<rapidjson::StringBuffer> jsonWriter{jsonBuf};
+
+    jsonWriter.StartObject();
+    jsonWriter.Key("version"); jsonWriter.Int(1);
+    jsonWriter.Key("peakRssBytes"); jsonWriter.Uint64(baseline.peakRssBytes);
+    jsonWriter.Key("benchmarks");
+    jsonWriter.StartArray();
+    for (const BenchResult& result : baseline.results) {
+        jsonWriter.StartObject();
+        jsonWriter.Key("name"); jsonWriter.String(result.name);
+        jsonWriter.Key("runs"); jsonWriter.Uint64(result.runs);
+        jsonWriter.Key("medianMs"); jsonWriter.Double(result.medianMs);
+        jsonWriter.Key("madMs"); jsonWriter.Double(result.madMs);
+        jsonWriter.Key("mbPerSecond"); jsonWriter.Double(result.mbPerSecond);
+        jsonWriter.Key("shadersPerSecond"); jsonWriter.Double(result.shadersPerSecond);
+        jsonWriter.Key("allocations"); jsonWriter.Uint64(result.allocations);
+        jsonWriter.Key("allocatedBytes"); jsonWriter.Uint64(result.allocatedBytes);
+        jsonWriter.Key("peakHeapBytes"); jsonWriter.Int64(result.peakHeapBytes);
+        jsonWriter.EndObject();
+    }
+    jsonWriter.EndArray();
+    jsonWriter.EndObject();
+
+    FILE* file = nullptr;
+    if (fopen_s(&file, path.c_str(), "wb") != 0 || !file) {
+        fprintf(stderr, "Error: Could not write baseline %s\n", path.c_str());
+        return false;
+    }
+
+    bool ok = fwrite(jsonBuf.GetString(), 1, jsonBuf.GetSize(), file) == jsonBuf.GetSize();
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: Could not write baseline %s\n", path.c_str());
+    }
+    return ok;
+}
+
+bool LoadBaseline(const std::string& path, BenchBaseline& baseline) {
+    JsonFile json;
+    if (!json.Load(path)) {
+        fprintf(stderr, "Error: Could not read baseline %s\n", path.c_str());
+        return false;
+    }
+
+    const rapidjson::Document& jsonDoc = json.GetDocument();
+    if (jsonDoc.HasParseError() || !jsonDoc.IsObject() || !jsonDoc.HasMember("benchmarks") ||
+        !jsonDoc["benchmarks"].IsArray()) {
+        fprintf(stderr, "Error: %s is not a bench baseline\n", path.c_str());
+        return false;
+    }
+
+    baseline.peakRssBytes = GetUint64(jsonDoc, "peakRssBytes");
+    baseline.results.clear();
+
+    for (const rapidjson::Value& item : jsonDoc["benchmarks"].GetArray()) {
+        if (!item.IsObject() || !item.HasMember("name") || !item["name"].IsString()) {
+            continue;
+        }
+
+        BenchResult result;
+        result.name = item["name"].GetString();
+        result.runs = GetUint64(item, "runs");
+        result.medianMs = GetDouble(item, "medianMs");
+        result.madMs = GetDouble(item, "madMs");
+        result.mbPerSecond = GetDouble(item, "mbPerSecond");
+        result.shadersPerSecond = GetDouble(item, "shadersPerSecond");
+        result.allocations = GetUint64(item, "allocations");
+        result.allocatedBytes = GetUint64(item, "allocatedBytes");
+        result.peakHeapBytes = GetInt64(item, "peakHeapBytes");
+        baseline.results.push_back(result);
+    }
+
+    return true;
+}
+
+int CompareBaselines(const BenchBaseline& base, const BenchBaseline& current, double thresholdPercent) {
+    int regressions = 0;
+
+    printf("\nCompared to baseline (threshold %.1f%%):\n", thresholdPercent);
+    printf("  %-28s %10s %10s %8s %8s %9s %9s  %s\n", "Benchmark", "Base ms", "Now ms", "Change", "Noise",
+           "Allocs", "Peak heap", "Result");
+
+    for (const BenchResult& now : current.results) {
+        const BenchResult* was = FindResult(base, now.name);
+        if (!was) {
+            printf("  %-28s %10s %10.3f %8s %8s %9s %9s  new\n", now.name.c_str(), "-", now.medianMs, "-", "-", "-", "-");
+            continue;
+        }
+
+        double delta = now.medianMs - was->medianMs;
+        double noise = NOISE_MADS * std::sqrt(was->madMs * was->madMs + now.madMs * now.madMs);
+        double threshold = was->medianMs * thresholdPercent / 100.0;
+
+        std::string verdict;
+        auto flag = [&](const char* text) {
+            verdict += verdict.empty() ? text : std::string(", ") + text;
+            regressions++;
+        };
+
+        if (delta > threshold && delta > noise) {
+            flag("SLOWER");
+        }
+        if (OverThreshold(static_cast<double>(was->allocations), static_cast<double>(now.allocations), thresholdPercent)) {
+            flag("MORE ALLOCS");
+        }
+        if (OverThreshold(static_cast<double>(was->peakHeapBytes), static_cast<double>(now.peakHeapBytes), thresholdPercent) &&
+            now.peakHeapBytes - was->peakHeapBytes > HEAP_SLACK_BYTES) {
+            flag("MORE HEAP");
+        }
+        if (verdict.empty()) {
+            verdict = -delta > threshold && -delta > noise ? "faster" : "ok";
+        }
+
+        printf("  %-28s %10.3f %10.3f %+7.1f%% %7.1f%% %+8.1f%% %+8.1f%%  %s\n", now.name.c_str(), was->medianMs,
+               now.medianMs, PercentChange(was->medianMs, now.medianMs),
+               was->medianMs > 0.0 ? noise * 100.0 / was->medianMs : 0.0,
+               PercentChange(static_cast<double>(was->allocations), static_cast<double>(now.allocations)),
+               PercentChange(static_cast<double>(was->peakHeapBytes), static_cast<double>(now.peakHeapBytes)),
+               verdict.c_str());
+    }
+
+    for (const BenchResult& was : base.results) {
+        if (!FindResult(current, was.name)) {
+            printf("  %-28s %10.3f %10s %8s %8s %9s %9s  not run\n", was.name.c_str(), was.medianMs, "-", "-", "-", "-", "-");
+        }
+    }
+
+    if (base.peakRssBytes && current.peakRssBytes) {
+        bool higher = OverThreshold(static_cast<double>(base.peakRssBytes), static_cast<double>(current.peakRssBytes), thresholdPercent) &&
+                      static_cast<int64_t>(current.peakRssBytes - base.peakRssBytes) > RSS_SLACK_BYTES;
+        printf("\n  Peak RSS: %.1f MB -> %.1f MB (%+.1f%%)%s\n", base.peakRssBytes / (1024.0 * 1024.0),
+               current.peakRssBytes / (1024.0 * 1024.0),
+               PercentChange(static_cast<double>(base.peakRssBytes), static_cast<double>(current.peakRssBytes)),
+               higher ? "  HIGHER" : "");
+        if (higher) {
+            regressions++;
+        }
+    }
+
+    if (regressions) {
+        printf("\n%d regression%s\n", regressions, regressions == 1 ? "" : "s");
+    } else {
+        printf("\nNo regressions\n");
+    }
+    return regressions;
+}
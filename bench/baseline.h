@@ -0,0 +1,52 @@
+#pragma once
+/*
+ * Benchmark Baselines
+ *
+ * Saves a run's results (bench --save) and compares a run against a saved
+ * one (bench compare). A benchmark counts as slower only when its median is
+ * over the threshold AND the difference is well outside the spread of both
+ * runs, measured as the median absolute deviation, so noisy benchmarks do
+ * not flag on every run. Allocation counts and peak heap have little noise
+ * and are checked against the threshold alone (peak heap with 64 KB of slack,
+ * threaded runs peak at slightly different points). The process peak RSS
+ * also has to grow by more than 8 MB: it moves by a few MB between runs, and
+ * compare mode holds the loaded baseline on top.
+ *
+ * {
+ *   "version": 1,
+ *   "peakRssBytes": ...,
+ *   "benchmarks": [ { "name", "runs", "medianMs", "madMs", "mbPerSecond",
+ *                     "shadersPerSecond", "allocations", "allocatedBytes",
+ *                     "peakHeapBytes" }, ... ]
+ * }
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct BenchResult {
+    std::string name;
+    uint64_t runs;
+    double medianMs;
+    double madMs;               // Median absolute deviation of the runs
+    double mbPerSecond;
+    double shadersPerSecond;
+    uint64_t allocations;       // Per run, fewest seen over the runs
+    uint64_t allocatedBytes;
+    int64_t peakHeapBytes;      // Heap growth over a run, most seen over the runs
+};
+
+struct BenchBaseline {
+    uint64_t peakRssBytes;
+    std::vector<BenchResult> results;
+
+    BenchBaseline() : peakRssBytes(0) {}
+};
+
+bool SaveBaseline(const std::string& path, const BenchBaseline& baseline);
+bool LoadBaseline(const std::string& path, BenchBaseline& baseline);
+
+// Prints a comparison table, returns the number of regressions.
+// thresholdPercent applies to time, allocations and memory alike.
+int CompareBaselines(const BenchBaseline& base, const BenchBaseline& current, double thresholdPercent);
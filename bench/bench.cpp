@@ -0,0 +1,537 @@
+/*
+ * MSWUnPacker Benchmarks
+ *
+ * Microbenchmarks of the DXBC hash, layout detection and each patch over every
+ * standard entry of the input MSWs, MSW read/write, and convert-legacy end to
+ * end through the batch pipeline. Each benchmark is repeated until it has run
+ * for --min-time and reports the median run, its median absolute deviation
+ * and the allocations a run makes (every allocation is counted, see
+ * memstats.h, which costs the same in every run and every baseline).
+ *
+ *   bench [options] [file.msw ...]     (default: the sample MSWs in the repo)
+ *   bench compare <baseline.json> [options] [file.msw ...]
+ *                                      Run, then compare against a saved run
+ *   bench compare <baseline.json> <current.json>
+ *                                      Compare two saved runs
+ *
+ * Exits with 1 if compare finds a regression, see baseline.h.
+ *
+ *     --filter <text>     Only run benchmarks whose name contains text
+ *     --min-time <s>      Time spent on each benchmark (default 0.5)
+ *     --min-runs <n>      Fewest runs of each benchmark (default 5)
+ *     --synthetic         Also sweep synthetic shaders from 1 KB to 1 MB and
+ *                         MSWs from 1 to 255 entries (see synth.h)
+ *     --save <file>       Save the results as a baseline
+ *     --threshold <pct>   Slowdown/growth compare flags (default 5)
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include "multishader.h"
+#include "lazymsw.h"
+#include "dxbc.h"
+#include "legacy.h"
+#include "pipeline.h"
+#include "log.h"
+#include "memstats.h"
+#include "synth.h"
+#include "baseline.h"
+
+namespace fs = std::filesystem;
+
+#ifndef MSW_SAMPLE_DIR
+#define MSW_SAMPLE_DIR "MSWUnPacker"
+#endif
+
+namespace {
+
+struct BenchOptions {
+    std::string filter;
+    double minSeconds;
+    int minRuns;
+    bool synthetic;
+    double thresholdPercent;
+    std::string savePath;
+    std::string baselinePath;   // bench compare
+    std::string currentPath;    // bench compare of two saved runs
+
+    BenchOptions() : minSeconds(0.5), minRuns(5), synthetic(false), thresholdPercent(5.0) {}
+};
+
+// One input MSW and the standard entries it holds
+struct Sample {
+    fs::path path;
+    uint64_t fileBytes;
+    std::vector<std::vector<uint8_t>> entries;
+};
+
+struct Corpus {
+    std::vector<Sample> samples;
+    uint64_t fileBytes;
+    uint64_t entryBytes;
+    uint64_t entryCount;
+
+    Corpus() : fileBytes(0), entryBytes(0), entryCount(0) {}
+};
+
+// What one run of a benchmark processes, for the throughput columns
+struct Workload {
+    uint64_t bytes;
+    uint64_t shaders;
+};
+
+// Every benchmark run so far, in order
+std::vector<BenchResult> g_results;
+
+double Seconds(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration<double>(duration).count();
+}
+
+double Median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+// ============================================================================
+// Harness
+// ============================================================================
+
+// setup runs untimed before every run (e.g. fresh copies of the entries to patch)
+void RunBenchmark(const BenchOptions& options, const char* name, const Workload& work,
+                  const std::function<void()>& setup, const std::function<void()>& body) {
+    if (!options.filter.empty() && !strstr(name, options.filter.c_str())) {
+        return;
+    }
+
+    std::vector<double> runs;
+    double total = 0.0;
+
+    BenchResult result;
+    result.name = name;
+    result.allocations = UINT64_MAX;
+    result.allocatedBytes = UINT64_MAX;
+    result.peakHeapBytes = 0;
+
+    while (static_cast<int>(runs.size()) < options.minRuns || total < options.minSeconds) {
+        if (setup) {
+            setup();
+        }
+
+        AllocCounters allocsBefore = AllocTotals();
+        ResetPeakHeap();
+        int64_t liveBefore = LiveHeapBytes();
+
+        auto start = std::chrono::steady_clock::now();
+        body();
+        double seconds = Seconds(std::chrono::steady_clock::now() - start);
+
+        AllocCounters allocsAfter = AllocTotals();
+        result.allocations = std::min(result.allocations, allocsAfter.allocations - allocsBefore.allocations);
+        result.allocatedBytes = std::min(result.allocatedBytes, allocsAfter.bytes - allocsBefore.bytes);
+        result.peakHeapBytes = std::max(result.peakHeapBytes, PeakHeapBytes() - liveBefore);
+
+        runs.push_back(seconds);
+        total += seconds;
+    }
+
+    double median = Median(runs);
+
+    std::vector<double> deviations;
+    for (double seconds : runs) {
+        deviations.push_back(std::fabs(seconds - median));
+    }
+    double mad = Median(deviations);
+
+    result.runs = runs.size();
+    result.medianMs = median * 1e3;
+    result.madMs = mad * 1e3;
+    result.mbPerSecond = median > 0.0 ? work.bytes / (1024.0 * 1024.0) / median : 0.0;
+    result.shadersPerSecond = median > 0.0 ? work.shaders / median : 0.0;
+    g_results.push_back(result);
+
+    double usPerShader = work.shaders ? median * 1e6 / work.shaders : 0.0;
+
+    printf("  %-28s %6zu %12.3f %6.1f%% %12.3f %12.1f %14.0f %12llu\n", name, runs.size(), result.medianMs,
+           median > 0.0 ? mad * 100.0 / median : 0.0, usPerShader, result.mbPerSecond, result.shadersPerSecond,
+           static_cast<unsigned long long>(result.allocations));
+    fflush(stdout);
+}
+
+void PrintHeader(const char* title) {
+    printf("\n%s\n", title);
+    printf("  %-28s %6s %12s %7s %12s %12s %14s %12s\n", "Benchmark", "Runs", "Median ms", "MAD", "us/shader", "MB/s",
+           "Shaders/s", "Allocs/run");
+}
+
+bool LoadCorpus(const std::vector<fs::path>& paths, Corpus& corpus) {
+    for (const fs::path& path : paths) {
+        CMultiShaderWrapperIO::ShaderCache_t cache;
+        CMultiShaderWrapperIO io;
+        if (!io.ReadFile(path.string().c_str(), &cache)) {
+            fprintf(stderr, "Error: Could not read %s\n", path.string().c_str());
+            return false;
+        }
+
+        Sample sample;
+        sample.path = path;
+        sample.fileBytes = fs::file_size(path);
+
+        if (cache.type == MultiShaderWrapperFileType_e::SHADER && cache.shader) {
+            for (const CMultiShaderWrapperIO::ShaderEntry_t& entry : cache.shader->entries) {
+                if (!entry.buffer) continue;
+
+                const uint8_t* bytes = reinterpret_cast<const uint8_t*>(entry.buffer);
+                sample.entries.emplace_back(bytes, bytes + entry.size);
+                corpus.entryBytes += entry.size;
+                corpus.entryCount++;
+            }
+        }
+
+        printf("  %s: %llu bytes, %zu standard entries\n", path.filename().string().c_str(),
+               static_cast<unsigned long long>(sample.fileBytes), sample.entries.size());
+
+        corpus.fileBytes += sample.fileBytes;
+        corpus.samples.push_back(std::move(sample));
+    }
+
+    return true;
+}
+
+// ============================================================================
+// Microbenchmarks
+// ============================================================================
+
+typedef dxbc::PatchResult (*PatchFunction)(std::vector<uint8_t>&);
+
+struct PatchBenchmark {
+    const char* name;
+    PatchFunction patch;
+};
+
+dxbc::PatchResult PatchSRVSlotsDefault(std::vector<uint8_t>& data) {
+    return dxbc::PatchSRVSlots(data);
+}
+
+void RunDxbcBenchmarks(const BenchOptions& options, const Corpus& corpus) {
+    PrintHeader("DXBC (per pass over every standard entry):");
+
+    Workload work = { corpus.entryBytes, corpus.entryCount };
+    volatile uint32_t sink = 0;
+
+    RunBenchmark(options, "ComputeHash", work, nullptr, [&]() {
+        for (const Sample& sample : corpus.samples) {
+            for (const std::vector<uint8_t>& entry : sample.entries) {
+                if (entry.size() < 20) continue;
+                std::array<uint32_t, 4> hash = dxbc::ComputeHash(entry.data() + 20, static_cast<uint32_t>(entry.size() - 20));
+                sink = sink + hash[0];
+            }
+        }
+    });
+
+    RunBenchmark(options, "DetectCBLayout", work, nullptr, [&]() {
+        for (const Sample& sample : corpus.samples) {
+            for (const std::vector<uint8_t>& entry : sample.entries) {
+                dxbc::CBLayoutInfo info = dxbc::DetectCBLayout(entry.data(), entry.size());
+                sink = sink + (info.needsSwap ? 1 : 0);
+            }
+        }
+    });
+
+    static const PatchBenchmark kPatches[] = {
+        { "PatchSunDataUnpacking", dxbc::PatchSunDataUnpacking },
+        { "PatchUberFeatureFlags", dxbc::PatchUberFeatureFlags },
+        { "PatchFeatureFlagBit1", dxbc::PatchFeatureFlagBit1 },
+        { "PatchShadowBlendMultiply", dxbc::PatchShadowBlendMultiply },
+        { "PatchSRVSlots", PatchSRVSlotsDefault },
+        { "PatchRemoveClusteredLighting", dxbc::PatchRemoveClusteredLighting },
+        { "PatchSubsurfaceMaterialID", dxbc::PatchSubsurfaceMaterialID },
+        { "SwapCB2CB3", dxbc::SwapCB2CB3 },
+    };
+
+    // Patches modify their input, every run gets fresh copies
+    std::vector<std::vector<uint8_t>> scratch;
+    auto copyEntries = [&]() {
+        scratch.clear();
+        for (const Sample& sample : corpus.samples) {
+            scratch.insert(scratch.end(), sample.entries.begin(), sample.entries.end());
+        }
+    };
+
+    for (const PatchBenchmark& bench : kPatches) {
+        RunBenchmark(options, bench.name, work, copyEntries, [&]() {
+            for (std::vector<uint8_t>& entry : scratch) {
+                dxbc::PatchResult result = bench.patch(entry);
+                sink = sink + result.shexPatches;
+            }
+        });
+    }
+
+    RunBenchmark(options, "UpdateHash", work, copyEntries, [&]() {
+        for (std::vector<uint8_t>& entry : scratch) {
+            dxbc::UpdateHash(entry);
+        }
+    });
+
+    RunBenchmark(options, "ApplyLegacyPatches", work, copyEntries, [&]() {
+        for (std::vector<uint8_t>& entry : scratch) {
+            dxbc::CBLayoutInfo info = dxbc::DetectCBLayout(entry.data(), entry.size());
+            LegacyPatchResult result = ApplyLegacyPatches(entry, info);
+            sink = sink + (result.wasPatched ? 1 : 0);
+        }
+    });
+}
+
+void RunFileBenchmarks(const BenchOptions& options, const Corpus& corpus, const fs::path& tempDir) {
+    PrintHeader("MSW files (per pass over every input):");
+
+    Workload work = { corpus.fileBytes, corpus.entryCount };
+    volatile uint32_t sink = 0;
+
+    RunBenchmark(options, "ReadFile", work, nullptr, [&]() {
+        for (const Sample& sample : corpus.samples) {
+            CMultiShaderWrapperIO::ShaderCache_t cache;
+            CMultiShaderWrapperIO io;
+            io.ReadFile(sample.path.string().c_str(), &cache);
+        }
+    });
+
+    // Headers, descriptors and names only, what listing and filtering need
+    RunBenchmark(options, "ReadHeaders", work, nullptr, [&]() {
+        for (const Sample& sample : corpus.samples) {
+            LazyMswReader reader;
+            sink = sink + (reader.Open(sample.path) ? 1 : 0);
+        }
+    });
+
+    // Written back from memory, so only the write itself is timed
+    std::vector<std::unique_ptr<CMultiShaderWrapperIO::ShaderCache_t>> caches;
+    for (const Sample& sample : corpus.samples) {
+        caches.emplace_back(new CMultiShaderWrapperIO::ShaderCache_t);
+        CMultiShaderWrapperIO io;
+        io.ReadFile(sample.path.string().c_str(), caches.back().get());
+    }
+
+    RunBenchmark(options, "WriteFile", work, nullptr, [&]() {
+        for (size_t i = 0; i < caches.size(); i++) {
+            CMultiShaderWrapperIO::ShaderCache_t& cache = *caches[i];
+            if (cache.type != MultiShaderWrapperFileType_e::SHADER) continue;
+
+            CMultiShaderWrapperIO writer{};
+            writer.SetFileType(MultiShaderWrapperFileType_e::SHADER);
+            writer.SetShader(cache.shader);
+            writer.WriteFile((tempDir / ("write_" + std::to_string(i) + ".msw")).string().c_str());
+        }
+    });
+}
+
+// ============================================================================
+// End to End
+// ============================================================================
+
+void RunConvertBenchmarks(const BenchOptions& options, const Corpus& corpus, const fs::path& tempDir) {
+    PrintHeader("convert-legacy (read, patch, write through the batch pipeline):");
+
+    Workload work = { corpus.fileBytes, corpus.entryCount };
+
+    std::vector<BatchInput> inputs;
+    for (const Sample& sample : corpus.samples) {
+        BatchInput input;
+        input.inputPath = sample.path;
+        input.outputPath = tempDir / sample.path.filename();
+        input.relativePath = sample.path.filename().generic_string();
+        inputs.push_back(input);
+    }
+
+    for (int workers : { 1, 0 }) {
+        BatchOptions batchOptions;
+        batchOptions.numWorkers = workers;
+
+        std::string name = workers == 1 ? "convert-legacy -j 1" : "convert-legacy -j auto";
+        RunBenchmark(options, name.c_str(), work, nullptr, [&]() {
+            RunLegacyBatch(inputs, batchOptions);
+        });
+    }
+}
+
+// ============================================================================
+// Synthetic Scaling
+// ============================================================================
+
+void RunSyntheticBenchmarks(const BenchOptions& options, const fs::path& tempDir) {
+    PrintHeader("Synthetic shader size (ApplyLegacyPatches over 8 S9 shaders):");
+
+    for (uint32_t size : { 1024u, 16u * 1024, 256u * 1024, 1024u * 1024 }) {
+        std::vector<std::vector<uint8_t>> entries;
+        Workload work = { 0, 0 };
+        for (uint32_t i = 0; i < 8; i++) {
+            SynthShaderOptions shaderOptions;
+            shaderOptions.targetBytes = size;
+            shaderOptions.seed = i + 1;
+            entries.push_back(BuildSyntheticDxbc(shaderOptions));
+            work.bytes += entries.back().size();
+            work.shaders++;
+        }
+
+        std::vector<std::vector<uint8_t>> scratch;
+        volatile uint32_t sink = 0;
+
+        std::string name = "patch chain " + FormatSynthSize(size);
+        RunBenchmark(options, name.c_str(), work, [&]() { scratch = entries; }, [&]() {
+            for (std::vector<uint8_t>& entry : scratch) {
+                dxbc::CBLayoutInfo info = dxbc::DetectCBLayout(entry.data(), entry.size());
+                LegacyPatchResult result = ApplyLegacyPatches(entry, info);
+                sink = sink + (result.wasPatched ? 1 : 0);
+            }
+        });
+    }
+
+    PrintHeader("Synthetic entry count (convert-legacy -j 1 of one MSW, 16 KB shaders):");
+
+    for (int entries : { 1, 16, 64, SYNTH_MAX_ENTRIES }) {
+        SynthMswOptions mswOptions;
+        mswOptions.entries = entries;
+        mswOptions.name = "synthetic";
+
+        std::string fileName = "synth_entries-" + std::to_string(entries) + ".msw";
+        BatchInput input;
+        input.inputPath = tempDir / fileName;
+        input.outputPath = tempDir / ("out_" + fileName);
+        input.relativePath = fileName;
+
+        std::unique_ptr<CMultiShaderWrapperIO::Shader_t> shader = BuildSyntheticShader(mswOptions);
+        Workload work = { 0, 0 };
+        for (const CMultiShaderWrapperIO::ShaderEntry_t& entry : shader->entries) {
+            if (!entry.buffer) continue;
+            work.bytes += entry.size;
+            work.shaders++;
+        }
+
+        CMultiShaderWrapperIO writer{};
+        writer.SetFileType(MultiShaderWrapperFileType_e::SHADER);
+        writer.SetShader(shader.get());
+        if (!writer.WriteFile(input.inputPath.string().c_str())) {
+            fprintf(stderr, "Error: Could not write %s\n", input.inputPath.string().c_str());
+            continue;
+        }
+
+        std::vector<BatchInput> inputs = { input };
+        BatchOptions batchOptions;
+        batchOptions.numWorkers = 1;
+
+        std::string name = "convert " + std::to_string(entries) + " entries";
+        RunBenchmark(options, name.c_str(), work, nullptr, [&]() {
+            RunLegacyBatch(inputs, batchOptions);
+        });
+    }
+}
+
+} // namespace
+
+int PrintUsage() {
+    fprintf(stderr, "Usage: bench [compare <baseline.json> [current.json]] [--filter text] [--min-time s] [--min-runs n]\n");
+    fprintf(stderr, "             [--synthetic] [--save file] [--threshold pct] [file.msw ...]\n");
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    std::vector<fs::path> paths;
+
+    int first = 1;
+    if (argc > 2 && !strcmp(argv[1], "compare")) {
+        options.baselinePath = argv[2];
+        first = 3;
+        if (argc > 3 && fs::path(argv[3]).extension() == ".json") {
+            options.currentPath = argv[3];
+            first = 4;
+        }
+    }
+
+    for (int i = first; i < argc; i++) {
+        if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (!strcmp(argv[i], "--min-time") && i + 1 < argc) {
+            options.minSeconds = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--min-runs") && i + 1 < argc) {
+            options.minRuns = std::max(1, atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "--synthetic")) {
+            options.synthetic = true;
+        } else if (!strcmp(argv[i], "--save") && i + 1 < argc) {
+            options.savePath = argv[++i];
+        } else if (!strcmp(argv[i], "--threshold") && i + 1 < argc) {
+            options.thresholdPercent = atof(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            return PrintUsage();
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+
+    BenchBaseline baseline;
+    if (!options.baselinePath.empty() && !LoadBaseline(options.baselinePath, baseline)) {
+        return 1;
+    }
+
+    // Two saved runs, nothing to benchmark
+    if (!options.currentPath.empty()) {
+        BenchBaseline current;
+        if (!LoadBaseline(options.currentPath, current)) {
+            return 1;
+        }
+        return CompareBaselines(baseline, current, options.thresholdPercent) ? 1 : 0;
+    }
+
+    if (paths.empty()) {
+        paths.push_back(fs::path(MSW_SAMPLE_DIR) / "uberSamp2222_wld_ps.msw");
+        paths.push_back(fs::path(MSW_SAMPLE_DIR) / "uberUnlitVcoltVcolaEntcolmdAddSamp2_ps.msw");
+    }
+
+    // The patchers and the pipeline report every file, keep the table readable
+    SetLogLevel(LogLevel::Warning);
+    EnableAllocStats();
+
+    printf("Inputs:\n");
+    Corpus corpus;
+    if (!LoadCorpus(paths, corpus)) {
+        return 1;
+    }
+
+    fs::path tempDir = fs::temp_directory_path() / "mswunpacker-bench";
+    fs::create_directories(tempDir);
+
+    RunDxbcBenchmarks(options, corpus);
+    RunFileBenchmarks(options, corpus, tempDir);
+    RunConvertBenchmarks(options, corpus, tempDir);
+    if (options.synthetic) {
+        RunSyntheticBenchmarks(options, tempDir);
+    }
+
+    std::error_code ec;
+    fs::remove_all(tempDir, ec);
+
+    BenchBaseline current;
+    current.peakRssBytes = PeakResidentBytes();
+    current.results = g_results;
+
+    printf("\nPeak RSS: %.1f MB\n", current.peakRssBytes / (1024.0 * 1024.0));
+
+    if (!options.savePath.empty()) {
+        if (!SaveBaseline(options.savePath, current)) {
+            return 1;
+        }
+        printf("Baseline saved to %s\n", options.savePath.c_str());
+    }
+
+    if (!options.baselinePath.empty()) {
+        return CompareBaselines(baseline, current, options.thresholdPercent) ? 1 : 0;
+    }
+    return 0;
+}
@@ -0,0 +1,160 @@
+/*
+ * Synthetic Corpus Generator
+ *
+ * Writes MSWs of synthetic DXBC shaders for every combination of shader size
+ * and entry count, to benchmark convert-legacy (or anything else reading
+ * MSWs) against inputs much larger and more varied than the repo samples.
+ *
+ *   gencorpus <outdir> [options]
+ *     --sizes <list>       Shader sizes, e.g. 1k,16k,256k,1m (default 1k,16k,256k)
+ *     --entries <list>     Entries per MSW, 1-255 (default 1,16,64,255)
+ *     --files <n>          MSWs per combination (default 1)
+ *     --ref-ratio <r>      Share of reference entries (default 0.25)
+ *     --null-ratio <r>     Share of null entries (default 0)
+ *     --layout <l>         s9, s7 or mixed (default s9)
+ *     --seed <n>           Base seed (default 1)
+ *
+ * Files are named size-<size>_entries-<n>_<i>.msw. The same options always
+ * produce the same files.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "synth.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+void PrintUsage() {
+    fprintf(stderr, "Usage: gencorpus <outdir> [--sizes 1k,16k,256k] [--entries 1,16,64,255] [--files n]\n");
+    fprintf(stderr, "                 [--ref-ratio r] [--null-ratio r] [--layout s9|s7|mixed] [--seed n]\n");
+}
+
+std::vector<std::string> SplitList(const char* text) {
+    std::vector<std::string> items;
+    std::string item;
+    for (const char* c = text; ; c++) {
+        if (*c == ',' || *c == '\0') {
+            if (!item.empty()) items.push_back(item);
+            item.clear();
+            if (*c == '\0') break;
+        } else {
+            item += *c;
+        }
+    }
+    return items;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argv[1][0] == '-') {
+        PrintUsage();
+        return 1;
+    }
+
+    fs::path outDir = argv[1];
+    std::vector<uint32_t> sizes = { 1024, 16 * 1024, 256 * 1024 };
+    std::vector<int> entryCounts = { 1, 16, 64, 255 };
+    int files = 1;
+    SynthMswOptions options;
+
+    for (int i = 2; i < argc; i++) {
+        if (!strcmp(argv[i], "--sizes") && i + 1 < argc) {
+            sizes.clear();
+            for (const std::string& item : SplitList(argv[++i])) {
+                uint32_t size = ParseSynthSize(item);
+                if (!size) {
+                    fprintf(stderr, "Error: Invalid size '%s'\n", item.c_str());
+                    return 1;
+                }
+                sizes.push_back(size);
+            }
+        } else if (!strcmp(argv[i], "--entries") && i + 1 < argc) {
+            entryCounts.clear();
+            for (const std::string& item : SplitList(argv[++i])) {
+                int count = atoi(item.c_str());
+                if (count < 1 || count > SYNTH_MAX_ENTRIES) {
+                    fprintf(stderr, "Error: Invalid entry count '%s' (an MSW holds 1 to %d entries)\n",
+                            item.c_str(), SYNTH_MAX_ENTRIES);
+                    return 1;
+                }
+                entryCounts.push_back(count);
+            }
+        } else if (!strcmp(argv[i], "--files") && i + 1 < argc) {
+            files = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--ref-ratio") && i + 1 < argc) {
+            options.referenceRatio = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--null-ratio") && i + 1 < argc) {
+            options.nullRatio = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--layout") && i + 1 < argc) {
+            const char* layout = argv[++i];
+            if (!strcmp(layout, "s9")) {
+                options.layout = SynthLayout::S9;
+            } else if (!strcmp(layout, "s7")) {
+                options.layout = SynthLayout::S7;
+            } else if (!strcmp(layout, "mixed")) {
+                options.layout = SynthLayout::Mixed;
+            } else {
+                fprintf(stderr, "Error: Invalid layout '%s'\n", layout);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            options.shader.seed = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        } else {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (files < 1 || sizes.empty() || entryCounts.empty() ||
+        options.referenceRatio < 0.0 || options.nullRatio < 0.0 || options.referenceRatio + options.nullRatio > 1.0) {
+        PrintUsage();
+        return 1;
+    }
+
+    std::error_code ec;
+    fs::create_directories(outDir, ec);
+    if (ec) {
+        fprintf(stderr, "Error: Could not create %s\n", outDir.string().c_str());
+        return 1;
+    }
+
+    uint32_t baseSeed = options.shader.seed;
+    int written = 0;
+    uint64_t totalBytes = 0;
+
+    for (uint32_t size : sizes) {
+        for (int entries : entryCounts) {
+            for (int i = 0; i < files; i++) {
+                std::string name = "size-" + FormatSynthSize(size) + "_entries-" + std::to_string(entries) + "_" +
+                                   std::to_string(i);
+
+                SynthMswOptions fileOptions = options;
+                fileOptions.entries = entries;
+                fileOptions.name = name;
+                fileOptions.shader.targetBytes = size;
+                fileOptions.shader.seed = baseSeed + static_cast<uint32_t>(written) * 7919u;
+
+                fs::path path = outDir / (name + ".msw");
+                if (!WriteSyntheticMsw(fileOptions, path.string())) {
+                    fprintf(stderr, "Error: Could not write %s\n", path.string().c_str());
+                    return 1;
+                }
+
+                uint64_t bytes = fs::file_size(path, ec);
+                printf("  %s (%llu bytes)\n", path.filename().string().c_str(), static_cast<unsigned long long>(bytes));
+                totalBytes += bytes;
+                written++;
+            }
+        }
+    }
+
+    printf("Wrote %d files, %.1f MB to %s\n", written, totalBytes / (1024.0 * 1024.0), outDir.string().c_str());
+    return 0;
+}
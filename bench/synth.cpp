@@ -0,0 +1,450 @@
+/*
+ * Synthetic DXBC/MSW Corpus
+ */
+
+#include "synth.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include "dxbc.h"
+
+namespace {
+
+// ============================================================================
+// SM5 Tokens
+// ============================================================================
+
+// Operand tokens (see GetOperandSize in dxbc.cpp for the encoding)
+constexpr uint32_t TEMP_MASK_XYZW = 0x001000F2;     // rN.xyzw (dest)
+constexpr uint32_t TEMP_MASK_X = 0x00100012;        // rN.x (dest)
+constexpr uint32_t TEMP_MASK_W = 0x00100082;        // rN.w (dest)
+constexpr uint32_t TEMP_SWIZZLE_XYZW = 0x00100E46;  // rN.xyzw
+constexpr uint32_t TEMP_SELECT_X = 0x0010000A;      // rN.x
+constexpr uint32_t TEMP_SELECT_W = 0x0010003A;      // rN.w
+constexpr uint32_t CB_SWIZZLE_XYZW = 0x00208E46;    // cbN[M].xyzw
+constexpr uint32_t CB_SELECT_X = 0x0020800A;        // cbN[M].x
+constexpr uint32_t CB_SELECT_W = 0x0020803A;        // cbN[M].w
+constexpr uint32_t RESOURCE_SWIZZLE = 0x00107E46;   // tN.xyzw
+constexpr uint32_t RESOURCE_DECL = 0x00107000;      // tN in dcl_resource_structured
+constexpr uint32_t IMMEDIATE_SCALAR = 0x00004001;   // l(value)
+
+constexpr uint32_t OPCODE_ADD = 0x00;
+constexpr uint32_t OPCODE_MAD = 0x32;
+constexpr uint32_t OPCODE_RET = 0x3E;
+constexpr uint32_t OPCODE_DCL_TEMPS = 0x68;
+constexpr uint32_t OPCODE_LD_STRUCTURED = 0xA7;
+
+constexpr uint32_t SUN_SCALE = 0x38000100;          // ~3.05e-05, the S9 16 bit sun scale
+
+// r0-r7 are filler, sun data sequences extract into r8-r11
+constexpr uint32_t FILLER_TEMPS = 8;
+constexpr uint32_t SUN_TEMP_BASE = 8;
+constexpr uint32_t TEMP_COUNT = 12;
+
+constexpr uint32_t SRV_MODEL_INST = 75;
+constexpr uint32_t MODEL_INST_STRIDE = 64;
+
+// Buffer sizes in vec4s, CBufUberStatic has to reach c_uberFeatureFlags at [24]
+constexpr uint32_t UBER_STATIC_VECTORS = 26;
+constexpr uint32_t MODEL_INSTANCE_VECTORS = 13;
+constexpr uint32_t CAMERA_S11_BYTES = 784;
+constexpr uint32_t CAMERA_S7_BYTES = 752;
+
+uint32_t Token(uint32_t opcode, uint32_t length) {
+    return opcode | (length << 24);
+}
+
+struct ShaderBuilder {
+    std::vector<uint32_t> dwords;
+    std::mt19937 rng;
+    uint32_t cameraSlot;
+    uint32_t modelSlot;
+    uint32_t cameraVectors;
+    bool modelInstSrv;
+
+    uint32_t Next(uint32_t count) {
+        return static_cast<uint32_t>(rng() % count);
+    }
+
+    void Emit(std::initializer_list<uint32_t> tokens) {
+        dwords.insert(dwords.end(), tokens);
+    }
+
+    // Any of the three buffers, at an element inside it
+    void PickCB(uint32_t& index, uint32_t& element) {
+        switch (Next(3)) {
+        case 0:
+            index = 0;
+            element = Next(UBER_STATIC_VECTORS);
+            break;
+        case 1:
+            index = cameraSlot;
+            element = Next(cameraVectors);
+            break;
+        default:
+            index = modelSlot;
+            element = Next(MODEL_INSTANCE_VECTORS);
+            break;
+        }
+    }
+
+    // One arithmetic instruction on r0-r7 that none of the patches match
+    void EmitFiller() {
+        uint32_t dest = Next(FILLER_TEMPS);
+        uint32_t src = Next(FILLER_TEMPS);
+        uint32_t cb, element;
+        PickCB(cb, element);
+
+        uint32_t kind = Next(16);
+        if (kind == 0 && modelInstSrv) {
+            // ld_structured rD.xyzw, rS.x, l(0), t75.xyzw
+            Emit({ Token(OPCODE_LD_STRUCTURED, 9), TEMP_MASK_XYZW, dest, TEMP_SELECT_X, src,
+                   IMMEDIATE_SCALAR, 0, RESOURCE_SWIZZLE, SRV_MODEL_INST });
+        } else if (kind < 5) {
+            Emit({ Token(dxbc::OPCODE_MOV, 6), TEMP_MASK_XYZW, dest, CB_SWIZZLE_XYZW, cb, element });
+        } else if (kind < 9) {
+            Emit({ Token(OPCODE_ADD, 8), TEMP_MASK_XYZW, dest, TEMP_SWIZZLE_XYZW, src, CB_SWIZZLE_XYZW, cb, element });
+        } else if (kind < 12) {
+            Emit({ Token(dxbc::OPCODE_MUL, 7), TEMP_MASK_XYZW, dest, TEMP_SWIZZLE_XYZW, src,
+                   TEMP_SWIZZLE_XYZW, Next(FILLER_TEMPS) });
+        } else {
+            Emit({ Token(OPCODE_MAD, 10), TEMP_MASK_XYZW, dest, TEMP_SWIZZLE_XYZW, src, CB_SWIZZLE_XYZW, cb, element,
+                   TEMP_SWIZZLE_XYZW, Next(FILLER_TEMPS) });
+        }
+    }
+
+    // and rX.x, cb0[24].x, l(flag)
+    void EmitFeatureFlagTest(uint32_t flag) {
+        Emit({ Token(dxbc::OPCODE_AND, 8), TEMP_MASK_X, Next(FILLER_TEMPS), CB_SELECT_X, 0, 24, IMMEDIATE_SCALAR, flag });
+    }
+
+    // ishr/and rS.w, cbModel[11].w, l(16/0xFFFF); itof rS.w, rS.w; mul rD.w, rS.w, l(3.05e-05)
+    // with a little filler in between, well inside the patch's search windows
+    void EmitSunDataSequence(uint32_t sequence) {
+        uint32_t temp = SUN_TEMP_BASE + sequence;
+
+        if (sequence % 2 == 0) {
+            Emit({ Token(dxbc::OPCODE_ISHR, 8), TEMP_MASK_W, temp, CB_SELECT_W, modelSlot, 11, IMMEDIATE_SCALAR, 16 });
+        } else {
+            Emit({ Token(dxbc::OPCODE_AND, 8), TEMP_MASK_W, temp, CB_SELECT_W, modelSlot, 11, IMMEDIATE_SCALAR, 0xFFFF });
+        }
+        EmitFiller();
+        EmitFiller();
+
+        Emit({ Token(dxbc::OPCODE_ITOF, 5), TEMP_MASK_W, temp, TEMP_SELECT_W, temp });
+        EmitFiller();
+        EmitFiller();
+
+        Emit({ Token(dxbc::OPCODE_MUL, 7), TEMP_MASK_W, Next(FILLER_TEMPS), TEMP_SELECT_W, temp, IMMEDIATE_SCALAR, SUN_SCALE });
+    }
+};
+
+// ============================================================================
+// Chunks
+// ============================================================================
+
+void AppendU32(std::vector<uint8_t>& out, uint32_t value) {
+    uint8_t bytes[4];
+    memcpy(bytes, &value, sizeof(bytes));
+    out.insert(out.end(), bytes, bytes + sizeof(bytes));
+}
+
+void PutU32(std::vector<uint8_t>& out, size_t offset, uint32_t value) {
+    memcpy(out.data() + offset, &value, sizeof(value));
+}
+
+uint32_t AppendString(std::vector<uint8_t>& out, const char* text) {
+    uint32_t offset = static_cast<uint32_t>(out.size());
+    out.insert(out.end(), text, text + strlen(text) + 1);
+    return offset;
+}
+
+void AlignTo4(std::vector<uint8_t>& out) {
+    while (out.size() % 4) {
+        out.push_back(0xAB);    // fxc pads RDEF strings the same way
+    }
+}
+
+struct CBufferDef {
+    const char* name;
+    uint32_t slot;
+    uint32_t bytes;
+};
+
+std::vector<uint8_t> BuildRDEF(const std::vector<CBufferDef>& cbuffers, bool modelInstSrv) {
+    constexpr uint32_t HEADER_SIZE = 60;    // RDEFHeader + the SM5 RD11 block
+    constexpr uint32_t CBUF_DESC_SIZE = 24;
+    constexpr uint32_t BIND_DESC_SIZE = 32;
+
+    uint32_t bindingCount = static_cast<uint32_t>(cbuffers.size()) + (modelInstSrv ? 1 : 0);
+    uint32_t cbufferOffset = HEADER_SIZE;
+    uint32_t bindingOffset = cbufferOffset + static_cast<uint32_t>(cbuffers.size()) * CBUF_DESC_SIZE;
+
+    std::vector<uint8_t> rdef(bindingOffset + bindingCount * BIND_DESC_SIZE, 0);
+
+    std::vector<uint32_t> nameOffsets;
+    for (const CBufferDef& cbuffer : cbuffers) {
+        nameOffsets.push_back(AppendString(rdef, cbuffer.name));
+    }
+    uint32_t srvNameOffset = modelInstSrv ? AppendString(rdef, "g_modelInst") : 0;
+    uint32_t creatorOffset = AppendString(rdef, "Microsoft (R) HLSL Shader Compiler 10.1");
+    AlignTo4(rdef);
+
+    PutU32(rdef, 0, static_cast<uint32_t>(cbuffers.size()));
+    PutU32(rdef, 4, cbufferOffset);
+    PutU32(rdef, 8, bindingCount);
+    PutU32(rdef, 12, bindingOffset);
+    PutU32(rdef, 16, 0xFFFF0500);           // ps_5_0
+    PutU32(rdef, 20, 0x100);                // D3DCOMPILE_NO_PRESHADER
+    PutU32(rdef, 24, creatorOffset);
+    memcpy(rdef.data() + 28, "RD11", 4);
+    PutU32(rdef, 32, HEADER_SIZE);
+    PutU32(rdef, 36, CBUF_DESC_SIZE);
+    PutU32(rdef, 40, 40);                   // Variable desc size
+    PutU32(rdef, 44, 40);
+    PutU32(rdef, 48, 36);                   // Type desc size
+    PutU32(rdef, 52, 12);                   // Member desc size
+    PutU32(rdef, 56, 0);
+
+    // Descriptors without variables, the patches only read names, slots and sizes
+    for (size_t i = 0; i < cbuffers.size(); i++) {
+        size_t offset = cbufferOffset + i * CBUF_DESC_SIZE;
+        PutU32(rdef, offset + 0, nameOffsets[i]);
+        PutU32(rdef, offset + 12, cbuffers[i].bytes);
+    }
+
+    size_t binding = bindingOffset;
+    if (modelInstSrv) {
+        PutU32(rdef, binding + 0, srvNameOffset);
+        PutU32(rdef, binding + 4, dxbc::SIT_STRUCTURED);
+        PutU32(rdef, binding + 8, 6);       // D3D_RETURN_TYPE_MIXED
+        PutU32(rdef, binding + 12, 1);      // D3D_SRV_DIMENSION_BUFFER
+        PutU32(rdef, binding + 16, MODEL_INST_STRIDE);
+        PutU32(rdef, binding + 20, SRV_MODEL_INST);
+        PutU32(rdef, binding + 24, 1);
+        binding += BIND_DESC_SIZE;
+    }
+    for (size_t i = 0; i < cbuffers.size(); i++, binding += BIND_DESC_SIZE) {
+        PutU32(rdef, binding + 0, nameOffsets[i]);
+        PutU32(rdef, binding + 4, dxbc::SIT_CBUFFER);
+        PutU32(rdef, binding + 20, cbuffers[i].slot);
+        PutU32(rdef, binding + 24, 1);
+    }
+
+    return rdef;
+}
+
+// Signature without elements
+std::vector<uint8_t> BuildEmptySignature() {
+    std::vector<uint8_t> signature;
+    AppendU32(signature, 0);
+    AppendU32(signature, 8);
+    return signature;
+}
+
+std::vector<uint8_t> BuildContainer(const std::vector<std::pair<const char*, std::vector<uint8_t>>>& chunks) {
+    uint32_t chunkCount = static_cast<uint32_t>(chunks.size());
+    uint32_t offset = sizeof(dxbc::DXBCHeader) + chunkCount * sizeof(uint32_t);
+
+    std::vector<uint8_t> data(offset, 0);
+    memcpy(data.data(), "DXBC", 4);
+    PutU32(data, 20, 1);
+    PutU32(data, 28, chunkCount);
+
+    for (uint32_t i = 0; i < chunkCount; i++) {
+        PutU32(data, sizeof(dxbc::DXBCHeader) + i * sizeof(uint32_t), static_cast<uint32_t>(data.size()));
+
+        const std::vector<uint8_t>& body = chunks[i].second;
+        data.insert(data.end(), chunks[i].first, chunks[i].first + 4);
+        AppendU32(data, static_cast<uint32_t>(body.size()));
+        data.insert(data.end(), body.begin(), body.end());
+    }
+
+    PutU32(data, 24, static_cast<uint32_t>(data.size()));
+    dxbc::UpdateHash(data);
+    return data;
+}
+
+} // namespace
+
+// ============================================================================
+// DXBC
+// ============================================================================
+
+std::vector<uint8_t> BuildSyntheticDxbc(const SynthShaderOptions& options) {
+    ShaderBuilder builder;
+    builder.rng.seed(options.seed);
+    builder.cameraSlot = options.s9Layout ? 3 : 2;
+    builder.modelSlot = options.s9Layout ? 2 : 3;
+    builder.modelInstSrv = options.modelInstSrv;
+
+    uint32_t cameraBytes = options.clusteredLighting ? CAMERA_S11_BYTES : CAMERA_S7_BYTES;
+    builder.cameraVectors = cameraBytes / 16;
+
+    std::vector<CBufferDef> cbuffers = {
+        { "CBufUberStatic", 0, UBER_STATIC_VECTORS * 16 },
+        { "CBufCommonPerCamera", builder.cameraSlot, cameraBytes },
+        { "CBufModelInstance", builder.modelSlot, MODEL_INSTANCE_VECTORS * 16 },
+    };
+
+    std::vector<uint8_t> rdef = BuildRDEF(cbuffers, options.modelInstSrv);
+    std::vector<uint8_t> signature = BuildEmptySignature();
+
+    // Declarations, in slot order like fxc
+    builder.Emit({ 0x00000050, 0 });        // ps_5_0, length patched below
+    builder.Emit({ Token(dxbc::OPCODE_DCL_CONSTANT_BUFFER, 4), CB_SWIZZLE_XYZW, 0, UBER_STATIC_VECTORS });
+    builder.Emit({ Token(dxbc::OPCODE_DCL_CONSTANT_BUFFER, 4), CB_SWIZZLE_XYZW, 2,
+                   options.s9Layout ? MODEL_INSTANCE_VECTORS : builder.cameraVectors });
+    builder.Emit({ Token(dxbc::OPCODE_DCL_CONSTANT_BUFFER, 4), CB_SWIZZLE_XYZW, 3,
+                   options.s9Layout ? builder.cameraVectors : MODEL_INSTANCE_VECTORS });
+    if (options.modelInstSrv) {
+        builder.Emit({ Token(dxbc::OPCODE_DCL_RESOURCE_STRUCTURED, 4), RESOURCE_DECL, SRV_MODEL_INST, MODEL_INST_STRIDE });
+    }
+    builder.Emit({ Token(OPCODE_DCL_TEMPS, 2), TEMP_COUNT });
+
+    // Whatever the target leaves after the fixed parts is instructions
+    size_t fixedBytes = sizeof(dxbc::DXBCHeader) + 4 * (sizeof(uint32_t) + sizeof(dxbc::ChunkHeader)) +
+                        rdef.size() + 2 * signature.size() + builder.dwords.size() * 4 + 4;
+    size_t bodyDwords = options.targetBytes > fixedBytes ? (options.targetBytes - fixedBytes) / 4 : 0;
+    size_t bodyEnd = builder.dwords.size() + bodyDwords;
+
+    // Pattern sites spread evenly through the body, each kind interleaved
+    std::vector<int> sites;
+    int sunSequences = std::clamp(options.sunDataSequences, 0, 4);
+    for (int i = 0; i < std::max({ sunSequences, options.uberFlagSites, options.bit1Sites }); i++) {
+        if (i < sunSequences) sites.push_back(0);
+        if (i < options.uberFlagSites) sites.push_back(1);
+        if (i < options.bit1Sites) sites.push_back(2);
+    }
+
+    int sunEmitted = 0;
+    for (size_t i = 0; i < sites.size(); i++) {
+        size_t sitePos = bodyEnd - bodyDwords + bodyDwords * (i + 1) / (sites.size() + 1);
+        while (builder.dwords.size() < sitePos) {
+            builder.EmitFiller();
+        }
+
+        switch (sites[i]) {
+        case 0: builder.EmitSunDataSequence(sunEmitted++); break;
+        case 1: builder.EmitFeatureFlagTest(2); break;
+        default: builder.EmitFeatureFlagTest(1); break;
+        }
+    }
+
+    while (builder.dwords.size() < bodyEnd) {
+        builder.EmitFiller();
+    }
+    builder.Emit({ Token(OPCODE_RET, 1) });
+    builder.dwords[1] = static_cast<uint32_t>(builder.dwords.size());
+
+    std::vector<uint8_t> shex(builder.dwords.size() * 4);
+    memcpy(shex.data(), builder.dwords.data(), shex.size());
+
+    return BuildContainer({
+        { "RDEF", rdef },
+        { "ISGN", signature },
+        { "OSGN", signature },
+        { "SHEX", shex },
+    });
+}
+
+// ============================================================================
+// MSW
+// ============================================================================
+
+std::unique_ptr<CMultiShaderWrapperIO::Shader_t> BuildSyntheticShader(const SynthMswOptions& options) {
+    std::unique_ptr<CMultiShaderWrapperIO::Shader_t> shader(
+        new CMultiShaderWrapperIO::Shader_t(MultiShaderWrapperShaderType_e::PIXEL));
+    shader->name = options.name;
+
+    std::mt19937 rng(options.shader.seed ^ 0x9E3779B9u);
+    auto chance = [&rng]() { return rng() / 4294967296.0; };
+
+    int entries = std::clamp(options.entries, 1, SYNTH_MAX_ENTRIES);
+    std::vector<unsigned short> standardIndices;
+    shader->entries.reserve(entries);
+
+    for (int i = 0; i < entries; i++) {
+        CMultiShaderWrapperIO::ShaderEntry_t& entry = shader->entries.emplace_back();
+        entry.refIndex = UINT16_MAX;
+        entry.flags[0] = rng();
+        entry.flags[1] = 0;
+
+        double roll = i == 0 ? 1.0 : chance();
+        if (roll < options.nullRatio) {
+            continue;
+        }
+        if (roll < options.nullRatio + options.referenceRatio) {
+            entry.refIndex = standardIndices[rng() % standardIndices.size()];
+            continue;
+        }
+
+        SynthShaderOptions shaderOptions = options.shader;
+        shaderOptions.seed = options.shader.seed * 1000003u + static_cast<uint32_t>(i);
+        if (options.layout == SynthLayout::S7) {
+            shaderOptions.s9Layout = false;
+        } else if (options.layout == SynthLayout::Mixed) {
+            shaderOptions.s9Layout = (rng() & 1) != 0;
+        } else {
+            shaderOptions.s9Layout = true;
+        }
+
+        std::vector<uint8_t> dxbc = BuildSyntheticDxbc(shaderOptions);
+        char* buffer = new char[dxbc.size()];
+        memcpy(buffer, dxbc.data(), dxbc.size());
+
+        entry.buffer = buffer;
+        entry.size = static_cast<unsigned int>(dxbc.size());
+        entry.deleteBuffer = true;
+        standardIndices.push_back(static_cast<unsigned short>(i));
+    }
+
+    return shader;
+}
+
+bool WriteSyntheticMsw(const SynthMswOptions& options, const std::string& path) {
+    std::unique_ptr<CMultiShaderWrapperIO::Shader_t> shader = BuildSyntheticShader(options);
+
+    CMultiShaderWrapperIO writer{};
+    writer.SetFileType(MultiShaderWrapperFileType_e::SHADER);
+    writer.SetShader(shader.get());
+    return writer.WriteFile(path.c_str());
+}
+
+// ============================================================================
+// Sizes
+// ============================================================================
+
+uint32_t ParseSynthSize(const std::string& text) {
+    if (text.empty()) {
+        return 0;
+    }
+
+    char* end = nullptr;
+    unsigned long long value = strtoull(text.c_str(), &end, 10);
+    if (end == text.c_str()) {
+        return 0;
+    }
+
+    std::string suffix(end);
+    if (suffix == "k" || suffix == "K") {
+        value *= 1024;
+    } else if (suffix == "m" || suffix == "M") {
+        value *= 1024 * 1024;
+    } else if (!suffix.empty()) {
+        return 0;
+    }
+
+    return value > UINT32_MAX ? 0 : static_cast<uint32_t>(value);
+}
+
+std::string FormatSynthSize(uint32_t bytes) {
+    if (bytes && bytes % (1024 * 1024) == 0) {
+        return std::to_string(bytes / (1024 * 1024)) + "m";
+    }
+    if (bytes && bytes % 1024 == 0) {
+        return std::to_string(bytes / 1024) + "k";
+    }
+    return std::to_string(bytes);
+}
@@ -0,0 +1,81 @@
+#pragma once
+/*
+ * Synthetic DXBC/MSW Corpus
+ *
+ * Builds valid DXBC containers (RDEF, ISGN, OSGN, SHEX, correct hash) shaped
+ * like the shaders convert-legacy patches, at any size, and wraps them in
+ * MSWs with any number of entries. Used by the scaling benchmarks and by
+ * gencorpus to write corpora to disk.
+ *
+ * The RDEF binds CBufUberStatic (cb0), CBufCommonPerCamera and
+ * CBufModelInstance (cb3/cb2 for the S9 layout, cb2/cb3 for S7) and the
+ * g_modelInst structured buffer at t75. The SHEX is a mix of mov/add/mul/mad
+ * on those buffers with the sun data, uber flag and feature flag bit 1
+ * patterns the legacy patches look for spread through it.
+ *
+ * Everything is derived from the seed, the same options give the same bytes.
+ */
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "multishader.h"
+
+struct SynthShaderOptions {
+    uint32_t targetBytes;       // Container size, rounded up to a whole instruction
+    bool s9Layout;              // Camera=CB3/ModelInstance=CB2, patched by convert-legacy
+    int sunDataSequences;       // ishr/and + itof + mul sequences on CBufModelInstance[11].w (at most 4)
+    int uberFlagSites;          // and rX, cb0[24], l(2)
+    int bit1Sites;              // and rX, cb0[24], l(1)
+    bool modelInstSrv;          // g_modelInst at t75, remapped to t61
+    bool clusteredLighting;     // 784 byte CBufCommonPerCamera (S11), trimmed to 752
+    uint32_t seed;
+
+    SynthShaderOptions()
+        : targetBytes(16 * 1024)
+        , s9Layout(true)
+        , sunDataSequences(2)
+        , uberFlagSites(1)
+        , bit1Sites(1)
+        , modelInstSrv(true)
+        , clusteredLighting(false)
+        , seed(1)
+    {}
+};
+
+// Largest entry count an MSW can hold, numShaderDescriptors is 8 bits
+constexpr int SYNTH_MAX_ENTRIES = 255;
+
+enum class SynthLayout {
+    S9,
+    S7,
+    Mixed,                      // Each standard entry picks one from the seed
+};
+
+struct SynthMswOptions {
+    int entries;                // 1..SYNTH_MAX_ENTRIES
+    double referenceRatio;      // Share of entries referencing an earlier standard entry
+    double nullRatio;           // Share of null entries
+    SynthLayout layout;
+    SynthShaderOptions shader;  // Every standard entry, the seed is varied per entry
+    std::string name;
+
+    SynthMswOptions()
+        : entries(16)
+        , referenceRatio(0.25)
+        , nullRatio(0.0)
+        , layout(SynthLayout::S9)
+    {}
+};
+
+std::vector<uint8_t> BuildSyntheticDxbc(const SynthShaderOptions& options);
+
+// Entry 0 is always standard, so every reference has something to point at
+std::unique_ptr<CMultiShaderWrapperIO::Shader_t> BuildSyntheticShader(const SynthMswOptions& options);
+
+bool WriteSyntheticMsw(const SynthMswOptions& options, const std::string& path);
+
+// "16k", "1m", "4096" -> bytes, 0 if malformed
+uint32_t ParseSynthSize(const std::string& text);
+std::string FormatSynthSize(uint32_t bytes);